@@ -0,0 +1,49 @@
+#include <unistd.h>
+
+#include "log.h"
+
+// 把 BinaryLogAppender 写出的二进制日志转换成文本, 输出到标准输出
+// 用法: log_decoder [-f pattern] file...
+// 默认格式和 Logger 的默认格式一致, 切分压缩后的 .gz 文件可以直接读取
+int main(int argc, char** argv) {
+    std::string pattern = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+    int opt;
+    while((opt = getopt(argc, argv, "f:")) != -1) {
+        if(opt == 'f') {
+            pattern = optarg;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [-f pattern] file..." << std::endl;
+            return 1;
+        }
+    }
+    if(optind >= argc) {
+        std::cerr << "usage: " << argv[0] << " [-f pattern] file..." << std::endl;
+        return 1;
+    }
+    MNSER::LogFormatter::ptr formatter(new MNSER::LogFormatter(pattern));
+    if(formatter->isError()) {
+        std::cerr << "invalid pattern: " << pattern << std::endl;
+        return 1;
+    }
+
+    int rt = 0;
+    std::string out;
+    for(int i = optind; i < argc; ++i) {
+        MNSER::BinaryLogReader reader(argv[i]);
+        if(!reader.isValid()) {
+            std::cerr << argv[i] << ": not a binary log file" << std::endl;
+            rt = 1;
+            continue;
+        }
+        out.clear();
+        while(reader.next(formatter, out)) {
+            if(out.size() >= 64 * 1024) {
+                std::cout.write(out.data(), out.size());
+                out.clear();
+            }
+        }
+        std::cout.write(out.data(), out.size());
+    }
+    std::cout.flush();
+    return rt;
+}
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <iomanip>
 #include <stdint.h>
+#include <sys/uio.h>
 
 namespace MNSER {
 
@@ -198,6 +199,7 @@ private:
 	size_t m_endian;			// 字节序，默认大端
 	Node* m_root;				// 第一个内存块指针
 	Node* m_cur;				// 当前操作的内存块指针
+	Node* m_tail;				// 最后一个内存块指针, 扩容时直接追加
 };
 
 }
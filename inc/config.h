@@ -16,6 +16,7 @@
 #include <yaml-cpp/yaml.h>
 #include <algorithm>
 #include <functional>
+#include <atomic>
 
 #include "log.h"
 #include "util.h"
@@ -31,22 +32,48 @@ public:
 	}
 };
 
+/*
+ * 从 YAML 节点直接转换, 容器类型逐个转换子节点, 不再输出成字符串后重新解析
+ * 容器类型的节点不存在或者类型不对时返回空容器
+ * 其他类型标量节点直接使用字符串转换, 复杂节点输出成字符串后转换
+ */
 template <class T>
-class LexicalCast<std::string, std::vector<T> > {
+class LexicalCast<YAML::Node, T> {
 public:
-	std::vector<T> operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
-		typename std::vector<T> vec;
+	T operator() (const YAML::Node& from) {
+		if (from.IsScalar()) {
+			return LexicalCast<std::string, T>()(from.Scalar());
+		}
 		std::stringstream ss;
-		for (size_t i=0; i<node.size(); ++i) {
-			ss.str("");	
-			ss << node[i];
-			vec.push_back(LexicalCast<std::string, T>()(ss.str()));
+		ss << from;
+		return LexicalCast<std::string, T>()(ss.str());
+	}
+};
+
+template <class T>
+class LexicalCast<YAML::Node, std::vector<T> > {
+public:
+	std::vector<T> operator() (const YAML::Node& from) { 
+		typename std::vector<T> vec;
+		if (!from.IsDefined() || !from.IsSequence()) {
+			return vec;
+		}
+		vec.reserve(from.size());
+		for (auto it = from.begin(); it != from.end(); ++it) {
+			vec.push_back(LexicalCast<YAML::Node, T>()(*it));
 		}
 		return vec;
 	}
 };
 
+template <class T>
+class LexicalCast<std::string, std::vector<T> > {
+public:
+	std::vector<T> operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, std::vector<T> >()(YAML::Load(from));
+	}
+};
+
 template <class T>
 class LexicalCast<std::vector<T>, std::string> {
 public:
@@ -63,21 +90,28 @@ public:
 };
 
 template <class T>
-class LexicalCast<std::string, std::list<T> > {
+class LexicalCast<YAML::Node, std::list<T> > {
 public:
-	std::list<T> operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
+	std::list<T> operator() (const YAML::Node& from) { 
 		typename std::list<T> li;
-		std::stringstream ss;
-		for (size_t i=0; i<node.size(); ++i) {
-			ss.str("");	
-			ss << node[i];
-			li.push_back(LexicalCast<std::string, T>()(ss.str()));
+		if (!from.IsDefined() || !from.IsSequence()) {
+			return li;
+		}
+		for (auto it = from.begin(); it != from.end(); ++it) {
+			li.push_back(LexicalCast<YAML::Node, T>()(*it));
 		}
 		return li;
 	}
 };
 
+template <class T>
+class LexicalCast<std::string, std::list<T> > {
+public:
+	std::list<T> operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, std::list<T> >()(YAML::Load(from));
+	}
+};
+
 template <class T>
 class LexicalCast<std::list<T>, std::string> {
 public:
@@ -94,21 +128,28 @@ public:
 };
 
 template <class T>
-class LexicalCast<std::string, std::set<T> > {
+class LexicalCast<YAML::Node, std::set<T> > {
 public:
-	std::set<T> operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
+	std::set<T> operator() (const YAML::Node& from) { 
 		typename std::set<T> se;
-		std::stringstream ss;
-		for (size_t i=0; i<node.size(); ++i) {
-			ss.str("");	
-			ss << node[i];
-			se.insert(LexicalCast<std::string, T>()(ss.str()));
+		if (!from.IsDefined() || !from.IsSequence()) {
+			return se;
+		}
+		for (auto it = from.begin(); it != from.end(); ++it) {
+			se.insert(LexicalCast<YAML::Node, T>()(*it));
 		}
 		return se;
 	}
 };
 
+template <class T>
+class LexicalCast<std::string, std::set<T> > {
+public:
+	std::set<T> operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, std::set<T> >()(YAML::Load(from));
+	}
+};
+
 template <class T>
 class LexicalCast<std::set<T>, std::string> {
 public:
@@ -125,21 +166,28 @@ public:
 };
 
 template <class T>
-class LexicalCast<std::string, std::unordered_set<T> > {
+class LexicalCast<YAML::Node, std::unordered_set<T> > {
 public:
-	std::unordered_set<T> operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
+	std::unordered_set<T> operator() (const YAML::Node& from) { 
 		typename std::unordered_set<T> se;
-		std::stringstream ss;
-		for (size_t i=0; i<node.size(); ++i) {
-			ss.str("");	
-			ss << node[i];
-			se.insert(LexicalCast<std::string, T>()(ss.str()));
+		if (!from.IsDefined() || !from.IsSequence()) {
+			return se;
+		}
+		for (auto it = from.begin(); it != from.end(); ++it) {
+			se.insert(LexicalCast<YAML::Node, T>()(*it));
 		}
 		return se;
 	}
 };
 
+template <class T>
+class LexicalCast<std::string, std::unordered_set<T> > {
+public:
+	std::unordered_set<T> operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, std::unordered_set<T> >()(YAML::Load(from));
+	}
+};
+
 template <class T>
 class LexicalCast<std::unordered_set<T>, std::string> {
 public:
@@ -156,21 +204,28 @@ public:
 };
 
 template <class T>
-class LexicalCast<std::string, std::map<std::string, T> > {
+class LexicalCast<YAML::Node, std::map<std::string, T> > {
 public:
-	std::map<std::string, T> operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
+	std::map<std::string, T> operator() (const YAML::Node& from) { 
 		typename std::map<std::string, T> ma;
-		std::stringstream ss;
-		for (auto it = node.begin(); it != node.end(); ++it) {
-			ss.str("");	
-			ss << it->second;
-			ma.insert(std::make_pair(it->first.Scalar(), LexicalCast<std::string, T>()(ss.str())));
+		if (!from.IsDefined() || !from.IsMap()) {
+			return ma;
+		}
+		for (auto it = from.begin(); it != from.end(); ++it) {
+			ma.insert(std::make_pair(it->first.Scalar(), LexicalCast<YAML::Node, T>()(it->second)));
 		}
 		return ma;
 	}
 };
 
+template <class T>
+class LexicalCast<std::string, std::map<std::string, T> > {
+public:
+	std::map<std::string, T> operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, std::map<std::string, T> >()(YAML::Load(from));
+	}
+};
+
 template <class T>
 class LexicalCast<std::map<std::string, T>, std::string> {
 public:
@@ -186,21 +241,28 @@ public:
 };
 
 template <class T>
-class LexicalCast<std::string, std::unordered_map<std::string, T> > {
+class LexicalCast<YAML::Node, std::unordered_map<std::string, T> > {
 public:
-	std::unordered_map<std::string, T> operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
+	std::unordered_map<std::string, T> operator() (const YAML::Node& from) { 
 		typename std::unordered_map<std::string, T> ma;
-		std::stringstream ss;
-		for (auto it = node.begin(); it != node.end(); ++it) {
-			ss.str("");	
-			ss << it->second;
-			ma.insert(std::make_pair(it->first.Scalar(), LexicalCast<std::string, T>()(ss.str())));
+		if (!from.IsDefined() || !from.IsMap()) {
+			return ma;
+		}
+		for (auto it = from.begin(); it != from.end(); ++it) {
+			ma.insert(std::make_pair(it->first.Scalar(), LexicalCast<YAML::Node, T>()(it->second)));
 		}
 		return ma;
 	}
 };
 
+template <class T>
+class LexicalCast<std::string, std::unordered_map<std::string, T> > {
+public:
+	std::unordered_map<std::string, T> operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, std::unordered_map<std::string, T> >()(YAML::Load(from));
+	}
+};
+
 template <class T>
 class LexicalCast<std::unordered_map<std::string, T>, std::string> {
 public:
@@ -240,6 +302,18 @@ public:
 	 */
 	virtual bool fromString(const std::string& val) = 0;
 
+	/*
+	 * 从 YAML 节点中初始化内容, 默认输出成字符串后调用 fromString
+	 */
+	virtual bool fromNode(const YAML::Node& node) {
+		if (node.IsScalar()) {
+			return fromString(node.Scalar());
+		}
+		std::stringstream ss;
+		ss << node;
+		return fromString(ss.str());
+	}
+
 	/*
 	 * 获取配置器参数名称
 	 */
@@ -252,23 +326,26 @@ protected:
 
 template <class T, 
 		  class FromStr=LexicalCast<std::string, T>, 
-		  class ToStr=LexicalCast<T, std::string> >
+		  class ToStr=LexicalCast<T, std::string>, 
+		  class FromNode=LexicalCast<YAML::Node, T> >
 class ConfigVar: public ConfigVarBase {
 public:
 	typedef std::shared_ptr<ConfigVar> ptr;
+	typedef std::shared_ptr<const T> ValuePtr;
 	typedef std::function< void (const T& old_val, const T& new_val) > on_change_val;
 	typedef RWLock RWLockType;
 
 	ConfigVar(const std::string& name, 
 			  const T& default_value,
 			  const std::string& description = ""):
-		ConfigVarBase(name, description), m_val(default_value) 
-		{ }
+		ConfigVarBase(name, description),
+		m_val(std::make_shared<const T>(default_value)),
+		m_index(NextIndex()) {
+	}
 	
 	std::string toString() override {
 		try {
-			RWLockType::ReadLock lock(m_mutex);
-			return ToStr()(m_val);
+			return ToStr()(*getValue());
 		} catch (std::exception& e) {
 			MS_LOG_ERROR(MS_LOG_ROOT()) << "ConfigVar::toString exception: "
 			<< e.what() << " convert: " << TypeToName<T>() << " to string" 
@@ -280,6 +357,7 @@ public:
 	bool fromString(const std::string& val) override {
 		try {
 			setValue(FromStr()(val));
+			return true;
 		} catch (std::exception& e) {
 			MS_LOG_ERROR(MS_LOG_ROOT()) << "ConfigVar::fromString exception: "
 			<< e.what() << " convert string to " << TypeToName<T>() 
@@ -288,27 +366,63 @@ public:
 		return false;
 	}
 
+	bool fromNode(const YAML::Node& node) override {
+		try {
+			setValue(FromNode()(node));
+			return true;
+		} catch (std::exception& e) {
+			MS_LOG_ERROR(MS_LOG_ROOT()) << "ConfigVar::fromNode exception: "
+			<< e.what() << " convert node to " << TypeToName<T>() 
+			<< " name =" << m_name << " - "  << node;
+		}
+		return false;
+	}
+
 	std::string getTypeName() const override {
 		return TypeToName<T>();
 	}
 
+	/*
+	 * 新值放到新的快照中再替换指针并增加版本号, 之后在锁外调用监听函数
+	 * 监听函数中调用 getValue 得到的已经是新值
+	 * 旧快照在最后一个持有它的读者(包括各线程的缓存)释放后析构
+	 */
 	void setValue(const T& v) {
+		ValuePtr old_val;
+		ValuePtr new_val;
+		std::vector<on_change_val> cbs;
 		{
-			RWLockType::ReadLock lock(m_mutex);
-			if (v == m_val) {
+			RWLockType::WriteLock lock(m_mutex);
+			old_val = m_val;
+			if (v == *old_val) {
 				return;
 			}
+			new_val = std::make_shared<const T>(v);
+			m_val = new_val;
+			m_version.fetch_add(1, std::memory_order_release);
 			for (auto &it: m_cbs) {
-				it.second(m_val, v);
+				cbs.push_back(it.second);
 			}
 		}
-		RWLockType::WriteLock lock(m_mutex);
-		m_val = v;
+		for (auto& cb: cbs) {
+			cb(*old_val, *new_val);
+		}
 	}
 
-	const T getValue() {
-		RWLockType::ReadLock lock(m_mutex);
-		return m_val;
+	/*
+	 * 返回当前快照, 快照不会被修改
+	 * 每个线程缓存一份快照和它的版本号, 版本号没有变化时只有一次原子读取,
+	 * 不加锁也不修改引用计数; 版本号变化后加读锁更新缓存
+	 * 返回的引用在本线程下一次调用这个配置的 getValue 之前有效, 需要一直持有时复制 ValuePtr
+	 */
+	const ValuePtr& getValue() const {
+		if (m_index < t_count) {
+			CacheEntry* e = t_entries[m_index];
+			if (e && e->version == m_version.load(std::memory_order_acquire)) {
+				return e->val;
+			}
+		}
+		return refresh();
 	}
 
 	int addListener(on_change_val cb) {
@@ -336,12 +450,70 @@ public:
 	}
 
 private:
-	T m_val;			// 自己配置的参数值
+	// 线程缓存的快照, 按配置的下标存放
+	struct CacheEntry {
+		uint64_t version = 0;
+		ValuePtr val;
+	};
+
+	// 同一类型的配置共用一个线程缓存, 线程退出时释放缓存的快照
+	struct ThreadCache {
+		std::vector<CacheEntry*> entries;
+
+		~ThreadCache() {
+			t_entries = nullptr;
+			t_count = 0;
+			for (auto i: entries) {
+				delete i;
+			}
+		}
+	};
+
+	// 第一次读取或版本号变化时加读锁更新本线程的缓存
+	const ValuePtr& refresh() const {
+		static thread_local ThreadCache s_cache;
+		if (m_index >= s_cache.entries.size()) {
+			s_cache.entries.resize(m_index + 1, nullptr);
+			t_entries = &s_cache.entries[0];
+			t_count = s_cache.entries.size();
+		}
+		CacheEntry*& e = s_cache.entries[m_index];
+		if (!e) {
+			e = new CacheEntry;
+		}
+		RWLockType::ReadLock lock(m_mutex);
+		e->val = m_val;
+		e->version = m_version.load(std::memory_order_relaxed);
+		return e->val;
+	}
+
+	static uint32_t NextIndex() {
+		static std::atomic<uint32_t> s_index{0};
+		return s_index++;
+	}
+
+private:
+	ValuePtr m_val;			// 当前值的快照, m_mutex 保护
+	std::atomic<uint64_t> m_version{1};	// 每次修改 m_val 时加一, 线程缓存据此判断是否过期
+	uint32_t m_index;		// 在线程缓存中的下标
 	std::map<int, on_change_val> m_cbs;  // function 对象不支持判断是否相同，所有使用一个 map 来实现回调函数的唯一性
 
-	RWLockType m_mutex;
+	mutable RWLockType m_mutex;
+
+	// 快速路径只读取这两个平凡的线程变量, 指向 ThreadCache::entries
+	static thread_local CacheEntry** t_entries;
+	static thread_local uint32_t t_count;
 };
 
+template <class T, class FromStr, class ToStr, class FromNode>
+thread_local typename ConfigVar<T, FromStr, ToStr, FromNode>::CacheEntry**
+	ConfigVar<T, FromStr, ToStr, FromNode>::t_entries = nullptr;
+
+template <class T, class FromStr, class ToStr, class FromNode>
+thread_local uint32_t ConfigVar<T, FromStr, ToStr, FromNode>::t_count = 0;
+
+class IOManager;
+
 class Config {
 public:
 	typedef std::unordered_map<std::string, ConfigVarBase::ptr> ConfigVarMap;
@@ -391,10 +563,28 @@ public:
 	static void LoadFromYaml(const YAML::Node& root); 
 
 	/*
-	 * 从文件中读取配置信息
+	 * 从目录中读取所有 .yml 文件
+	 * 记录每个文件的状态和上次导入的节点, 文件没有变化时不再解析,
+	 * 有变化时只更新节点内容不同的配置项, force 为 true 时全部重新导入
 	 */
 	static void LoadFromConfigDir(const std::string& path, bool force=false);
 
+	/*
+	 * 增量导入单个文件, 返回更新的配置项个数, 读取或解析失败返回 -1
+	 */
+	static int LoadFromConfigFile(const std::string& file, bool force=false);
+
+	/*
+	 * 用 inotify 监听目录(包括子目录)下 .yml 文件的修改
+	 * 修改后在 iom 的协程中增量导入, 不占用其他线程
+	 */
+	static bool WatchConfigDir(const std::string& path, IOManager* iom);
+
+	/*
+	 * 停止所有目录的监听
+	 */
+	static void UnwatchConfigDir();
+
 	static ConfigVarBase::ptr LookupBase(const std::string& name);
 
 	static void Visit(std::function<void(ConfigVarBase::ptr)> cb);
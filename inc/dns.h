@@ -0,0 +1,133 @@
+#ifndef __MNSER_DNS_H__
+#define __MNSER_DNS_H__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "address.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "singleton.h"
+
+namespace MNSER {
+
+// 协程友好的 DNS 解析器
+// 先查 hosts 文件, 再查共享缓存, 最后通过 hook 过的 UDP socket 向 nameserver 查询,
+// 等待应答时只挂起当前协程, 不会阻塞 IOManager 线程
+// 缓存按记录的 TTL 过期, NXDOMAIN/NODATA 结果按 dns.negative_ttl 做否定缓存
+class DnsResolver: Noncopyable {
+public:
+	typedef std::shared_ptr<DnsResolver> ptr;
+	typedef RWLock RWMutexType;
+
+	// 查询记录类型
+	enum Type {
+		A    = 1,
+		AAAA = 28,
+	};
+
+	// 查询结果
+	enum Result {
+		OK       = 0,	// 有应答记录
+		NOTFOUND = 1,	// NXDOMAIN 或没有对应类型的记录, 可以做否定缓存
+		ERROR    = 2,	// 超时/SERVFAIL/格式错误等, 不缓存
+	};
+
+	// dns.enable 配置, 是否在 Address::Lookup 中使用本解析器
+	static bool IsEnabled();
+
+	DnsResolver();
+
+	// 解析域名, family 为 AF_INET/AF_INET6/AF_UNSPEC, 成功返回 true
+	// 返回的地址是新创建的对象, 端口为 0, 调用方可以直接修改
+	bool lookup(std::vector<IPAddress::ptr>& result, const std::string& name,
+		int family = AF_INET);
+
+	// 指定 nameserver, 不为空时忽略 dns.servers 配置和 resolv.conf
+	void setServers(const std::vector<Address::ptr>& servers);
+
+	// 当前使用的 nameserver
+	std::vector<Address::ptr> getServers();
+
+	// 是否有可用的 nameserver
+	bool hasServers() { return !getServers().empty();}
+
+	// 指定 hosts 文件, 为空表示不使用 hosts 文件
+	void setHostsFile(const std::string& path);
+
+	// 清空缓存
+	void clearCache();
+
+	// 缓存条目数
+	size_t getCacheSize();
+
+	// 发往 nameserver 的查询次数
+	uint64_t getQueryCount() const { return m_queryCount;}
+
+private:
+	// 缓存条目, addrs 为空表示否定缓存
+	struct CacheEntry {
+		std::vector<Address::ptr> addrs;
+		uint64_t expire = 0;	// 过期时间(毫秒)
+	};
+
+	// hosts 文件中的记录
+	struct HostsFile {
+		std::string path;
+		time_t mtime = 0;
+		uint64_t checkTime = 0;		// 上次检查文件修改时间(毫秒)
+		std::unordered_map<std::string, std::vector<Address::ptr> > hosts;
+	};
+
+	// resolv.conf 中的配置
+	struct ResolvConf {
+		time_t mtime = 0;
+		uint64_t checkTime = 0;
+		std::vector<Address::ptr> servers;
+		std::vector<std::string> search;
+		int ndots = 1;
+	};
+
+	// 查 hosts 文件
+	bool lookupHosts(std::vector<IPAddress::ptr>& result, const std::string& name, int family);
+
+	// 查询单个完整域名的单一类型记录, 先查缓存, 返回 Result
+	int lookupName(std::vector<IPAddress::ptr>& result, const std::string& name, Type type);
+
+	// 依次向 nameserver 发起查询
+	int query(const std::string& name, Type type, std::vector<Address::ptr>& addrs,
+		uint64_t& ttl_ms);
+
+	// 向单个 nameserver 查询一次
+	int queryServer(Address::ptr server, const std::string& name, Type type,
+		std::vector<Address::ptr>& addrs, uint64_t& ttl_ms, uint64_t timeout_ms);
+
+	// 写入缓存
+	void addCache(const std::string& key, const std::vector<Address::ptr>& addrs,
+		uint64_t ttl_ms);
+
+	// 文件有变化时重新加载 hosts / resolv.conf
+	void reloadHosts();
+	void reloadResolvConf();
+
+	// 获取 search 列表和 ndots
+	void getSearch(std::vector<std::string>& search, int& ndots);
+
+private:
+	RWMutexType m_mutex;		// 保护缓存
+	std::unordered_map<std::string, CacheEntry> m_cache;
+	RWMutexType m_confMutex;	// 保护 hosts/resolv.conf/servers
+	HostsFile m_hosts;
+	ResolvConf m_resolv;
+	std::vector<Address::ptr> m_servers;	// setServers 指定的 nameserver
+	std::atomic<uint64_t> m_queryCount;
+};
+
+typedef MNSER::Singleton<DnsResolver> DnsMgr;
+
+}
+
+#endif
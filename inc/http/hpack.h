@@ -0,0 +1,109 @@
+#ifndef __MNSER_HTTP_HPACK_H__
+#define __MNSER_HTTP_HPACK_H__
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MNSER {
+namespace http {
+
+// HTTP/2 头部压缩 HPACK(RFC 7541)
+
+// 头部列表, 保持顺序, 名称为小写
+typedef std::vector<std::pair<std::string, std::string> > HPackHeaders;
+
+// 按前缀位数 prefix 编码整数, flags 为首字节中前缀之外的高位
+void HPackEncodeInt(std::string& out, uint64_t value, int prefix, uint8_t flags);
+
+// 解码整数, 成功返回消耗的字节数, 数据不足或溢出返回 -1
+int HPackDecodeInt(const uint8_t* data, size_t len, int prefix, uint64_t& value);
+
+// Huffman 编码后的长度(字节)
+size_t HuffmanEncodeLength(const std::string& str);
+
+// Huffman 编码, 追加到 out
+void HuffmanEncode(std::string& out, const std::string& str);
+
+// Huffman 解码, 追加到 out, 数据非法(含 EOS 或填充不正确)返回 false
+bool HuffmanDecode(std::string& out, const uint8_t* data, size_t len);
+
+// 动态表, 索引从 1 开始, 1~61 是静态表, 之后是动态表(最新加入的在前)
+class HPackTable {
+public:
+    HPackTable(uint32_t max_size = 4096);
+
+    // 按索引取头部, 索引无效返回 false
+    bool get(uint64_t idx, std::string& name, std::string& value) const;
+
+    // 查找头部, 返回索引, 没有找到返回 0; 名称和值都匹配时 full 为 true
+    uint32_t find(const std::string& name, const std::string& value, bool& full) const;
+
+    // 加入动态表, 超出容量时淘汰最早的条目
+    void add(const std::string& name, const std::string& value);
+
+    // 修改容量, 淘汰超出的条目
+    void setMaxSize(uint32_t v);
+
+    uint32_t getMaxSize() const { return m_maxSize;}
+    uint32_t getSize() const { return m_size;}
+    size_t getCount() const { return m_entries.size();}
+
+private:
+    void evict();
+
+private:
+    std::deque<std::pair<std::string, std::string> > m_entries;
+    uint32_t m_size;        // 按 RFC 计算的大小, 每条为 name + value + 32
+    uint32_t m_maxSize;
+};
+
+// 解码器, 一个连接一个, 头部块必须按收到的顺序解码
+class HPackDecoder {
+public:
+    // max_table_size 为通过 SETTINGS_HEADER_TABLE_SIZE 允许对端使用的最大容量
+    HPackDecoder(uint32_t max_table_size = 4096);
+
+    // 解码一个完整的头部块, 追加到 headers, 失败返回 -1(连接级的 COMPRESSION_ERROR)
+    // max_list_size 限制解码后的头部总大小, 0 不限制
+    // 超过限制时仍然解码完整个块以更新动态表, headers 为空, 返回 1, 由调用方只拒绝这个流
+    int decode(const uint8_t* data, size_t len, HPackHeaders& headers, size_t max_list_size = 0);
+
+    const HPackTable& getTable() const { return m_table;}
+
+private:
+    bool readString(const uint8_t*& p, const uint8_t* end, std::string& out);
+
+private:
+    HPackTable m_table;
+    uint32_t m_maxAllowed;
+};
+
+// 编码器, 一个连接一个, 头部块必须按编码的顺序发送
+class HPackEncoder {
+public:
+    HPackEncoder(uint32_t max_table_size = 4096);
+
+    // 编码一个头部块, 追加到 out
+    void encode(const HPackHeaders& headers, std::string& out);
+
+    // 对端 SETTINGS_HEADER_TABLE_SIZE 变化, 下一个头部块开头发送容量更新
+    void setMaxTableSize(uint32_t v);
+
+    const HPackTable& getTable() const { return m_table;}
+
+private:
+    void encodeString(std::string& out, const std::string& str);
+
+private:
+    HPackTable m_table;
+    uint32_t m_pendingSize;     // 待发送的容量更新
+    bool m_sizeUpdate;
+};
+
+}
+}
+
+#endif
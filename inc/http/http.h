@@ -9,6 +9,8 @@
 #include <sstream>
 #include <boost/lexical_cast.hpp>
 
+#include "stream.h"
+
 namespace MNSER {
 namespace http {
 
@@ -203,6 +205,7 @@ public:
     const MapType& getCookies() const { return m_cookies;}      // 返回HTTP请求的 cookie MAP
     bool isClose() const { return m_close;}  					// 是否自动关闭
     bool isWebsocket() const { return m_websocket;}  			// 是否websocket
+    Stream::ptr getBodyStream() const { return m_bodyStream;}  	// 返回流式读取的消息体, 非流式请求为空
 
     void setMethod(HttpMethod v) { m_method = v;}  				// 设置HTTP请求的方法名
     void setVersion(uint8_t v) { m_version = v;}  				// 设置HTTP请求的协议版本, v 协议版本0x11, 0x10
@@ -215,6 +218,7 @@ public:
     void setHeaders(const MapType& v) { m_headers = v;}  		// 设置HTTP请求的头部MAP
     void setParams(const MapType& v) { m_params = v;}  			// 设置HTTP请求的参数MAP
     void setCookies(const MapType& v) { m_cookies = v;}  		// 设置HTTP请求的Cookie MAP
+    void setBodyStream(Stream::ptr v) { m_bodyStream = v;}  	// 设置流式读取的消息体
 	
     // 获取HTTP请求的头部参数, def 默认值
     std::string getHeader(const std::string& key, const std::string& def = "") const;
@@ -318,6 +322,7 @@ private:
     MapType 		m_headers;  		// 请求头部MAP
     MapType 		m_params;  			// 请求参数MAP
     MapType 		m_cookies;  		// 请求Cookie MAP
+    Stream::ptr 	m_bodyStream;  		// 流式消息体, 为空时消息体在 m_body 中
 };
 
 class HttpResponse {
@@ -332,6 +337,7 @@ public:
     const std::string& 	getBody() const 	{ return m_body;}  				// 返回响应消息体
     const std::string& 	getReason() const 	{ return m_reason;}  			// 返回响应原因
     const MapType& 		getHeaders() const 	{ return m_headers;}  			// 返回响应头部MAP
+    const std::vector<std::string>& getCookies() const { return m_cookies;}	// 返回 Set-Cookie 的值
     bool 				isWebsocket() const { return m_websocket;}   		// 是否websocket
     bool 				isClose() const 	{ return m_close;} 				// 是否自动关闭
 
@@ -355,6 +361,12 @@ public:
     // 序列化输出到流
     std::ostream& dump(std::ostream& os) const;
 
+    // 将响应行和头部(含结尾空行, 不含消息体)追加到 buf, 返回追加的字节数
+    // with_length 为 true 时按消息体补上 content-length(空消息体为 0), 以下情况除外:
+    // 1xx/204/304, websocket, 已经设置了 content-length 或 transfer-encoding
+    // 写入器自己决定分帧方式, 传 false
+    size_t dumpHeader(std::string& buf, bool with_length = true) const;
+
     // 转成字符串
     std::string toString() const;
 
@@ -0,0 +1,121 @@
+#ifndef __MNSER_HTTP_HTTP2_FRAME_H__
+#define __MNSER_HTTP_HTTP2_FRAME_H__
+
+#include <stdint.h>
+#include <string>
+
+namespace MNSER {
+namespace http {
+
+// HTTP/2 帧格式(RFC 7540 第 4, 6 节)
+
+// 客户端连接前言
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_PREFACE_SIZE 24
+
+// 帧头长度
+#define HTTP2_FRAME_HEADER_SIZE 9
+
+// 流控窗口的默认值和最大值
+#define HTTP2_DEFAULT_WINDOW_SIZE 65535
+#define HTTP2_MAX_WINDOW_SIZE 0x7fffffff
+
+// 帧的最小和最大长度上限
+#define HTTP2_MIN_FRAME_SIZE 16384
+#define HTTP2_MAX_FRAME_SIZE 16777215
+
+enum class Http2FrameType : uint8_t {
+    DATA            = 0x0,
+    HEADERS         = 0x1,
+    PRIORITY        = 0x2,
+    RST_STREAM      = 0x3,
+    SETTINGS        = 0x4,
+    PUSH_PROMISE    = 0x5,
+    PING            = 0x6,
+    GOAWAY          = 0x7,
+    WINDOW_UPDATE   = 0x8,
+    CONTINUATION    = 0x9
+};
+
+// 帧标志位
+enum Http2Flag {
+    HTTP2_FLAG_END_STREAM   = 0x1,
+    HTTP2_FLAG_ACK          = 0x1,
+    HTTP2_FLAG_END_HEADERS  = 0x4,
+    HTTP2_FLAG_PADDED       = 0x8,
+    HTTP2_FLAG_PRIORITY     = 0x20
+};
+
+// RST_STREAM 和 GOAWAY 的错误码
+enum class Http2Error : uint32_t {
+    NO_ERROR            = 0x0,
+    PROTOCOL_ERROR      = 0x1,
+    INTERNAL_ERROR      = 0x2,
+    FLOW_CONTROL_ERROR  = 0x3,
+    SETTINGS_TIMEOUT    = 0x4,
+    STREAM_CLOSED       = 0x5,
+    FRAME_SIZE_ERROR    = 0x6,
+    REFUSED_STREAM      = 0x7,
+    CANCEL              = 0x8,
+    COMPRESSION_ERROR   = 0x9,
+    CONNECT_ERROR       = 0xa,
+    ENHANCE_YOUR_CALM   = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED   = 0xd
+};
+
+// SETTINGS 参数
+enum class Http2Setting : uint16_t {
+    HEADER_TABLE_SIZE       = 0x1,
+    ENABLE_PUSH             = 0x2,
+    MAX_CONCURRENT_STREAMS  = 0x3,
+    INITIAL_WINDOW_SIZE     = 0x4,
+    MAX_FRAME_SIZE          = 0x5,
+    MAX_HEADER_LIST_SIZE    = 0x6
+};
+
+const char* Http2FrameTypeToString(Http2FrameType type);
+const char* Http2ErrorToString(Http2Error err);
+
+// 帧头
+struct Http2FrameHeader {
+    uint32_t length = 0;
+    Http2FrameType type = Http2FrameType::DATA;
+    uint8_t flags = 0;
+    uint32_t streamId = 0;
+
+    // 从 9 字节的帧头解析
+    void decode(const uint8_t* data);
+
+    // 编码成 9 字节
+    void encode(char* out) const;
+
+    bool hasFlag(uint8_t flag) const { return flags & flag;}
+
+    std::string toString() const;
+};
+
+// 下面的函数把一个完整的帧追加到 out
+
+void Http2AppendFrame(std::string& out, Http2FrameType type, uint8_t flags
+                      ,uint32_t stream_id, const void* payload, size_t length);
+
+// 只追加帧头, 载荷由调用者随后追加
+void Http2AppendFrameHeader(std::string& out, Http2FrameType type, uint8_t flags
+                            ,uint32_t stream_id, size_t length);
+
+// 头部块超过 max_frame_size 时拆成 HEADERS + CONTINUATION
+void Http2AppendHeaders(std::string& out, uint32_t stream_id, const std::string& block
+                        ,bool end_stream, size_t max_frame_size);
+
+void Http2AppendSetting(std::string& payload, Http2Setting id, uint32_t value);
+void Http2AppendWindowUpdate(std::string& out, uint32_t stream_id, uint32_t increment);
+void Http2AppendRstStream(std::string& out, uint32_t stream_id, Http2Error err);
+void Http2AppendGoaway(std::string& out, uint32_t last_stream_id, Http2Error err
+                       ,const std::string& debug = "");
+void Http2AppendPing(std::string& out, const void* data, bool ack);
+
+}
+}
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef __MNSER_HTTP_HTTP2_SESSION_H__
+#define __MNSER_HTTP_HTTP2_SESSION_H__
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "http_session.h"
+#include "http_servlet.h"
+#include "http2_frame.h"
+#include "hpack.h"
+#include "iomanager.h"
+#include "mutex.h"
+
+namespace MNSER {
+namespace http {
+
+class Http2Session;
+
+// 等待条件的协程, 唤醒时调度回它所在的调度器
+struct Http2Waiter {
+    Fiber::ptr fiber;
+    Scheduler* scheduler = nullptr;
+};
+
+// HTTP/2 的一个流, 对 servlet 表现为一个 HttpSession, 现有的 servlet 不需要修改
+// 请求消息体通过 read 读取(流式 servlet 的 getBodyStream() 就是它), 响应通过 sendResponse 或写入器发送
+// 不能直接 write 原始字节; close 只重置这个流, 不关闭连接
+class Http2Stream : public HttpSession {
+public:
+    typedef std::shared_ptr<Http2Stream> ptr;
+
+    Http2Stream(std::shared_ptr<Http2Session> conn, uint32_t id);
+
+    uint32_t getId() const { return m_id;}
+    HttpRequest::ptr getRequest() const { return m_request;}
+
+    // 以 HEADERS + DATA 帧发送响应
+    virtual int sendResponse(HttpResponse::ptr rsp, bool head = false) override;
+
+    // 创建以 DATA 帧发送消息体的写入器
+    virtual HttpResponseWriter::ptr createResponseWriter(HttpResponse::ptr rsp
+                                    ,int64_t content_length = -1) override;
+
+    // 读请求消息体, 数据不够时等待, 读完返回 0, 流被重置返回 -1
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    // 不支持, 返回 -1
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    // 响应没有发送完时以 CANCEL 重置流
+    virtual void close() override;
+
+    // 发送响应头, end_stream 为 true 时响应没有消息体
+    bool sendHeaders(HttpResponse::ptr rsp, bool end_stream);
+
+    // 发送消息体, 流中待发送的数据超过 http2.stream_send_buffer 时等待, 成功返回 length, 失败返回 -1
+    int sendData(const void* data, size_t length, bool end_stream);
+
+private:
+    friend class Http2Session;
+
+    std::shared_ptr<Http2Session> m_conn;
+    uint32_t m_id;
+    HttpRequest::ptr m_request;
+    Servlet::ptr m_servlet;
+
+    // 以下字段由连接的 m_mutex 保护
+    bool m_remoteClosed = false;    // 收到了 END_STREAM
+    bool m_localClosed = false;     // 不再发送数据, END_STREAM 等待发出
+    bool m_endSent = false;         // END_STREAM 已经进入发送缓冲
+    bool m_headersSent = false;     // 响应头已经进入发送缓冲
+    bool m_reset = false;           // 流已经重置
+    bool m_dispatched = false;      // 已经交给 servlet 处理
+    bool m_discard = false;         // 消息体超过上限, 之后的数据丢弃
+
+    std::string m_recvBuf;          // 收到还未读取的消息体
+    size_t m_recvPos = 0;
+    uint64_t m_recvSize = 0;        // 收到的消息体总长度
+    int64_t m_recvWindow = 0;       // 接收窗口
+    uint32_t m_recvConsumed = 0;    // 已经处理还没有通过 WINDOW_UPDATE 归还的字节数
+    Http2Waiter m_readWaiter;       // 等待消息体的协程
+
+    std::string m_sendBuf;          // 待发送的消息体
+    size_t m_sendPos = 0;
+    int64_t m_sendWindow = 0;       // 发送窗口
+    Http2Waiter m_sendWaiter;       // 等待发送缓冲空间的协程
+
+    uint32_t m_parent = 0;          // 依赖的流
+    uint32_t m_weight = 16;         // 权重 1~256
+    uint64_t m_pass = 0;            // 加权公平调度的虚拟时间, 小的先发送
+};
+
+// HTTP/2 响应写入器, 消息体以 DATA 帧发送, 压缩和长度检查沿用 HttpResponseWriter
+class Http2ResponseWriter : public HttpResponseWriter {
+public:
+    Http2ResponseWriter(Http2Stream* stream, HttpResponse::ptr rsp, int64_t content_length);
+
+protected:
+    virtual bool writeHeader() override;
+    virtual int writeRaw(const void* buffer, size_t length) override;
+    // 帧需要在用户态组装, 文件内容用 pread 读出后发送
+    virtual int64_t writeFile(int fd, off_t offset, size_t length) override;
+    virtual bool writeEnd() override;
+
+private:
+    Http2Stream* m_stream;
+};
+
+// 服务端的 HTTP/2 连接(h2c), 由 HttpServer 在收到连接前言或 Upgrade: h2c 后创建
+// run 所在的协程读取并处理帧; 每个请求在 IOManager 的新协程中交给 servlet 处理;
+// 一个写协程按优先级(依赖关系 + 权重)和流控窗口把各个流的数据组帧发出, 控制帧优先
+class Http2Session : public SocketStream, public std::enable_shared_from_this<Http2Session> {
+public:
+    typedef std::shared_ptr<Http2Session> ptr;
+    typedef Mutex MutexType;
+
+    Http2Session(Socket::ptr sock, ServletDispatch::ptr dispatch
+                 ,const std::string& server_name, bool owner = false);
+
+    ~Http2Session();
+
+    // 请求交给 servlet 处理的调度器, 默认是创建连接时的调度器
+    void setWorker(IOManager* v) { m_worker = v;}
+
+    // 协议切换前已经读到的数据, 从连接前言开始
+    void setPending(const std::string& data) { m_recvBuf = data; m_recvPos = 0;}
+
+    // 由 HTTP/1.1 Upgrade: h2c 升级, req 作为流 1 处理
+    // settings 为 HTTP2-Settings 头的值(base64url 编码的 SETTINGS 载荷), 格式错误返回 false
+    bool setUpgrade(HttpRequest::ptr req, const std::string& settings);
+
+    // 处理连接直到对端关闭或出错, 返回前等待所有请求处理完
+    void run();
+
+    // 当前的流数量
+    size_t getStreamCount();
+
+    // 是否启用 HTTP/2(http2.enable)
+    static bool IsEnabled();
+
+private:
+    friend class Http2Stream;
+
+    // 保证接收缓冲中至少有 n 个未处理的字节
+    bool fill(size_t n);
+
+    bool handleFrame(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onData(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onHeaders(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onHeaderBlockEnd();
+    bool onPriority(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onRstStream(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onSettings(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onPing(const Http2FrameHeader& fh, const uint8_t* payload);
+    bool onWindowUpdate(const Http2FrameHeader& fh, const uint8_t* payload);
+
+    // 应用对端的设置, 需要持有锁
+    Http2Error applySettings(const uint8_t* data, size_t length);
+
+    // 修改流的优先级, 需要持有锁
+    void setPriority(Http2Stream::ptr stream, uint32_t parent, uint32_t weight, bool exclusive);
+
+    // 交给 servlet 处理, 需要持有锁
+    void dispatch(Http2Stream::ptr stream);
+
+    // 在独立的协程中处理一个请求
+    void handleStream(Http2Stream::ptr stream);
+
+    // 发送头部块, 由 Http2Stream 调用
+    bool submitHeaders(Http2Stream* stream, const HPackHeaders& headers, bool end_stream);
+
+    // 连接错误, 发送 GOAWAY 后返回 false, 读循环随之结束
+    bool connectionError(Http2Error err, const std::string& msg);
+
+    // 流错误, 发送 RST_STREAM, 需要持有锁
+    void resetStream(uint32_t id, Http2Error err);
+
+    // 两个方向都结束的流从表中移除, 需要持有锁
+    void tryRemoveStream(Http2Stream* stream);
+
+    // 写协程
+    void writeLoop();
+
+    // 按优先级和窗口把 DATA 帧追加到 out, 需要持有锁
+    void fillData(std::string& out);
+
+    // 下一个要发送数据的流, 需要持有锁
+    Http2Stream* nextStream();
+
+    // 流现在是否可以发送数据, 需要持有锁
+    bool isSendable(Http2Stream* stream) const;
+
+    // 读循环结束后收不到 WINDOW_UPDATE, 重置窗口用完的流, 需要持有锁
+    void resetStalledStreams();
+
+    // 在 lock 上等待, 返回时重新持有锁
+    void wait(Http2Waiter& waiter, MutexType::Lock& lock);
+
+    // 唤醒等待的协程
+    static void Wake(Http2Waiter& waiter);
+
+private:
+    ServletDispatch::ptr m_dispatch;
+    std::string m_serverName;
+    IOManager* m_iom;
+    IOManager* m_worker;                // 处理请求的调度器
+
+    // 只在读协程中使用
+    std::string m_recvBuf;              // 接收缓冲
+    size_t m_recvPos = 0;               // 接收缓冲中已处理的长度
+    HPackDecoder m_decoder;
+    uint32_t m_headerStream = 0;        // 正在接收头部块(CONTINUATION)的流, 0 表示没有
+    std::string m_headerBlock;          // 正在接收的头部块
+    bool m_headerEndStream = false;     // 头部块所在的 HEADERS 帧带 END_STREAM
+    uint32_t m_headerParent = 0;        // 头部块携带的优先级
+    uint32_t m_headerWeight = 16;
+    bool m_headerExclusive = false;
+    Http2Stream::ptr m_upgradeStream;   // 升级请求对应的流 1
+
+    MutexType m_mutex;
+    HPackEncoder m_encoder;
+    std::map<uint32_t, Http2Stream::ptr> m_streams;
+    std::string m_sendBuf;              // 待发送的控制帧和头部帧, 先于 DATA 发送
+    uint32_t m_lastStreamId = 0;        // 收到的最大流 id
+    int64_t m_sendWindow;               // 连接的发送窗口
+    int64_t m_recvWindow;               // 连接的接收窗口
+    uint32_t m_recvConsumed = 0;        // 连接上还没有归还的接收字节数
+    uint32_t m_peerInitialWindow;       // 对端的 SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t m_peerMaxFrameSize;        // 对端的 SETTINGS_MAX_FRAME_SIZE
+    // 本端的设置, run 开始时从配置读取, 整个连接使用同一份
+    uint32_t m_localInitialWindow;      // 流的接收窗口
+    uint32_t m_localConnWindow;         // 连接的接收窗口
+    uint32_t m_localMaxStreams;         // 同时处理的最大流数
+    uint32_t m_localMaxFrameSize;       // 接收的帧的最大长度
+    uint64_t m_vtime = 0;               // 调度的虚拟时间
+    uint32_t m_activeHandlers = 0;      // 正在处理的请求数
+    bool m_readDone = false;            // 读循环已经结束
+    bool m_goawaySent = false;
+    bool m_goawayReceived = false;
+    bool m_error = false;               // 连接出错, 不再发送
+    bool m_writerExited = false;
+    Http2Waiter m_writeWaiter;          // 没有数据可发时等待的写协程
+    Http2Waiter m_runWaiter;            // 等待写协程退出的 run
+};
+
+}
+}
+
+#endif
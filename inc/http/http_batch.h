@@ -0,0 +1,131 @@
+#ifndef __MNSER_HTTP_BATCH_H__
+#define __MNSER_HTTP_BATCH_H__
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "http_connection.h"
+#include "fiber.h"
+#include "iomanager.h"
+#include "mutex.h"
+
+namespace MNSER {
+namespace http {
+
+// 并发请求(fan-out), 把一批请求同时发往一个或多个连接池, 按完成顺序收集结果
+// 每个请求(或每组流水线请求)在 IOManager 上各跑一个协程, 互不阻塞
+// 每个请求有自己的截止时间, 超时或被取消的请求立即以 TIMEOUT/CANCELLED 完成,
+// 正在等待它的连接会被 shutdown, 不会放回连接池
+//
+// 用法:
+//     HttpBatch::ptr batch(new HttpBatch);
+//     batch->add(pool, pool->createRequest(HttpMethod::GET, "/a"), 200);
+//     batch->add(pool, pool->createRequest(HttpMethod::GET, "/b"), 500);
+//     batch->start();
+//     int64_t idx;
+//     while((idx = batch->next()) >= 0) {
+//         auto r = batch->getResult(idx);
+//     }
+class HttpBatch : public std::enable_shared_from_this<HttpBatch> {
+public:
+    typedef std::shared_ptr<HttpBatch> ptr;
+    typedef Mutex MutexType;
+    // 单个请求完成时的回调, 在完成它的协程(或定时器)中调用
+    typedef std::function<void(size_t idx, HttpResult::ptr result)> Callback;
+
+    // iom 运行请求协程的 IOManager, 为空时用 start 调用方所在的 IOManager
+    HttpBatch(IOManager* iom = nullptr);
+
+    ~HttpBatch();
+
+    // 添加一个请求, timeout_ms 从 start 开始计算的截止时间, 返回请求序号
+    size_t add(HttpConnectionPool::ptr pool, HttpRequest::ptr req, uint64_t timeout_ms);
+
+    // 流水线深度, 大于 1 时发往同一个连接池的请求每 v 个一组,
+    // 在同一个连接上一次写出再按顺序读取响应(HTTP/1.1 pipelining)
+    void setPipelineDepth(uint32_t v) { m_pipelineDepth = v ? v : 1;}
+
+    // 设置完成回调
+    void setCallback(Callback cb) { m_cb = cb;}
+
+    // 发出所有请求, 只能调用一次
+    bool start();
+
+    // 等待下一个完成的请求, 返回它的序号, 全部取完返回 -1, 只能在协程中调用
+    int64_t next();
+
+    // 等待全部请求完成
+    void wait();
+
+    // 取消一个未完成的请求, 已经完成返回 false
+    bool cancel(size_t idx);
+
+    // 取消所有未完成的请求
+    void cancelAll();
+
+    // 获取请求结果, 未完成返回 nullptr
+    HttpResult::ptr getResult(size_t idx);
+
+    // 请求总数
+    size_t size() const { return m_tasks.size();}
+
+    // 已完成的请求数
+    size_t getDoneCount();
+
+private:
+    struct Group;
+
+    // 单个请求
+    struct Task {
+        HttpConnectionPool::ptr pool;
+        HttpRequest::ptr req;
+        uint64_t timeout = 0;
+        uint64_t deadline = 0;          // 绝对截止时间(毫秒)
+        HttpResult::ptr result;
+        Timer::ptr timer;               // 截止时间定时器
+        std::shared_ptr<Group> group;
+        bool done = false;
+    };
+
+    // 在同一个连接上执行的一组请求, 不开流水线时每组只有一个请求
+    struct Group {
+        typedef std::shared_ptr<Group> ptr;
+        HttpConnectionPool::ptr pool;
+        std::vector<size_t> tasks;
+        size_t pending = 0;             // 未完成的请求数
+        HttpConnection::ptr conn;       // 正在使用的连接
+        bool shutdown = false;          // 连接是否因为取消/超时被 shutdown
+    };
+
+    // 执行一组请求
+    void runGroup(Group::ptr group);
+
+    // 完成一个请求, 已完成返回 false; abort 为 true 表示超时/取消,
+    // 所在组的请求都结束后 shutdown 连接, 唤醒阻塞在上面的协程
+    bool finish(size_t idx, HttpResult::ptr result, bool abort = false);
+
+    // 组内未完成请求中最晚的截止时间
+    uint64_t groupDeadline(Group::ptr group);
+
+    // 截止时间到
+    void onTimeout(size_t idx);
+
+private:
+    IOManager* m_iom;
+    MutexType m_mutex;
+    std::vector<Task> m_tasks;
+    std::deque<size_t> m_done;          // 已完成但还没被 next 取走的请求
+    size_t m_doneCount = 0;
+    uint32_t m_pipelineDepth = 1;
+    bool m_started = false;
+    Callback m_cb;
+    Fiber::ptr m_waiter;                // 在 next 中等待的协程
+    Scheduler* m_waiterScheduler = nullptr;
+};
+
+}
+}
+
+#endif
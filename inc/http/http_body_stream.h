@@ -0,0 +1,99 @@
+#ifndef __MNSER_HTTP_BODY_STREAM_H__
+#define __MNSER_HTTP_BODY_STREAM_H__
+
+#include <string>
+
+#include "stream.h"
+#include "bytearray.h"
+
+namespace MNSER {
+namespace http {
+
+// HTTP 消息体流, 按 content-length / chunked / 读到连接关闭 三种方式
+// 从底层流中增量读取消息体, chunked 编码边读边解码
+class HttpBodyStream : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyStream> ptr;
+
+    // 消息体的分帧方式
+    enum Mode {
+        LENGTH      = 0,    // 由 content-length 指定长度
+        CHUNKED     = 1,    // Transfer-Encoding: chunked
+        UNTIL_CLOSE = 2,    // 读到连接关闭为止(仅用于响应)
+    };
+
+    // src 底层流, pending 底层流上已经读出但未消费的数据(解析头部时多读的部分)
+    // src 和 pending 的生命周期由调用方保证长于本对象
+    // length LENGTH 模式下消息体长度, max_size 消息体允许的最大长度
+    HttpBodyStream(Stream* src, std::string* pending, Mode mode
+                   ,uint64_t length, uint64_t max_size);
+
+    // 把 pending 中已经消费的数据去掉, 剩下的留给同一连接上的下一个消息
+    ~HttpBodyStream();
+
+    // 读消息体, 返回值: >0 读到的字节数, =0 消息体结束, <0 出错(连接异常/格式错误/超过最大长度)
+    virtual int read(void* buffer, size_t length) override;
+
+    // 读消息体到 ByteArray
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    // 消息体流只读, 写操作返回 -1
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    // 消息体流不拥有底层连接, 关闭由连接自己负责, 这里什么也不做
+    virtual void close() override;
+
+    // 读取剩余全部消息体追加到 body, 成功返回 true
+    // 长度未知(chunked/读到关闭)时先分段接收, 最后一次性拷贝, 避免 body 反复扩容
+    bool readAll(std::string& body);
+
+    // 读取剩余全部消息体写入 ba 的当前位置, 数据直接读进 ba 的内存块, 成功返回 true
+    bool readAll(ByteArray::ptr ba);
+
+    // 丢弃剩余的消息体, 使连接可以继续处理下一个请求, 成功返回 true
+    bool discard();
+
+    // 消息体是否已经读完
+    bool isFinished() const { return m_finished;}
+
+    // 是否出错
+    bool hasError() const { return m_error;}
+
+    // 已读取的消息体长度
+    uint64_t getReadSize() const { return m_readSize;}
+
+    Mode getMode() const { return m_mode;}
+
+private:
+    // 从 pending 或底层流读数据, 不超过 length
+    int readRaw(void* buffer, size_t length);
+
+    // 读一行(不含 \r\n), 行长度超过 max_len 视为错误
+    bool readLine(std::string& line, size_t max_len);
+
+    // 消费 pending 中的 n 个字节, 只移动偏移, 全部消费完时清空
+    void consumePending(size_t n);
+
+    // 去掉 pending 中已经消费的部分
+    void compactPending();
+
+    // 读取下一个 chunk 的头部, 最后一个 chunk 时读完 trailer 并结束
+    bool nextChunk();
+
+private:
+    Stream* m_src;              // 底层流
+    std::string* m_pending;     // 底层流上多读的数据
+    size_t m_pendingPos;        // pending 中已经消费的长度
+    Mode m_mode;                // 分帧方式
+    uint64_t m_left;            // LENGTH 模式剩余长度 / CHUNKED 模式当前 chunk 剩余长度
+    uint64_t m_maxSize;         // 最大消息体长度
+    uint64_t m_readSize;        // 已读取的消息体长度
+    bool m_finished;            // 是否读完
+    bool m_error;               // 是否出错
+};
+
+}
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <atomic>
 
 #include "mutex.h"
+#include "timer.h"
 #include "uri.h"
 #include "http.h"
 #include "socket_stream.h"
@@ -28,6 +29,8 @@ struct HttpResult {
         CREATE_SOCKET_ERROR 	= 7,    	// 创建Socket失败
         POOL_GET_CONNECTION 	= 8,    	// 从连接池中取连接失败
         POOL_INVALID_CONNECTION = 9,		// 无效的连接
+        CANCELLED 				= 10,		// 请求被取消
+        HANDSHAKE_FAIL 			= 11,		// WebSocket 握手失败
     };
 
     HttpResult(int _result
@@ -106,13 +109,29 @@ public:
 
     ~HttpConnection();
 
-    // 接收HTTP响应
-    HttpResponse::ptr recvResponse();
+    // 接收HTTP响应, method 对应请求的方法, HEAD 请求的响应没有消息体
+    // 多读到的数据留在连接的缓冲区里, 流水线上的下一个响应从这里接着解析
+    // gzip/deflate 编码的消息体会透明解压, 并去掉 Content-Encoding/Content-Length 头部
+    HttpResponse::ptr recvResponse(HttpMethod method = HttpMethod::GET);
 
     // 发送HTTP请求, req HTTP请求结构
     int sendRequest(HttpRequest::ptr req);
 
+    // 取走连接缓冲中还未处理的数据, 协议升级(WebSocket)后交给新协议继续解析
+    std::string takeBuffer();
+
+    // 一次写出多个请求(HTTP/1.1 流水线), 响应按请求顺序用 recvResponse 读取
+    int sendRequests(const std::vector<HttpRequest::ptr>& reqs);
+
+private:
+    // 接收响应行和头部
+    HttpResponse::ptr recvResponseHeader();
+
+    // 按 content-length / chunked / 连接关闭接收消息体, 边读边解压
+    bool recvResponseBody(HttpResponse::ptr rsp, HttpMethod method);
+
 private:
+    std::string m_buffer;       // 已读取但还没解析的数据
     uint64_t m_createTime = 0;  
     uint64_t m_request = 0;
 };
@@ -120,7 +139,6 @@ private:
 class HttpConnectionPool {
 public:
     typedef std::shared_ptr<HttpConnectionPool> ptr;
-    typedef Mutex MutexType;
 
     static HttpConnectionPool::ptr Create(const std::string& uri
                                    ,const std::string& vhost
@@ -136,8 +154,14 @@ public:
                        , uint32_t max_alive_time
                        , uint32_t max_request);
 
+    ~HttpConnectionPool();
+
+    // 获取连接, 优先取当前线程缓存的连接, 其次从共享的空闲栈中取, 都没有就新建
     HttpConnection::ptr getConnection();
 
+    // 当前创建的连接总数
+    int32_t getTotal() const { return m_total;}
+
 
     // 发送HTTP的GET请求, url 请求的url, timeout_ms 超时时间(毫秒), headers HTTP请求头部参数, body 请求消息体
     // 返回HTTP结果结构体
@@ -188,10 +212,56 @@ public:
     HttpResult::ptr doRequest(HttpRequest::ptr req
                             , uint64_t timeout_ms);
 
+    // 按连接池的 Host 配置构造请求, 长连接
+    HttpRequest::ptr createRequest(HttpMethod method
+                            , const std::string& url
+                            , const std::map<std::string, std::string>& headers = {}
+                            , const std::string& body = "") const;
+
+    const std::string& getHost() const { return m_host;}
+    uint32_t getPort() const { return m_port;}
+
 private:
     static void ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool);
 
+    // 连接是否还可以复用
+    bool isValid(HttpConnection* conn, uint64_t now_ms) const;
+
+    // 从共享空闲栈中取一个连接, 跳过已经被淘汰的节点, 没有返回 nullptr
+    HttpConnection* popIdle();
+
+    // 放回共享空闲栈, 栈满返回 false
+    bool pushIdle(HttpConnection* conn);
+
+    // 销毁连接
+    void destroy(HttpConnection* conn);
+
+    // 淘汰过期的空闲连接, 由后台定时器调用
+    // 只取走过期的连接, 有效的连接留在原处, 已断开的连接在取用时发现并销毁
+    void evict();
+
+    // 过期时间不晚于 now_ms 时取走槽中的连接并销毁, 取走的连接仍然有效时放回空闲栈
+    // 返回是否销毁了连接
+    bool evictSlot(std::atomic<HttpConnection*>& slot, const std::atomic<uint64_t>& expire, uint64_t now_ms);
+
+    // 在当前 IOManager 上启动淘汰定时器, 只启动一次
+    void startEvictTimer();
+
 private:
+    // 共享空闲栈的节点, 预先分配, 用下标链接
+    // conn 被淘汰定时器取走后节点仍在空闲栈中, 由 popIdle 放回空闲节点栈
+    struct Node {
+        std::atomic<HttpConnection*> conn = {nullptr};
+        std::atomic<uint64_t> expire = {0};     // conn 的过期时间, 淘汰时不需要访问连接
+        std::atomic<uint32_t> next = {0};
+    };
+
+    // 线程缓存槽, 每个线程独占一个, 按缓存行对齐避免伪共享
+    struct alignas(64) CacheSlot {
+        std::atomic<HttpConnection*> conn = {nullptr};
+        std::atomic<uint64_t> expire = {0};     // conn 的过期时间
+    };
+
     std::string m_host;
     std::string m_vhost;
     uint32_t m_port;
@@ -200,8 +270,13 @@ private:
     uint32_t m_maxRequest;
     bool m_isHttps;
 
-    MutexType m_mutex;
-    std::list<HttpConnection*> m_conns;
+    std::unique_ptr<Node[]> m_nodes;            // m_maxSize 个节点
+    std::atomic<uint64_t> m_idle = {0};         // 空闲连接栈顶, 高 32 位版本号, 低 32 位节点下标
+    std::atomic<uint64_t> m_free = {0};         // 空节点栈顶
+    std::unique_ptr<CacheSlot[]> m_caches;      // 线程缓存
+    std::atomic<bool> m_timerStarted = {false};
+    Timer::ptr m_timer;                         // 淘汰定时器
+    std::shared_ptr<char> m_timerCond;          // 定时器条件, 析构时释放
     std::atomic<int32_t> m_total = {0};
 };
 
@@ -0,0 +1,63 @@
+#ifndef __MNSER_HTTP_FILE_SERVLET_H__
+#define __MNSER_HTTP_FILE_SERVLET_H__
+
+#include <sys/stat.h>
+#include <unordered_map>
+
+#include "http_servlet.h"
+#include "mutex.h"
+
+namespace MNSER {
+namespace http {
+
+// 静态文件 Servlet, 把 prefix 之后的请求路径映射到 root 目录下的文件
+// 文件内容通过 sendfile 发送, 支持单段 Range, If-Modified-Since/If-None-Match 和 HEAD
+// 打开的 fd 和 stat 结果会缓存 http.static_file.cache_ttl 毫秒
+class StaticFileServlet : public Servlet {
+public:
+    typedef std::shared_ptr<StaticFileServlet> ptr;
+
+    // root 文件根目录, prefix 注册时的路径前缀, 例如 "/static/"
+    StaticFileServlet(const std::string& root, const std::string& prefix = "/");
+
+	// 处理请求 reques HTTP请求, response HTTP响应, session HTTP连接响应
+    virtual int32_t handle(MNSER::http::HttpRequest::ptr request
+                   , MNSER::http::HttpResponse::ptr response
+                   , MNSER::http::HttpSession::ptr session) override;
+
+    // 清空文件缓存
+    void clearCache();
+
+    const std::string& getRoot() const { return m_root;}
+
+private:
+    // 缓存的文件信息, 最后一个引用释放时关闭 fd
+    struct FileInfo {
+        typedef std::shared_ptr<FileInfo> ptr;
+        ~FileInfo();
+
+        int fd = -1;
+        struct stat st;
+        uint64_t expire = 0;            // 缓存过期时间(毫秒)
+        std::string etag;
+        std::string lastModified;
+        std::string contentType;        // 按实际打开的文件计算, 目录对应其中的 index.html
+    };
+
+    // 获取文件信息, path 为 root 下的绝对路径, 不存在或不是普通文件返回空
+    FileInfo::ptr getFile(const std::string& path, HttpStatus& status);
+
+    // 把请求路径转换成 root 下的文件路径, 非法路径返回 false
+    bool toLocalPath(const std::string& uri, std::string& path) const;
+
+private:
+    std::string m_root;     // 根目录(realpath)
+    std::string m_prefix;   // 路径前缀
+    Mutex m_mutex;
+    std::unordered_map<std::string, FileInfo::ptr> m_cache;     // 文件缓存
+};
+
+}
+}
+
+#endif
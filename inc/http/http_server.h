@@ -4,6 +4,7 @@
 #include "tcp_server.h"
 #include "http_session.h"
 #include "http_servlet.h"
+#include "ws_servlet.h"
 
 namespace MNSER {
 namespace http {
@@ -23,15 +24,28 @@ public:
     // 设置ServletDispatch
     void setServletDispatch(ServletDispatch::ptr v) { m_dispatch = v;}
 
+    // 获取 WebSocket 的 Servlet 分发器, 带 Upgrade: websocket 的请求按它匹配
+    WSServletDispatch::ptr getWSServletDispatch() const { return m_wsDispatch;}
+
+    // 设置 WebSocket 的 Servlet 分发器
+    void setWSServletDispatch(WSServletDispatch::ptr v) { m_wsDispatch = v;}
+
 	// 设置名称
     virtual void setName(const std::string& v) override;
 
 protected:
     virtual void handleClient(Socket::ptr client) override;
 
+    // 完成 WebSocket 握手, 之后在当前协程中接收消息并分发给 slt, 直到连接关闭
+    void handleWebsocket(HttpRequest::ptr req, HttpSession::ptr session, WSServlet::ptr slt);
+
+    // 以 HTTP/2 处理连接, req 不为空时是 Upgrade: h2c 的请求, 先回复 101 再作为流 1 处理
+    void handleHttp2(HttpSession::ptr session, HttpRequest::ptr req = nullptr);
+
 private:
     bool m_isKeepalive;  					// 是否支持长连接
     ServletDispatch::ptr m_dispatch;   		// Servlet分发器
+    WSServletDispatch::ptr m_wsDispatch;    // WebSocket Servlet分发器
 };
 
 }
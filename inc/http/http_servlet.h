@@ -20,7 +20,8 @@ public:
 	typedef std::shared_ptr<Servlet> ptr;
 
     Servlet(const std::string& name)
-        :m_name(name) {}
+        :m_name(name)
+        ,m_streamBody(false) {}
 
 	virtual ~Servlet() {};
 	
@@ -31,8 +32,16 @@ public:
 	
 	// 返回 Servlet 名称
 	const std::string& getName() { return m_name; }
+
+	// 由 PoolServletCreator 复用实例时, 每次请求结束后调用, 清理上一次请求留下的状态
+	virtual void reset() {}
+
+	// 是否以流的方式读取请求消息体, 是则消息体不会预先读入内存, 通过 request->getBodyStream() 读取
+	bool isStreamBody() const { return m_streamBody; }
+	void setStreamBody(bool v) { m_streamBody = v; }
 protected:
 	std::string m_name;
+	bool m_streamBody;
 };
 
 // 函数式 Servlet
@@ -99,13 +108,78 @@ public:
     }
 };
 
+// 池化的 ServletCreator, 每个线程保存一个空闲实例列表
+// 请求结束后实例调用 reset() 放回当前线程的列表, 下一次请求直接复用, 避免每次都重新构造
+// 同一个 T 的所有 PoolServletCreator 共享线程的空闲列表
+template<class T>
+class PoolServletCreator : public IServletCreator {
+public:
+    typedef std::shared_ptr<PoolServletCreator> ptr;
+
+    // max_free 每个线程最多缓存的空闲实例数
+    PoolServletCreator(size_t max_free = 64)
+        :m_maxFree(max_free) {
+    }
+
+    Servlet::ptr get() const override {
+        FreeList& list = GetFreeList();
+        T* slt = nullptr;
+        if(!list.items.empty()) {
+            slt = list.items.back();
+            list.items.pop_back();
+        } else {
+            slt = new T;
+        }
+        size_t max_free = m_maxFree;
+        return Servlet::ptr(slt, [max_free](Servlet* p) {
+            Release(static_cast<T*>(p), max_free);
+        });
+    }
+
+    std::string getName() const override {
+        return TypeToName<T>();
+    }
+
+private:
+    struct FreeList {
+        ~FreeList() {
+            for(auto i : items) {
+                delete i;
+            }
+        }
+        std::vector<T*> items;
+    };
+
+    static FreeList& GetFreeList() {
+        static thread_local FreeList s_list;
+        return s_list;
+    }
+
+    // 归还到释放时所在线程的空闲列表
+    static void Release(T* slt, size_t max_free) {
+        FreeList& list = GetFreeList();
+        if(list.items.size() >= max_free) {
+            delete slt;
+            return;
+        }
+        slt->reset();
+        list.items.push_back(slt);
+    }
+
+private:
+    size_t m_maxFree;
+};
+
 // Servlet 分发器
+// 匹配顺序: 精确匹配 > 路由匹配(addRouteServlet) > 模糊匹配(按添加顺序) > 默认servlet
+// 所有规则在注册时编译成路由表, 以 RCU 快照发布, 请求匹配时不加锁
 class ServletDispatch : public Servlet {
 public:
     typedef std::shared_ptr<ServletDispatch> ptr;
     typedef RWLock RWMutexType;
 
     ServletDispatch();
+    ~ServletDispatch();
 
 	// 处理请求 reques HTTP请求, response HTTP响应, session HTTP连接响应
     virtual int32_t handle(MNSER::http::HttpRequest::ptr request
@@ -124,6 +198,20 @@ public:
     // 添加模糊匹配servlet
     void addGlobServlet(const std::string& uri, FunctionServlet::callback cb);
 
+    // 添加路由servlet, 路径按 / 分段匹配
+    // ":name" 段匹配任意一段并作为请求参数 name, 最后一段 "*name" 或 "*" 匹配剩余的全部路径
+    // 例如 "/user/:id/info", "/files/*path", 参数通过 request->getParam 获取
+    void addRouteServlet(const std::string& pattern, Servlet::ptr slt);
+
+    // 添加路由servlet
+    void addRouteServlet(const std::string& pattern, FunctionServlet::callback cb);
+
+	// 添加路由 IServletCreator
+    void addRouteServletCreator(const std::string& pattern, IServletCreator::ptr creator);
+
+    // 删除路由servlet
+    void delRouteServlet(const std::string& pattern);
+
 	// 添加 IServletCreator
     void addServletCreator(const std::string& uri, IServletCreator::ptr creator);
 
@@ -142,6 +230,18 @@ public:
         addGlobServletCreator(uri, std::make_shared<ServletCreator<T> >());
     }
 
+	// 添加池化的 ServletCreator
+    template<class T>
+    void addPoolServletCreator(const std::string& uri) {
+        addServletCreator(uri, std::make_shared<PoolServletCreator<T> >());
+    }
+
+	// 添加模糊匹配的池化 ServletCreator
+    template<class T>
+    void addGlobPoolServletCreator(const std::string& uri) {
+        addGlobServletCreator(uri, std::make_shared<PoolServletCreator<T> >());
+    }
+
     // 删除servlet
     void delServlet(const std::string& uri);
 
@@ -160,18 +260,33 @@ public:
     // 通过uri获取模糊匹配servlet
     Servlet::ptr getGlobServlet(const std::string& uri);
 
-    // 通过uri获取servlet
+    // 通过uri获取servlet, 路由参数不会保存
     Servlet::ptr getMatchedServlet(const std::string& uri);
 
+    // 通过请求路径获取servlet, 路由参数写入 request 的参数中
+    Servlet::ptr getMatchedServlet(HttpRequest::ptr request);
+
 	// 
     void listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
     void listAllGlobServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
+    void listAllRouteServletCreator(std::map<std::string, IServletCreator::ptr>& infos);
+private:
+    struct RouteTable;
+
+    // 匹配 uri, params 非空时保存路由参数
+    Servlet::ptr match(const std::string& uri
+                       ,std::vector<std::pair<std::string, std::string> >* params);
+
+    // 根据当前的注册信息重新编译路由表并发布, 需要持有写锁
+    void rebuild();
+
 private:
-    
-    RWMutexType m_mutex;  													// 读写互斥量
+    RWMutexType m_mutex;  													// 保护注册信息的读写互斥量
     std::unordered_map<std::string, IServletCreator::ptr> m_datas;  		// 精准匹配servlet MAP
     std::vector<std::pair<std::string, IServletCreator::ptr> > m_globs;  	// 模糊匹配servlet 数组
+    std::vector<std::pair<std::string, IServletCreator::ptr> > m_routes; 	// 路由匹配servlet 数组
     Servlet::ptr m_default;  												// 默认servlet，所有路径都没匹配到时使用
+    RcuPtr<RouteTable> m_table;  											// 编译好的路由表快照
 };
 
 // NotFoundServlet 默认返回 404
@@ -2,21 +2,138 @@
 #define __MNSER_HTTP_SESSION_H__
 
 #include "socket_stream.h"
+#include "zlib_stream.h"
 #include "http.h"
+#include "http_body_stream.h"
 
 namespace MNSER {
 namespace http {
+
+class HttpSession;
+
+// 响应写入器, servlet 可以先发送响应头, 再把消息体分块直接写到连接上
+// 已知长度时按 content-length 发送, 否则 HTTP/1.1 使用 chunked 编码, HTTP/1.0 发完后关闭连接
+// 写入经过 hook 的 socket, 发送缓冲满时协程让出, 等可写后继续
+// 会话协商出了压缩编码时, 消息体边写边压缩, 以 chunked 编码发送(sendFile 除外)
+// 头部, 消息体和结束标记的实际发送由 writeHeader/writeRaw/writeFile/writeEnd 完成, HTTP/2 的流重写它们
+class HttpResponseWriter : public Stream {
+public:
+    typedef std::shared_ptr<HttpResponseWriter> ptr;
+
+    // content_length < 0 表示长度未知
+    HttpResponseWriter(HttpSession* session, HttpResponse::ptr rsp, int64_t content_length);
+
+    // 发送响应头, 之后再修改 rsp 的头部不会生效, 重复调用直接返回
+    bool sendHeader();
+
+    // 写消息体, 第一次写时自动发送响应头, 返回写入的字节数, <=0 出错
+    virtual int write(const void* buffer, size_t length) override;
+
+    // 写 ByteArray 中的数据
+    virtual int write(ByteArray::ptr ba, size_t length) override;
+
+    // 用 sendfile 把文件 fd 从 offset 开始的 length 字节作为消息体发送, 数据不拷贝到用户态
+    // 只能用于已知长度(非 chunked)的响应, 返回发送的字节数, <=0 出错
+    int64_t sendFile(int fd, off_t offset, size_t length);
+
+    // 写入器只写, 读操作返回 -1
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteArray::ptr ba, size_t length) override;
+
+    // 结束响应, chunked 模式发送结束块, 已知长度时检查写入长度是否一致
+    bool finish();
+
+    // 同 finish
+    virtual void close() override;
+
+    HttpResponse::ptr getResponse() const { return m_response;}
+    bool isHeaderSent() const { return m_headerSent;}
+    bool isFinished() const { return m_finished;}
+    bool isChunked() const { return m_chunked;}
+    uint64_t getWriteSize() const { return m_writeSize;}
+
+protected:
+    // 发送已经准备好的响应头
+    virtual bool writeHeader();
+
+    // 把数据按 content-length / chunked 分帧写到连接上
+    virtual int writeRaw(const void* buffer, size_t length);
+
+    // 发送文件中的一段, 长度已经检查过
+    virtual int64_t writeFile(int fd, off_t offset, size_t length);
+
+    // 消息体写完, chunked 模式发送结束块
+    virtual bool writeEnd();
+
+protected:
+    HttpSession* m_session;         // 所属会话
+    HttpResponse::ptr m_response;   // 响应头
+    int64_t m_contentLength;        // 消息体长度, <0 未知
+    uint64_t m_writeSize;           // 已写入的消息体长度
+    bool m_chunked;                 // 是否 chunked 编码
+    bool m_headerSent;              // 是否已经发送响应头
+    bool m_finished;                // 是否已经结束
+    bool m_error;                   // 是否出错
+    bool m_allowEncode;             // 是否允许压缩, 使用 sendFile 时关闭
+    ZlibStream::ptr m_zs;           // 压缩流, 不压缩时为空
+};
+
 class HttpSession: public SocketStream {
 public:
     typedef std::shared_ptr<HttpSession> ptr;
 
     HttpSession(Socket::ptr sock, bool owner = true);
 
-	// 接收 http 请求
+	// 接收 http 请求, 包括完整的消息体
     HttpRequest::ptr recvRequest();
 
-	// 发送 http 响应, 返回值：>0成功 =0对方关闭 <0socket异常
-    int sendResponse(HttpResponse::ptr rsp);
+	// 只接收 http 请求头部, 头部之后多读的数据保留在会话缓冲中
+    HttpRequest::ptr recvRequestHeader();
+
+	// 将请求的消息体完整读入 req->getBody(), 消息体超过 http.request.max_body_size 时失败
+    bool recvRequestBody(HttpRequest::ptr req);
+
+	// 为请求创建流式消息体, 从会话缓冲和 socket 中按需读取, 支持 chunked 编码
+	// 返回的流依赖本会话, 不能超出会话的生命周期使用
+    HttpBodyStream::ptr createBodyStream(HttpRequest::ptr req);
+
+	// 按请求的 Accept-Encoding 和 http.gzip 配置确定本次响应的压缩编码, 每个请求调用一次
+    void negotiateEncoding(HttpRequest::ptr req);
+
+	// 本次响应使用的压缩编码, gzip/deflate, 不压缩时为空
+    const std::string& getContentEncoding() const { return m_encoding;}
+
+	// 发送 http 响应, head 为 true 时(HEAD 请求)只发送头部, 返回值：>0成功 =0对方关闭 <0socket异常
+	// 协商了压缩编码且消息体不小于 http.gzip.min_length 时先压缩消息体
+    virtual int sendResponse(HttpResponse::ptr rsp, bool head = false);
+
+	// 创建响应写入器, 之后响应由写入器发送, 不再调用 sendResponse
+	// content_length 消息体长度, <0 表示未知长度
+    virtual HttpResponseWriter::ptr createResponseWriter(HttpResponse::ptr rsp, int64_t content_length = -1);
+
+	// 当前请求创建的响应写入器, 没有时为空
+    HttpResponseWriter::ptr getResponseWriter() const { return m_writer;}
+
+	// 结束当前请求的响应: 有写入器则结束写入器, 否则发送 rsp, 成功返回 true
+    bool finishResponse(HttpResponse::ptr rsp, bool head = false);
+
+	// 取走会话缓冲中还未处理的数据, 协议升级(WebSocket, HTTP/2)后交给新协议继续解析
+    std::string takeBuffer();
+
+	// 连接是否以 HTTP/2 连接前言开头, 只读取判断所需的数据, 读到的数据留在会话缓冲中
+    bool peekHttp2Preface();
+
+protected:
+	// 请求带 Expect: 100-continue 时, 在读消息体之前先回复 100 Continue
+    bool sendContinue(HttpRequest::ptr req);
+
+	// 需要时压缩 rsp 的消息体并设置 Content-Encoding, 失败返回 false, 消息体保持不变
+    bool encodeBody(HttpResponse::ptr rsp);
+
+protected:
+    std::string m_buffer;               // 已经从 socket 读出但还未处理的数据
+    HttpResponseWriter::ptr m_writer;   // 当前请求的响应写入器
+    std::string m_encoding;             // 当前响应的压缩编码
 };
 
 }
@@ -0,0 +1,33 @@
+#ifndef __MNSER_HTTP_WS_CONNECTION_H__
+#define __MNSER_HTTP_WS_CONNECTION_H__
+
+#include <map>
+
+#include "http_connection.h"
+#include "ws_session.h"
+
+namespace MNSER {
+namespace http {
+
+// WebSocket 客户端连接, 发出的帧带掩码
+class WSConnection : public WSSession {
+public:
+    typedef std::shared_ptr<WSConnection> ptr;
+
+    WSConnection(Socket::ptr sock, bool owner = true);
+
+    // 连接 ws://host[:port]/path 并完成握手, timeout_ms 为连接和握手的超时时间, 握手后接收不再超时
+    // headers 附加的请求头, 失败时返回的连接为空, HttpResult 中是失败原因或握手响应
+    static std::pair<HttpResult::ptr, WSConnection::ptr> Create(const std::string& url
+                                    ,uint64_t timeout_ms
+                                    ,const std::map<std::string, std::string>& headers = {});
+
+    static std::pair<HttpResult::ptr, WSConnection::ptr> Create(Uri::ptr uri
+                                    ,uint64_t timeout_ms
+                                    ,const std::map<std::string, std::string>& headers = {});
+};
+
+}
+}
+
+#endif
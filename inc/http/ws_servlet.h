@@ -0,0 +1,107 @@
+#ifndef __MNSER_HTTP_WS_SERVLET_H__
+#define __MNSER_HTTP_WS_SERVLET_H__
+
+#include "http_servlet.h"
+#include "ws_session.h"
+
+namespace MNSER {
+namespace http {
+
+// WebSocket Servlet, 握手成功后 onConnect, 每收到一条消息调用 handle, 连接结束 onClose
+// header 是握手请求, 路由参数也保存在里面
+// onConnect/handle 返回非 0 时关闭连接
+class WSServlet : public Servlet {
+public:
+    typedef std::shared_ptr<WSServlet> ptr;
+
+    WSServlet(const std::string& name)
+        :Servlet(name) {
+    }
+
+    virtual ~WSServlet() {}
+
+    // 普通 http 请求不会分发到 WSServlet
+    virtual int32_t handle(MNSER::http::HttpRequest::ptr request
+                   , MNSER::http::HttpResponse::ptr response
+                   , MNSER::http::HttpSession::ptr session) override {
+        return 0;
+    }
+
+    virtual int32_t onConnect(MNSER::http::HttpRequest::ptr header
+                              ,MNSER::http::WSSession::ptr session) = 0;
+
+    virtual int32_t onClose(MNSER::http::HttpRequest::ptr header
+                            ,MNSER::http::WSSession::ptr session) = 0;
+
+    virtual int32_t handle(MNSER::http::HttpRequest::ptr header
+                           ,MNSER::http::WSMessage::ptr msg
+                           ,MNSER::http::WSSession::ptr session) = 0;
+};
+
+// 函数式 WSServlet, on_connect/on_close 可以为空
+class FunctionWSServlet : public WSServlet {
+public:
+    typedef std::shared_ptr<FunctionWSServlet> ptr;
+    typedef std::function<int32_t (MNSER::http::HttpRequest::ptr header
+                              ,MNSER::http::WSSession::ptr session)> on_connect_cb;
+    typedef std::function<int32_t (MNSER::http::HttpRequest::ptr header
+                             ,MNSER::http::WSSession::ptr session)> on_close_cb;
+    typedef std::function<int32_t (MNSER::http::HttpRequest::ptr header
+                           ,MNSER::http::WSMessage::ptr msg
+                           ,MNSER::http::WSSession::ptr session)> callback;
+
+    FunctionWSServlet(callback cb, on_connect_cb connect_cb = nullptr
+                      ,on_close_cb close_cb = nullptr);
+
+    using WSServlet::handle;
+
+    virtual int32_t onConnect(MNSER::http::HttpRequest::ptr header
+                              ,MNSER::http::WSSession::ptr session) override;
+
+    virtual int32_t onClose(MNSER::http::HttpRequest::ptr header
+                            ,MNSER::http::WSSession::ptr session) override;
+
+    virtual int32_t handle(MNSER::http::HttpRequest::ptr header
+                           ,MNSER::http::WSMessage::ptr msg
+                           ,MNSER::http::WSSession::ptr session) override;
+
+protected:
+    callback m_callback;
+    on_connect_cb m_onConnect;
+    on_close_cb m_onClose;
+};
+
+// WebSocket Servlet 分发器, 匹配规则和 ServletDispatch 相同
+class WSServletDispatch : public ServletDispatch {
+public:
+    typedef std::shared_ptr<WSServletDispatch> ptr;
+
+    WSServletDispatch();
+
+    using ServletDispatch::addServlet;
+    using ServletDispatch::addGlobServlet;
+    using ServletDispatch::addRouteServlet;
+
+    void addServlet(const std::string& uri
+                    ,FunctionWSServlet::callback cb
+                    ,FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                    ,FunctionWSServlet::on_close_cb close_cb = nullptr);
+
+    void addGlobServlet(const std::string& uri
+                    ,FunctionWSServlet::callback cb
+                    ,FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                    ,FunctionWSServlet::on_close_cb close_cb = nullptr);
+
+    void addRouteServlet(const std::string& pattern
+                    ,FunctionWSServlet::callback cb
+                    ,FunctionWSServlet::on_connect_cb connect_cb = nullptr
+                    ,FunctionWSServlet::on_close_cb close_cb = nullptr);
+
+    // 按握手请求的路径匹配 WSServlet, 路由参数写入 request, 没有匹配时返回空
+    WSServlet::ptr getWSServlet(HttpRequest::ptr request);
+};
+
+}
+}
+
+#endif
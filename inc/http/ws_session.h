@@ -0,0 +1,169 @@
+#ifndef __MNSER_HTTP_WS_SESSION_H__
+#define __MNSER_HTTP_WS_SESSION_H__
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "socket_stream.h"
+#include "http.h"
+#include "iomanager.h"
+#include "mutex.h"
+
+namespace MNSER {
+namespace http {
+
+// WebSocket 帧类型(RFC 6455)
+enum class WSOpcode {
+    CONTINUE    = 0x0,  // 分片消息的后续帧
+    TEXT        = 0x1,  // 文本帧
+    BIN         = 0x2,  // 二进制帧
+    CLOSE       = 0x8,  // 关闭连接
+    PING        = 0x9,  // 心跳 ping
+    PONG        = 0xA   // 心跳 pong
+};
+
+// 对 data 的 len 个字节做掩码运算, offset 为 data[0] 在整个载荷中的偏移
+// 有 SSE2 时每次处理 16 字节, 否则每次 8 字节
+void WSMask(char* data, size_t len, const uint8_t key[4], size_t offset = 0);
+
+// 计算握手应答的 Sec-WebSocket-Accept
+std::string WSAcceptKey(const std::string& key);
+
+// 收到的一条完整消息, 分片消息已经拼接好
+class WSMessage {
+public:
+    typedef std::shared_ptr<WSMessage> ptr;
+
+    WSMessage(WSOpcode opcode = WSOpcode::TEXT, const std::string& data = "")
+        :m_opcode(opcode)
+        ,m_data(data) {}
+
+    WSOpcode getOpcode() const { return m_opcode;}
+    void setOpcode(WSOpcode v) { m_opcode = v;}
+
+    const std::string& getData() const { return m_data;}
+    std::string& getData() { return m_data;}
+    void setData(const std::string& v) { m_data = v;}
+
+private:
+    WSOpcode m_opcode;
+    std::string m_data;
+};
+
+// 编码好的一帧, 头部和载荷分开存放, 发送时用 writev 一起写出
+// 服务端发出的帧不加掩码, 同一个帧可以放进多个会话的发送队列, 广播时只编码一次
+class WSFrame {
+public:
+    typedef std::shared_ptr<WSFrame> ptr;
+
+    // 编码一帧, mask 为 true 时(客户端发出的帧)生成随机掩码, 载荷会被拷贝一次
+    static ptr Create(WSOpcode opcode, std::string data, bool fin = true, bool mask = false);
+
+    // 共享载荷的版本, 不加掩码, 载荷不拷贝
+    static ptr Create(WSOpcode opcode, std::shared_ptr<const std::string> data, bool fin = true);
+
+    WSOpcode getOpcode() const { return m_opcode;}
+    const char* getHead() const { return m_head;}
+    size_t getHeadSize() const { return m_headSize;}
+    const std::string& getPayload() const { return *m_payload;}
+
+    // 帧的总长度
+    size_t size() const { return m_headSize + m_payload->size();}
+
+private:
+    WSFrame() {}
+
+private:
+    WSOpcode m_opcode = WSOpcode::TEXT;
+    char m_head[14];
+    size_t m_headSize = 0;
+    std::shared_ptr<const std::string> m_payload;
+};
+
+// WebSocket 会话, 服务端和客户端共用帧的收发
+// 接收只能在一个协程中进行; 发送可以来自任意协程/线程, 帧先进入发送队列,
+// 同一时刻只有一个协程在写 socket, 后来的帧由它一并发出, 不会交错
+class WSSession : public SocketStream, public std::enable_shared_from_this<WSSession> {
+public:
+    typedef std::shared_ptr<WSSession> ptr;
+    typedef Mutex MutexType;
+
+    // client 为 true 时发出的帧加掩码, 收到的帧不能带掩码; 服务端反之
+    WSSession(Socket::ptr sock, bool client = false, bool owner = true);
+
+    ~WSSession();
+
+    // 握手阶段多读到的数据, 作为帧数据的开头
+    void setPending(const std::string& data) { m_recvBuf = data; m_recvPos = 0;}
+
+    // 接收一条完整的数据消息(TEXT/BIN), ping 自动回复 pong, 收到 close 或出错返回 nullptr
+    WSMessage::ptr recvMessage();
+
+    // 发送一条消息, 返回 >0 成功(可能只是进入发送队列), <=0 失败
+    int32_t sendMessage(WSMessage::ptr msg, bool fin = true);
+    int32_t sendMessage(const std::string& data, WSOpcode opcode = WSOpcode::TEXT, bool fin = true);
+
+    // 发送编码好的帧; async 为 true 时不在当前协程写 socket, 由调度到 IOManager 的协程发送
+    int32_t sendFrame(WSFrame::ptr frame, bool async = false);
+
+    int32_t ping();
+    int32_t pong(const std::string& data = "");
+
+    // 发送 close 帧, 只发送一次
+    int32_t sendClose(uint16_t code = 1000, const std::string& reason = "");
+
+    // 把同一帧发给多个会话, 只入队不等待, 慢的连接不会拖住其它连接, 返回成功入队的会话数
+    static size_t Broadcast(const std::vector<WSSession::ptr>& sessions, WSFrame::ptr frame);
+
+    // 启动心跳, 每 interval_ms 发一次 ping, timeout_ms 内没有收到任何数据则关闭连接
+    // 需要在 IOManager 中调用
+    void startKeepalive(uint64_t interval_ms, uint64_t timeout_ms);
+
+    // 关闭连接, 停止心跳
+    virtual void close() override;
+
+    bool isClient() const { return m_client;}
+
+    // 发送队列中等待发送的字节数
+    size_t getSendQueueSize();
+
+    // 最后一次收到数据的时间(毫秒)
+    uint64_t getLastRecvTime() const { return m_lastRecv;}
+
+private:
+    // 保证接收缓冲中至少有 n 个未处理的字节
+    bool fill(size_t n);
+
+    // 读取载荷并解掩码, 追加到 out
+    bool readPayload(std::string& out, uint64_t len, bool masked, const uint8_t key[4]);
+
+    // 把发送队列中的帧全部写出, 由抢到发送权的协程调用
+    int32_t flush();
+
+    // 关闭 socket 的读写, 唤醒阻塞在上面的协程
+    void shutdown();
+
+private:
+    bool m_client;
+    IOManager* m_iom;               // 创建会话的 IOManager, 异步发送和心跳在这里运行
+    std::string m_recvBuf;          // 接收缓冲
+    size_t m_recvPos = 0;           // 接收缓冲中已处理的长度
+    std::atomic<uint64_t> m_lastRecv;   // 最后一次收到数据的时间, 心跳定时器会读取
+
+    MutexType m_mutex;              // 保护发送队列
+    std::deque<WSFrame::ptr> m_sendQueue;
+    size_t m_sendQueueSize = 0;
+    bool m_sending = false;         // 是否有协程正在发送
+    bool m_closeSent = false;
+    bool m_sendError = false;
+
+    Timer::ptr m_timer;             // 心跳定时器
+};
+
+}
+}
+
+#endif
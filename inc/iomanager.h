@@ -42,7 +42,7 @@ private:
 		EventContext read;		// 读事件
 		EventContext write;		// 写事件
 		int fd; 				// 事件关联的句柄
-		Event curEvents;		// 当前的事件
+		Event curEvents = NONE;	// 当前的事件
 		MutexType mutex;		// 事件的 mutex
 	};
 
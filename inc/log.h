@@ -13,7 +13,11 @@
 #include <functional>
 #include <map>
 #include <sstream>
+#include <atomic>
 #include <stdarg.h>
+#include <string.h>
+#include <type_traits>
+#include <sys/uio.h>
 
 #include "util.h"
 #include "singleton.h"
@@ -21,10 +25,11 @@
 #include "mutex.h"
 
 // 宏通过 LogEventWarp  LogEvent的包装器的析构函数将内容写到文件中
+// LogEventWarp 是栈上的临时对象, 整条语句结束时析构
 #define MS_LOG_LEVEL(logger, level) \
 	if(logger->getLevel() <= level) \
-		MNSER::LogEventWarp(MNSER::LogEvent::ptr(new MNSER::LogEvent(logger, level, __FILE__, __LINE__, \
-			0, MNSER::GetThreadId(), MNSER::GetFiberId(), time(0), MNSER::Thread::GetName()))).getSS()
+		MNSER::LogEventWarp(logger, level, __FILE__, __LINE__, \
+			0, MNSER::GetThreadId(), MNSER::GetFiberId(), time(0), MNSER::Thread::GetName().c_str()).getSS()
 
 #define MS_LOG_DEBUG(logger) MS_LOG_LEVEL(logger, MNSER::LogLevel::DEBUG)
 #define MS_LOG_INFO(logger) MS_LOG_LEVEL(logger, MNSER::LogLevel::INFO)
@@ -34,8 +39,8 @@
 
 #define MS_LOG_FMT_LEVEL(logger, level, fmt, ...) \
 	if(logger->getLevel() <= level) \
-		MNSER::LogEventWarp(MNSER::LogEvent::ptr(new MNSER::LogEvent(logger, level, __FILE__, __LINE__, \
-			0, MNSER::GetThreadId(), MNSER::GetFiberId(), time(0), Thread::GetName()))).getEvent()->format(fmt, __VA_ARGS__)
+		MNSER::LogEventWarp(logger, level, __FILE__, __LINE__, \
+			0, MNSER::GetThreadId(), MNSER::GetFiberId(), time(0), MNSER::Thread::GetName().c_str()).getEvent().format(fmt, __VA_ARGS__)
 
 #define MS_LOG_FMT_DEBUG(logger, fmt, ...) MS_LOG_FMT_LEVEL(logger, MNSER::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define MS_LOG_FMT_INFO(logger, fmt, ...) MS_LOG_FMT_LEVEL(logger, MNSER::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -43,6 +48,51 @@
 #define MS_LOG_FMT_ERROR(logger, fmt, ...) MS_LOG_FMT_LEVEL(logger, MNSER::LogLevel::ERROR, fmt, __VA_ARGS__)
 #define MS_LOG_FMT_FATAL(logger, fmt, ...) MS_LOG_FMT_LEVEL(logger, MNSER::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+// 二进制日志, 格式串和调用位置在每个调用点只登记一次
+// 每条日志只记录调用点编号和原始参数, 由 BinaryLogAppender 写出, 用 log_decoder 转换成文本
+// 格式串按 printf 的规则, 参数只能是整数, 浮点数, 字符串和指针
+#define MS_LOG_BIN_LEVEL(logger, level, fmt, ...) \
+	if(logger->getLevel() <= level) \
+		MNSER::LogEventWarp(logger, level, __FILE__, __LINE__, \
+			0, MNSER::GetThreadId(), MNSER::GetFiberId(), time(0), MNSER::Thread::GetName().c_str()).getEvent().binary( \
+			[]() -> const MNSER::LogBinSite* { \
+				static const MNSER::LogBinSite s_site(__FILE__, __LINE__, level, fmt); \
+				return &s_site; \
+			}(), ##__VA_ARGS__)
+
+#define MS_LOG_BIN_DEBUG(logger, fmt, ...) MS_LOG_BIN_LEVEL(logger, MNSER::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define MS_LOG_BIN_INFO(logger, fmt, ...) MS_LOG_BIN_LEVEL(logger, MNSER::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define MS_LOG_BIN_WARN(logger, fmt, ...) MS_LOG_BIN_LEVEL(logger, MNSER::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define MS_LOG_BIN_ERROR(logger, fmt, ...) MS_LOG_BIN_LEVEL(logger, MNSER::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+#define MS_LOG_BIN_FATAL(logger, fmt, ...) MS_LOG_BIN_LEVEL(logger, MNSER::LogLevel::FATAL, fmt, ##__VA_ARGS__)
+
+// 限制输出频率的日志, 每个调用点单独计数
+// 恢复输出的那一条在内容后面加上之前被跳过的条数
+// type 是 LogEveryN, LogEveryMs, LogTokenBucket 之一, 之后的参数传给它的 check
+#define MS_LOG_LIMITED_LEVEL(logger, level, type, ...) \
+	if(logger->getLevel() <= level) \
+		if(uint64_t __ms_log_pass = []() -> MNSER::type& { static MNSER::type s_limiter; return s_limiter; }().check(__VA_ARGS__)) \
+			MNSER::LogEventWarp(logger, level, __FILE__, __LINE__, \
+				0, MNSER::GetThreadId(), MNSER::GetFiberId(), time(0), MNSER::Thread::GetName().c_str()).suppressed(__ms_log_pass - 1).getSS()
+
+// 每 n 条输出一条
+#define MS_LOG_DEBUG_EVERY_N(logger, n) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::DEBUG, LogEveryN, n)
+#define MS_LOG_INFO_EVERY_N(logger, n) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::INFO, LogEveryN, n)
+#define MS_LOG_WARN_EVERY_N(logger, n) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::WARN, LogEveryN, n)
+#define MS_LOG_ERROR_EVERY_N(logger, n) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::ERROR, LogEveryN, n)
+
+// 每 ms 毫秒最多输出一条
+#define MS_LOG_DEBUG_EVERY_MS(logger, ms) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::DEBUG, LogEveryMs, ms)
+#define MS_LOG_INFO_EVERY_MS(logger, ms) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::INFO, LogEveryMs, ms)
+#define MS_LOG_WARN_EVERY_MS(logger, ms) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::WARN, LogEveryMs, ms)
+#define MS_LOG_ERROR_EVERY_MS(logger, ms) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::ERROR, LogEveryMs, ms)
+
+// 令牌桶, 平均每秒 rate 条, 最多连续输出 burst 条
+#define MS_LOG_DEBUG_LIMIT(logger, rate, burst) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::DEBUG, LogTokenBucket, rate, burst)
+#define MS_LOG_INFO_LIMIT(logger, rate, burst) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::INFO, LogTokenBucket, rate, burst)
+#define MS_LOG_WARN_LIMIT(logger, rate, burst) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::WARN, LogTokenBucket, rate, burst)
+#define MS_LOG_ERROR_LIMIT(logger, rate, burst) MS_LOG_LIMITED_LEVEL(logger, MNSER::LogLevel::ERROR, LogTokenBucket, rate, burst)
+
 #define MS_LOG_ROOT() MNSER::LoggerMgr::GetInstance()->getRoot()
 #define MS_LOG_NAME(name) MNSER::LoggerMgr::GetInstance()->getLogger(name)
 
@@ -50,6 +100,7 @@ namespace  MNSER {
 
 #define LogAppenderItemType_FILE 		0
 #define LogAppenderItemType_STDOUT 	1
+#define LogAppenderItemType_BINARY 	2
 
 class Logger;
 class LoggerManager;
@@ -70,13 +121,156 @@ public:
 	static LogLevel::Level FromString(const std::string& str);
 };
 
-class LogEvent {
+// 日志内容的输出流, 用法和 std::ostream 一样
+// 常用类型直接格式化到内部固定大小的缓冲区, 超出时才转到堆上
+// 遇到 std::hex 之类的格式控制或者其他自定义了 operator<< 的类型时, 之后的内容都交给 std::stringstream 处理
+class LogStream: private Noncopyable {
+public:
+	static const size_t INLINE_SIZE = 1024;
+
+	LogStream() {}
+	~LogStream();
+
+	LogStream& operator<<(bool v);
+	LogStream& operator<<(char v);
+	LogStream& operator<<(signed char v) { return *this << (char)v; }
+	LogStream& operator<<(unsigned char v) { return *this << (char)v; }
+	LogStream& operator<<(short v);
+	LogStream& operator<<(unsigned short v);
+	LogStream& operator<<(int v);
+	LogStream& operator<<(unsigned int v);
+	LogStream& operator<<(long v);
+	LogStream& operator<<(unsigned long v);
+	LogStream& operator<<(long long v);
+	LogStream& operator<<(unsigned long long v);
+	LogStream& operator<<(float v) { return *this << (double)v; }
+	LogStream& operator<<(double v);
+	LogStream& operator<<(const char* v);
+	LogStream& operator<<(char* v) { return *this << (const char*)v; }
+	LogStream& operator<<(const std::string& v);
+	LogStream& operator<<(const void* v);
+	// std::endl, std::flush 等
+	LogStream& operator<<(std::ostream& (*f)(std::ostream&));
+	// std::hex, std::boolalpha 等
+	LogStream& operator<<(std::ios_base& (*f)(std::ios_base&));
+
+	template<class T>
+	LogStream& operator<<(const T& v) {
+		getStream() << v;
+		return *this;
+	}
+
+	void append(const char* data, size_t len);
+	void format(const char* fmt, va_list al);
+
+	const char* data();
+	size_t size();
+	std::string str() { return std::string(data(), size()); }
+
+private:
+	char* reserve(size_t len);
+	std::ostream& getStream();
+	void flushStream();
+	template<class T>
+	LogStream& appendNumber(T v, const char* fmt);
+
+private:
+	char m_buf[INLINE_SIZE];
+	size_t m_size = 0;
+	std::string m_overflow;				// 超出 m_buf 之后的全部内容
+	bool m_useOverflow = false;
+	std::stringstream* m_ss = nullptr;
+};
+
+// 二进制日志的调用点, 每个 MS_LOG_BIN_* 调用点一个静态对象, 构造时分配编号
+struct LogBinSite {
+	LogBinSite(const char* file, int32_t line, LogLevel::Level level, const char* fmt);
+
+	// 按编号查找, 不存在返回 nullptr
+	static const LogBinSite* Get(uint32_t id);
+
+	const char* file;
+	int32_t line;
+	LogLevel::Level level;
+	const char* fmt;
+	uint32_t id;		// 从 1 开始, 0 表示普通的文本日志
+};
+
+// 二进制日志参数的编码
+// 每个参数是 1 字节的类型加内容, 整数, 浮点数和指针都是 8 字节, 字符串是 4 字节长度加内容
+class LogBinArgs {
+public:
+	enum Type {
+		INT = 'i',
+		UINT = 'u',
+		DOUBLE = 'd',
+		STRING = 's',
+		POINTER = 'p',
+	};
+
+	static void Encode(LogStream& ss) {}
+
+	template<class T, class... Args>
+	static void Encode(LogStream& ss, const T& v, const Args&... args) {
+		Put(ss, v);
+		Encode(ss, args...);
+	}
+
+	// 按 printf 格式串把编码后的参数格式化, 追加到 out 中
+	// 转换符和参数类型不一致时按参数本身的类型输出
+	static void Format(std::string& out, const char* fmt, const char* data, size_t len);
+
+private:
+	template<class T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+	Put(LogStream& ss, T v) { PutValue(ss, INT, (int64_t)v); }
+
+	template<class T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+	Put(LogStream& ss, T v) { PutValue(ss, UINT, (uint64_t)v); }
+
+	template<class T>
+	static typename std::enable_if<std::is_enum<T>::value>::type
+	Put(LogStream& ss, T v) { PutValue(ss, INT, (int64_t)v); }
+
+	template<class T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type
+	Put(LogStream& ss, T v) { PutValue(ss, DOUBLE, (double)v); }
+
+	template<class T>
+	static void Put(LogStream& ss, T* v) { PutValue(ss, POINTER, (uint64_t)(uintptr_t)v); }
+
+	static void Put(LogStream& ss, const char* v) { PutString(ss, v, v ? strlen(v) : 0); }
+	static void Put(LogStream& ss, char* v) { Put(ss, (const char*)v); }
+	static void Put(LogStream& ss, const std::string& v) { PutString(ss, v.data(), v.size()); }
+
+	template<class T>
+	static void PutValue(LogStream& ss, Type type, T v) {
+		char buf[1 + sizeof(T)];
+		buf[0] = type;
+		memcpy(buf + 1, &v, sizeof(T));
+		ss.append(buf, sizeof(buf));
+	}
+
+	static void PutString(LogStream& ss, const char* v, size_t len) {
+		char buf[5];
+		uint32_t n = len;
+		buf[0] = STRING;
+		memcpy(buf + 1, &n, sizeof(n));
+		ss.append(buf, sizeof(buf));
+		ss.append(v, len);
+	}
+};
+
+// 日志事件, 由 LogEventWarp 在栈上构造, 不能在日志语句之外保存
+class LogEvent: private Noncopyable {
 public:
 	typedef std::shared_ptr<LogEvent> ptr;
-	LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, 
+	// 持有 logger, 保证格式化时 logger 有效
+	LogEvent(const std::shared_ptr<Logger>& logger, LogLevel::Level level, 
 			const char *file, int32_t line, uint32_t elapse, 
 			uint32_t threadId, uint32_t fiberId, uint64_t time
-			, const std::string threadName);
+			, const char* threadName);
 	
 	const char * getFile() const { return m_file; }
 	int32_t getLine() const { return m_line; }
@@ -84,37 +278,96 @@ public:
 	int32_t getThreadId() const { return m_threadId; }
 	int32_t getFiberId() const { return m_fiberId; }
 	uint64_t getTime() const { return m_time; }
-	std::string getThreadName() const { return m_threadName; }
-	std::string getContent() const { return m_ss.str(); }
+	const char* getThreadName() const { return m_threadName; }
+	std::string getContent() { return std::string(getContentData(), getContentSize()); }
+	// 二进制日志在第一次取内容时按格式串格式化
+	const char* getContentData() { return m_site ? getText().data() : m_ss.data(); }
+	size_t getContentSize() { return m_site ? getText().size() : m_ss.size(); }
 	LogLevel::Level getLevel() { return m_level; }
-	std::shared_ptr<Logger> getLogger() { return m_logger; }
-	std::stringstream& getSS() { return m_ss; }
+	const std::shared_ptr<Logger>& getLogger() { return m_logger; }
+	LogStream& getSS() { return m_ss; }
 	void format(const char * fmt, ...); // 以格式化写入内容
 	void format(const char * fmt, va_list al);  // 以格式化写入内容
 
+	// 写入二进制日志的参数, 见 MS_LOG_BIN_LEVEL
+	template<class... Args>
+	void binary(const LogBinSite* site, const Args&... args) {
+		m_site = site;
+		LogBinArgs::Encode(m_ss, args...);
+	}
+	// 二进制日志的调用点, 普通日志为 nullptr, 这时 getSS() 中是编码后的参数
+	const LogBinSite* getSite() const { return m_site; }
+
 private:
+	const std::string& getText();
+
+private:
+	std::shared_ptr<Logger> m_logger;
+	LogLevel::Level 		m_level;	// 日志级别
 	const char * m_file 	= nullptr; 	// 文件名
 	int32_t m_line 			= 0;		// 行号
 	uint32_t m_elapse 		= 0;		// 程序启动开始到现在的毫秒数
 	int32_t m_threadId 		= 0;		// 线程ID
 	int32_t m_fiberId 		= 0;		// 协程ID
 	uint64_t m_time			= 0;		// 时间戳
-	LogLevel::Level 		m_level;	// 日志级别
-	std::stringstream 		m_ss;		// 日志流内容
-	std::string 			m_threadName; 
-	std::shared_ptr<Logger>	m_logger; 
+	const char* 			m_threadName;
+	LogStream 				m_ss;		// 日志流内容
+	const LogBinSite* m_site = nullptr;
+	std::string m_text;					// 二进制日志格式化后的内容
+	bool m_hasText = false;
 };
 
-// 日志事件包装器
+// 日志事件包装器, 析构时把事件交给 Logger
 class LogEventWarp {
 public:
-	LogEventWarp(LogEvent::ptr e);
+	LogEventWarp(const std::shared_ptr<Logger>& logger, LogLevel::Level level, 
+			const char *file, int32_t line, uint32_t elapse, 
+			uint32_t threadId, uint32_t fiberId, uint64_t time
+			, const char* threadName);
 	~LogEventWarp();
 
-	LogEvent::ptr getEvent() const { return m_event; }
-	std::stringstream& getSS();
+	LogEvent& getEvent() { return m_event; }
+	LogStream& getSS() { return m_event.getSS(); }
+	// 之前被限频跳过的条数, 析构时加在内容后面
+	LogEventWarp& suppressed(uint64_t v) { m_suppressed = v; return *this; }
+private:
+	LogEvent m_event;
+	uint64_t m_suppressed = 0;
+};
+
+// 限频日志的调用点状态, 见 MS_LOG_LIMITED_LEVEL
+// check 不输出时返回 0, 输出时返回 1 + 之前跳过的条数, 都不加锁
+class LogEveryN {
+public:
+	uint64_t check(uint64_t n) {
+		uint64_t c = m_count.fetch_add(1, std::memory_order_relaxed);
+		if (n <= 1) {
+			return 1;
+		}
+		if (c % n) {
+			return 0;
+		}
+		return c ? n : 1;
+	}
+private:
+	std::atomic<uint64_t> m_count{0};
+};
+
+class LogEveryMs {
+public:
+	uint64_t check(uint64_t ms);
+private:
+	std::atomic<uint64_t> m_last{0};		// 上次输出的时间, 单调时钟毫秒数加 1
+	std::atomic<uint64_t> m_suppressed{0};
+};
+
+// 按 GCRA 算法实现的令牌桶, 只需要一个原子变量
+class LogTokenBucket {
+public:
+	uint64_t check(double rate, uint32_t burst);
 private:
-	LogEvent::ptr m_event;
+	std::atomic<uint64_t> m_tat{0};			// 理论上下一条到达的时间, 单调时钟微秒数
+	std::atomic<uint64_t> m_suppressed{0};
 };
 
 // 不同日志器格式不一样
@@ -133,86 +386,150 @@ private:
  * %N 线程名称
  * 默认格式 : "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
  */
+// 构造时把模式编译成一组格式项, 相邻的固定字符串(包括 %T %n)合并成一项
+// 格式化时按顺序直接追加到字符缓冲区, 时间按线程缓存, 同一秒内只格式化一次
 class LogFormatter {
 public:
 	typedef std::shared_ptr<LogFormatter> ptr;
 	LogFormatter(const std::string &pattern);
+	// 格式化后追加到 out 中
+	void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event);
 	// 解析成固定格式的输出
-	std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-	std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-
-public:
-	class FormatItem {
-		public:
-			typedef std::shared_ptr<FormatItem> ptr;
-			virtual ~FormatItem() {}
-			virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
-	};
+	std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event);
+	std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event);
 
 public:
 	void init();
 	bool isError() const { return m_error; }
 	std::string getPattern() const { return m_pattern; }
 
+private:
+	// 编译后的格式项
+	struct Item {
+		enum Type {
+			STRING,			// 固定字符串
+			MESSAGE,		// %m
+			LEVEL,			// %p
+			ELAPSE,			// %r
+			NAME,			// %c
+			THREAD_ID,		// %t
+			DATETIME,		// %d
+			FILE,			// %f
+			LINE,			// %l
+			FIBER_ID,		// %F
+			THREAD_NAME,	// %N
+		};
+		Type type;
+		std::string str;	// STRING 的内容, DATETIME 的时间格式
+		uint32_t id;		// DATETIME 的缓存编号
+	};
+
+	void addString(const std::string& str);
+	void appendDateTime(std::string& out, const Item& item, time_t time);
+
 private:
 	std::string m_pattern;
-	std::vector<FormatItem::ptr> m_items;
+	std::vector<Item> m_items;
 	bool  m_error = false;  // 用于 setFormatter(const std::string&) 函数
 };
 
 // 日志输出地
+// 同步模式下在调用线程格式化并直接写出
+// 异步模式下在调用线程格式化后放入本线程的环形缓冲区, 由 AsyncLogWriter 的后台线程批量写出
 class LogAppender {
 friend class Logger;
+friend class AsyncLogWriter;
 public:
 	typedef std::shared_ptr<LogAppender> ptr;
 	typedef SpinLock MutexType;
 	//typedef Mutex MutexType;
 
+	// 异步模式下缓冲区满时的处理方式
+	enum Overflow {
+		BLOCK = 0,		// 等待后台线程写出
+		DROP = 1,		// 丢弃
+		DROP_DEBUG = 2,	// 缓冲区超过 3/4 时丢弃 DEBUG, 满了之后其他级别等待
+	};
+
+	static const char* OverflowToString(Overflow v);
+	static Overflow OverflowFromString(const std::string& str);
+
 	virtual ~LogAppender() {}
 
-	virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+	virtual void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event);
 
 	void setFormatter(LogFormatter::ptr val) ;
 	LogFormatter::ptr getFormatter();
-	void setLevel(LogLevel::Level level) { m_level = level; }
-	LogLevel::Level getLevel() const { return m_level; }
+	void setLevel(LogLevel::Level level) { m_level.store(level, std::memory_order_relaxed); }
+	LogLevel::Level getLevel() const { return m_level.load(std::memory_order_relaxed); }
+
+	// 设置异步模式, 在添加到 Logger 之前设置
+	void setAsync(bool v, Overflow overflow = BLOCK) { m_async = v; m_overflow = overflow; }
+	bool isAsync() const { return m_async; }
+	Overflow getOverflow() const { return m_overflow; }
+	// 异步模式下累计丢弃的日志条数
+	uint64_t getDropCount() const { return m_dropCount; }
 
 	// 配置文件操作
 	virtual std::string toYamlString() = 0;
 
 protected:
-	LogLevel::Level m_level = LogLevel::DEBUG;
+	// 写出格式化好的日志, 调用时已持有 m_writeMutex
+	virtual void write(const struct iovec* iov, int cnt) = 0;
+	// 异步模式下丢弃日志后写出的提示
+	virtual void formatDropped(std::string& out, uint64_t count);
+	// 同步写出或者放入异步缓冲区
+	void submit(LogLevel::Level level, const std::string& msg);
+	// 异步模式下等待已提交的日志写出, 子类析构时调用
+	void flushAsync();
+
+private:
+	// 持有 m_mutex 时调用
+	void resetFormatter(LogFormatter::ptr val);
+
+protected:
+	std::atomic<LogLevel::Level> m_level{LogLevel::DEBUG};
 	bool m_hasFormatter = false; // 记录是不是有 formatter
-	LogFormatter::ptr m_formatter;
-	MutexType m_mutex;
+	bool m_async = false;
+	Overflow m_overflow = BLOCK;
+	std::atomic<uint64_t> m_dropped{0};		// 还没有报告的丢弃条数
+	std::atomic<uint64_t> m_dropCount{0};
+	LogFormatter::ptr m_formatter;		// 持有 m_mutex 时读写
+	// 写日志时读取的 formatter, 和 m_formatter 一起替换, 读取时不加锁也不修改引用计数
+	RcuPtr<LogFormatter::ptr> m_logFormatter;
+	MutexType m_mutex;		// 保护 formatter 和配置
+	Mutex m_writeMutex;		// 写出时持有, 写得慢时不影响其他线程获取 formatter
 };
 
 // 日志器
+// 级别是原子变量, 低于级别的日志只需要一次 relaxed 读取
+// Appender 列表修改时整体替换, 写日志时通过 RcuPtr 读取当前列表, 不加锁
 class Logger: public std::enable_shared_from_this<Logger> {
 friend class LoggerManager;
 public:
 	typedef std::shared_ptr<Logger> ptr; // 使用智能指针方便内存管理
 	typedef SpinLock MutexType;
 	//typedef Mutex MutexType;
+	typedef std::vector<LogAppender::ptr> AppenderList;
 
 	Logger(const std::string& name="root");
 
-	void log(LogLevel::Level level, LogEvent::ptr event);
+	void log(LogLevel::Level level, LogEvent& event);
 
 	// 不同的日志级别
-	void debug(LogEvent::ptr event);
-	void info(LogEvent::ptr event);
-	void warn(LogEvent::ptr event);
-	void error(LogEvent::ptr event);
-	void fatal(LogEvent::ptr event);
+	void debug(LogEvent& event);
+	void info(LogEvent& event);
+	void warn(LogEvent& event);
+	void error(LogEvent& event);
+	void fatal(LogEvent& event);
 
 	// 输出器的操作
 	void addAppender(LogAppender::ptr appender);
 	void delAppender(LogAppender::ptr appender);
 	void clearAppender();
 	// 自己信息的返回
-	LogLevel::Level getLevel() const { return m_level; }
-	void setLevel(LogLevel::Level level) { m_level = level; }
+	LogLevel::Level getLevel() const { return m_level.load(std::memory_order_relaxed); }
+	void setLevel(LogLevel::Level level) { m_level.store(level, std::memory_order_relaxed); }
 	const std::string& getName() const { return m_name; }
 	
 	// 格式器的操作
@@ -222,10 +539,14 @@ public:
 
 	// 配置文件操作
 	std::string toYamlString();
+private:
+	// 持有 m_mutex 时调用, 被替换的列表在所有读者退出后析构
+	void setAppenders(AppenderList* list);
+
 private:
 	std::string m_name;					// 日志名称
-	LogLevel::Level m_level;			// 日志级别
-	std::list<LogAppender::ptr> m_appenders;			// Appender集合
+	std::atomic<LogLevel::Level> m_level;			// 日志级别
+	RcuPtr<AppenderList> m_appenders;	// Appender集合, 持有 m_mutex 时整体替换
 	Logger::ptr m_root;
 	LogFormatter::ptr m_formatter;
 	MutexType m_mutex;
@@ -236,33 +557,208 @@ private:
 class StdoutLogAppender: public LogAppender {
 public:
 	typedef std::shared_ptr<StdoutLogAppender> ptr;
-	void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+	~StdoutLogAppender();
 	// 配置文件操作
 	std::string toYamlString() override;
+protected:
+	void write(const struct iovec* iov, int cnt) override;
 };
 
 // 输出到文件的 Apperder
+// 文件一直保持打开, 每 log.file.check_interval 秒检查一次文件是否被删除或被外部移走, 是则重新打开
+// 可以按大小或按时间切分, 切出去的文件名为 原文件名.时间[.序号], 可以在后台线程中压缩为 .gz
 class FileLogAppender: public LogAppender {
 public:
 	typedef std::shared_ptr<FileLogAppender> ptr;
+
+	// 按时间切分
+	enum Rotate {
+		NONE = 0,
+		HOURLY = 1,
+		DAILY = 2,
+	};
+
+	static const char* RotateToString(Rotate v);
+	static Rotate RotateFromString(const std::string& str);
+
 	FileLogAppender(const std::string &filename);
-	void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+	~FileLogAppender();
 
 	// 重新打开文件， 文件打开成功返回 true
 	bool reopen();
+
+	// 文件超过 max_size 字节时切分, 0 不按大小切分
+	void setMaxSize(uint64_t v);
+	void setRotate(Rotate v);
+	// 最多保留多少个切出去的文件, 0 不限制
+	void setMaxFiles(uint32_t v);
+	// 切出去的文件是否压缩
+	void setCompress(bool v);
+
+	const std::string& getFilename() const { return m_filename; }
+	uint64_t getMaxSize() const { return m_maxSize; }
+	Rotate getRotate() const { return m_rotate; }
+	uint32_t getMaxFiles() const { return m_maxFiles; }
+	bool getCompress() const { return m_compress; }
+
 	// 配置文件操作
 	std::string toYamlString() override;
 
+protected:
+	void write(const struct iovec* iov, int cnt) override;
+	// 写入 len 字节之前检查文件是否需要重新打开或者切分
+	void checkWrite(size_t len);
+	// 写到当前文件
+	void writeFile(const struct iovec* iov, int cnt, size_t len);
+	// 当前文件的大小
+	uint64_t getFileSize() const { return m_size; }
+	// 打开文件的次数, 重新打开和切分之后都会增加
+	uint64_t getOpenCount() const { return m_openCount; }
+
+private:
+	bool openFile();
+	void checkFile(time_t now);
+	void rotate(time_t now);
+	time_t getPeriodEnd(time_t t) const;
+
 private:
 	std::string m_filename;
-	std::ofstream m_filestream;
-	uint64_t m_lastTime = 0;
+	int m_fd = -1;
+	uint64_t m_size = 0;		// 当前文件大小
+	time_t m_periodEnd = 0;		// 当前文件所属时间段的结束时间
+	time_t m_lastCheck = 0;
+	uint64_t m_maxSize = 0;
+	Rotate m_rotate = NONE;
+	uint32_t m_maxFiles = 0;
+	bool m_compress = false;
+	uint64_t m_openCount = 0;
+};
+
+/*
+ * 二进制日志文件的格式, 数值都是本机字节序
+ * 文件头 "MSBLOG1\n", 之后是一条条记录, 每条记录是 BinaryRecord 头加 len 字节内容
+ * SITE     调用点定义: 编号(4) 行号(4) 文件名(2 字节长度+内容) 格式串(2 字节长度+内容)
+ * EVENT    一条日志: 调用点编号(4) 线程id(4) 协程id(4) 累计毫秒数(4) 时间(8)
+ *          日志名称(2+n) 线程名称(2+n) [调用点编号为 0 时: 文件名(2+n) 行号(4)] 参数
+ *          普通文本日志的调用点编号为 0, 参数是一个字符串
+ * DROPPED  异步模式下丢弃的条数(8)
+ */
+struct BinaryRecord {
+	enum Type {
+		SITE = 1,
+		EVENT = 2,
+		DROPPED = 3,
+	};
+	uint32_t len;
+	uint8_t type;
+	uint8_t level;
+	uint16_t reserved;
 };
 
+// 输出二进制日志文件的 Appender, 不使用 formatter
+// 调用线程只拷贝参数, 格式化推迟到用 BinaryLogReader 读取的时候
+// 每个调用点第一次写到某个文件时, 先写出调用点的定义, 切分出的文件都可以单独解码
+class BinaryLogAppender: public FileLogAppender {
+public:
+	typedef std::shared_ptr<BinaryLogAppender> ptr;
+	static const char MAGIC[8];
+
+	BinaryLogAppender(const std::string& filename);
+	~BinaryLogAppender();
+
+	void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event) override;
+	std::string toYamlString() override;
+
+protected:
+	void write(const struct iovec* iov, int cnt) override;
+	void formatDropped(std::string& out, uint64_t count) override;
+
+private:
+	uint64_t m_lastOpenCount = 0;
+	std::vector<bool> m_defined;			// 当前文件中已经写出定义的调用点
+	std::string m_defs;
+	std::vector<size_t> m_defEnds;
+	std::vector<struct iovec> m_iovs;
+};
+
+// 读取 BinaryLogAppender 写出的文件, 也可以直接读压缩后的 .gz 文件
+class BinaryLogReader: private Noncopyable {
+public:
+	typedef std::shared_ptr<BinaryLogReader> ptr;
+	BinaryLogReader(const std::string& filename);
+	~BinaryLogReader();
+
+	// 文件打开成功并且文件头正确
+	bool isValid() const { return m_valid; }
+	// 读出下一条日志, 用 formatter 格式化后追加到 out 中, 读完或者内容不完整时返回 false
+	bool next(LogFormatter::ptr formatter, std::string& out);
+
+private:
+	struct Site {
+		int32_t line;
+		LogLevel::Level level;
+		std::string file;
+		std::string fmt;
+	};
+
+	bool read(void* buf, size_t len);
+	Logger::ptr getLogger(const std::string& name);
+
+private:
+	struct gzFile_s* m_file = nullptr;
+	bool m_valid = false;
+	std::string m_buf;
+	std::string m_content;
+	std::map<uint32_t, Site> m_sites;
+	std::map<std::string, Logger::ptr> m_loggers;
+};
+
+class LogRing;
+
+// 异步日志的后台写线程
+// 每个线程第一次写异步日志时创建自己的单生产者单消费者环形缓冲区,
+// 后台线程定期(log.async.flush_interval 毫秒)或缓冲区过半时把所有缓冲区中的日志
+// 按 Appender 聚合后用 writev 写出
+class AsyncLogWriter {
+public:
+	static AsyncLogWriter* GetInstance();
+
+	// 放入当前线程的缓冲区, 后台线程已停止或者日志过大时返回 false, 由调用方同步写出
+	bool append(LogAppender* appender, LogLevel::Level level, const std::string& msg);
+
+	// 等待所有线程已提交的日志写出
+	void flush();
+
+	// 写出剩余的日志并停止后台线程, 之后的日志都同步写出, 进程退出时自动调用
+	void stop();
+
+private:
+	AsyncLogWriter();
+	void run();
+	void notify();
+	LogRing* getRing();
+	size_t drain(LogRing* ring);
+	void output(LogAppender* appender, std::vector<struct iovec>& iovs);
+
+private:
+	Mutex m_mutex;
+	std::vector<std::shared_ptr<LogRing> > m_rings;
+	std::vector<struct iovec> m_iovs;
+	std::string m_notice;
+	int m_eventFd = -1;
+	Thread::ptr m_thread;
+	std::atomic<uint64_t> m_round{0};		// 后台线程完整处理一遍缓冲区的次数
+	std::atomic<bool> m_stopping{false};
+	std::atomic<bool> m_stopped{false};
+};
+
+// 查找 Logger 时读取不加锁的快照, 新增 Logger 时复制一份新的快照发布
+// Logger 创建后不会删除, 调用方可以把 MS_LOG_NAME 的结果保存下来重复使用
 class LoggerManager {
 public:
 	typedef SpinLock MutexType;
 	//typedef Mutex MutexType;
+	typedef std::map<std::string, Logger::ptr> LoggerMap;
 
 	LoggerManager();
 
@@ -276,8 +772,13 @@ public:
 
 private:
 	Logger::ptr _addLogger(const std::string& name);
+	// 持有 m_mutex 时调用
+	void publish();
+
 	Logger::ptr m_root;
 	std::map<std::string, typename Logger::ptr> m_loggers;
+	// m_loggers 的只读快照, 查找时不加锁, 旧快照没有读者后释放
+	RcuPtr<LoggerMap> m_snapshot;
 	MutexType m_mutex;
 };
 
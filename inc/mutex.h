@@ -9,6 +9,8 @@
 #include <stdexcept>
 #include <thread>
 #include <memory>
+#include <atomic>
+#include <sched.h>
 
 #include "noncopyable.h"
 
@@ -262,6 +264,86 @@ private:
 	pthread_spinlock_t m_lock;
 };
 
+/*
+ * RCU 风格的指针
+ * 读者通过 ReadGuard 无锁地拿到当前快照, 只做两次原子计数, 不会阻塞
+ * 写者发布新快照后等待所有可能持有旧快照的读者退出, 再释放旧快照
+ * 读者持有 ReadGuard 期间不能让出协程, 否则写者会一直等待
+ */
+template <class T>
+class RcuPtr: private Noncopyable {
+public:
+	class ReadGuard {
+	public:
+		ReadGuard(const RcuPtr* rcu)
+			:m_rcu(rcu) {
+			m_slot = m_rcu->m_epoch.load() & 1;
+			m_rcu->m_readers[m_slot].fetch_add(1);
+			m_ptr = m_rcu->m_ptr.load();
+		}
+
+		ReadGuard(ReadGuard&& other)
+			:m_rcu(other.m_rcu)
+			,m_ptr(other.m_ptr)
+			,m_slot(other.m_slot) {
+			other.m_rcu = nullptr;
+		}
+
+		~ReadGuard() {
+			if (m_rcu) {
+				m_rcu->m_readers[m_slot].fetch_sub(1);
+			}
+		}
+
+		const T* get() const { return m_ptr; }
+		const T* operator->() const { return m_ptr; }
+		const T& operator*() const { return *m_ptr; }
+	private:
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+	private:
+		const RcuPtr* m_rcu;
+		const T* m_ptr;
+		uint32_t m_slot;
+	};
+
+	RcuPtr(T* ptr = nullptr)
+		:m_ptr(ptr)
+		,m_epoch(0) {
+		m_readers[0] = 0;
+		m_readers[1] = 0;
+	}
+
+	~RcuPtr() {
+		delete m_ptr.load();
+	}
+
+	// 读取当前快照
+	ReadGuard read() const {
+		return ReadGuard(this);
+	}
+
+	// 发布新快照, 等旧快照没有读者之后释放它, 多个写者之间互斥
+	void update(T* ptr) {
+		Mutex::Lock lock(m_mutex);
+		T* old = m_ptr.exchange(ptr);
+		// 交换之后切换两次读计数槽, 每次都等待旧槽清零
+		// 拿到旧快照的读者一定在交换前已经计数, 两个槽都清零过一次就说明它们都退出了
+		for (int i = 0; i < 2; ++i) {
+			uint32_t slot = m_epoch.fetch_add(1) & 1;
+			while (m_readers[slot].load() != 0) {
+				sched_yield();
+			}
+		}
+		delete old;
+	}
+private:
+	Mutex m_mutex;
+	std::atomic<T*> m_ptr;
+	mutable std::atomic<uint32_t> m_epoch;
+	mutable std::atomic<int64_t> m_readers[2];
+};
+
 }
 #endif
 
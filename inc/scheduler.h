@@ -33,6 +33,10 @@ public:
 	// 切换协程执行的线程
 	void switchTo(int thread_id=-1);
 
+	// 把调度器的线程绑定到 CPU, 第 i 个线程绑定到 cpus[i % cpus.size()], 在 start 之后调用
+	// use_caller 时调用者线程不绑定
+	bool setCpuAffinity(const std::vector<int>& cpus);
+
 	// 输出调度器信息
 	std::ostream& dump(std::ostream& os);
 
@@ -88,6 +92,9 @@ protected:
 
 	// 设置当前的协程调度器
 	void setThis();
+
+	// 协程通过 switchTo 让出后, 把它加入目标调度器
+	void switchFiber(Fiber::ptr fiber);
 	
 	// 返回是否有空闲协程
 	bool hasIdleThreads() { return m_idleThreadCount > 0; }
@@ -157,6 +164,7 @@ private:
 
 };
 
+// 在作用域内把当前协程切换到 target 调度器上执行, 离开作用域时切换回原来的调度器
 class SchedulerSwitcher : public Noncopyable {
 public:
     SchedulerSwitcher(Scheduler* target = nullptr);
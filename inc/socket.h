@@ -7,11 +7,17 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <vector>
+#include <openssl/ssl.h>
 
 #include "noncopyable.h"
 #include "address.h"
+#include "mutex.h"
 
 namespace MNSER {
+class Fiber;
+class Scheduler;
+
 class Socket: public std::enable_shared_from_this<Socket>, Noncopyable {
 public:
 	typedef std::shared_ptr<Socket> ptr;
@@ -115,6 +121,10 @@ public:
 	// 发送数据, buffers 接收数据的内存, length 接收数据的大小, flags 标志字, 返回 >0 接收的数据大小 =0 socket被关闭 <0 出错
 	virtual int send(const struct iovec* buffers, size_t length, int flags=0);
 
+	// 用 sendfile 发送文件内容, 数据不经过用户态, in_fd 文件句柄, offset 文件偏移(发送后更新), length 发送长度
+	// 返回 >0 发送的数据大小 =0 socket被关闭 <0 出错
+	virtual int sendFile(int in_fd, off_t* offset, size_t length);
+
 	// 发送数据, buffer 接收数据的内存, length 接收数据的大小, to 段地址, flags 标志字, 返回 >0 接收的数据大小 =0 socket被关闭 <0 出错
 	virtual int sendTo(const void* buffer, size_t length, const Address::ptr to, int flags=0);
   
@@ -199,7 +209,12 @@ protected:
 	Address::ptr m_remoteAddress;	// 远端地址
 };
 
-#if 0
+// TLS socket, 基于 OpenSSL
+// 服务端: 监听 socket 持有 SSL_CTX(loadCertificates 或 setContext), accept 出的连接共享同一个 SSL_CTX,
+// 握手在第一次 recv/send 时由处理连接的协程完成, 不占用 accept 协程
+// 客户端: 所有连接共享一个 SSL_CTX, connect 时完成握手, 按 主机名+地址 缓存会话用于恢复
+// socket 在 OpenSSL 看来是非阻塞的, 需要等待时注册 IOManager 事件让出协程(不在协程中时用 poll),
+// 超时沿用 setRecvTimeout/setSendTimeout; recv 和 send 可以在不同协程中同时调用
 class SSLSocket: public Socket {
 public:
 	typedef std::shared_ptr<SSLSocket> ptr;
@@ -208,32 +223,71 @@ public:
 	static SSLSocket::ptr CreateTCPSocket();
 	static SSLSocket::ptr CreateTCPSocket6();
 
+	// 创建服务端 SSL_CTX, 证书文件可以包含证书链, 失败返回 nullptr
+	static std::shared_ptr<SSL_CTX> CreateServerContext(const std::string& cert_file
+							,const std::string& key_file);
+
+	// 客户端共享的 SSL_CTX, 第一次使用时按 ssl.* 配置创建
+	static std::shared_ptr<SSL_CTX> GetClientContext();
+
 	SSLSocket(int family, int type, int protocol=0);
-    virtual Socket::ptr accept() override;
-    virtual bool bind(const Address::ptr addr) override;
-    virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1) override;
-    virtual bool listen(int backlog = SOMAXCONN) override;
-    virtual bool close() override;
-    virtual int send(const void* buffer, size_t length, int flags = 0) override;
-    virtual int send(const iovec* buffers, size_t length, int flags = 0) override;
-    virtual int sendTo(const void* buffer, size_t length, const Address::ptr to, int flags = 0) override;
-    virtual int sendTo(const iovec* buffers, size_t length, const Address::ptr to, int flags = 0) override;
-    virtual int recv(void* buffer, size_t length, int flags = 0) override;
-    virtual int recv(iovec* buffers, size_t length, int flags = 0) override;
-    virtual int recvFrom(void* buffer, size_t length, Address::ptr from, int flags = 0) override;
-    virtual int recvFrom(iovec* buffers, size_t length, Address::ptr from, int flags = 0) override;
 
+	~SSLSocket();
+
+	virtual Socket::ptr accept() override;
+	virtual bool connect(const Address::ptr addr, uint64_t timeout_ms = -1) override;
+	virtual bool close() override;
+	virtual int send(const void* buffer, size_t length, int flags = 0) override;
+	// SSL 没有聚集写, 小块数据先拼成一块再写, 避免每块都成为一个 TLS 记录
+	virtual int send(const iovec* buffers, size_t length, int flags = 0) override;
+	// 文件内容需要在用户态加密, 用 pread 读出后发送
+	virtual int sendFile(int in_fd, off_t* offset, size_t length) override;
+	virtual int recv(void* buffer, size_t length, int flags = 0) override;
+	virtual int recv(iovec* buffers, size_t length, int flags = 0) override;
+
+	// 服务端导入证书和私钥
 	bool loadCertificates(const std::string& cert_file, const std::string& key_file);
+
+	// 设置服务端的 SSL_CTX, 多个监听 socket 可以共享
+	void setContext(std::shared_ptr<SSL_CTX> ctx) { m_ctx = ctx;}
+
+	// 客户端连接的主机名, 用于 SNI 和证书校验, 需要在 connect 之前设置
+	void setHostName(const std::string& v) { m_hostName = v;}
+	const std::string& getHostName() const { return m_hostName;}
+
+	// 握手是否复用了之前的会话
+	bool isSessionReused() const;
+
 	virtual std::ostream& dump(std::ostream& os) const override;
 
 protected:
 	virtual bool init(int sock) override;
 
+private:
+	// 执行一次 SSL 操作, 需要等待时让出协程后重试, 返回值同 recv/send
+	template<class Fun>
+	int doIO(Fun fun, uint64_t read_timeout, uint64_t write_timeout);
+
+	// 等待 socket 可读或可写, 超时或被取消返回 false
+	bool waitEvent(bool readable, uint64_t timeout_ms);
+
+	// 等待同一事件的协程, 在它前面等待的协程读写后被唤醒
+	typedef std::vector<std::pair<Scheduler*, std::shared_ptr<Fiber> > > WaitQueue;
+
+	// 客户端新会话的回调, 存入会话缓存
+	static int OnNewSession(SSL* ssl, SSL_SESSION* session);
+
 private:
 	std::shared_ptr<SSL_CTX> m_ctx;
 	std::shared_ptr<SSL> m_ssl;
+	Mutex m_mutex;					// SSL 对象不能被多个线程同时使用
+	std::string m_hostName;
+	std::string m_sessionKey;		// 客户端会话缓存的 key
+	bool m_readWaiting = false;		// 有协程在等待可读
+	bool m_writeWaiting = false;	// 有协程在等待可写
+	WaitQueue m_readQueue;			// 排在 m_readWaiting 后面的协程, m_mutex 保护
+	WaitQueue m_writeQueue;			// 排在 m_writeWaiting 后面的协程, m_mutex 保护
 };
-#endif
 
 // 流式输出
 std::ostream& operator<<(std::ostream& os, const Socket& sock);
@@ -1,6 +1,8 @@
 #ifndef __MNSER_SOCKET_STREAM_H__
 #define __MNSER_SOCKET_STREAM_H__
 
+#include <sys/uio.h>
+
 #include "stream.h"
 #include "socket.h"
 
@@ -25,6 +27,14 @@ public:
     // 写数据, ba 写数据的ByteArray, length 接收数据的内存大小
     virtual int write(ByteArray::ptr ba, size_t length) override;
 
+    // 聚集写, 处理部分写直到 iovs 中的数据全部发送完, 会修改 iovs 的内容
+    // 返回值: >0 发送的总字节数, =0 对方关闭, <0 socket 异常
+    int writevFixSize(struct iovec* iovs, size_t iovcnt);
+
+    // 用 sendfile 发送文件 fd 从 offset 开始的 length 字节, 处理部分发送直到全部发完
+    // 返回值: >0 发送的总字节数, =0 对方关闭, <0 socket 异常
+    int64_t sendFileFixSize(int fd, off_t offset, size_t length);
+
     // 关闭流
     virtual void close() override;
 
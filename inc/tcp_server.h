@@ -52,12 +52,11 @@ struct TcpServerConf {
     }
 };
 
-// 配置系统词义转换
+// 配置系统词义转换, 直接从节点读取, args 也不再转成字符串
 template<>
-class LexicalCast<std::string, TcpServerConf> {
+class LexicalCast<YAML::Node, TcpServerConf> {
 public:
-    TcpServerConf operator()(const std::string& v) {
-        YAML::Node node = YAML::Load(v);
+    TcpServerConf operator()(const YAML::Node& node) {
         TcpServerConf conf;
         conf.id = node["id"].as<std::string>(conf.id);
         conf.type = node["type"].as<std::string>(conf.type);
@@ -67,20 +66,25 @@ public:
         conf.ssl = node["ssl"].as<int>(conf.ssl);
         conf.cert_file = node["cert_file"].as<std::string>(conf.cert_file);
         conf.key_file = node["key_file"].as<std::string>(conf.key_file);
-        conf.accept_worker = node["accept_worker"].as<std::string>();
-        conf.io_worker = node["io_worker"].as<std::string>();
-        conf.process_worker = node["process_worker"].as<std::string>();
-        conf.args = LexicalCast<std::string
-            ,std::map<std::string, std::string> >()(node["args"].as<std::string>(""));
-        if(node["address"].IsDefined()) {
-            for(size_t i = 0; i < node["address"].size(); ++i) {
-                conf.address.push_back(node["address"][i].as<std::string>());
-            }
-        }
+        conf.accept_worker = node["accept_worker"].as<std::string>(conf.accept_worker);
+        conf.io_worker = node["io_worker"].as<std::string>(conf.io_worker);
+        conf.process_worker = node["process_worker"].as<std::string>(conf.process_worker);
+        conf.args = LexicalCast<YAML::Node
+            ,std::map<std::string, std::string> >()(node["args"]);
+        conf.address = LexicalCast<YAML::Node
+            ,std::vector<std::string> >()(node["address"]);
         return conf;
     }
 };
 
+template<>
+class LexicalCast<std::string, TcpServerConf> {
+public:
+    TcpServerConf operator()(const std::string& v) {
+        return LexicalCast<YAML::Node, TcpServerConf>()(YAML::Load(v));
+    }
+};
+
 // 配置系统词义转换
 template<>
 class LexicalCast<TcpServerConf, std::string> {
@@ -121,6 +125,20 @@ public:
 
 	virtual ~TcpServer();
 
+	// 按配置创建服务器的函数, 由各类型的服务器注册, worker 对应 process_worker
+	typedef std::function<TcpServer::ptr(const TcpServerConf& conf, IOManager* worker
+				,IOManager* io_worker, IOManager* accept_worker)> Creator;
+
+	// 注册 type 类型服务器的创建函数
+	static void RegisterCreator(const std::string& type, Creator creator);
+
+	// 按配置创建服务器: accept_worker/io_worker/process_worker 从 WorkerMgr 中按名称获取, 为空时用当前调度器,
+	// 然后绑定 address 中的地址(host:port 或 unix 域的绝对路径), ssl 时导入证书; 失败返回 nullptr, 不会启动
+	static TcpServer::ptr Create(const TcpServerConf& conf);
+
+	// 按配置 servers 创建所有服务器, 有一个失败就返回 false
+	static bool CreateFromConfig(std::vector<TcpServer::ptr>& servers);
+
     // 绑定地址, 返回是否绑定成功
     virtual bool bind(MNSER::Address::ptr addr, bool ssl = false);
 
@@ -129,7 +147,7 @@ public:
                         ,std::vector<Address::ptr>& fails
                         ,bool ssl = false);
 
-	// 导入证书
+	// 导入证书, 在 bind(ssl = true) 之后调用, 所有 SSL 监听 socket 共享一个 SSL_CTX
     bool loadCertificates(const std::string& cert_file, const std::string& key_file);
 
     // 启动服务
@@ -16,6 +16,7 @@ public:
 	pid_t getId() const {return m_pid; }
 	const std::string& getName() const { return m_name; } // 线程名称
 	void join(); // 等待线程完成
+	bool setAffinity(int cpu); // 绑定到指定 CPU 上运行
 	static Thread* GetThis();
 	static const std::string& GetName();
 	static void SetName(const std::string& name);
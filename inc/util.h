@@ -45,6 +45,15 @@ std::string Time2Str(time_t ts = time(0), const std::string& format = "%Y-%m-%d
 
 time_t Str2Time(const char* str, const char* format = "%Y-%m-%d %H:%M:%S");
 
+// 计算 data 的 SHA1 摘要, 返回 20 字节的二进制结果
+std::string Sha1Sum(const std::string& data);
+
+// base64 编码
+std::string Base64Encode(const std::string& data);
+
+// base64 解码, 格式错误返回空字符串
+std::string Base64Decode(const std::string& data);
+
 class FSUtil {
 public:
     static void ListAllFile(std::vector<std::string>& files
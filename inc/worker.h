@@ -0,0 +1,65 @@
+#ifndef __MNSER_WORKER_H__
+#define __MNSER_WORKER_H__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "iomanager.h"
+#include "mutex.h"
+#include "singleton.h"
+
+namespace MNSER {
+
+// 按名称管理的工作调度器, 一般由配置 workers 创建, 例如:
+// workers:
+//     accept:
+//         thread_num: 1
+//         cpus: 0
+//     io:
+//         thread_num: 4
+//         cpus: 1-4
+//     process:
+//         thread_num: 8
+//         cpus: 5-7,9
+// thread_num 默认为 1; cpus 为空时不绑定, 否则第 i 个线程绑定到列表中的第 i % n 个 CPU
+// TcpServerConf 中的 accept_worker/io_worker/process_worker 引用这里的名称
+class WorkerManager {
+public:
+	typedef RWLock RWLockType;
+
+	// 按配置 workers 创建调度器, 已经存在的同名调度器不变, 任何一个失败都返回 false
+	bool init();
+
+	// 按参数创建调度器, key 为名称, value 为 thread_num 和 cpus
+	bool init(const std::map<std::string, std::map<std::string, std::string> >& v);
+
+	// 添加调度器, 同名的已经存在时返回 false
+	bool add(const std::string& name, std::shared_ptr<IOManager> iom);
+
+	// 获取调度器, 不存在返回 nullptr
+	IOManager* get(const std::string& name);
+
+	// 停止并移除所有调度器, 等待其中的任务执行完
+	void stop();
+
+	// 调度器数量
+	size_t getCount();
+
+	// 输出调度器信息
+	std::ostream& dump(std::ostream& os);
+
+private:
+	RWLockType m_mutex;
+	std::map<std::string, std::shared_ptr<IOManager> > m_datas;
+};
+
+typedef Singleton<WorkerManager> WorkerMgr;
+
+// 解析 CPU 列表, 如 "0,2,4-7", 格式错误返回 false
+bool ParseCpuList(const std::string& str, std::vector<int>& cpus);
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __MNSER_ZLIB_STREAM_H__
+#define __MNSER_ZLIB_STREAM_H__
+
+#include <zlib.h>
+#include <functional>
+#include <string>
+
+#include "stream.h"
+
+namespace MNSER {
+
+// zlib 压缩/解压流, 写入的数据边写边压缩(解压)
+// 输出默认追加到内部分段的 ByteArray, 设置了输出回调时每填满一块就交给回调, 内部不保留
+// z_stream 从线程本地缓存中获取, 用完 reset 后放回, 省掉每次 deflateInit/inflateInit 分配内存的开销
+class ZlibStream: public Stream {
+public:
+	typedef std::shared_ptr<ZlibStream> ptr;
+	// 输出回调, 返回 <=0 表示出错, 流随之进入错误状态
+	typedef std::function<int(const void* data, size_t length)> OutputCallback;
+
+	// 数据格式
+	enum Type {
+		ZLIB,		// zlib 格式(RFC 1950), 即 HTTP 的 deflate
+		DEFLATE,	// 不带头的原始 deflate 数据(RFC 1951)
+		GZIP		// gzip 格式(RFC 1952)
+	};
+
+	// 压缩级别
+	enum CompressLevel {
+		NO_COMPRESSION = Z_NO_COMPRESSION,
+		BEST_SPEED = Z_BEST_SPEED,
+		BEST_COMPRESSION = Z_BEST_COMPRESSION,
+		DEFAULT_COMPRESSION = Z_DEFAULT_COMPRESSION
+	};
+
+	// encode 为 true 压缩, 否则解压; 解压 ZLIB/GZIP 时自动识别两种格式
+	static ptr CreateGzip(bool encode, uint32_t buff_size = 4096);
+	static ptr CreateZlib(bool encode, uint32_t buff_size = 4096);
+	static ptr CreateDeflate(bool encode, uint32_t buff_size = 4096);
+	static ptr Create(bool encode, uint32_t buff_size = 4096, Type type = DEFLATE
+			, int level = DEFAULT_COMPRESSION);
+
+	ZlibStream(bool encode, uint32_t buff_size, Type type, int level);
+
+	~ZlibStream();
+
+	// 只写流, 读操作返回 -1
+	virtual int read(void* buffer, size_t length) override;
+	virtual int read(ByteArray::ptr ba, size_t length) override;
+
+	// 写入待处理的数据, 返回 length, 出错返回 -1
+	virtual int write(const void* buffer, size_t length) override;
+
+	// 写入 ba 中从当前位置开始的 length 字节
+	virtual int write(ByteArray::ptr ba, size_t length) override;
+
+	// 同 flush
+	virtual void close() override;
+
+	// 结束数据流, 输出剩余的全部数据, 成功返回 0
+	// 解压时数据不完整(没有遇到结束标记)返回 -1
+	int flush();
+
+	// 设置输出回调, 要在第一次写入之前设置
+	void setOutputCallback(OutputCallback cb) { m_cb = cb;}
+
+	// 输出数据的上限, 超过时出错, 0 表示不限制, 解压不可信的数据时用来防止解压炸弹
+	void setMaxOutSize(uint64_t v) { m_maxOutSize = v;}
+
+	// 没有输出回调时获取输出的全部数据
+	std::string getResult() const;
+
+	// 没有输出回调时获取输出数据, 读位置在开头
+	ByteArray::ptr getByteArray();
+
+	bool isEncode() const { return m_encode;}
+	bool isFinished() const { return m_finished;}
+	bool hasError() const { return m_error;}
+	uint64_t getInSize() const { return m_inSize;}
+	uint64_t getOutSize() const { return m_outSize;}
+
+private:
+	// 处理 data 中的数据, flush 为 zlib 的 flush 参数
+	int process(const void* data, size_t length, int flush);
+
+private:
+	z_stream* m_zstream;		// 从缓存中取得的 z_stream
+	uint32_t m_key;				// 缓存分类
+	uint32_t m_buffSize;		// 每次输出的块大小
+	bool m_encode;
+	bool m_finished;
+	bool m_error;
+	uint64_t m_inSize;
+	uint64_t m_outSize;
+	uint64_t m_maxOutSize;
+	OutputCallback m_cb;
+	std::string m_out;			// 有输出回调时的输出块
+	ByteArray::ptr m_result;	// 没有输出回调时的输出数据
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "address.h"
+#include "dns.h"
 #include "mnser_endian.h"
 #include "log.h"
 
@@ -42,6 +43,35 @@ Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
     return result;
 }
 
+// 是否是数字形式的 IP 地址
+static bool IsNumericHost(const std::string& node) {
+    in6_addr addr;
+    return inet_pton(AF_INET, node.c_str(), &addr) == 1
+        || inet_pton(AF_INET6, node.c_str(), &addr) == 1;
+}
+
+// 解析服务名或端口号, 服务名通过 /etc/services 查找
+static bool ParseService(const char* service, int type, uint16_t& port) {
+    if(!service || !*service) {
+        port = 0;
+        return true;
+    }
+    char* end = nullptr;
+    unsigned long v = strtoul(service, &end, 10);
+    if(*end == '\0') {
+        port = v;
+        return v <= 65535;
+    }
+    struct servent se, *res = nullptr;
+    char buf[1024];
+    if(getservbyname_r(service, type == SOCK_DGRAM ? "udp" : "tcp"
+                , &se, buf, sizeof(buf), &res) != 0 || !res) {
+        return false;
+    }
+    port = ntohs(res->s_port);
+    return true;
+}
+
 // 通过 host 地址返回对应条件的所有的 Address
 bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host, 
 		int family, int type, int protocol) {
@@ -86,6 +116,25 @@ bool Address::Lookup(std::vector<Address::ptr>& result, const std::string& host,
         node = host;
     }
 
+    // 域名交给 DnsResolver, 查询期间只挂起当前协程; 数字地址仍走 getaddrinfo
+    if((family == AF_INET || family == AF_INET6 || family == AF_UNSPEC)
+            && DnsResolver::IsEnabled() && !IsNumericHost(node)) {
+        uint16_t port = 0;
+        if(ParseService(service, type, port) && DnsMgr::GetInstance()->hasServers()) {
+            std::vector<IPAddress::ptr> addrs;
+            if(!DnsMgr::GetInstance()->lookup(addrs, node, family)) {
+                MS_LOG_DEBUG(g_logger) << "Address::Lookup dns resolve(" << host << ", "
+                    << family << ", " << type << ") fail";
+                return false;
+            }
+            for(auto& i : addrs) {
+                i->setPort(port);
+                result.push_back(i);
+            }
+            return true;
+        }
+    }
+
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if(error) {
         MS_LOG_DEBUG(g_logger) << "Address::Lookup getaddress(" << host << ", "
@@ -36,6 +36,7 @@ ByteArray::ByteArray(size_t base_size)
 	, m_root(new Node(base_size))  // TODO 这个理解好像不对, 这里的 m_root 设置成哨兵节点，将这个节点作为链表的尾节点
 	{
 	m_cur = m_root;
+	m_tail = m_root;
 }
 
 // 析构函数
@@ -356,6 +357,7 @@ void ByteArray::clear() {  // 留一个节点，清除其他节点
         delete m_cur;
     }
     m_cur = m_root;
+    m_tail = m_root;
     m_root->next = NULL;
 }
 
@@ -432,11 +434,18 @@ void ByteArray::read(void* buf, size_t size, size_t position) const {
     if(size > (m_size - position)) {
         throw std::out_of_range("not enough len");
     }
+    if(size == 0) {
+        return;
+    }
 
+    // 从 position 所在的节点开始读, 不能直接用 m_cur, 它对应的是 m_position
+    Node* cur = m_root;
+    for(size_t i = position / m_baseSize; i > 0; --i) {
+        cur = cur->next;
+    }
     size_t npos = position % m_baseSize;
-    size_t ncap = m_cur->size - npos;
+    size_t ncap = cur->size - npos;
     size_t bpos = 0;
-    Node* cur = m_cur;
     while(size > 0) {
         if(ncap >= size) {
             memcpy((char*)buf + bpos, cur->ptr + npos, size);
@@ -463,19 +472,23 @@ void ByteArray::setPosition(size_t v) {
     if(v > m_capacity) {
         throw std::out_of_range("set_position out of range");
     }
+    // m_cur 总是第 position / m_baseSize 个节点(刚好在节点末尾时是下一个节点)
+    // 向后移动时从当前节点接着走, 顺序写入大块数据时不用每次从头遍历
+    size_t steps = v / m_baseSize;
+    Node* cur = m_root;
+    if(m_cur && v >= m_position) {
+        steps -= m_position / m_baseSize;
+        cur = m_cur;
+    }
+    while(steps > 0) {
+        cur = cur->next;
+        --steps;
+    }
+    m_cur = cur;
     m_position = v;
     if(m_position > m_size) {
         m_size = m_position;
     }
-    m_cur = m_root;
-	// TODO 为什么这里使用的是 下一个节点
-    while(v > m_cur->size) {
-        v -= m_cur->size;
-        m_cur = m_cur->next;
-    }
-    if(v == m_cur->size) {
-        m_cur = m_cur->next;
-    }
 }
 
 // 把 ByteArray 的数据写入到文件中
@@ -676,11 +689,7 @@ void ByteArray::addCapacity(size_t size) {
 
     size = size - old_cap;  // 需要扩充的容量大小
     size_t count = ceil(1.0 * size / m_baseSize);  // 需要扩充的节点数量，向上取整
-    Node* tmp = m_root;
-    while(tmp->next) {
-        tmp = tmp->next;
-    }
-
+    Node* tmp = m_tail;
     Node* first = NULL;
     for(size_t i = 0; i < count; ++i) {
         tmp->next = new Node(m_baseSize);
@@ -690,6 +699,7 @@ void ByteArray::addCapacity(size_t size) {
         tmp = tmp->next;
         m_capacity += m_baseSize;
     }
+    m_tail = tmp;
 
     if(old_cap == 0) {
         m_cur = first;
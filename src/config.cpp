@@ -1,4 +1,11 @@
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <dirent.h>
+
 #include "config.h"
+#include "iomanager.h"
 
 namespace MNSER {
 
@@ -18,6 +25,42 @@ namespace MNSER {
 		}
 	}
 
+	// 比较两个节点的内容, Map 的顺序不同也认为不同
+	static bool IsSameNode(const YAML::Node& a, const YAML::Node& b) {
+		if (a.Type() != b.Type()) {
+			return false;
+		}
+		switch (a.Type()) {
+			case YAML::NodeType::Scalar:
+				return a.Scalar() == b.Scalar();
+			case YAML::NodeType::Sequence:
+				if (a.size() != b.size()) {
+					return false;
+				}
+				for (size_t i = 0; i < a.size(); ++i) {
+					if (!IsSameNode(a[i], b[i])) {
+						return false;
+					}
+				}
+				return true;
+			case YAML::NodeType::Map: {
+				if (a.size() != b.size()) {
+					return false;
+				}
+				auto bit = b.begin();
+				for (auto ait = a.begin(); ait != a.end(); ++ait, ++bit) {
+					if (!IsSameNode(ait->first, bit->first)
+						|| !IsSameNode(ait->second, bit->second)) {
+						return false;
+					}
+				}
+				return true;
+			}
+			default:
+				return true;
+		}
+	}
+
 	void Config::LoadFromYaml(const YAML::Node& root) {
 		std::list<std::pair<std::string, const YAML::Node> > all_nodes;
 		ListAllMember("", root, all_nodes); // 将所有的节点导入
@@ -33,19 +76,255 @@ namespace MNSER {
 			ConfigVarBase::ptr var = LookupBase(key);
 
 			if (var != nullptr) {
-				if (it.second.IsScalar()) {
-					var->fromString(it.second.Scalar());
-				} else {
-					std::stringstream ss;
-					ss << it.second;
-					var->fromString(ss.str());
-				}
+				var->fromNode(it.second);
 			}
 		}
 	}
 
+	namespace {
+	// 文件上次导入时的状态
+	struct ConfigFileState {
+		struct timespec mtime;
+		off_t size = 0;
+		ino_t ino = 0;
+		std::unordered_map<std::string, YAML::Node> nodes;	// 有对应配置项的节点
+	};
+
+	struct ConfigFiles {
+		Mutex mutex;
+		std::unordered_map<std::string, ConfigFileState> files;
+	};
+
+	ConfigFiles& GetConfigFiles() {
+		static ConfigFiles s_files;
+		return s_files;
+	}
+	}
+
 	void Config::LoadFromConfigDir(const std::string& path, bool force) {
+		std::vector<std::string> files;
+		FSUtil::ListAllFile(files, path, ".yml");
+		std::sort(files.begin(), files.end());
+		for (auto& file: files) {
+			LoadFromConfigFile(file, force);
+		}
+	}
+
+	int Config::LoadFromConfigFile(const std::string& file, bool force) {
+		struct stat st;
+		if (stat(file.c_str(), &st) != 0) {
+			MS_LOG_ERROR(MS_LOG_ROOT()) << "LoadFromConfigFile stat " << file
+				<< " errno=" << errno << " errstr=" << strerror(errno);
+			return -1;
+		}
+
+		// 同一个文件的导入串行执行, 监听函数在锁内调用
+		ConfigFiles& cf = GetConfigFiles();
+		Mutex::Lock lock(cf.mutex);
+		auto it = cf.files.find(file);
+		if (!force && it != cf.files.end()
+			&& it->second.mtime.tv_sec == st.st_mtim.tv_sec
+			&& it->second.mtime.tv_nsec == st.st_mtim.tv_nsec
+			&& it->second.size == st.st_size
+			&& it->second.ino == st.st_ino) {
+			return 0;
+		}
+
+		YAML::Node root;
+		try {
+			root = YAML::LoadFile(file);
+		} catch (std::exception& e) {
+			// 不记录状态, 下次检查时重新读取
+			MS_LOG_ERROR(MS_LOG_ROOT()) << "LoadFromConfigFile " << file
+				<< " failed: " << e.what();
+			return -1;
+		}
+
+		std::list<std::pair<std::string, const YAML::Node> > all_nodes;
+		ListAllMember("", root, all_nodes);
+
+		ConfigFileState state;
+		state.mtime = st.st_mtim;
+		state.size = st.st_size;
+		state.ino = st.st_ino;
+		int changed = 0;
+		for (auto& n: all_nodes) {
+			std::string key = n.first;
+			if (key.empty()) {
+				continue;
+			}
+			std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+			ConfigVarBase::ptr var = LookupBase(key);
+			if (var == nullptr) {
+				continue;
+			}
+			state.nodes[key] = n.second;
+
+			// 和上次导入的节点相同就不再转换
+			if (!force && it != cf.files.end()) {
+				auto old = it->second.nodes.find(key);
+				if (old != it->second.nodes.end() && IsSameNode(old->second, n.second)) {
+					continue;
+				}
+			}
+			var->fromNode(n.second);
+			++changed;
+		}
+		cf.files[file] = std::move(state);
+		MS_LOG_INFO(MS_LOG_ROOT()) << "LoadFromConfigFile " << file
+			<< " changed=" << changed;
+		return changed;
+	}
+
+	namespace {
+	// inotify 监听的状态, 同一时间只有一个
+	struct ConfigWatcher {
+		Mutex mutex;
+		int fd = -1;
+		uint64_t gen = 0;					// 每次打开加一, 忽略之前取消时触发的回调
+		IOManager* iom = nullptr;
+		std::map<int, std::string> dirs;	// wd -> 目录
+	};
+
+	ConfigWatcher& GetConfigWatcher() {
+		static ConfigWatcher s_watcher;
+		return s_watcher;
+	}
 
+	bool IsConfigFile(const std::string& name) {
+		return name.size() > 4 && name.compare(name.size() - 4, 4, ".yml") == 0;
+	}
+
+	// 监听目录和所有子目录, 需要持有 watcher.mutex
+	void AddWatchDir(ConfigWatcher& w, const std::string& path) {
+		int wd = inotify_add_watch(w.fd, path.c_str()
+					, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+		if (wd < 0) {
+			MS_LOG_ERROR(MS_LOG_ROOT()) << "inotify_add_watch " << path
+				<< " errno=" << errno << " errstr=" << strerror(errno);
+			return;
+		}
+		w.dirs[wd] = path;
+
+		DIR* dir = opendir(path.c_str());
+		if (dir == nullptr) {
+			return;
+		}
+		struct dirent* dp = nullptr;
+		while ((dp = readdir(dir)) != nullptr) {
+			if (dp->d_type == DT_DIR && strcmp(dp->d_name, ".") && strcmp(dp->d_name, "..")) {
+				AddWatchDir(w, path + "/" + dp->d_name);
+			}
+		}
+		closedir(dir);
+	}
+
+	void OnConfigDirEvent(uint64_t gen);
+
+	// addEvent 记录的是当前线程的调度器, 需要在 iom 中调用
+	void AddConfigDirEvent(uint64_t gen) {
+		ConfigWatcher& w = GetConfigWatcher();
+		Mutex::Lock lock(w.mutex);
+		if (w.fd >= 0 && w.gen == gen) {
+			w.iom->addEvent(w.fd, IOManager::READ, std::bind(OnConfigDirEvent, gen));
+		}
+	}
+
+	void OnConfigDirEvent(uint64_t gen) {
+		ConfigWatcher& w = GetConfigWatcher();
+		std::set<std::string> files;
+		std::vector<std::string> new_dirs;
+		{
+			Mutex::Lock lock(w.mutex);
+			if (w.fd < 0 || w.gen != gen) {
+				return;
+			}
+			// 边缘触发, 需要一次读完
+			char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+			while (true) {
+				ssize_t len = read(w.fd, buf, sizeof(buf));
+				if (len <= 0) {
+					break;
+				}
+				for (char* p = buf; p < buf + len; ) {
+					const struct inotify_event* ev = (const struct inotify_event*)p;
+					p += sizeof(struct inotify_event) + ev->len;
+					auto dit = w.dirs.find(ev->wd);
+					if (ev->mask & IN_IGNORED) {
+						if (dit != w.dirs.end()) {
+							w.dirs.erase(dit);
+						}
+						continue;
+					}
+					if (dit == w.dirs.end() || ev->len == 0) {
+						continue;
+					}
+					std::string name = dit->second + "/" + ev->name;
+					if (ev->mask & IN_ISDIR) {
+						if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+							new_dirs.push_back(name);
+						}
+					} else if ((ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) && IsConfigFile(ev->name)) {
+						files.insert(name);
+					}
+				}
+			}
+			for (auto& d: new_dirs) {
+				AddWatchDir(w, d);
+			}
+			w.iom->addEvent(w.fd, IOManager::READ, std::bind(OnConfigDirEvent, gen));
+		}
+
+		for (auto& d: new_dirs) {
+			Config::LoadFromConfigDir(d);
+		}
+		for (auto& f: files) {
+			Config::LoadFromConfigFile(f);
+		}
+	}
+	}
+
+	bool Config::WatchConfigDir(const std::string& path, IOManager* iom) {
+		ConfigWatcher& w = GetConfigWatcher();
+		{
+			Mutex::Lock lock(w.mutex);
+			if (w.fd < 0) {
+				w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+				if (w.fd < 0) {
+					MS_LOG_ERROR(MS_LOG_ROOT()) << "inotify_init1 errno=" << errno
+						<< " errstr=" << strerror(errno);
+					return false;
+				}
+				++w.gen;
+				w.iom = iom;
+				w.iom->schedule(std::bind(AddConfigDirEvent, w.gen));
+			} else if (w.iom != iom) {
+				MS_LOG_ERROR(MS_LOG_ROOT()) << "WatchConfigDir " << path
+					<< " already watching on another IOManager";
+				return false;
+			}
+			size_t n = w.dirs.size();
+			AddWatchDir(w, path);
+			if (w.dirs.size() == n) {
+				return false;
+			}
+		}
+		// 先监听再导入, 中间的修改不会丢失
+		LoadFromConfigDir(path);
+		return true;
+	}
+
+	void Config::UnwatchConfigDir() {
+		ConfigWatcher& w = GetConfigWatcher();
+		Mutex::Lock lock(w.mutex);
+		if (w.fd < 0) {
+			return;
+		}
+		w.iom->cancelEvent(w.fd, IOManager::READ);
+		close(w.fd);
+		w.fd = -1;
+		w.iom = nullptr;
+		w.dirs.clear();
 	}
 
 	ConfigVarBase::ptr Config::LookupBase(const std::string& name) {
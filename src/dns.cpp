@@ -0,0 +1,701 @@
+#include <sys/stat.h>
+#include <ctype.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "dns.h"
+#include "config.h"
+#include "log.h"
+#include "socket.h"
+#include "util.h"
+
+namespace MNSER {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 是否使用 DnsResolver 解析 Address::Lookup 中的域名, 关闭后使用 getaddrinfo
+static MNSER::ConfigVar<bool>::ptr g_dns_enable =
+    MNSER::Config::Lookup("dns.enable", true, "use fiber dns resolver in Address::Lookup");
+
+// nameserver 列表, 格式 ip 或 ip:port, 为空时使用 resolv.conf 中的 nameserver
+static MNSER::ConfigVar<std::vector<std::string> >::ptr g_dns_servers =
+    MNSER::Config::Lookup("dns.servers", std::vector<std::string>(), "dns nameservers");
+
+static MNSER::ConfigVar<std::string>::ptr g_dns_hosts_file =
+    MNSER::Config::Lookup("dns.hosts_file", std::string("/etc/hosts"), "dns hosts file");
+
+static MNSER::ConfigVar<std::string>::ptr g_dns_resolv_conf =
+    MNSER::Config::Lookup("dns.resolv_conf", std::string("/etc/resolv.conf"), "dns resolv.conf");
+
+// 单次查询超时时间
+static MNSER::ConfigVar<uint64_t>::ptr g_dns_timeout =
+    MNSER::Config::Lookup("dns.timeout", (uint64_t)2000, "dns query timeout(ms)");
+
+// 每个 nameserver 的重试轮数
+static MNSER::ConfigVar<uint32_t>::ptr g_dns_attempts =
+    MNSER::Config::Lookup("dns.attempts", (uint32_t)2, "dns query attempts");
+
+// 正常应答缓存时间的上限, 实际缓存时间取记录 TTL 和它的较小值
+static MNSER::ConfigVar<uint64_t>::ptr g_dns_max_ttl =
+    MNSER::Config::Lookup("dns.max_ttl", (uint64_t)300000, "dns cache max ttl(ms)");
+
+// 否定缓存时间的上限
+static MNSER::ConfigVar<uint64_t>::ptr g_dns_negative_ttl =
+    MNSER::Config::Lookup("dns.negative_ttl", (uint64_t)5000, "dns negative cache ttl(ms)");
+
+static MNSER::ConfigVar<uint64_t>::ptr g_dns_cache_size =
+    MNSER::Config::Lookup("dns.cache_size", (uint64_t)10000, "dns cache max entries");
+
+// hosts / resolv.conf 检查文件变化的间隔
+static const uint64_t s_conf_check_interval = 1000;
+
+namespace {
+struct _DnsIniter {
+    _DnsIniter() {
+        g_dns_hosts_file->addListener([](const std::string& ov, const std::string& nv){
+                DnsMgr::GetInstance()->setHostsFile(nv);
+        });
+    }
+};
+static _DnsIniter _init;
+}
+
+static Address::ptr Clone(const Address::ptr& addr) {
+    return Address::Create(addr->getAddr(), addr->getAddrLen());
+}
+
+// 解析文本形式的 IP 地址, 失败返回 nullptr
+static Address::ptr ParseIP(const std::string& str, uint16_t port) {
+    Address::ptr addr = IPv4Address::Create(str.c_str(), port);
+    if(!addr && str.find(':') != std::string::npos) {
+        addr = IPv6Address::Create(str.c_str(), port);
+    }
+    return addr;
+}
+
+// 解析 nameserver 地址: ip, ip:port, [ipv6]:port
+static Address::ptr ParseServer(const std::string& str) {
+    std::string host = str;
+    uint16_t port = 53;
+    if(!str.empty() && str[0] == '[') {
+        size_t pos = str.find(']');
+        if(pos == std::string::npos) {
+            return nullptr;
+        }
+        host = str.substr(1, pos - 1);
+        if(pos + 1 < str.size() && str[pos + 1] == ':') {
+            port = atoi(str.c_str() + pos + 2);
+        }
+    } else if(std::count(str.begin(), str.end(), ':') == 1) {
+        size_t pos = str.find(':');
+        host = str.substr(0, pos);
+        port = atoi(str.c_str() + pos + 1);
+    }
+    return ParseIP(host, port);
+}
+
+static uint16_t Read16(const uint8_t* p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t Read32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void Append16(std::string& out, uint16_t v) {
+    out.push_back((char)(v >> 8));
+    out.push_back((char)(v & 0xff));
+}
+
+// 构造查询报文, 带一个 EDNS0 OPT 记录, 声明可以接收 1232 字节的 UDP 应答
+static bool BuildQuery(std::string& out, uint16_t id, const std::string& name, uint16_t type) {
+    out.clear();
+    Append16(out, id);
+    Append16(out, 0x0100);      // RD
+    Append16(out, 1);           // QDCOUNT
+    Append16(out, 0);           // ANCOUNT
+    Append16(out, 0);           // NSCOUNT
+    Append16(out, 1);           // ARCOUNT
+    size_t start = 0;
+    while(start < name.size()) {
+        size_t dot = name.find('.', start);
+        if(dot == std::string::npos) {
+            dot = name.size();
+        }
+        size_t len = dot - start;
+        if(len == 0 || len > 63) {
+            return false;
+        }
+        out.push_back((char)len);
+        out.append(name, start, len);
+        start = dot + 1;
+    }
+    out.push_back('\0');
+    Append16(out, type);
+    Append16(out, 1);           // IN
+    // OPT: 根域名, type 41, class 为 UDP 负载大小, ttl 0, rdlen 0
+    out.push_back('\0');
+    Append16(out, 41);
+    Append16(out, 1232);
+    Append16(out, 0);
+    Append16(out, 0);
+    Append16(out, 0);
+    return true;
+}
+
+// 读取域名(支持压缩指针), 结果转为小写, pos 移动到域名之后
+static bool ReadName(const uint8_t* msg, size_t len, size_t& pos, std::string& name) {
+    name.clear();
+    size_t p = pos;
+    bool jumped = false;
+    int jumps = 0;
+    while(true) {
+        if(p >= len) {
+            return false;
+        }
+        uint8_t c = msg[p];
+        if((c & 0xC0) == 0xC0) {
+            if(p + 1 >= len || ++jumps > 32) {
+                return false;
+            }
+            if(!jumped) {
+                pos = p + 2;
+                jumped = true;
+            }
+            p = (c & 0x3F) << 8 | msg[p + 1];
+            continue;
+        }
+        if(c & 0xC0) {
+            return false;
+        }
+        ++p;
+        if(c == 0) {
+            break;
+        }
+        if(p + c > len || name.size() + c > 255) {
+            return false;
+        }
+        if(!name.empty()) {
+            name.push_back('.');
+        }
+        for(size_t i = 0; i < c; ++i) {
+            name.push_back(tolower(msg[p + i]));
+        }
+        p += c;
+    }
+    if(!jumped) {
+        pos = p;
+    }
+    return true;
+}
+
+namespace {
+// 应答中的一条资源记录
+struct DnsRecord {
+    std::string name;
+    uint16_t type;
+    uint32_t ttl;
+    size_t rdata;       // rdata 在报文中的偏移
+    uint16_t rdlen;
+};
+}
+
+// 最高位为 1 的 TTL 按 0 处理(RFC 2181 8)
+static uint32_t NormalizeTtl(uint32_t ttl) {
+    return (ttl & 0x80000000) ? 0 : ttl;
+}
+
+// 读取一条资源记录
+static bool ReadRecord(const uint8_t* msg, size_t len, size_t& pos, DnsRecord& rr) {
+    if(!ReadName(msg, len, pos, rr.name) || pos + 10 > len) {
+        return false;
+    }
+    rr.type = Read16(msg + pos);
+    rr.ttl = Read32(msg + pos + 4);
+    rr.rdlen = Read16(msg + pos + 8);
+    rr.rdata = pos + 10;
+    pos += 10 + rr.rdlen;
+    rr.ttl = NormalizeTtl(rr.ttl);
+    return pos <= len;
+}
+
+// 解析应答, 返回 -1 表示不是本次查询的应答, 需要继续等待
+// 成功时 ttl_ms 为所用记录的最小 TTL, 否定应答时为 SOA 给出的否定缓存时间
+static int ParseResponse(const uint8_t* msg, size_t len, uint16_t id, const std::string& name
+                         ,uint16_t type, std::vector<Address::ptr>& addrs, uint64_t& ttl_ms) {
+    if(len < 12 || Read16(msg) != id) {
+        return -1;
+    }
+    uint16_t flags = Read16(msg + 2);
+    if(!(flags & 0x8000) || Read16(msg + 4) != 1) {
+        return -1;
+    }
+    size_t pos = 12;
+    std::string qname;
+    if(!ReadName(msg, len, pos, qname) || pos + 4 > len
+            || qname != name || Read16(msg + pos) != type) {
+        return -1;
+    }
+    pos += 4;
+
+    int rcode = flags & 0x0F;
+    if(rcode != 0 && rcode != 3) {
+        MS_LOG_DEBUG(g_logger) << "dns query " << name << " type=" << type << " rcode=" << rcode;
+        return DnsResolver::ERROR;
+    }
+
+    uint16_t ancount = Read16(msg + 6);
+    uint16_t nscount = Read16(msg + 8);
+    std::unordered_map<std::string, std::pair<std::string, uint32_t> > cnames;
+    std::vector<DnsRecord> records;
+    DnsRecord rr;
+    for(uint16_t i = 0; i < ancount; ++i) {
+        if(!ReadRecord(msg, len, pos, rr)) {
+            return DnsResolver::ERROR;
+        }
+        if(rr.type == 5) {
+            size_t p = rr.rdata;
+            std::string target;
+            if(!ReadName(msg, len, p, target)) {
+                return DnsResolver::ERROR;
+            }
+            cnames[rr.name] = std::make_pair(target, rr.ttl);
+        } else if(rr.type == type) {
+            records.push_back(rr);
+        }
+    }
+
+    // 沿 CNAME 链找到最终的名字
+    uint32_t ttl = 0xFFFFFFFF;
+    std::string cur = name;
+    for(int i = 0; i < 16; ++i) {
+        auto it = cnames.find(cur);
+        if(it == cnames.end()) {
+            break;
+        }
+        ttl = std::min(ttl, it->second.second);
+        cur = it->second.first;
+    }
+
+    for(auto& i : records) {
+        if(i.name != cur) {
+            continue;
+        }
+        if(type == DnsResolver::A && i.rdlen == 4) {
+            sockaddr_in sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sin_family = AF_INET;
+            memcpy(&sa.sin_addr, msg + i.rdata, 4);
+            addrs.push_back(Address::Create((const sockaddr*)&sa, sizeof(sa)));
+        } else if(type == DnsResolver::AAAA && i.rdlen == 16) {
+            sockaddr_in6 sa;
+            memset(&sa, 0, sizeof(sa));
+            sa.sin6_family = AF_INET6;
+            memcpy(&sa.sin6_addr, msg + i.rdata, 16);
+            addrs.push_back(Address::Create((const sockaddr*)&sa, sizeof(sa)));
+        } else {
+            continue;
+        }
+        ttl = std::min(ttl, i.ttl);
+    }
+    if(!addrs.empty()) {
+        // 用 64 位计算, 由调用方按 dns.max_ttl 截断
+        ttl_ms = (uint64_t)ttl * 1000;
+        return DnsResolver::OK;
+    }
+    if(flags & 0x0200) {
+        // 被截断且没有可用记录
+        MS_LOG_DEBUG(g_logger) << "dns query " << name << " type=" << type << " truncated";
+        return DnsResolver::ERROR;
+    }
+
+    // 否定应答, 否定缓存时间取 SOA 的 TTL 和 MINIMUM 的较小值
+    ttl_ms = ~0ull;
+    for(uint16_t i = 0; i < nscount; ++i) {
+        if(!ReadRecord(msg, len, pos, rr)) {
+            break;
+        }
+        if(rr.type == 6) {
+            size_t p = rr.rdata;
+            std::string mname, rname;
+            if(ReadName(msg, len, p, mname) && ReadName(msg, len, p, rname)
+                    && p + 20 <= len) {
+                uint32_t minimum = NormalizeTtl(Read32(msg + p + 16));
+                ttl_ms = (uint64_t)std::min(rr.ttl, minimum) * 1000;
+            }
+            break;
+        }
+    }
+    return DnsResolver::NOTFOUND;
+}
+
+bool DnsResolver::IsEnabled() {
+    return *g_dns_enable->getValue();
+}
+
+DnsResolver::DnsResolver()
+    :m_queryCount(0) {
+    m_hosts.path = *g_dns_hosts_file->getValue();
+}
+
+bool DnsResolver::lookup(std::vector<IPAddress::ptr>& result, const std::string& name,
+                         int family) {
+    std::string lname = ToLower(name);
+    bool absolute = false;
+    if(!lname.empty() && lname.back() == '.') {
+        lname.pop_back();
+        absolute = true;
+    }
+    if(lname.empty() || lname.size() > 253) {
+        return false;
+    }
+    if(lookupHosts(result, lname, family)) {
+        return true;
+    }
+
+    // 按 resolv.conf 的 search/ndots 规则生成候选域名
+    std::vector<std::string> names;
+    std::vector<std::string> search;
+    int ndots = 1;
+    if(!absolute) {
+        getSearch(search, ndots);
+    }
+    int dots = std::count(lname.begin(), lname.end(), '.');
+    if(dots >= ndots) {
+        names.push_back(lname);
+    }
+    for(auto& i : search) {
+        names.push_back(lname + "." + i);
+    }
+    if(dots < ndots) {
+        names.push_back(lname);
+    }
+
+    size_t size = result.size();
+    for(auto& i : names) {
+        if(family != AF_INET6) {
+            lookupName(result, i, A);
+        }
+        if(family != AF_INET) {
+            lookupName(result, i, AAAA);
+        }
+        if(result.size() > size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DnsResolver::setServers(const std::vector<Address::ptr>& servers) {
+    RWMutexType::WriteLock lock(m_confMutex);
+    m_servers = servers;
+}
+
+std::vector<Address::ptr> DnsResolver::getServers() {
+    {
+        RWMutexType::ReadLock lock(m_confMutex);
+        if(!m_servers.empty()) {
+            return m_servers;
+        }
+    }
+    reloadResolvConf();
+    RWMutexType::ReadLock lock(m_confMutex);
+    return m_resolv.servers;
+}
+
+void DnsResolver::setHostsFile(const std::string& path) {
+    RWMutexType::WriteLock lock(m_confMutex);
+    m_hosts.path = path;
+    m_hosts.mtime = 0;
+    m_hosts.checkTime = 0;
+    m_hosts.hosts.clear();
+}
+
+void DnsResolver::clearCache() {
+    RWMutexType::WriteLock lock(m_mutex);
+    m_cache.clear();
+}
+
+size_t DnsResolver::getCacheSize() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_cache.size();
+}
+
+bool DnsResolver::lookupHosts(std::vector<IPAddress::ptr>& result, const std::string& name,
+                              int family) {
+    reloadHosts();
+    RWMutexType::ReadLock lock(m_confMutex);
+    auto it = m_hosts.hosts.find(name);
+    if(it == m_hosts.hosts.end()) {
+        return false;
+    }
+    size_t size = result.size();
+    for(auto& i : it->second) {
+        if(family == AF_UNSPEC || i->getFamily() == family) {
+            result.push_back(std::dynamic_pointer_cast<IPAddress>(Clone(i)));
+        }
+    }
+    return result.size() > size;
+}
+
+int DnsResolver::lookupName(std::vector<IPAddress::ptr>& result, const std::string& name,
+                            Type type) {
+    std::string key = (type == A ? "A " : "AAAA ") + name;
+    uint64_t now = MNSER::GetCurrentMS();
+    {
+        RWMutexType::ReadLock lock(m_mutex);
+        auto it = m_cache.find(key);
+        if(it != m_cache.end() && it->second.expire > now) {
+            if(it->second.addrs.empty()) {
+                return NOTFOUND;
+            }
+            for(auto& i : it->second.addrs) {
+                result.push_back(std::dynamic_pointer_cast<IPAddress>(Clone(i)));
+            }
+            return OK;
+        }
+    }
+
+    std::vector<Address::ptr> addrs;
+    uint64_t ttl_ms = 0;
+    int rt = query(name, type, addrs, ttl_ms);
+    if(rt == OK) {
+        addCache(key, addrs, std::min(ttl_ms, *g_dns_max_ttl->getValue()));
+        for(auto& i : addrs) {
+            result.push_back(std::dynamic_pointer_cast<IPAddress>(Clone(i)));
+        }
+    } else if(rt == NOTFOUND) {
+        addCache(key, addrs, std::min(ttl_ms, *g_dns_negative_ttl->getValue()));
+    }
+    return rt;
+}
+
+int DnsResolver::query(const std::string& name, Type type, std::vector<Address::ptr>& addrs,
+                       uint64_t& ttl_ms) {
+    std::vector<Address::ptr> servers = getServers();
+    if(servers.empty()) {
+        return ERROR;
+    }
+    uint32_t attempts = std::max(*g_dns_attempts->getValue(), (uint32_t)1);
+    uint64_t timeout = *g_dns_timeout->getValue();
+    for(uint32_t i = 0; i < attempts; ++i) {
+        for(auto& s : servers) {
+            int rt = queryServer(s, name, type, addrs, ttl_ms, timeout);
+            if(rt != ERROR) {
+                return rt;
+            }
+        }
+    }
+    MS_LOG_WARN(g_logger) << "dns query " << name << " type=" << type << " fail";
+    return ERROR;
+}
+
+int DnsResolver::queryServer(Address::ptr server, const std::string& name, Type type,
+                             std::vector<Address::ptr>& addrs, uint64_t& ttl_ms,
+                             uint64_t timeout_ms) {
+    static thread_local std::mt19937 s_rand(std::random_device{}());
+    uint16_t id = s_rand() & 0xFFFF;
+    std::string pkt;
+    if(!BuildQuery(pkt, id, name, type)) {
+        return NOTFOUND;
+    }
+
+    ++m_queryCount;
+    // connect 之后内核只会把该 nameserver 发来的报文交给这个 socket
+    Socket::ptr sock = Socket::CreateUDP(server);
+    if(!sock->connect(server)) {
+        return ERROR;
+    }
+    if(sock->send(pkt.data(), pkt.size()) != (int)pkt.size()) {
+        MS_LOG_DEBUG(g_logger) << "dns send to " << *server << " fail errno=" << errno
+            << " errstr=" << strerror(errno);
+        return ERROR;
+    }
+
+    uint8_t buf[4096];
+    uint64_t deadline = MNSER::GetCurrentMS() + timeout_ms;
+    while(true) {
+        uint64_t now = MNSER::GetCurrentMS();
+        if(now >= deadline) {
+            break;
+        }
+        sock->setRecvTimeout(deadline - now);
+        int rt = sock->recv(buf, sizeof(buf));
+        if(rt <= 0) {
+            break;
+        }
+        addrs.clear();
+        int r = ParseResponse(buf, rt, id, name, type, addrs, ttl_ms);
+        if(r >= 0) {
+            return r;
+        }
+    }
+    MS_LOG_DEBUG(g_logger) << "dns query " << name << " from " << *server
+        << " timeout=" << timeout_ms << " errno=" << errno;
+    return ERROR;
+}
+
+void DnsResolver::addCache(const std::string& key, const std::vector<Address::ptr>& addrs,
+                           uint64_t ttl_ms) {
+    uint64_t cache_size = *g_dns_cache_size->getValue();
+    if(ttl_ms == 0 || cache_size == 0) {
+        return;
+    }
+    uint64_t now = MNSER::GetCurrentMS();
+    RWMutexType::WriteLock lock(m_mutex);
+    if(m_cache.size() >= cache_size) {
+        // 先清掉过期的, 还是放不下就全部清空
+        for(auto it = m_cache.begin(); it != m_cache.end();) {
+            if(it->second.expire <= now) {
+                it = m_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if(m_cache.size() >= cache_size) {
+            m_cache.clear();
+        }
+    }
+    CacheEntry& entry = m_cache[key];
+    entry.addrs = addrs;
+    entry.expire = now + ttl_ms;
+}
+
+void DnsResolver::reloadHosts() {
+    uint64_t now = MNSER::GetCurrentMS();
+    {
+        RWMutexType::ReadLock lock(m_confMutex);
+        if(m_hosts.checkTime && now < m_hosts.checkTime + s_conf_check_interval) {
+            return;
+        }
+    }
+    RWMutexType::WriteLock lock(m_confMutex);
+    if(m_hosts.checkTime && now < m_hosts.checkTime + s_conf_check_interval) {
+        return;
+    }
+    m_hosts.checkTime = now;
+    struct stat st;
+    if(m_hosts.path.empty() || stat(m_hosts.path.c_str(), &st) != 0) {
+        m_hosts.mtime = 0;
+        m_hosts.hosts.clear();
+        return;
+    }
+    if(st.st_mtime == m_hosts.mtime) {
+        return;
+    }
+    std::ifstream ifs(m_hosts.path);
+    if(!ifs) {
+        return;
+    }
+    m_hosts.mtime = st.st_mtime;
+    m_hosts.hosts.clear();
+    std::string line;
+    while(std::getline(ifs, line)) {
+        size_t pos = line.find('#');
+        if(pos != std::string::npos) {
+            line.resize(pos);
+        }
+        std::istringstream iss(line);
+        std::string ip;
+        if(!(iss >> ip)) {
+            continue;
+        }
+        Address::ptr addr = ParseIP(ip, 0);
+        if(!addr) {
+            continue;
+        }
+        std::string host;
+        while(iss >> host) {
+            m_hosts.hosts[ToLower(host)].push_back(addr);
+        }
+    }
+}
+
+void DnsResolver::reloadResolvConf() {
+    uint64_t now = MNSER::GetCurrentMS();
+    {
+        RWMutexType::ReadLock lock(m_confMutex);
+        if(m_resolv.checkTime && now < m_resolv.checkTime + s_conf_check_interval) {
+            return;
+        }
+    }
+    std::vector<std::string> conf_servers = *g_dns_servers->getValue();
+    std::string path = *g_dns_resolv_conf->getValue();
+
+    RWMutexType::WriteLock lock(m_confMutex);
+    if(m_resolv.checkTime && now < m_resolv.checkTime + s_conf_check_interval) {
+        return;
+    }
+    m_resolv.checkTime = now;
+
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) {
+        memset(&st, 0, sizeof(st));
+    }
+    if(st.st_mtime != m_resolv.mtime) {
+        m_resolv.mtime = st.st_mtime;
+        m_resolv.servers.clear();
+        m_resolv.search.clear();
+        m_resolv.ndots = 1;
+        std::ifstream ifs(path);
+        std::string line;
+        while(ifs && std::getline(ifs, line)) {
+            std::istringstream iss(line);
+            std::string key;
+            if(!(iss >> key) || key[0] == '#' || key[0] == ';') {
+                continue;
+            }
+            std::string value;
+            if(key == "nameserver") {
+                if(iss >> value) {
+                    Address::ptr addr = ParseIP(value, 53);
+                    if(addr) {
+                        m_resolv.servers.push_back(addr);
+                    }
+                }
+            } else if(key == "search" || key == "domain") {
+                // 后出现的 search/domain 覆盖前面的
+                m_resolv.search.clear();
+                while(iss >> value) {
+                    if(value.back() == '.') {
+                        value.pop_back();
+                    }
+                    if(!value.empty()) {
+                        m_resolv.search.push_back(ToLower(value));
+                    }
+                }
+            } else if(key == "options") {
+                while(iss >> value) {
+                    if(value.compare(0, 6, "ndots:") == 0) {
+                        m_resolv.ndots = std::min(atoi(value.c_str() + 6), 15);
+                    }
+                }
+            }
+        }
+    }
+
+    if(!conf_servers.empty()) {
+        // 配置的 nameserver 优先于 resolv.conf
+        m_resolv.servers.clear();
+        m_resolv.mtime = 0;
+        for(auto& i : conf_servers) {
+            Address::ptr addr = ParseServer(i);
+            if(addr) {
+                m_resolv.servers.push_back(addr);
+            } else {
+                MS_LOG_ERROR(g_logger) << "invalid dns server: " << i;
+            }
+        }
+    }
+}
+
+void DnsResolver::getSearch(std::vector<std::string>& search, int& ndots) {
+    reloadResolvConf();
+    RWMutexType::ReadLock lock(m_confMutex);
+    search = m_resolv.search;
+    ndots = m_resolv.ndots;
+}
+
+}
@@ -38,14 +38,14 @@ Fiber::Fiber() { // 这个构造函数只有主协程用得到,而且这个实
 	}
 
 	++s_fiber_count;
-	MS_LOG_DEBUG(g_logger) << "Fiber::Fiber main";
+	MS_LOG_BIN_DEBUG(g_logger, "Fiber::Fiber main");
 }
 
 // 这个构造函数指定了回调函数，分配了栈空间
 Fiber::Fiber(std::function<void()> cb, size_t stackSize, bool use_caller) 
 	: m_id(++s_fiber_id), m_cb(cb)  {
 	++s_fiber_count;
-	m_stacksize = stackSize ? stackSize: g_fiber_stack_size->getValue();
+	m_stacksize = stackSize ? stackSize: *g_fiber_stack_size->getValue();
 
 	m_stack = MSAlloctor::Alloc(m_stacksize);
 	if (m_stack == nullptr) {
@@ -66,7 +66,7 @@ Fiber::Fiber(std::function<void()> cb, size_t stackSize, bool use_caller)
 		makecontext(&m_ctx, &Fiber::CallerMainFunc, 0);
 	}
 
-	MS_LOG_DEBUG(g_logger) << "Fiber::Fiber id = " << m_id;
+	MS_LOG_BIN_DEBUG(g_logger, "Fiber::Fiber id = %lu", m_id);
 }
 
 Fiber::~Fiber() {
@@ -87,12 +87,10 @@ Fiber::~Fiber() {
 		Fiber* cur = t_fiber;
 		if (cur == this) {  // 如果就是现在这个协程调用自己的析构函数，那就将当前运行的协程指针指向 nullptr
 			SetThis(nullptr);
-			MS_LOG_DEBUG(g_logger) << "Thread id: " << MNSER::GetThreadId() 
-				<< " Main Fiber Set nullptr";
+			MS_LOG_BIN_DEBUG(g_logger, "Thread id: %d Main Fiber Set nullptr", MNSER::GetThreadId());
 		}
 	}
-	MS_LOG_DEBUG(g_logger) << "Finish Fiber::~Fiber id=" << m_id 
-		<< " total=" << s_fiber_count;
+	MS_LOG_BIN_DEBUG(g_logger, "Finish Fiber::~Fiber id=%lu total=%lu", m_id, s_fiber_count.load());
 }
 
 // 重置协程执行函数
@@ -1,4 +1,5 @@
 #include <dlfcn.h>
+#include <sys/sendfile.h>
 
 #include "hook.h"
 #include "log.h"
@@ -37,6 +38,7 @@ bool is_hook_enable() {
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendfile) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -56,18 +58,9 @@ void hook_init() {
 #undef XX
 }
 
-static uint64_t s_connect_timeout = -1;
 struct _HookIniter {
     _HookIniter() {
         hook_init();
-        s_connect_timeout = g_tcp_connect_timeout->getValue();  // 为了设置统一的超时时间
-
-        g_tcp_connect_timeout->addListener([](const int& old_value,
-			const int& new_value){
-                MS_LOG_INFO(g_logger) << "tcp connect timeout changed from "
-                                         << old_value << " to " << new_value;
-                s_connect_timeout = new_value;
-        });
     }
 };
 
@@ -294,7 +287,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 }
 
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-    return connect_with_timeout(sockfd, addr, addrlen, MNSER::s_connect_timeout);
+    return connect_with_timeout(sockfd, addr, addrlen, (uint64_t)*MNSER::g_tcp_connect_timeout->getValue());
 }
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
@@ -346,6 +339,11 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
     return do_io(s, sendmsg_f, "sendmsg", MNSER::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+// 文件数据在内核中直接拷贝到 socket, 发送缓冲满时和 send 一样让出协程
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return do_io(out_fd, sendfile_f, "sendfile", MNSER::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
 int close(int fd) {
     if(!MNSER::t_hook_enable) {
         return close_f(fd);
@@ -550,7 +548,9 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
             MNSER::FdCtx::ptr ctx = MNSER::FdMgr::GetInstance()->get(sockfd);
             if(ctx) {
                 const timeval* v = (const timeval*)optval;
-                ctx->setTimeout(optname, v->tv_sec * 1000 + v->tv_usec / 1000);
+                uint64_t ms = v->tv_sec * 1000 + v->tv_usec / 1000;
+                // 和内核一致, 0 表示不超时
+                ctx->setTimeout(optname, ms ? ms : (uint64_t)-1);
             }
         }
     }
@@ -0,0 +1,598 @@
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+#include "hpack.h"
+#include "log.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 静态表(RFC 7541 附录 A)
+static const std::pair<const char*, const char*> s_static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+};
+
+static const uint32_t s_static_table_size = sizeof(s_static_table) / sizeof(s_static_table[0]);
+
+// 静态表的查找索引, key 为 name 或 name + '\0' + value, 值为最小的索引
+struct StaticIndex {
+    StaticIndex() {
+        for(uint32_t i = 0; i < s_static_table_size; ++i) {
+            std::string name = s_static_table[i].first;
+            names.insert(std::make_pair(name, i + 1));
+            if(s_static_table[i].second[0]) {
+                fulls.insert(std::make_pair(name + '\0' + s_static_table[i].second, i + 1));
+            }
+        }
+    }
+    std::unordered_map<std::string, uint32_t> names;
+    std::unordered_map<std::string, uint32_t> fulls;
+};
+
+static const StaticIndex& GetStaticIndex() {
+    static StaticIndex s_index;
+    return s_index;
+}
+
+// Huffman 码表(RFC 7541 附录 B), {编码, 位数}, 最后一项是 EOS
+static const struct {
+    uint32_t code;
+    uint8_t bits;
+} s_huffman_codes[257] = {
+    {0x00001ff8, 13}, {0x007fffd8, 23}, {0x0fffffe2, 28}, {0x0fffffe3, 28},
+    {0x0fffffe4, 28}, {0x0fffffe5, 28}, {0x0fffffe6, 28}, {0x0fffffe7, 28},
+    {0x0fffffe8, 28}, {0x00ffffea, 24}, {0x3ffffffc, 30}, {0x0fffffe9, 28},
+    {0x0fffffea, 28}, {0x3ffffffd, 30}, {0x0fffffeb, 28}, {0x0fffffec, 28},
+    {0x0fffffed, 28}, {0x0fffffee, 28}, {0x0fffffef, 28}, {0x0ffffff0, 28},
+    {0x0ffffff1, 28}, {0x0ffffff2, 28}, {0x3ffffffe, 30}, {0x0ffffff3, 28},
+    {0x0ffffff4, 28}, {0x0ffffff5, 28}, {0x0ffffff6, 28}, {0x0ffffff7, 28},
+    {0x0ffffff8, 28}, {0x0ffffff9, 28}, {0x0ffffffa, 28}, {0x0ffffffb, 28},
+    {0x00000014,  6}, {0x000003f8, 10}, {0x000003f9, 10}, {0x00000ffa, 12},
+    {0x00001ff9, 13}, {0x00000015,  6}, {0x000000f8,  8}, {0x000007fa, 11},
+    {0x000003fa, 10}, {0x000003fb, 10}, {0x000000f9,  8}, {0x000007fb, 11},
+    {0x000000fa,  8}, {0x00000016,  6}, {0x00000017,  6}, {0x00000018,  6},
+    {0x00000000,  5}, {0x00000001,  5}, {0x00000002,  5}, {0x00000019,  6},
+    {0x0000001a,  6}, {0x0000001b,  6}, {0x0000001c,  6}, {0x0000001d,  6},
+    {0x0000001e,  6}, {0x0000001f,  6}, {0x0000005c,  7}, {0x000000fb,  8},
+    {0x00007ffc, 15}, {0x00000020,  6}, {0x00000ffb, 12}, {0x000003fc, 10},
+    {0x00001ffa, 13}, {0x00000021,  6}, {0x0000005d,  7}, {0x0000005e,  7},
+    {0x0000005f,  7}, {0x00000060,  7}, {0x00000061,  7}, {0x00000062,  7},
+    {0x00000063,  7}, {0x00000064,  7}, {0x00000065,  7}, {0x00000066,  7},
+    {0x00000067,  7}, {0x00000068,  7}, {0x00000069,  7}, {0x0000006a,  7},
+    {0x0000006b,  7}, {0x0000006c,  7}, {0x0000006d,  7}, {0x0000006e,  7},
+    {0x0000006f,  7}, {0x00000070,  7}, {0x00000071,  7}, {0x00000072,  7},
+    {0x000000fc,  8}, {0x00000073,  7}, {0x000000fd,  8}, {0x00001ffb, 13},
+    {0x0007fff0, 19}, {0x00001ffc, 13}, {0x00003ffc, 14}, {0x00000022,  6},
+    {0x00007ffd, 15}, {0x00000003,  5}, {0x00000023,  6}, {0x00000004,  5},
+    {0x00000024,  6}, {0x00000005,  5}, {0x00000025,  6}, {0x00000026,  6},
+    {0x00000027,  6}, {0x00000006,  5}, {0x00000074,  7}, {0x00000075,  7},
+    {0x00000028,  6}, {0x00000029,  6}, {0x0000002a,  6}, {0x00000007,  5},
+    {0x0000002b,  6}, {0x00000076,  7}, {0x0000002c,  6}, {0x00000008,  5},
+    {0x00000009,  5}, {0x0000002d,  6}, {0x00000077,  7}, {0x00000078,  7},
+    {0x00000079,  7}, {0x0000007a,  7}, {0x0000007b,  7}, {0x00007ffe, 15},
+    {0x000007fc, 11}, {0x00003ffd, 14}, {0x00001ffd, 13}, {0x0ffffffc, 28},
+    {0x000fffe6, 20}, {0x003fffd2, 22}, {0x000fffe7, 20}, {0x000fffe8, 20},
+    {0x003fffd3, 22}, {0x003fffd4, 22}, {0x003fffd5, 22}, {0x007fffd9, 23},
+    {0x003fffd6, 22}, {0x007fffda, 23}, {0x007fffdb, 23}, {0x007fffdc, 23},
+    {0x007fffdd, 23}, {0x007fffde, 23}, {0x00ffffeb, 24}, {0x007fffdf, 23},
+    {0x00ffffec, 24}, {0x00ffffed, 24}, {0x003fffd7, 22}, {0x007fffe0, 23},
+    {0x00ffffee, 24}, {0x007fffe1, 23}, {0x007fffe2, 23}, {0x007fffe3, 23},
+    {0x007fffe4, 23}, {0x001fffdc, 21}, {0x003fffd8, 22}, {0x007fffe5, 23},
+    {0x003fffd9, 22}, {0x007fffe6, 23}, {0x007fffe7, 23}, {0x00ffffef, 24},
+    {0x003fffda, 22}, {0x001fffdd, 21}, {0x000fffe9, 20}, {0x003fffdb, 22},
+    {0x003fffdc, 22}, {0x007fffe8, 23}, {0x007fffe9, 23}, {0x001fffde, 21},
+    {0x007fffea, 23}, {0x003fffdd, 22}, {0x003fffde, 22}, {0x00fffff0, 24},
+    {0x001fffdf, 21}, {0x003fffdf, 22}, {0x007fffeb, 23}, {0x007fffec, 23},
+    {0x001fffe0, 21}, {0x001fffe1, 21}, {0x003fffe0, 22}, {0x001fffe2, 21},
+    {0x007fffed, 23}, {0x003fffe1, 22}, {0x007fffee, 23}, {0x007fffef, 23},
+    {0x000fffea, 20}, {0x003fffe2, 22}, {0x003fffe3, 22}, {0x003fffe4, 22},
+    {0x007ffff0, 23}, {0x003fffe5, 22}, {0x003fffe6, 22}, {0x007ffff1, 23},
+    {0x03ffffe0, 26}, {0x03ffffe1, 26}, {0x000fffeb, 20}, {0x0007fff1, 19},
+    {0x003fffe7, 22}, {0x007ffff2, 23}, {0x003fffe8, 22}, {0x01ffffec, 25},
+    {0x03ffffe2, 26}, {0x03ffffe3, 26}, {0x03ffffe4, 26}, {0x07ffffde, 27},
+    {0x07ffffdf, 27}, {0x03ffffe5, 26}, {0x00fffff1, 24}, {0x01ffffed, 25},
+    {0x0007fff2, 19}, {0x001fffe3, 21}, {0x03ffffe6, 26}, {0x07ffffe0, 27},
+    {0x07ffffe1, 27}, {0x03ffffe7, 26}, {0x07ffffe2, 27}, {0x00fffff2, 24},
+    {0x001fffe4, 21}, {0x001fffe5, 21}, {0x03ffffe8, 26}, {0x03ffffe9, 26},
+    {0x0ffffffd, 28}, {0x07ffffe3, 27}, {0x07ffffe4, 27}, {0x07ffffe5, 27},
+    {0x000fffec, 20}, {0x00fffff3, 24}, {0x000fffed, 20}, {0x001fffe6, 21},
+    {0x003fffe9, 22}, {0x001fffe7, 21}, {0x001fffe8, 21}, {0x007ffff3, 23},
+    {0x003fffea, 22}, {0x003fffeb, 22}, {0x01ffffee, 25}, {0x01ffffef, 25},
+    {0x00fffff4, 24}, {0x00fffff5, 24}, {0x03ffffea, 26}, {0x007ffff4, 23},
+    {0x03ffffeb, 26}, {0x07ffffe6, 27}, {0x03ffffec, 26}, {0x03ffffed, 26},
+    {0x07ffffe7, 27}, {0x07ffffe8, 27}, {0x07ffffe9, 27}, {0x07ffffea, 27},
+    {0x07ffffeb, 27}, {0x0ffffffe, 28}, {0x07ffffec, 27}, {0x07ffffed, 27},
+    {0x07ffffee, 27}, {0x07ffffef, 27}, {0x07fffff0, 27}, {0x03ffffee, 26},
+    {0x3fffffff, 30}
+};
+
+// Huffman 解码状态机, 每次处理 4 位, 状态为 Huffman 树的内部节点(共 256 个, 0 为根)
+// 最短的编码是 5 位, 所以每一步最多输出一个字符
+struct HuffmanDecodeTable {
+    enum Flag {
+        EMIT    = 0x1,  // 输出 sym
+        FAIL    = 0x2,  // 遇到 EOS, 数据非法
+        ACCEPT  = 0x4   // 在这个状态结束是合法的(根节点, 或不超过 7 位的全 1 填充)
+    };
+    struct Entry {
+        uint8_t state;
+        uint8_t flags;
+        uint8_t sym;
+    };
+
+    HuffmanDecodeTable() {
+        // 建树, 叶子节点记录字符, 内部节点记录编号
+        struct Node {
+            int child[2];
+            int sym;
+        };
+        std::vector<Node> nodes(1, Node{{-1, -1}, -1});
+        for(int sym = 0; sym < 257; ++sym) {
+            int cur = 0;
+            for(int i = s_huffman_codes[sym].bits - 1; i >= 0; --i) {
+                int bit = (s_huffman_codes[sym].code >> i) & 1;
+                if(nodes[cur].child[bit] < 0) {
+                    nodes[cur].child[bit] = nodes.size();
+                    nodes.push_back(Node{{-1, -1}, -1});
+                }
+                cur = nodes[cur].child[bit];
+            }
+            nodes[cur].sym = sym;
+        }
+
+        std::vector<int> ids(nodes.size(), -1);
+        std::vector<int> internals;
+        std::vector<bool> accept;
+        // 从根开始遍历, 记录是否全 1 路径和深度
+        std::vector<std::pair<int, int> > stack;  // 节点, 深度(全 1 路径时为正, 否则为 -1)
+        stack.push_back(std::make_pair(0, 0));
+        while(!stack.empty()) {
+            auto item = stack.back();
+            stack.pop_back();
+            int n = item.first;
+            if(nodes[n].sym >= 0) {
+                continue;
+            }
+            ids[n] = internals.size();
+            internals.push_back(n);
+            accept.push_back(item.second >= 0 && item.second <= 7);
+            stack.push_back(std::make_pair(nodes[n].child[0], -1));
+            stack.push_back(std::make_pair(nodes[n].child[1]
+                        ,item.second >= 0 ? item.second + 1 : -1));
+        }
+
+        for(size_t s = 0; s < internals.size() && s < 256; ++s) {
+            for(int nibble = 0; nibble < 16; ++nibble) {
+                Entry& e = table[s][nibble];
+                e.flags = 0;
+                e.sym = 0;
+                int cur = internals[s];
+                for(int i = 3; i >= 0; --i) {
+                    cur = nodes[cur].child[(nibble >> i) & 1];
+                    if(nodes[cur].sym >= 0) {
+                        if(nodes[cur].sym == 256) {
+                            e.flags |= FAIL;
+                            break;
+                        }
+                        e.flags |= EMIT;
+                        e.sym = nodes[cur].sym;
+                        cur = 0;
+                    }
+                }
+                e.state = ids[cur] < 0 ? 0 : ids[cur];
+                if(!(e.flags & FAIL) && accept[e.state]) {
+                    e.flags |= ACCEPT;
+                }
+            }
+        }
+    }
+
+    Entry table[256][16];
+};
+
+static const HuffmanDecodeTable& GetHuffmanDecodeTable() {
+    static HuffmanDecodeTable s_table;
+    return s_table;
+}
+
+void HPackEncodeInt(std::string& out, uint64_t value, int prefix, uint8_t flags) {
+    uint64_t max = (1u << prefix) - 1;
+    if(value < max) {
+        out.push_back((char)(flags | value));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    value -= max;
+    while(value >= 128) {
+        out.push_back((char)(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+int HPackDecodeInt(const uint8_t* data, size_t len, int prefix, uint64_t& value) {
+    if(len == 0) {
+        return -1;
+    }
+    uint64_t max = (1u << prefix) - 1;
+    value = data[0] & max;
+    if(value < max) {
+        return 1;
+    }
+    int shift = 0;
+    for(size_t i = 1; i < len; ++i) {
+        value += (uint64_t)(data[i] & 0x7f) << shift;
+        if(!(data[i] & 0x80)) {
+            return i + 1;
+        }
+        shift += 7;
+        // 头部中不会出现超过 32 位的整数
+        if(shift > 28) {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+size_t HuffmanEncodeLength(const std::string& str) {
+    uint64_t bits = 0;
+    for(unsigned char c : str) {
+        bits += s_huffman_codes[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void HuffmanEncode(std::string& out, const std::string& str) {
+    uint64_t bits = 0;
+    int nbits = 0;
+    for(unsigned char c : str) {
+        bits = (bits << s_huffman_codes[c].bits) | s_huffman_codes[c].code;
+        nbits += s_huffman_codes[c].bits;
+        while(nbits >= 8) {
+            nbits -= 8;
+            out.push_back((char)(bits >> nbits));
+        }
+        bits &= (1ull << nbits) - 1;
+    }
+    if(nbits > 0) {
+        // 用 EOS 的高位(全 1)填充
+        out.push_back((char)((bits << (8 - nbits)) | (0xff >> nbits)));
+    }
+}
+
+bool HuffmanDecode(std::string& out, const uint8_t* data, size_t len) {
+    const HuffmanDecodeTable& t = GetHuffmanDecodeTable();
+    uint8_t state = 0;
+    bool accept = true;
+    for(size_t i = 0; i < len; ++i) {
+        const HuffmanDecodeTable::Entry& hi = t.table[state][data[i] >> 4];
+        if(hi.flags & HuffmanDecodeTable::FAIL) {
+            return false;
+        }
+        if(hi.flags & HuffmanDecodeTable::EMIT) {
+            out.push_back((char)hi.sym);
+        }
+        const HuffmanDecodeTable::Entry& lo = t.table[hi.state][data[i] & 0xf];
+        if(lo.flags & HuffmanDecodeTable::FAIL) {
+            return false;
+        }
+        if(lo.flags & HuffmanDecodeTable::EMIT) {
+            out.push_back((char)lo.sym);
+        }
+        state = lo.state;
+        accept = lo.flags & HuffmanDecodeTable::ACCEPT;
+    }
+    return accept;
+}
+
+HPackTable::HPackTable(uint32_t max_size)
+    :m_size(0)
+    ,m_maxSize(max_size) {
+}
+
+bool HPackTable::get(uint64_t idx, std::string& name, std::string& value) const {
+    if(idx == 0) {
+        return false;
+    }
+    if(idx <= s_static_table_size) {
+        name = s_static_table[idx - 1].first;
+        value = s_static_table[idx - 1].second;
+        return true;
+    }
+    idx -= s_static_table_size + 1;
+    if(idx >= m_entries.size()) {
+        return false;
+    }
+    name = m_entries[idx].first;
+    value = m_entries[idx].second;
+    return true;
+}
+
+uint32_t HPackTable::find(const std::string& name, const std::string& value, bool& full) const {
+    const StaticIndex& si = GetStaticIndex();
+    full = false;
+    uint32_t name_idx = 0;
+    auto it = si.names.find(name);
+    if(it != si.names.end()) {
+        name_idx = it->second;
+        if(!value.empty()) {
+            auto fit = si.fulls.find(name + '\0' + value);
+            if(fit != si.fulls.end()) {
+                full = true;
+                return fit->second;
+            }
+        }
+    }
+    for(size_t i = 0; i < m_entries.size(); ++i) {
+        if(m_entries[i].first != name) {
+            continue;
+        }
+        if(m_entries[i].second == value) {
+            full = true;
+            return s_static_table_size + 1 + i;
+        }
+        if(!name_idx) {
+            name_idx = s_static_table_size + 1 + i;
+        }
+    }
+    return name_idx;
+}
+
+void HPackTable::add(const std::string& name, const std::string& value) {
+    uint32_t size = name.size() + value.size() + 32;
+    if(size > m_maxSize) {
+        // 比整个表还大, 表被清空, 条目也不加入
+        m_entries.clear();
+        m_size = 0;
+        return;
+    }
+    m_entries.push_front(std::make_pair(name, value));
+    m_size += size;
+    evict();
+}
+
+void HPackTable::setMaxSize(uint32_t v) {
+    m_maxSize = v;
+    evict();
+}
+
+void HPackTable::evict() {
+    while(m_size > m_maxSize && !m_entries.empty()) {
+        auto& e = m_entries.back();
+        m_size -= e.first.size() + e.second.size() + 32;
+        m_entries.pop_back();
+    }
+}
+
+HPackDecoder::HPackDecoder(uint32_t max_table_size)
+    :m_table(max_table_size)
+    ,m_maxAllowed(max_table_size) {
+}
+
+bool HPackDecoder::readString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if(p >= end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint64_t len = 0;
+    int n = HPackDecodeInt(p, end - p, 7, len);
+    if(n < 0 || len > (uint64_t)(end - p - n)) {
+        return false;
+    }
+    p += n;
+    out.clear();
+    if(huffman) {
+        if(!HuffmanDecode(out, p, len)) {
+            return false;
+        }
+    } else {
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+int HPackDecoder::decode(const uint8_t* data, size_t len, HPackHeaders& headers, size_t max_list_size) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    size_t list_size = 0;
+    bool header_seen = false;
+    bool too_large = false;
+    std::string name;
+    std::string value;
+    while(p < end) {
+        uint8_t b = *p;
+        uint64_t idx = 0;
+        int n = 0;
+        if(b & 0x80) {
+            // 索引表示
+            n = HPackDecodeInt(p, end - p, 7, idx);
+            if(n < 0 || !m_table.get(idx, name, value)) {
+                MS_LOG_DEBUG(g_logger) << "hpack invalid index " << idx;
+                return -1;
+            }
+            p += n;
+        } else if((b & 0xe0) == 0x20) {
+            // 动态表容量更新, 只能出现在头部块开头
+            n = HPackDecodeInt(p, end - p, 5, idx);
+            if(n < 0 || header_seen || idx > m_maxAllowed) {
+                MS_LOG_DEBUG(g_logger) << "hpack invalid table size update " << idx;
+                return -1;
+            }
+            p += n;
+            m_table.setMaxSize(idx);
+            continue;
+        } else {
+            // 字面量: 01 加入动态表, 0000 不加入, 0001 永不加入
+            bool indexing = (b & 0xc0) == 0x40;
+            n = HPackDecodeInt(p, end - p, indexing ? 6 : 4, idx);
+            if(n < 0) {
+                return -1;
+            }
+            p += n;
+            if(idx) {
+                std::string ignore;
+                if(!m_table.get(idx, name, ignore)) {
+                    MS_LOG_DEBUG(g_logger) << "hpack invalid name index " << idx;
+                    return -1;
+                }
+            } else if(!readString(p, end, name)) {
+                return -1;
+            }
+            if(!readString(p, end, value)) {
+                return -1;
+            }
+            if(indexing) {
+                m_table.add(name, value);
+            }
+        }
+        header_seen = true;
+        list_size += name.size() + value.size() + 32;
+        if(max_list_size && list_size > max_list_size) {
+            // 继续解码完整个块, 保持动态表和对端同步, 只是不再保存头部
+            if(!too_large) {
+                MS_LOG_DEBUG(g_logger) << "hpack header list too large " << list_size;
+                too_large = true;
+                headers.clear();
+            }
+            continue;
+        }
+        headers.push_back(std::make_pair(name, value));
+    }
+    return too_large ? 1 : 0;
+}
+
+// 编码器最多使用的动态表容量, 对端允许更大时也不超过这个值
+static const uint32_t s_encoder_max_table_size = 4096;
+
+HPackEncoder::HPackEncoder(uint32_t max_table_size)
+    :m_table(std::min(max_table_size, s_encoder_max_table_size))
+    ,m_pendingSize(0)
+    ,m_sizeUpdate(false) {
+}
+
+void HPackEncoder::setMaxTableSize(uint32_t v) {
+    v = std::min(v, s_encoder_max_table_size);
+    if(v != m_table.getMaxSize() || m_sizeUpdate) {
+        m_pendingSize = v;
+        m_sizeUpdate = true;
+    }
+}
+
+void HPackEncoder::encodeString(std::string& out, const std::string& str) {
+    size_t hlen = HuffmanEncodeLength(str);
+    if(hlen < str.size()) {
+        HPackEncodeInt(out, hlen, 7, 0x80);
+        HuffmanEncode(out, str);
+    } else {
+        HPackEncodeInt(out, str.size(), 7, 0);
+        out.append(str);
+    }
+}
+
+// 不加入动态表的头部: 每次都不同的值, 加入只会挤掉有用的条目
+static bool IsNoIndexHeader(const std::string& name) {
+    return name == ":path" || name == "content-length" || name == "date"
+        || name == "etag" || name == "last-modified" || name == "content-range";
+}
+
+// 敏感头部, 以永不索引的方式发送, 中间节点也不能压缩它们
+static bool IsSensitiveHeader(const std::string& name) {
+    return name == "authorization" || name == "proxy-authorization"
+        || name == "set-cookie" || name == "cookie";
+}
+
+void HPackEncoder::encode(const HPackHeaders& headers, std::string& out) {
+    if(m_sizeUpdate) {
+        HPackEncodeInt(out, m_pendingSize, 5, 0x20);
+        m_table.setMaxSize(m_pendingSize);
+        m_sizeUpdate = false;
+    }
+    for(auto& i : headers) {
+        bool full = false;
+        uint32_t idx = m_table.find(i.first, i.second, full);
+        if(full) {
+            HPackEncodeInt(out, idx, 7, 0x80);
+            continue;
+        }
+        if(IsSensitiveHeader(i.first)) {
+            HPackEncodeInt(out, idx, 4, 0x10);
+        } else if(IsNoIndexHeader(i.first)
+                || i.first.size() + i.second.size() + 32 > m_table.getMaxSize() / 2) {
+            HPackEncodeInt(out, idx, 4, 0x00);
+        } else {
+            HPackEncodeInt(out, idx, 6, 0x40);
+            m_table.add(i.first, i.second);
+        }
+        if(!idx) {
+            encodeString(out, i.first);
+        }
+        encodeString(out, i.second);
+    }
+}
+
+}
+}
@@ -321,35 +321,71 @@ std::string HttpResponse::toString() const {
     return ss.str();
 }
 
-std::ostream& HttpResponse::dump(std::ostream& os) const {
-    os << "HTTP/"
-       << ((uint32_t)(m_version >> 4))
-       << "."
-       << ((uint32_t)(m_version & 0x0F))
-       << " "
-       << (uint32_t)m_status
-       << " "
-       << (m_reason.empty() ? HttpStatusToString(m_status) : m_reason)
-       << "\r\n";
+// 追加无符号整数的十进制表示, 避免经过 ostream 格式化
+static void AppendUint(std::string& buf, uint64_t v) {
+    char tmp[24];
+    char* p = tmp + sizeof(tmp);
+    do {
+        *--p = '0' + (v % 10);
+        v /= 10;
+    } while(v);
+    buf.append(p, tmp + sizeof(tmp) - p);
+}
+
+size_t HttpResponse::dumpHeader(std::string& buf, bool with_length) const {
+    size_t old_size = buf.size();
+    buf.append("HTTP/", 5);
+    buf.push_back('0' + (m_version >> 4));
+    buf.push_back('.');
+    buf.push_back('0' + (m_version & 0x0F));
+    buf.push_back(' ');
+    AppendUint(buf, (uint32_t)m_status);
+    buf.push_back(' ');
+    if(m_reason.empty()) {
+        buf.append(HttpStatusToString(m_status));
+    } else {
+        buf.append(m_reason);
+    }
+    buf.append("\r\n", 2);
 
     for(auto& i : m_headers) {
         if(!m_websocket && strcasecmp(i.first.c_str(), "connection") == 0) {
             continue;
         }
-        os << i.first << ": " << i.second << "\r\n";
+        buf.append(i.first);
+        buf.append(": ", 2);
+        buf.append(i.second);
+        buf.append("\r\n", 2);
     }
     for(auto& i : m_cookies) {
-        os << "Set-Cookie: " << i << "\r\n";
+        buf.append("Set-Cookie: ", 12);
+        buf.append(i);
+        buf.append("\r\n", 2);
     }
     if(!m_websocket) {
-        os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
+        if(m_close) {
+            buf.append("connection: close\r\n");
+        } else {
+            buf.append("connection: keep-alive\r\n");
+        }
     }
-    if(!m_body.empty()) {
-        os << "content-length: " << m_body.size() << "\r\n\r\n"
-           << m_body;
-    } else {
-        os << "\r\n";
+    // 空消息体也写出 content-length: 0, 否则长连接上的客户端只能读到连接关闭
+    int status = (int)m_status;
+    if(with_length && !m_websocket && status >= 200 && status != 204 && status != 304
+            && m_headers.find("content-length") == m_headers.end()
+            && m_headers.find("transfer-encoding") == m_headers.end()) {
+        buf.append("content-length: ", 16);
+        AppendUint(buf, m_body.size());
+        buf.append("\r\n", 2);
     }
+    buf.append("\r\n", 2);
+    return buf.size() - old_size;
+}
+
+std::ostream& HttpResponse::dump(std::ostream& os) const {
+    std::string header;
+    dumpHeader(header);
+    os << header << m_body;
     return os;
 }
 
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <sstream>
+
+#include "http2_frame.h"
+
+namespace MNSER {
+namespace http {
+
+const char* Http2FrameTypeToString(Http2FrameType type) {
+    switch(type) {
+#define XX(name) \
+        case Http2FrameType::name: \
+            return #name;
+        XX(DATA);
+        XX(HEADERS);
+        XX(PRIORITY);
+        XX(RST_STREAM);
+        XX(SETTINGS);
+        XX(PUSH_PROMISE);
+        XX(PING);
+        XX(GOAWAY);
+        XX(WINDOW_UPDATE);
+        XX(CONTINUATION);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+const char* Http2ErrorToString(Http2Error err) {
+    switch(err) {
+#define XX(name) \
+        case Http2Error::name: \
+            return #name;
+        XX(NO_ERROR);
+        XX(PROTOCOL_ERROR);
+        XX(INTERNAL_ERROR);
+        XX(FLOW_CONTROL_ERROR);
+        XX(SETTINGS_TIMEOUT);
+        XX(STREAM_CLOSED);
+        XX(FRAME_SIZE_ERROR);
+        XX(REFUSED_STREAM);
+        XX(CANCEL);
+        XX(COMPRESSION_ERROR);
+        XX(CONNECT_ERROR);
+        XX(ENHANCE_YOUR_CALM);
+        XX(INADEQUATE_SECURITY);
+        XX(HTTP_1_1_REQUIRED);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+static void PutUint32(char* out, uint32_t v) {
+    out[0] = (char)(v >> 24);
+    out[1] = (char)(v >> 16);
+    out[2] = (char)(v >> 8);
+    out[3] = (char)v;
+}
+
+static void AppendUint32(std::string& out, uint32_t v) {
+    char buf[4];
+    PutUint32(buf, v);
+    out.append(buf, 4);
+}
+
+void Http2FrameHeader::decode(const uint8_t* data) {
+    length = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    type = (Http2FrameType)data[3];
+    flags = data[4];
+    // 最高位保留, 忽略
+    streamId = (((uint32_t)data[5] << 24) | ((uint32_t)data[6] << 16)
+                | ((uint32_t)data[7] << 8) | data[8]) & 0x7fffffff;
+}
+
+void Http2FrameHeader::encode(char* out) const {
+    out[0] = (char)(length >> 16);
+    out[1] = (char)(length >> 8);
+    out[2] = (char)length;
+    out[3] = (char)type;
+    out[4] = (char)flags;
+    PutUint32(out + 5, streamId & 0x7fffffff);
+}
+
+std::string Http2FrameHeader::toString() const {
+    std::stringstream ss;
+    ss << "[" << Http2FrameTypeToString(type) << " stream=" << streamId
+       << " length=" << length << " flags=0x" << std::hex << (int)flags << "]";
+    return ss.str();
+}
+
+void Http2AppendFrameHeader(std::string& out, Http2FrameType type, uint8_t flags
+                            ,uint32_t stream_id, size_t length) {
+    Http2FrameHeader fh;
+    fh.length = length;
+    fh.type = type;
+    fh.flags = flags;
+    fh.streamId = stream_id;
+    char buf[HTTP2_FRAME_HEADER_SIZE];
+    fh.encode(buf);
+    out.append(buf, sizeof(buf));
+}
+
+void Http2AppendFrame(std::string& out, Http2FrameType type, uint8_t flags
+                      ,uint32_t stream_id, const void* payload, size_t length) {
+    Http2AppendFrameHeader(out, type, flags, stream_id, length);
+    if(length) {
+        out.append((const char*)payload, length);
+    }
+}
+
+void Http2AppendHeaders(std::string& out, uint32_t stream_id, const std::string& block
+                        ,bool end_stream, size_t max_frame_size) {
+    size_t len = std::min(block.size(), max_frame_size);
+    uint8_t flags = end_stream ? HTTP2_FLAG_END_STREAM : 0;
+    if(len == block.size()) {
+        flags |= HTTP2_FLAG_END_HEADERS;
+    }
+    Http2AppendFrame(out, Http2FrameType::HEADERS, flags, stream_id, block.data(), len);
+    for(size_t pos = len; pos < block.size(); pos += len) {
+        len = std::min(block.size() - pos, max_frame_size);
+        Http2AppendFrame(out, Http2FrameType::CONTINUATION
+                ,pos + len == block.size() ? HTTP2_FLAG_END_HEADERS : 0
+                ,stream_id, block.data() + pos, len);
+    }
+}
+
+void Http2AppendSetting(std::string& payload, Http2Setting id, uint32_t value) {
+    payload.push_back((char)((uint16_t)id >> 8));
+    payload.push_back((char)((uint16_t)id & 0xff));
+    AppendUint32(payload, value);
+}
+
+void Http2AppendWindowUpdate(std::string& out, uint32_t stream_id, uint32_t increment) {
+    Http2AppendFrameHeader(out, Http2FrameType::WINDOW_UPDATE, 0, stream_id, 4);
+    AppendUint32(out, increment & 0x7fffffff);
+}
+
+void Http2AppendRstStream(std::string& out, uint32_t stream_id, Http2Error err) {
+    Http2AppendFrameHeader(out, Http2FrameType::RST_STREAM, 0, stream_id, 4);
+    AppendUint32(out, (uint32_t)err);
+}
+
+void Http2AppendGoaway(std::string& out, uint32_t last_stream_id, Http2Error err
+                       ,const std::string& debug) {
+    Http2AppendFrameHeader(out, Http2FrameType::GOAWAY, 0, 0, 8 + debug.size());
+    AppendUint32(out, last_stream_id & 0x7fffffff);
+    AppendUint32(out, (uint32_t)err);
+    out.append(debug);
+}
+
+void Http2AppendPing(std::string& out, const void* data, bool ack) {
+    Http2AppendFrame(out, Http2FrameType::PING, ack ? HTTP2_FLAG_ACK : 0, 0, data, 8);
+}
+
+}
+}
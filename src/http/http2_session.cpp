@@ -0,0 +1,1233 @@
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "http2_session.h"
+#include "http_parser.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 是否支持 HTTP/2(h2c 前言和 Upgrade)
+static MNSER::ConfigVar<bool>::ptr g_http2_enable =
+    MNSER::Config::Lookup("http2.enable", true, "http2 enable");
+
+// 每个连接同时处理的最大流数
+static MNSER::ConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams =
+    MNSER::Config::Lookup("http2.max_concurrent_streams"
+                ,(uint32_t)100, "http2 max concurrent streams");
+
+// 每个流的接收窗口, 不小于 65535
+static MNSER::ConfigVar<uint32_t>::ptr g_http2_initial_window_size =
+    MNSER::Config::Lookup("http2.initial_window_size"
+                ,(uint32_t)(1024 * 1024), "http2 stream initial window size");
+
+// 连接的接收窗口
+static MNSER::ConfigVar<uint32_t>::ptr g_http2_connection_window_size =
+    MNSER::Config::Lookup("http2.connection_window_size"
+                ,(uint32_t)(16 * 1024 * 1024), "http2 connection window size");
+
+// 接收的帧的最大长度
+static MNSER::ConfigVar<uint32_t>::ptr g_http2_max_frame_size =
+    MNSER::Config::Lookup("http2.max_frame_size"
+                ,(uint32_t)HTTP2_MIN_FRAME_SIZE, "http2 max frame size");
+
+// 流中待发送的数据超过这个值时, 发送协程等待
+static MNSER::ConfigVar<uint32_t>::ptr g_http2_stream_send_buffer =
+    MNSER::Config::Lookup("http2.stream_send_buffer"
+                ,(uint32_t)(256 * 1024), "http2 stream send buffer size");
+
+static uint32_t ClampWindow(uint32_t v) {
+    return std::min(std::max(v, (uint32_t)HTTP2_DEFAULT_WINDOW_SIZE), (uint32_t)HTTP2_MAX_WINDOW_SIZE);
+}
+
+static uint32_t ClampFrameSize(uint32_t v) {
+    return std::min(std::max(v, (uint32_t)HTTP2_MIN_FRAME_SIZE), (uint32_t)HTTP2_MAX_FRAME_SIZE);
+}
+
+// 接收缓冲每次至少读取的字节数
+static const size_t s_http2_read_size = 16 * 1024;
+
+// 写协程每次最多组装的 DATA 字节数, 避免一次 writev 太大
+static const size_t s_http2_write_batch = 64 * 1024;
+
+static uint32_t GetUint32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// HTTP/2 中不允许出现的连接相关头部
+static bool IsConnectionHeader(const std::string& name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+// 把解码出的头部转换成 HttpRequest, 格式错误返回 nullptr
+static HttpRequest::ptr CreateRequest(const HPackHeaders& headers) {
+    HttpRequest::ptr req(new HttpRequest(0x20, false));
+    bool regular_seen = false;
+    bool has_method = false;
+    bool has_path = false;
+    bool has_scheme = false;
+    std::string cookie;
+    for(auto& i : headers) {
+        const std::string& name = i.first;
+        for(char c : name) {
+            if(c >= 'A' && c <= 'Z') {
+                return nullptr;
+            }
+        }
+        if(!name.empty() && name[0] == ':') {
+            // 伪头部必须在普通头部之前
+            if(regular_seen) {
+                return nullptr;
+            }
+            if(name == ":method") {
+                HttpMethod m = StringToHttpMethod(i.second);
+                if(m == HttpMethod::INVALID_METHOD) {
+                    return nullptr;
+                }
+                req->setMethod(m);
+                has_method = true;
+            } else if(name == ":path") {
+                if(i.second.empty()) {
+                    return nullptr;
+                }
+                std::string path = i.second;
+                size_t pos = path.find('#');
+                if(pos != std::string::npos) {
+                    req->setFragment(path.substr(pos + 1));
+                    path.resize(pos);
+                }
+                pos = path.find('?');
+                if(pos != std::string::npos) {
+                    req->setQuery(path.substr(pos + 1));
+                    path.resize(pos);
+                }
+                req->setPath(path);
+                has_path = true;
+            } else if(name == ":scheme") {
+                has_scheme = true;
+            } else if(name == ":authority") {
+                if(!req->hasHeader("host")) {
+                    req->setHeader("host", i.second);
+                }
+            } else {
+                return nullptr;
+            }
+            continue;
+        }
+        regular_seen = true;
+        if(IsConnectionHeader(name) || (name == "te" && i.second != "trailers")) {
+            return nullptr;
+        }
+        if(name == "cookie") {
+            // 分开发送的 cookie 重新拼接
+            if(!cookie.empty()) {
+                cookie.append("; ");
+            }
+            cookie.append(i.second);
+        } else if(name == "host") {
+            req->setHeader(name, i.second);
+        } else {
+            std::string old = req->getHeader(name);
+            req->setHeader(name, old.empty() ? i.second : old + ", " + i.second);
+        }
+    }
+    if(!has_method || !has_path || !has_scheme) {
+        return nullptr;
+    }
+    if(!cookie.empty()) {
+        req->setHeader("cookie", cookie);
+    }
+    return req;
+}
+
+Http2Stream::Http2Stream(std::shared_ptr<Http2Session> conn, uint32_t id)
+    :HttpSession(conn->getSocket(), false)
+    ,m_conn(conn)
+    ,m_id(id) {
+}
+
+int Http2Stream::sendResponse(HttpResponse::ptr rsp, bool head) {
+    if(!encodeBody(rsp)) {
+        MS_LOG_WARN(g_logger) << "encode response body fail, encoding=" << getContentEncoding();
+    }
+    const std::string& body = rsp->getBody();
+    bool end_stream = head || body.empty();
+    rsp->setHeader("content-length", std::to_string(body.size()));
+    if(!sendHeaders(rsp, end_stream)) {
+        return -1;
+    }
+    if(!end_stream && sendData(body.data(), body.size(), true) < 0) {
+        return -1;
+    }
+    return 1;
+}
+
+HttpResponseWriter::ptr Http2Stream::createResponseWriter(HttpResponse::ptr rsp
+                                                          ,int64_t content_length) {
+    m_writer.reset(new Http2ResponseWriter(this, rsp, content_length));
+    return m_writer;
+}
+
+int Http2Stream::read(void* buffer, size_t length) {
+    Http2Session::MutexType::Lock lock(m_conn->m_mutex);
+    while(m_recvPos == m_recvBuf.size()) {
+        if(m_discard || m_reset) {
+            return -1;
+        }
+        if(m_remoteClosed) {
+            return 0;
+        }
+        if(m_conn->m_readDone) {
+            return -1;
+        }
+        m_conn->wait(m_readWaiter, lock);
+    }
+    size_t n = std::min(length, m_recvBuf.size() - m_recvPos);
+    memcpy(buffer, m_recvBuf.data() + m_recvPos, n);
+    m_recvPos += n;
+    if(m_recvPos == m_recvBuf.size()) {
+        m_recvBuf.clear();
+        m_recvPos = 0;
+    }
+    // 读走一半窗口后归还, 对端可以继续发送
+    m_recvConsumed += n;
+    if(!m_remoteClosed && m_recvConsumed >= m_conn->m_localInitialWindow / 2) {
+        Http2AppendWindowUpdate(m_conn->m_sendBuf, m_id, m_recvConsumed);
+        m_recvWindow += m_recvConsumed;
+        m_recvConsumed = 0;
+        Http2Session::Wake(m_conn->m_writeWaiter);
+    }
+    return n;
+}
+
+int Http2Stream::read(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+    if(rt > 0) {
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+int Http2Stream::write(const void* buffer, size_t length) {
+    MS_LOG_ERROR(g_logger) << "http2 stream can not write raw data, use sendResponse"
+        << " or createResponseWriter, stream=" << m_id;
+    return -1;
+}
+
+int Http2Stream::write(ByteArray::ptr ba, size_t length) {
+    return write((const void*)nullptr, length);
+}
+
+void Http2Stream::close() {
+    Http2Session::MutexType::Lock lock(m_conn->m_mutex);
+    if(!m_endSent && !m_reset) {
+        m_conn->resetStream(m_id, Http2Error::CANCEL);
+    }
+}
+
+bool Http2Stream::sendHeaders(HttpResponse::ptr rsp, bool end_stream) {
+    HPackHeaders headers;
+    headers.push_back(std::make_pair(std::string(":status")
+                ,std::to_string((uint32_t)rsp->getStatus())));
+    for(auto& i : rsp->getHeaders()) {
+        std::string name = MNSER::ToLower(i.first);
+        if(IsConnectionHeader(name)) {
+            continue;
+        }
+        headers.push_back(std::make_pair(name, i.second));
+    }
+    for(auto& i : rsp->getCookies()) {
+        headers.push_back(std::make_pair(std::string("set-cookie"), i));
+    }
+    return m_conn->submitHeaders(this, headers, end_stream);
+}
+
+int Http2Stream::sendData(const void* data, size_t length, bool end_stream) {
+    uint32_t send_buffer = *g_http2_stream_send_buffer->getValue();
+    Http2Session::MutexType::Lock lock(m_conn->m_mutex);
+    while(true) {
+        if(m_conn->m_error || m_reset || m_localClosed || !m_headersSent) {
+            return -1;
+        }
+        if(m_sendBuf.size() - m_sendPos < send_buffer) {
+            break;
+        }
+        m_conn->wait(m_sendWaiter, lock);
+    }
+    if(m_sendPos == m_sendBuf.size()) {
+        // 从空闲变为有数据, 不能用过去积累的虚拟时间抢占其它流
+        m_sendBuf.clear();
+        m_sendPos = 0;
+        m_pass = std::max(m_pass, m_conn->m_vtime);
+    } else if(m_sendPos > send_buffer) {
+        m_sendBuf.erase(0, m_sendPos);
+        m_sendPos = 0;
+    }
+    m_sendBuf.append((const char*)data, length);
+    if(end_stream) {
+        m_localClosed = true;
+    }
+    Http2Session::Wake(m_conn->m_writeWaiter);
+    return length;
+}
+
+Http2ResponseWriter::Http2ResponseWriter(Http2Stream* stream, HttpResponse::ptr rsp
+                                         ,int64_t content_length)
+    :HttpResponseWriter(stream, rsp, content_length)
+    ,m_stream(stream) {
+}
+
+bool Http2ResponseWriter::writeHeader() {
+    return m_stream->sendHeaders(m_response, false);
+}
+
+int Http2ResponseWriter::writeRaw(const void* buffer, size_t length) {
+    if(m_contentLength >= 0 && m_writeSize + length > (uint64_t)m_contentLength) {
+        MS_LOG_ERROR(g_logger) << "Http2ResponseWriter write more than content-length="
+            << m_contentLength << " write_size=" << (m_writeSize + length);
+        m_error = true;
+        return -1;
+    }
+    if(m_stream->sendData(buffer, length, false) < 0) {
+        m_error = true;
+        return -1;
+    }
+    m_writeSize += length;
+    return length;
+}
+
+int64_t Http2ResponseWriter::writeFile(int fd, off_t offset, size_t length) {
+    std::string buf(std::min(length, (size_t)s_http2_write_batch), '\0');
+    size_t left = length;
+    while(left > 0) {
+        ssize_t n = pread(fd, &buf[0], std::min(left, buf.size()), offset);
+        if(n <= 0) {
+            MS_LOG_ERROR(g_logger) << "Http2ResponseWriter pread fail, fd=" << fd
+                << " offset=" << offset << " errno=" << errno << " errstr=" << strerror(errno);
+            return -1;
+        }
+        if(m_stream->sendData(buf.data(), n, false) < 0) {
+            return -1;
+        }
+        offset += n;
+        left -= n;
+    }
+    return length;
+}
+
+bool Http2ResponseWriter::writeEnd() {
+    return m_stream->sendData(nullptr, 0, true) >= 0;
+}
+
+bool Http2Session::IsEnabled() {
+    return *g_http2_enable->getValue();
+}
+
+Http2Session::Http2Session(Socket::ptr sock, ServletDispatch::ptr dispatch
+                           ,const std::string& server_name, bool owner)
+    :SocketStream(sock, owner)
+    ,m_dispatch(dispatch)
+    ,m_serverName(server_name)
+    ,m_iom(IOManager::GetThis())
+    ,m_worker(m_iom)
+    ,m_decoder(4096)
+    ,m_encoder(4096)
+    ,m_sendWindow(HTTP2_DEFAULT_WINDOW_SIZE)
+    ,m_recvWindow(HTTP2_DEFAULT_WINDOW_SIZE)
+    ,m_peerInitialWindow(HTTP2_DEFAULT_WINDOW_SIZE)
+    ,m_peerMaxFrameSize(HTTP2_MIN_FRAME_SIZE)
+    ,m_localInitialWindow(HTTP2_DEFAULT_WINDOW_SIZE)
+    ,m_localConnWindow(HTTP2_DEFAULT_WINDOW_SIZE)
+    ,m_localMaxStreams(0)
+    ,m_localMaxFrameSize(HTTP2_MIN_FRAME_SIZE) {
+}
+
+Http2Session::~Http2Session() {
+    MS_LOG_DEBUG(g_logger) << "Http2Session::~Http2Session";
+}
+
+size_t Http2Session::getStreamCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_streams.size();
+}
+
+bool Http2Session::setUpgrade(HttpRequest::ptr req, const std::string& settings) {
+    // base64url, 没有填充
+    std::string b64 = settings;
+    for(auto& c : b64) {
+        if(c == '-') {
+            c = '+';
+        } else if(c == '_') {
+            c = '/';
+        }
+    }
+    while(b64.size() % 4) {
+        b64.push_back('=');
+    }
+    std::string payload = MNSER::Base64Decode(b64);
+    if(payload.size() % 6) {
+        return false;
+    }
+    Http2Stream::ptr stream(new Http2Stream(shared_from_this(), 1));
+    stream->m_request = req;
+    stream->m_servlet = m_dispatch->getMatchedServlet(req);
+    // 请求已经完整收到, 流 1 处于半关闭(远端)状态
+    stream->m_remoteClosed = true;
+
+    MutexType::Lock lock(m_mutex);
+    if(applySettings((const uint8_t*)payload.data(), payload.size()) != Http2Error::NO_ERROR) {
+        return false;
+    }
+    stream->m_sendWindow = m_peerInitialWindow;
+    m_streams[1] = stream;
+    m_lastStreamId = 1;
+    m_upgradeStream = stream;
+    return true;
+}
+
+bool Http2Session::fill(size_t n) {
+    while(m_recvBuf.size() - m_recvPos < n) {
+        if(m_recvPos > 0) {
+            m_recvBuf.erase(0, m_recvPos);
+            m_recvPos = 0;
+        }
+        size_t old = m_recvBuf.size();
+        m_recvBuf.resize(old + std::max(s_http2_read_size, n));
+        int rt = SocketStream::read(&m_recvBuf[old], m_recvBuf.size() - old);
+        if(rt <= 0) {
+            m_recvBuf.resize(old);
+            return false;
+        }
+        m_recvBuf.resize(old + rt);
+    }
+    return true;
+}
+
+void Http2Session::run() {
+    if(!fill(HTTP2_PREFACE_SIZE)
+            || memcmp(m_recvBuf.data() + m_recvPos, HTTP2_PREFACE, HTTP2_PREFACE_SIZE) != 0) {
+        MS_LOG_DEBUG(g_logger) << "http2 invalid preface";
+        return;
+    }
+    m_recvPos += HTTP2_PREFACE_SIZE;
+
+    {
+        // 服务端的 SETTINGS, 连接窗口通过 WINDOW_UPDATE 扩大
+        MutexType::Lock lock(m_mutex);
+        m_localInitialWindow = ClampWindow(*g_http2_initial_window_size->getValue());
+        m_localConnWindow = ClampWindow(*g_http2_connection_window_size->getValue());
+        m_localMaxStreams = *g_http2_max_concurrent_streams->getValue();
+        m_localMaxFrameSize = ClampFrameSize(*g_http2_max_frame_size->getValue());
+        std::string payload;
+        Http2AppendSetting(payload, Http2Setting::MAX_CONCURRENT_STREAMS, m_localMaxStreams);
+        Http2AppendSetting(payload, Http2Setting::INITIAL_WINDOW_SIZE, m_localInitialWindow);
+        Http2AppendSetting(payload, Http2Setting::MAX_FRAME_SIZE, m_localMaxFrameSize);
+        Http2AppendSetting(payload, Http2Setting::MAX_HEADER_LIST_SIZE
+                    ,HttpRequestParser::GetHttpRequestBufferSize());
+        Http2AppendFrame(m_sendBuf, Http2FrameType::SETTINGS, 0, 0, payload.data(), payload.size());
+        if(m_localConnWindow > HTTP2_DEFAULT_WINDOW_SIZE) {
+            Http2AppendWindowUpdate(m_sendBuf, 0, m_localConnWindow - HTTP2_DEFAULT_WINDOW_SIZE);
+            m_recvWindow = m_localConnWindow;
+        }
+        // 流 1 的窗口在升级时还没有通告, 按协议默认值计算
+        if(m_upgradeStream) {
+            m_upgradeStream->m_recvWindow = HTTP2_DEFAULT_WINDOW_SIZE;
+            dispatch(m_upgradeStream);
+            m_upgradeStream.reset();
+        }
+    }
+    m_iom->schedule(std::bind(&Http2Session::writeLoop, shared_from_this()));
+
+    while(true) {
+        if(!fill(HTTP2_FRAME_HEADER_SIZE)) {
+            break;
+        }
+        Http2FrameHeader fh;
+        fh.decode((const uint8_t*)m_recvBuf.data() + m_recvPos);
+        if(fh.length > m_localMaxFrameSize) {
+            connectionError(Http2Error::FRAME_SIZE_ERROR, "frame too large");
+            break;
+        }
+        if(!fill(HTTP2_FRAME_HEADER_SIZE + fh.length)) {
+            break;
+        }
+        const uint8_t* payload = (const uint8_t*)m_recvBuf.data() + m_recvPos + HTTP2_FRAME_HEADER_SIZE;
+        m_recvPos += HTTP2_FRAME_HEADER_SIZE + fh.length;
+        if(!handleFrame(fh, payload)) {
+            break;
+        }
+    }
+
+    MutexType::Lock lock(m_mutex);
+    m_readDone = true;
+    if(!m_goawaySent) {
+        Http2AppendGoaway(m_sendBuf, m_lastStreamId, Http2Error::NO_ERROR);
+        m_goawaySent = true;
+    }
+    // 不再读取, 请求还没有收完的流重置, 已经收完的流在 GOAWAY 的 last-stream-id 之内,
+    // 按现有的窗口继续发送响应, 窗口用完时由写协程重置
+    std::vector<uint32_t> ids;
+    for(auto& i : m_streams) {
+        if(!i.second->m_remoteClosed) {
+            ids.push_back(i.first);
+        }
+    }
+    for(auto id : ids) {
+        resetStream(id, Http2Error::CANCEL);
+    }
+    resetStalledStreams();
+    Wake(m_writeWaiter);
+    // 写协程发送完剩下的响应, 等正在处理的请求都返回后退出
+    while(!m_writerExited) {
+        wait(m_runWaiter, lock);
+    }
+}
+
+bool Http2Session::handleFrame(const Http2FrameHeader& fh, const uint8_t* payload) {
+    MS_LOG_DEBUG(g_logger) << "http2 recv " << fh.toString();
+    if(m_headerStream && fh.type != Http2FrameType::CONTINUATION) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "expect CONTINUATION");
+    }
+    switch(fh.type) {
+        case Http2FrameType::DATA:
+            return onData(fh, payload);
+        case Http2FrameType::HEADERS:
+            return onHeaders(fh, payload);
+        case Http2FrameType::CONTINUATION:
+            if(!m_headerStream || fh.streamId != m_headerStream) {
+                return connectionError(Http2Error::PROTOCOL_ERROR, "unexpected CONTINUATION");
+            }
+            if(m_headerBlock.size() + fh.length > HttpRequestParser::GetHttpRequestBufferSize()) {
+                return connectionError(Http2Error::ENHANCE_YOUR_CALM, "header block too large");
+            }
+            m_headerBlock.append((const char*)payload, fh.length);
+            if(fh.hasFlag(HTTP2_FLAG_END_HEADERS)) {
+                return onHeaderBlockEnd();
+            }
+            return true;
+        case Http2FrameType::PRIORITY:
+            return onPriority(fh, payload);
+        case Http2FrameType::RST_STREAM:
+            return onRstStream(fh, payload);
+        case Http2FrameType::SETTINGS:
+            return onSettings(fh, payload);
+        case Http2FrameType::PUSH_PROMISE:
+            return connectionError(Http2Error::PROTOCOL_ERROR, "client sent PUSH_PROMISE");
+        case Http2FrameType::PING:
+            return onPing(fh, payload);
+        case Http2FrameType::GOAWAY:
+            if(fh.streamId != 0) {
+                return connectionError(Http2Error::PROTOCOL_ERROR, "GOAWAY on stream");
+            }
+            {
+                // 对端不再创建新流, 继续读取以便收到 WINDOW_UPDATE
+                MutexType::Lock lock(m_mutex);
+                m_goawayReceived = true;
+            }
+            return true;
+        case Http2FrameType::WINDOW_UPDATE:
+            return onWindowUpdate(fh, payload);
+        default:
+            // 未知类型的帧忽略
+            return true;
+    }
+}
+
+bool Http2Session::onData(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.streamId == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "DATA on stream 0");
+    }
+    const uint8_t* data = payload;
+    size_t len = fh.length;
+    if(fh.hasFlag(HTTP2_FLAG_PADDED)) {
+        if(len < 1 || payload[0] >= len) {
+            return connectionError(Http2Error::PROTOCOL_ERROR, "invalid padding");
+        }
+        len -= payload[0] + 1;
+        ++data;
+    }
+
+    MutexType::Lock lock(m_mutex);
+    // 连接窗口: 数据已经放进各个流的缓冲(由流窗口限制), 随即归还
+    m_recvWindow -= fh.length;
+    if(m_recvWindow < 0) {
+        return connectionError(Http2Error::FLOW_CONTROL_ERROR, "connection window exceeded");
+    }
+    m_recvConsumed += fh.length;
+    if(m_recvConsumed >= m_localConnWindow / 2) {
+        Http2AppendWindowUpdate(m_sendBuf, 0, m_recvConsumed);
+        m_recvWindow += m_recvConsumed;
+        m_recvConsumed = 0;
+        Wake(m_writeWaiter);
+    }
+
+    auto it = m_streams.find(fh.streamId);
+    if(it == m_streams.end()) {
+        if(fh.streamId > m_lastStreamId) {
+            return connectionError(Http2Error::PROTOCOL_ERROR, "DATA on idle stream");
+        }
+        resetStream(fh.streamId, Http2Error::STREAM_CLOSED);
+        return true;
+    }
+    Http2Stream::ptr stream = it->second;
+    if(stream->m_remoteClosed) {
+        resetStream(fh.streamId, Http2Error::STREAM_CLOSED);
+        return true;
+    }
+    stream->m_recvWindow -= fh.length;
+    if(stream->m_recvWindow < 0) {
+        resetStream(fh.streamId, Http2Error::FLOW_CONTROL_ERROR);
+        return true;
+    }
+
+    // 填充, 丢弃的数据和还没有交给 servlet 的消息体不等读取, 直接归还窗口
+    uint32_t consumed = fh.length - len;
+    stream->m_recvSize += len;
+    if(stream->m_recvSize > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+        if(!stream->m_discard) {
+            MS_LOG_DEBUG(g_logger) << "http2 request body too large, stream=" << fh.streamId;
+            stream->m_discard = true;
+            stream->m_recvBuf.clear();
+            stream->m_recvPos = 0;
+            Wake(stream->m_readWaiter);
+        }
+    }
+    if(stream->m_discard) {
+        consumed = fh.length;
+    } else {
+        stream->m_recvBuf.append((const char*)data, len);
+        if(!stream->m_dispatched) {
+            consumed = fh.length;
+        }
+        Wake(stream->m_readWaiter);
+    }
+    stream->m_recvConsumed += consumed;
+
+    if(fh.hasFlag(HTTP2_FLAG_END_STREAM)) {
+        stream->m_remoteClosed = true;
+        Wake(stream->m_readWaiter);
+        if(!stream->m_dispatched) {
+            dispatch(stream);
+        }
+        tryRemoveStream(stream.get());
+    } else if(stream->m_recvConsumed >= m_localInitialWindow / 2) {
+        Http2AppendWindowUpdate(m_sendBuf, fh.streamId, stream->m_recvConsumed);
+        stream->m_recvWindow += stream->m_recvConsumed;
+        stream->m_recvConsumed = 0;
+        Wake(m_writeWaiter);
+    }
+    return true;
+}
+
+bool Http2Session::onHeaders(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.streamId == 0 || (fh.streamId & 1) == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "invalid stream id");
+    }
+    const uint8_t* p = payload;
+    size_t len = fh.length;
+    if(fh.hasFlag(HTTP2_FLAG_PADDED)) {
+        if(len < 1 || payload[0] >= len) {
+            return connectionError(Http2Error::PROTOCOL_ERROR, "invalid padding");
+        }
+        len -= payload[0] + 1;
+        ++p;
+    }
+    m_headerParent = 0;
+    m_headerWeight = 16;
+    m_headerExclusive = false;
+    if(fh.hasFlag(HTTP2_FLAG_PRIORITY)) {
+        if(len < 5) {
+            return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid priority");
+        }
+        uint32_t dep = GetUint32(p);
+        m_headerExclusive = dep >> 31;
+        m_headerParent = dep & 0x7fffffff;
+        m_headerWeight = p[4] + 1;
+        p += 5;
+        len -= 5;
+    }
+    m_headerStream = fh.streamId;
+    m_headerEndStream = fh.hasFlag(HTTP2_FLAG_END_STREAM);
+    m_headerBlock.assign((const char*)p, len);
+    if(fh.hasFlag(HTTP2_FLAG_END_HEADERS)) {
+        return onHeaderBlockEnd();
+    }
+    return true;
+}
+
+bool Http2Session::onHeaderBlockEnd() {
+    uint32_t id = m_headerStream;
+    m_headerStream = 0;
+    HPackHeaders headers;
+    // 即使流会被拒绝也要解码, 保持动态表同步
+    int rt = m_decoder.decode((const uint8_t*)m_headerBlock.data(), m_headerBlock.size(), headers
+                ,HttpRequestParser::GetHttpRequestBufferSize());
+    if(rt < 0) {
+        return connectionError(Http2Error::COMPRESSION_ERROR, "hpack decode fail");
+    }
+    bool too_large = rt > 0;
+    m_headerBlock.clear();
+
+    {
+        MutexType::Lock lock(m_mutex);
+        auto it = m_streams.find(id);
+        if(it != m_streams.end()) {
+            // 请求的 trailer, 必须结束流, 内容忽略
+            Http2Stream::ptr stream = it->second;
+            if(stream->m_remoteClosed) {
+                resetStream(id, Http2Error::STREAM_CLOSED);
+            } else if(too_large) {
+                resetStream(id, Http2Error::ENHANCE_YOUR_CALM);
+            } else if(!m_headerEndStream) {
+                resetStream(id, Http2Error::PROTOCOL_ERROR);
+            } else {
+                stream->m_remoteClosed = true;
+                Wake(stream->m_readWaiter);
+                if(!stream->m_dispatched) {
+                    dispatch(stream);
+                }
+                tryRemoveStream(stream.get());
+            }
+            return true;
+        }
+        if(id <= m_lastStreamId) {
+            return connectionError(Http2Error::STREAM_CLOSED, "HEADERS on closed stream");
+        }
+        m_lastStreamId = id;
+        if(m_goawaySent || m_streams.size() >= m_localMaxStreams) {
+            resetStream(id, Http2Error::REFUSED_STREAM);
+            return true;
+        }
+        if(too_large) {
+            // 头部过大只拒绝这个流, 回复 431 并结束流, 请求还没发完时再让对端停止发送
+            MS_LOG_DEBUG(g_logger) << "http2 request header too large, stream=" << id;
+            HPackHeaders rsp_headers;
+            rsp_headers.push_back(std::make_pair(std::string(":status")
+                        ,std::to_string((uint32_t)HttpStatus::REQUEST_HEADER_FIELDS_TOO_LARGE)));
+            std::string block;
+            m_encoder.encode(rsp_headers, block);
+            Http2AppendHeaders(m_sendBuf, id, block, true, m_peerMaxFrameSize);
+            if(!m_headerEndStream) {
+                resetStream(id, Http2Error::NO_ERROR);
+            }
+            Wake(m_writeWaiter);
+            return true;
+        }
+    }
+
+    HttpRequest::ptr req = CreateRequest(headers);
+    if(!req) {
+        MS_LOG_DEBUG(g_logger) << "http2 malformed request, stream=" << id;
+        MutexType::Lock lock(m_mutex);
+        resetStream(id, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    Http2Stream::ptr stream(new Http2Stream(shared_from_this(), id));
+    stream->m_request = req;
+    stream->m_servlet = m_dispatch->getMatchedServlet(req);
+    stream->m_recvWindow = m_localInitialWindow;
+    stream->m_remoteClosed = m_headerEndStream;
+
+    MutexType::Lock lock(m_mutex);
+    stream->m_sendWindow = m_peerInitialWindow;
+    m_streams[id] = stream;
+    if(m_headerParent == id) {
+        resetStream(id, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    setPriority(stream, m_headerParent, m_headerWeight, m_headerExclusive);
+    // 流式 servlet 收到头部就开始处理, 其余的等消息体收完
+    if(stream->m_remoteClosed || (stream->m_servlet && stream->m_servlet->isStreamBody())) {
+        dispatch(stream);
+    }
+    return true;
+}
+
+bool Http2Session::onPriority(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.streamId == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "PRIORITY on stream 0");
+    }
+    if(fh.length != 5) {
+        MutexType::Lock lock(m_mutex);
+        resetStream(fh.streamId, Http2Error::FRAME_SIZE_ERROR);
+        return true;
+    }
+    uint32_t dep = GetUint32(payload);
+    uint32_t parent = dep & 0x7fffffff;
+    MutexType::Lock lock(m_mutex);
+    if(parent == fh.streamId) {
+        resetStream(fh.streamId, Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    auto it = m_streams.find(fh.streamId);
+    if(it != m_streams.end()) {
+        setPriority(it->second, parent, payload[4] + 1, dep >> 31);
+    }
+    return true;
+}
+
+bool Http2Session::onRstStream(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.streamId == 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "RST_STREAM on stream 0");
+    }
+    if(fh.length != 4) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid RST_STREAM");
+    }
+    MutexType::Lock lock(m_mutex);
+    if(fh.streamId > m_lastStreamId) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "RST_STREAM on idle stream");
+    }
+    auto it = m_streams.find(fh.streamId);
+    if(it == m_streams.end()) {
+        return true;
+    }
+    MS_LOG_DEBUG(g_logger) << "http2 stream " << fh.streamId << " reset by peer, error="
+        << Http2ErrorToString((Http2Error)GetUint32(payload));
+    Http2Stream::ptr stream = it->second;
+    stream->m_reset = true;
+    stream->m_sendBuf.clear();
+    stream->m_sendPos = 0;
+    Wake(stream->m_readWaiter);
+    Wake(stream->m_sendWaiter);
+    m_streams.erase(it);
+    return true;
+}
+
+bool Http2Session::onSettings(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.streamId != 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "SETTINGS on stream");
+    }
+    if(fh.hasFlag(HTTP2_FLAG_ACK)) {
+        if(fh.length != 0) {
+            return connectionError(Http2Error::FRAME_SIZE_ERROR, "SETTINGS ack with payload");
+        }
+        return true;
+    }
+    if(fh.length % 6) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid SETTINGS");
+    }
+    MutexType::Lock lock(m_mutex);
+    Http2Error err = applySettings(payload, fh.length);
+    if(err != Http2Error::NO_ERROR) {
+        lock.unlock();
+        return connectionError(err, "invalid SETTINGS value");
+    }
+    Http2AppendFrame(m_sendBuf, Http2FrameType::SETTINGS, HTTP2_FLAG_ACK, 0, nullptr, 0);
+    Wake(m_writeWaiter);
+    return true;
+}
+
+Http2Error Http2Session::applySettings(const uint8_t* data, size_t length) {
+    for(size_t i = 0; i + 6 <= length; i += 6) {
+        uint16_t id = ((uint16_t)data[i] << 8) | data[i + 1];
+        uint32_t value = GetUint32(data + i + 2);
+        switch((Http2Setting)id) {
+            case Http2Setting::HEADER_TABLE_SIZE:
+                m_encoder.setMaxTableSize(value);
+                break;
+            case Http2Setting::ENABLE_PUSH:
+                // 服务端不推送, 只检查取值
+                if(value > 1) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                break;
+            case Http2Setting::INITIAL_WINDOW_SIZE: {
+                if(value > HTTP2_MAX_WINDOW_SIZE) {
+                    return Http2Error::FLOW_CONTROL_ERROR;
+                }
+                // 已有流的窗口按差值调整, 可能变成负数
+                int64_t delta = (int64_t)value - m_peerInitialWindow;
+                for(auto& s : m_streams) {
+                    s.second->m_sendWindow += delta;
+                    if(s.second->m_sendWindow > HTTP2_MAX_WINDOW_SIZE) {
+                        return Http2Error::FLOW_CONTROL_ERROR;
+                    }
+                }
+                m_peerInitialWindow = value;
+                break;
+            }
+            case Http2Setting::MAX_FRAME_SIZE:
+                if(value < HTTP2_MIN_FRAME_SIZE || value > HTTP2_MAX_FRAME_SIZE) {
+                    return Http2Error::PROTOCOL_ERROR;
+                }
+                m_peerMaxFrameSize = value;
+                break;
+            default:
+                break;
+        }
+    }
+    return Http2Error::NO_ERROR;
+}
+
+bool Http2Session::onPing(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.streamId != 0) {
+        return connectionError(Http2Error::PROTOCOL_ERROR, "PING on stream");
+    }
+    if(fh.length != 8) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid PING");
+    }
+    if(!fh.hasFlag(HTTP2_FLAG_ACK)) {
+        MutexType::Lock lock(m_mutex);
+        Http2AppendPing(m_sendBuf, payload, true);
+        Wake(m_writeWaiter);
+    }
+    return true;
+}
+
+bool Http2Session::onWindowUpdate(const Http2FrameHeader& fh, const uint8_t* payload) {
+    if(fh.length != 4) {
+        return connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid WINDOW_UPDATE");
+    }
+    uint32_t inc = GetUint32(payload) & 0x7fffffff;
+    MutexType::Lock lock(m_mutex);
+    if(fh.streamId == 0) {
+        if(inc == 0) {
+            lock.unlock();
+            return connectionError(Http2Error::PROTOCOL_ERROR, "zero WINDOW_UPDATE");
+        }
+        m_sendWindow += inc;
+        if(m_sendWindow > HTTP2_MAX_WINDOW_SIZE) {
+            lock.unlock();
+            return connectionError(Http2Error::FLOW_CONTROL_ERROR, "connection window overflow");
+        }
+    } else {
+        auto it = m_streams.find(fh.streamId);
+        if(it == m_streams.end()) {
+            // 已经关闭的流还可能收到 WINDOW_UPDATE
+            return true;
+        }
+        if(inc == 0) {
+            resetStream(fh.streamId, Http2Error::PROTOCOL_ERROR);
+            return true;
+        }
+        it->second->m_sendWindow += inc;
+        if(it->second->m_sendWindow > HTTP2_MAX_WINDOW_SIZE) {
+            resetStream(fh.streamId, Http2Error::FLOW_CONTROL_ERROR);
+            return true;
+        }
+    }
+    Wake(m_writeWaiter);
+    return true;
+}
+
+void Http2Session::setPriority(Http2Stream::ptr stream, uint32_t parent, uint32_t weight, bool exclusive) {
+    // 新的父节点是自己的后代时, 先把它移到自己原来的父节点下(RFC 7540 5.3.3)
+    auto pit = m_streams.find(parent);
+    if(pit != m_streams.end()) {
+        uint32_t cur = pit->second->m_parent;
+        for(int depth = 0; cur && depth < 64; ++depth) {
+            if(cur == stream->m_id) {
+                pit->second->m_parent = stream->m_parent;
+                break;
+            }
+            auto it = m_streams.find(cur);
+            if(it == m_streams.end()) {
+                break;
+            }
+            cur = it->second->m_parent;
+        }
+    } else {
+        // 依赖的流不存在时依赖根节点
+        parent = 0;
+    }
+    if(exclusive) {
+        for(auto& i : m_streams) {
+            if(i.second->m_parent == parent && i.second != stream) {
+                i.second->m_parent = stream->m_id;
+            }
+        }
+    }
+    stream->m_parent = parent;
+    stream->m_weight = weight;
+}
+
+void Http2Session::dispatch(Http2Stream::ptr stream) {
+    stream->m_dispatched = true;
+    ++m_activeHandlers;
+    m_worker->schedule(std::bind(&Http2Session::handleStream, shared_from_this(), stream));
+}
+
+void Http2Session::handleStream(Http2Stream::ptr stream) {
+    HttpRequest::ptr req = stream->m_request;
+    HttpResponse::ptr rsp(new HttpResponse(0x20, false));
+    rsp->setHeader("Server", m_serverName);
+
+    bool discard = false;
+    bool stream_body = stream->m_servlet && stream->m_servlet->isStreamBody();
+    {
+        MutexType::Lock lock(m_mutex);
+        discard = stream->m_discard;
+        if(!stream_body && !discard && stream->m_recvPos < stream->m_recvBuf.size()) {
+            req->setBody(stream->m_recvBuf.substr(stream->m_recvPos));
+            stream->m_recvBuf.clear();
+            stream->m_recvPos = 0;
+        }
+    }
+    if(discard) {
+        rsp->setStatus(HttpStatus::PAYLOAD_TOO_LARGE);
+        stream->sendResponse(rsp);
+    } else {
+        stream->negotiateEncoding(req);
+        if(stream_body) {
+            req->setBodyStream(stream);
+        }
+        if(stream->m_servlet) {
+            stream->m_servlet->handle(req, rsp, stream);
+        }
+        stream->finishResponse(rsp, req->getMethod() == HttpMethod::HEAD);
+    }
+    req->setBodyStream(nullptr);
+
+    MutexType::Lock lock(m_mutex);
+    // 响应已经发完而请求还没有收完, 告诉对端不用再发(RFC 7540 8.1)
+    if(!stream->m_remoteClosed && !stream->m_reset && stream->m_endSent) {
+        resetStream(stream->m_id, Http2Error::NO_ERROR);
+    }
+    --m_activeHandlers;
+    Wake(m_writeWaiter);
+}
+
+bool Http2Session::submitHeaders(Http2Stream* stream, const HPackHeaders& headers, bool end_stream) {
+    MutexType::Lock lock(m_mutex);
+    if(m_error || stream->m_reset || stream->m_headersSent) {
+        return false;
+    }
+    // 编码和入队在同一把锁内, 保证头部块按编码顺序发送
+    std::string block;
+    m_encoder.encode(headers, block);
+    Http2AppendHeaders(m_sendBuf, stream->m_id, block, end_stream, m_peerMaxFrameSize);
+    stream->m_headersSent = true;
+    if(end_stream) {
+        stream->m_localClosed = true;
+        stream->m_endSent = true;
+        tryRemoveStream(stream);
+    }
+    Wake(m_writeWaiter);
+    return true;
+}
+
+bool Http2Session::connectionError(Http2Error err, const std::string& msg) {
+    MS_LOG_DEBUG(g_logger) << "http2 connection error " << Http2ErrorToString(err) << ": " << msg;
+    MutexType::Lock lock(m_mutex);
+    if(!m_goawaySent) {
+        Http2AppendGoaway(m_sendBuf, m_lastStreamId, err, msg);
+        m_goawaySent = true;
+    }
+    // 之后只把 GOAWAY 发出去
+    for(auto& i : m_streams) {
+        i.second->m_reset = true;
+        i.second->m_sendBuf.clear();
+        i.second->m_sendPos = 0;
+        Wake(i.second->m_readWaiter);
+        Wake(i.second->m_sendWaiter);
+    }
+    m_streams.clear();
+    Wake(m_writeWaiter);
+    return false;
+}
+
+void Http2Session::resetStream(uint32_t id, Http2Error err) {
+    MS_LOG_DEBUG(g_logger) << "http2 reset stream " << id << " error=" << Http2ErrorToString(err);
+    Http2AppendRstStream(m_sendBuf, id, err);
+    auto it = m_streams.find(id);
+    if(it != m_streams.end()) {
+        Http2Stream::ptr stream = it->second;
+        stream->m_reset = true;
+        stream->m_sendBuf.clear();
+        stream->m_sendPos = 0;
+        Wake(stream->m_readWaiter);
+        Wake(stream->m_sendWaiter);
+        m_streams.erase(it);
+    }
+    Wake(m_writeWaiter);
+}
+
+void Http2Session::tryRemoveStream(Http2Stream* stream) {
+    if(stream->m_remoteClosed && stream->m_endSent) {
+        m_streams.erase(stream->m_id);
+    }
+}
+
+bool Http2Session::isSendable(Http2Stream* stream) const {
+    if(stream->m_reset || !stream->m_headersSent || stream->m_endSent) {
+        return false;
+    }
+    size_t pending = stream->m_sendBuf.size() - stream->m_sendPos;
+    if(pending == 0) {
+        // 只剩 END_STREAM 的空 DATA 帧, 不受窗口限制
+        return stream->m_localClosed;
+    }
+    return stream->m_sendWindow > 0 && m_sendWindow > 0;
+}
+
+void Http2Session::resetStalledStreams() {
+    std::vector<uint32_t> ids;
+    for(auto& i : m_streams) {
+        Http2Stream* s = i.second.get();
+        if(!s->m_reset && s->m_headersSent && !s->m_endSent
+                && s->m_sendBuf.size() > s->m_sendPos
+                && (s->m_sendWindow <= 0 || m_sendWindow <= 0)) {
+            ids.push_back(i.first);
+        }
+    }
+    for(auto id : ids) {
+        resetStream(id, Http2Error::CANCEL);
+    }
+}
+
+Http2Stream* Http2Session::nextStream() {
+    Http2Stream* best = nullptr;
+    uint64_t best_finish = 0;
+    for(auto& i : m_streams) {
+        Http2Stream* s = i.second.get();
+        if(!isSendable(s)) {
+            continue;
+        }
+        // 依赖的流还有数据可发时先发它的
+        bool blocked = false;
+        uint32_t cur = s->m_parent;
+        for(int depth = 0; cur && depth < 64; ++depth) {
+            auto it = m_streams.find(cur);
+            if(it == m_streams.end()) {
+                break;
+            }
+            if(isSendable(it->second.get())) {
+                blocked = true;
+                break;
+            }
+            cur = it->second->m_parent;
+        }
+        if(blocked) {
+            continue;
+        }
+        // 按发完一个帧后的虚拟时间比较, 起点相同时权重大的先发
+        uint64_t finish = s->m_pass + (uint64_t)HTTP2_MIN_FRAME_SIZE * 256 / s->m_weight;
+        if(!best || finish < best_finish) {
+            best = s;
+            best_finish = finish;
+        }
+    }
+    return best;
+}
+
+void Http2Session::fillData(std::string& out) {
+    size_t budget = s_http2_write_batch;
+    while(budget > 0) {
+        Http2Stream* s = nextStream();
+        if(!s) {
+            break;
+        }
+        size_t pending = s->m_sendBuf.size() - s->m_sendPos;
+        size_t n = std::min(pending, (size_t)m_peerMaxFrameSize);
+        n = std::min(n, budget);
+        if(n > 0) {
+            n = std::min(n, (size_t)std::min(m_sendWindow, s->m_sendWindow));
+        }
+        bool end = s->m_localClosed && n == pending;
+        Http2AppendFrameHeader(out, Http2FrameType::DATA, end ? HTTP2_FLAG_END_STREAM : 0
+                ,s->m_id, n);
+        out.append(s->m_sendBuf.data() + s->m_sendPos, n);
+        s->m_sendPos += n;
+        s->m_sendWindow -= n;
+        m_sendWindow -= n;
+        budget -= std::min(budget, n + HTTP2_FRAME_HEADER_SIZE);
+
+        // 加权公平调度: 发送得越多虚拟时间前进越多, 权重越大前进越慢
+        m_vtime = s->m_pass;
+        s->m_pass += (n + HTTP2_FRAME_HEADER_SIZE) * 256 / s->m_weight;
+
+        if(s->m_sendPos == s->m_sendBuf.size()) {
+            s->m_sendBuf.clear();
+            s->m_sendPos = 0;
+        }
+        if(s->m_sendBuf.size() - s->m_sendPos < *g_http2_stream_send_buffer->getValue()) {
+            Wake(s->m_sendWaiter);
+        }
+        if(end) {
+            s->m_endSent = true;
+            tryRemoveStream(s);
+        }
+    }
+}
+
+void Http2Session::writeLoop() {
+    std::string batch;
+    while(true) {
+        {
+            MutexType::Lock lock(m_mutex);
+            while(true) {
+                batch.clear();
+                if(m_error) {
+                    break;
+                }
+                batch.swap(m_sendBuf);
+                fillData(batch);
+                if(!batch.empty()) {
+                    break;
+                }
+                // 读循环结束后, 等正在处理的请求都完成再退出
+                if(m_readDone) {
+                    if(m_activeHandlers == 0) {
+                        break;
+                    }
+                    resetStalledStreams();
+                    if(!m_sendBuf.empty()) {
+                        continue;
+                    }
+                }
+                wait(m_writeWaiter, lock);
+            }
+        }
+        if(batch.empty()) {
+            break;
+        }
+        if(writeFixSize(batch.data(), batch.size()) <= 0) {
+            MS_LOG_DEBUG(g_logger) << "http2 write fail, errno=" << errno
+                << " errstr=" << strerror(errno);
+            MutexType::Lock lock(m_mutex);
+            m_error = true;
+            for(auto& i : m_streams) {
+                Wake(i.second->m_readWaiter);
+                Wake(i.second->m_sendWaiter);
+            }
+            break;
+        }
+    }
+    // 唤醒阻塞在读上的 run
+    Socket::ptr sock = getSocket();
+    if(sock) {
+        ::shutdown(sock->getSocket(), SHUT_RDWR);
+    }
+    MutexType::Lock lock(m_mutex);
+    m_writerExited = true;
+    Wake(m_runWaiter);
+}
+
+void Http2Session::wait(Http2Waiter& waiter, MutexType::Lock& lock) {
+    waiter.fiber = Fiber::GetThis();
+    waiter.scheduler = Scheduler::GetThis();
+    lock.unlock();
+    // 唤醒可能发生在 YieldToHold 之前, 调度器会等本协程让出后再执行它
+    Fiber::YieldToHold();
+    lock.lock();
+}
+
+void Http2Session::Wake(Http2Waiter& waiter) {
+    if(waiter.fiber) {
+        Fiber::ptr fiber;
+        fiber.swap(waiter.fiber);
+        waiter.scheduler->schedule(fiber);
+    }
+}
+
+}
+}
@@ -0,0 +1,273 @@
+#include <map>
+#include <sys/socket.h>
+
+#include "http/http_batch.h"
+#include "log.h"
+#include "macro.h"
+#include "util.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+static const uint64_t s_no_deadline = ~0ull;
+
+HttpBatch::HttpBatch(IOManager* iom)
+    :m_iom(iom) {
+}
+
+HttpBatch::~HttpBatch() {
+    for(auto& i : m_tasks) {
+        if(i.timer) {
+            i.timer->cancel();
+        }
+    }
+}
+
+size_t HttpBatch::add(HttpConnectionPool::ptr pool, HttpRequest::ptr req, uint64_t timeout_ms) {
+    MutexType::Lock lock(m_mutex);
+    MS_ASSERT2(!m_started, "HttpBatch::add after start");
+    m_tasks.push_back(Task());
+    Task& task = m_tasks.back();
+    task.pool = pool;
+    task.req = req;
+    task.timeout = timeout_ms;
+    return m_tasks.size() - 1;
+}
+
+bool HttpBatch::start() {
+    std::vector<Group::ptr> groups;
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_started) {
+            return false;
+        }
+        if(!m_iom) {
+            m_iom = IOManager::GetThis();
+        }
+        if(!m_iom) {
+            MS_LOG_ERROR(g_logger) << "HttpBatch::start without IOManager";
+            return false;
+        }
+        m_started = true;
+
+        // 按连接池分组, 每组最多 m_pipelineDepth 个请求
+        uint64_t now = MNSER::GetCurrentMS();
+        std::map<HttpConnectionPool*, Group::ptr> filling;
+        for(size_t i = 0; i < m_tasks.size(); ++i) {
+            Task& task = m_tasks[i];
+            task.deadline = task.timeout == s_no_deadline ? s_no_deadline : now + task.timeout;
+            Group::ptr& group = filling[task.pool.get()];
+            if(!group || group->tasks.size() >= m_pipelineDepth) {
+                group.reset(new Group);
+                group->pool = task.pool;
+                groups.push_back(group);
+            }
+            group->tasks.push_back(i);
+            ++group->pending;
+            task.group = group;
+        }
+
+        std::weak_ptr<HttpBatch> weak_self(shared_from_this());
+        for(size_t i = 0; i < m_tasks.size(); ++i) {
+            if(m_tasks[i].timeout != s_no_deadline) {
+                m_tasks[i].timer = m_iom->addConditionTimer(m_tasks[i].timeout
+                        ,std::bind(&HttpBatch::onTimeout, this, i), weak_self);
+            }
+        }
+    }
+
+    for(auto& i : groups) {
+        m_iom->schedule(std::bind(&HttpBatch::runGroup, shared_from_this(), i));
+    }
+    return true;
+}
+
+int64_t HttpBatch::next() {
+    while(true) {
+        {
+            MutexType::Lock lock(m_mutex);
+            if(!m_done.empty()) {
+                size_t idx = m_done.front();
+                m_done.pop_front();
+                return idx;
+            }
+            if(!m_started || m_doneCount == m_tasks.size()) {
+                return -1;
+            }
+            m_waiter = Fiber::GetThis();
+            m_waiterScheduler = Scheduler::GetThis();
+        }
+        // finish 可能在 YieldToHold 之前就调度了本协程, 调度器会等本协程让出后再执行它
+        Fiber::YieldToHold();
+    }
+}
+
+void HttpBatch::wait() {
+    while(next() >= 0);
+}
+
+bool HttpBatch::cancel(size_t idx) {
+    if(idx >= m_tasks.size()) {
+        return false;
+    }
+    return finish(idx, std::make_shared<HttpResult>((int)HttpResult::Error::CANCELLED
+                , nullptr, "request cancelled"), true);
+}
+
+void HttpBatch::cancelAll() {
+    for(size_t i = 0; i < m_tasks.size(); ++i) {
+        cancel(i);
+    }
+}
+
+HttpResult::ptr HttpBatch::getResult(size_t idx) {
+    MutexType::Lock lock(m_mutex);
+    return idx < m_tasks.size() ? m_tasks[idx].result : nullptr;
+}
+
+size_t HttpBatch::getDoneCount() {
+    MutexType::Lock lock(m_mutex);
+    return m_doneCount;
+}
+
+void HttpBatch::onTimeout(size_t idx) {
+    finish(idx, std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                , nullptr, "request deadline exceeded, timeout_ms:"
+                + std::to_string(m_tasks[idx].timeout)), true);
+}
+
+bool HttpBatch::finish(size_t idx, HttpResult::ptr result, bool abort) {
+    Fiber::ptr waiter;
+    Scheduler* scheduler = nullptr;
+    Timer::ptr timer;
+    {
+        MutexType::Lock lock(m_mutex);
+        Task& task = m_tasks[idx];
+        if(task.done) {
+            return false;
+        }
+        task.done = true;
+        task.result = result;
+        timer.swap(task.timer);
+        m_done.push_back(idx);
+        ++m_doneCount;
+
+        Group::ptr group = task.group;
+        if(group && --group->pending == 0 && abort && group->conn && !group->shutdown) {
+            // 组内已经没有需要等待的请求, 唤醒阻塞在这个连接上的协程
+            group->shutdown = true;
+            ::shutdown(group->conn->getSocket()->getSocket(), SHUT_RDWR);
+        }
+        waiter.swap(m_waiter);
+        scheduler = m_waiterScheduler;
+    }
+    if(timer) {
+        timer->cancel();
+    }
+    if(m_cb) {
+        m_cb(idx, result);
+    }
+    if(waiter) {
+        scheduler->schedule(waiter);
+    }
+    return true;
+}
+
+uint64_t HttpBatch::groupDeadline(Group::ptr group) {
+    MutexType::Lock lock(m_mutex);
+    uint64_t deadline = 0;
+    for(auto i : group->tasks) {
+        if(!m_tasks[i].done) {
+            deadline = std::max(deadline, m_tasks[i].deadline);
+        }
+    }
+    return deadline;
+}
+
+void HttpBatch::runGroup(Group::ptr group) {
+    HttpConnectionPool::ptr pool = group->pool;
+    HttpConnection::ptr conn = pool->getConnection();
+    if(!conn) {
+        for(auto i : group->tasks) {
+            finish(i, std::make_shared<HttpResult>((int)HttpResult::Error::POOL_GET_CONNECTION
+                    , nullptr, "pool host:" + pool->getHost()
+                    + " port:" + std::to_string(pool->getPort())));
+        }
+        return;
+    }
+
+    // 开始之前已经被取消的请求不再发送
+    std::vector<size_t> idxs;
+    std::vector<HttpRequest::ptr> reqs;
+    {
+        MutexType::Lock lock(m_mutex);
+        for(auto i : group->tasks) {
+            if(!m_tasks[i].done) {
+                idxs.push_back(i);
+                reqs.push_back(m_tasks[i].req);
+            }
+        }
+        if(idxs.empty()) {
+            return;
+        }
+        group->conn = conn;
+    }
+
+    Socket::ptr sock = conn->getSocket();
+    auto set_timeout = [this, &group, &sock]() {
+        uint64_t deadline = groupDeadline(group);
+        if(deadline == s_no_deadline) {
+            return;
+        }
+        uint64_t now = MNSER::GetCurrentMS();
+        int64_t left = deadline > now ? deadline - now : 1;
+        sock->setSendTimeout(left);
+        sock->setRecvTimeout(left);
+    };
+
+    set_timeout();
+    size_t i = 0;
+    int rt = conn->sendRequests(reqs);
+    if(rt <= 0) {
+        HttpResult::ptr result = std::make_shared<HttpResult>(rt == 0
+                ? (int)HttpResult::Error::SEND_CLOSE_BY_PEER
+                : (int)HttpResult::Error::SEND_SOCKET_ERROR
+                , nullptr, "send request fail errno=" + std::to_string(errno)
+                + " errstr=" + std::string(strerror(errno)));
+        conn->close();
+        for(; i < idxs.size(); ++i) {
+            finish(idxs[i], result);
+        }
+    }
+
+    // 响应按请求顺序返回, 已经超时/取消的请求的响应也要读掉, 后面的请求才能拿到自己的响应
+    for(; i < idxs.size(); ++i) {
+        set_timeout();
+        HttpResponse::ptr rsp = conn->recvResponse(reqs[i]->getMethod());
+        if(!rsp) {
+            break;
+        }
+        finish(idxs[i], std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok"));
+        if(rsp->isClose()) {
+            conn->close();
+            ++i;
+            break;
+        }
+    }
+    for(; i < idxs.size(); ++i) {
+        finish(idxs[i], std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                    , nullptr, "recv response fail: " + pool->getHost()
+                    + ":" + std::to_string(pool->getPort())));
+    }
+
+    MutexType::Lock lock(m_mutex);
+    group->conn.reset();
+    if(group->shutdown) {
+        conn->close();
+    }
+}
+
+}
+}
@@ -0,0 +1,279 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "http/http_body_stream.h"
+#include "log.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// chunk 头部行的最大长度
+static const size_t s_max_chunk_line = 1024;
+
+// 长度未知的消息体按这个大小分段接收, 每段读满再申请下一段, 不需要重新分配和搬移已有数据
+static const size_t s_segment_size = 16 * 1024;
+
+HttpBodyStream::HttpBodyStream(Stream* src, std::string* pending, Mode mode
+                               ,uint64_t length, uint64_t max_size)
+    :m_src(src)
+    ,m_pending(pending)
+    ,m_pendingPos(0)
+    ,m_mode(mode)
+    ,m_left(mode == LENGTH ? length : 0)
+    ,m_maxSize(max_size)
+    ,m_readSize(0)
+    ,m_finished(false)
+    ,m_error(false) {
+    if(mode == LENGTH) {
+        if(length > max_size) {
+            MS_LOG_WARN(g_logger) << "http body too large, length=" << length
+                << " max_size=" << max_size;
+            m_error = true;
+        } else if(length == 0) {
+            m_finished = true;
+        }
+    }
+}
+
+HttpBodyStream::~HttpBodyStream() {
+    compactPending();
+}
+
+void HttpBodyStream::consumePending(size_t n) {
+    m_pendingPos += n;
+    if(m_pendingPos >= m_pending->size()) {
+        // 全部消费完直接清空, 不用搬移数据
+        m_pending->clear();
+        m_pendingPos = 0;
+    }
+}
+
+void HttpBodyStream::compactPending() {
+    if(m_pendingPos > 0) {
+        m_pending->erase(0, m_pendingPos);
+        m_pendingPos = 0;
+    }
+}
+
+int HttpBodyStream::readRaw(void* buffer, size_t length) {
+    size_t left = m_pending->size() - m_pendingPos;
+    if(left > 0) {
+        size_t n = std::min(length, left);
+        memcpy(buffer, m_pending->data() + m_pendingPos, n);
+        consumePending(n);
+        return n;
+    }
+    return m_src->read(buffer, length);
+}
+
+bool HttpBodyStream::readLine(std::string& line, size_t max_len) {
+    size_t pos = m_pendingPos;
+    while(true) {
+        size_t idx = m_pending->find("\r\n", pos);
+        if(idx != std::string::npos) {
+            line.assign(*m_pending, m_pendingPos, idx - m_pendingPos);
+            consumePending(idx + 2 - m_pendingPos);
+            return true;
+        }
+        if(m_pending->size() - m_pendingPos > max_len) {
+            return false;
+        }
+        // 行跨越了两次读取, 先把已消费的部分去掉再追加
+        compactPending();
+        // 上次末尾可能是 \r, 从它开始继续查找
+        pos = m_pending->empty() ? 0 : m_pending->size() - 1;
+        char buf[4096];
+        int rt = m_src->read(buf, sizeof(buf));
+        if(rt <= 0) {
+            return false;
+        }
+        m_pending->append(buf, rt);
+    }
+}
+
+bool HttpBodyStream::nextChunk() {
+    std::string line;
+    if(!readLine(line, s_max_chunk_line)) {
+        return false;
+    }
+    // chunk-size [; chunk-ext]
+    char* end = nullptr;
+    uint64_t size = strtoull(line.c_str(), &end, 16);
+    if(end == line.c_str() || (*end && *end != ';' && *end != ' ' && *end != '\t')) {
+        MS_LOG_WARN(g_logger) << "invalid chunk size line: " << line;
+        return false;
+    }
+    if(size == 0) {
+        // 最后一个 chunk, 读完 trailer 直到空行
+        do {
+            if(!readLine(line, s_max_chunk_line)) {
+                return false;
+            }
+        } while(!line.empty());
+        m_finished = true;
+        compactPending();
+        return true;
+    }
+    if(m_readSize + size > m_maxSize) {
+        MS_LOG_WARN(g_logger) << "http chunked body too large, size="
+            << (m_readSize + size) << " max_size=" << m_maxSize;
+        return false;
+    }
+    m_left = size;
+    return true;
+}
+
+int HttpBodyStream::read(void* buffer, size_t length) {
+    if(m_error) {
+        return -1;
+    }
+    if(m_finished || length == 0) {
+        return 0;
+    }
+
+    int rt = 0;
+    switch(m_mode) {
+        case LENGTH:
+            rt = readRaw(buffer, std::min((uint64_t)length, m_left));
+            if(rt <= 0) {
+                m_error = true;
+                return -1;
+            }
+            m_left -= rt;
+            if(m_left == 0) {
+                m_finished = true;
+                compactPending();
+            }
+            break;
+        case CHUNKED:
+            if(m_left == 0) {
+                if(!nextChunk()) {
+                    m_error = true;
+                    return -1;
+                }
+                if(m_finished) {
+                    return 0;
+                }
+            }
+            rt = readRaw(buffer, std::min((uint64_t)length, m_left));
+            if(rt <= 0) {
+                m_error = true;
+                return -1;
+            }
+            m_left -= rt;
+            if(m_left == 0) {
+                // chunk 数据后面跟着 \r\n
+                std::string line;
+                if(!readLine(line, 2) || !line.empty()) {
+                    m_error = true;
+                    return -1;
+                }
+            }
+            break;
+        case UNTIL_CLOSE:
+            rt = readRaw(buffer, length);
+            if(rt == 0) {
+                m_finished = true;
+                return 0;
+            }
+            if(rt < 0) {
+                m_error = true;
+                return -1;
+            }
+            break;
+    }
+
+    m_readSize += rt;
+    if(m_readSize > m_maxSize) {
+        MS_LOG_WARN(g_logger) << "http body too large, read_size=" << m_readSize
+            << " max_size=" << m_maxSize;
+        m_error = true;
+        return -1;
+    }
+    return rt;
+}
+
+int HttpBodyStream::read(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    if(iovs.empty()) {
+        return 0;
+    }
+    int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+    if(rt > 0) {
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+int HttpBodyStream::write(const void* buffer, size_t length) {
+    return -1;
+}
+
+int HttpBodyStream::write(ByteArray::ptr ba, size_t length) {
+    return -1;
+}
+
+void HttpBodyStream::close() {
+}
+
+bool HttpBodyStream::readAll(std::string& body) {
+    if(m_error) {
+        return false;
+    }
+    if(m_mode == LENGTH) {
+        if(m_left == 0) {
+            return true;
+        }
+        // 长度已知, 一次分配好直接读入
+        size_t offset = body.size();
+        size_t left = m_left;
+        body.resize(offset + left);
+        if(readFixSize(&body[offset], left) <= 0) {
+            body.resize(offset);
+            return false;
+        }
+        return true;
+    }
+    // 长度未知, 先分段收进 ByteArray, 读完后按总长度一次拷贝出来
+    ByteArray::ptr ba(new ByteArray(s_segment_size));
+    if(!readAll(ba)) {
+        return false;
+    }
+    size_t offset = body.size();
+    body.resize(offset + ba->getSize());
+    if(ba->getSize()) {
+        ba->read(&body[offset], ba->getSize(), 0);
+    }
+    return true;
+}
+
+bool HttpBodyStream::readAll(ByteArray::ptr ba) {
+    std::vector<iovec> iovs;
+    while(!m_finished) {
+        // 直接读进 ByteArray 当前段的剩余空间
+        iovs.clear();
+        ba->getWriteBuffers(iovs, s_segment_size);
+        int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+        if(rt < 0) {
+            return false;
+        }
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return !m_error;
+}
+
+bool HttpBodyStream::discard() {
+    char buf[4096];
+    while(!m_finished) {
+        if(read(buf, sizeof(buf)) < 0) {
+            return false;
+        }
+    }
+    return !m_error;
+}
+
+}
+}
@@ -1,6 +1,11 @@
 #include "http_connection.h"
 #include "http_parser.h"
+#include "http_body_stream.h"
+#include "zlib_stream.h"
 #include "log.h"
+#include "config.h"
+#include "iomanager.h"
+#include <sched.h>
 
 namespace MNSER {
 namespace http {
@@ -24,31 +29,56 @@ HttpConnection::~HttpConnection() {
     MS_LOG_DEBUG(g_logger) << "HttpConnection::~HttpConnection";
 }
 
-HttpResponse::ptr HttpConnection::recvResponse() {
+HttpResponse::ptr HttpConnection::recvResponse(HttpMethod method) {
+    while(true) {
+        HttpResponse::ptr rsp = recvResponseHeader();
+        if(!rsp) {
+            return nullptr;
+        }
+        // 跳过 100 Continue 之类的临时响应
+        int status = (int)rsp->getStatus();
+        if(status >= 100 && status < 200 && status != 101) {
+            continue;
+        }
+        if(!recvResponseBody(rsp, method)) {
+            return nullptr;
+        }
+        return rsp;
+    }
+}
+
+HttpResponse::ptr HttpConnection::recvResponseHeader() {
     HttpResponseParser::ptr parser(new HttpResponseParser);
-    uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
-    //uint64_t buff_size = 100;
-    std::shared_ptr<char> buffer(
-            new char[buff_size + 1], [](char* ptr){
-                delete[] ptr;
-            });
-    char* data = buffer.get();
-    int offset = 0;
+    uint64_t buff_size = HttpResponseParser::GetHttpResponseBufferSize();
+    // 上一个响应多读的数据先参与解析
+    size_t offset = m_buffer.size();
+    if(offset > buff_size) {
+        buff_size = offset;
+    }
+    m_buffer.resize(buff_size + 1);
+    char* data = &m_buffer[0];
+    bool need_read = (offset == 0);
     do {
-        int len = read(data + offset, buff_size - offset);
-        if(len <= 0) {
-            close();
-            return nullptr;
+        if(need_read) {
+            int len = read(data + offset, buff_size - offset);
+            if(len <= 0) {
+                m_buffer.clear();
+                close();
+                return nullptr;
+            }
+            offset += len;
         }
-        len += offset;
-        data[len] = '\0';
-        size_t nparse = parser->execute(data, len, false);
+        need_read = true;
+        data[offset] = '\0';
+        size_t nparse = parser->execute(data, offset, false);
         if(parser->hasError()) {
+            m_buffer.clear();
             close();
             return nullptr;
         }
-        offset = len - nparse;
-        if(offset == (int)buff_size) {
+        offset -= nparse;
+        if(offset == buff_size) {
+            m_buffer.clear();
             close();
             return nullptr;
         }
@@ -56,104 +86,92 @@ HttpResponse::ptr HttpConnection::recvResponse() {
             break;
         }
     } while(true);
-    auto& client_parser = parser->getParser();
+    m_buffer.resize(offset);    // 剩下的是消息体或下一个响应的数据
+
+    HttpResponse::ptr rsp = parser->getData();
+    std::string conn = rsp->getHeader("connection");
+    if(rsp->getVersion() == 0x10) {
+        rsp->setClose(strcasecmp(conn.c_str(), "keep-alive") != 0);
+    } else {
+        rsp->setClose(strcasecmp(conn.c_str(), "close") == 0);
+    }
+    return rsp;
+}
+
+bool HttpConnection::recvResponseBody(HttpResponse::ptr rsp, HttpMethod method) {
+    int status = (int)rsp->getStatus();
+    if(method == HttpMethod::HEAD || status < 200 || status == 204 || status == 304) {
+        return true;
+    }
+    HttpBodyStream::Mode mode = HttpBodyStream::LENGTH;
+    uint64_t length = 0;
+    std::string te = rsp->getHeader("transfer-encoding");
+    if(!te.empty() && strcasestr(te.c_str(), "chunked")) {
+        mode = HttpBodyStream::CHUNKED;
+    } else if(!rsp->checkGetHeaderAs<uint64_t>("content-length", length)) {
+        if(rsp->isClose()) {
+            // 没有长度的响应读到连接关闭为止
+            mode = HttpBodyStream::UNTIL_CLOSE;
+        }
+        // 长连接上没有长度的响应按空消息体处理(旧版本的服务端空消息体不带 content-length),
+        // 否则会一直等到超时
+    }
+    uint64_t max_size = HttpResponseParser::GetHttpResponseMaxBodySize();
+    HttpBodyStream stream(this, &m_buffer, mode, length, max_size);
+    if(stream.hasError()) {
+        m_buffer.clear();
+        close();
+        return false;
+    }
+
+    // gzip/deflate 编码的消息体边读边解压, 解压后的长度同样受 max_body_size 限制
+    std::string content_encoding = rsp->getHeader("content-encoding");
+    ZlibStream::ptr zs;
+    if(strcasecmp(content_encoding.c_str(), "gzip") == 0
+            || strcasecmp(content_encoding.c_str(), "x-gzip") == 0) {
+        zs = ZlibStream::CreateGzip(false);
+    } else if(strcasecmp(content_encoding.c_str(), "deflate") == 0) {
+        zs = ZlibStream::CreateZlib(false);
+    }
+
     std::string body;
-    if(client_parser.chunked) {
-        int len = offset;
-        do {
-            bool begin = true;
-            do {
-                if(!begin || len == 0) {
-                    int rt = read(data + len, buff_size - len);
-                    if(rt <= 0) {
-                        close();
-                        return nullptr;
-                    }
-                    len += rt;
-                }
-                data[len] = '\0';
-				// 解析了 nparse 个数据
-                size_t nparse = parser->execute(data, len, true);
-                if(parser->hasError()) {
-                    close();
-                    return nullptr;
-                }
-				// 剩余长度
-                len -= nparse;
-                if(len == (int)buff_size) {  // 一个都没有解
-                    close();
-                    return nullptr;
-                }
-                begin = false;
-            } while(!parser->isFinished());
-            //len -= 2;
-            
-            MS_LOG_DEBUG(g_logger) << "content_len=" << client_parser.content_len;
-			// 有数据了
-            if(client_parser.content_len + 2 <= len) {
-                body.append(data, client_parser.content_len);
-                memmove(data, data + client_parser.content_len + 2
-                        , len - client_parser.content_len - 2);
-                len -= client_parser.content_len + 2;
-            } else {
-                body.append(data, len);
-                int left = client_parser.content_len - len + 2;
-                while(left > 0) {
-                    int rt = read(data, left > (int)buff_size ? (int)buff_size : left);
-                    if(rt <= 0) {
-                        close();
-                        return nullptr;
-                    }
-                    body.append(data, rt);
-                    left -= rt;
-                }
-                body.resize(body.size() - 2);
-                len = 0;
-            }
-        } while(!client_parser.chunks_done);
+    if(!zs) {
+        if(!stream.readAll(body)) {
+            m_buffer.clear();
+            close();
+            return false;
+        }
     } else {
-        int64_t length = parser->getContentLength();
-        if(length > 0) {
-            body.resize(length);
-
-            int len = 0;
-            if(length >= offset) {
-                memcpy(&body[0], data, offset);
-                len = offset;
-            } else {
-                memcpy(&body[0], data, length);
-                len = length;
-            }
-            length -= offset;
-            if(length > 0) {
-                if(readFixSize(&body[len], length) <= 0) {
-                    close();
-                    return nullptr;
-                }
+        zs->setMaxOutSize(max_size);
+        char buf[4096];
+        int rt = 0;
+        while((rt = stream.read(buf, sizeof(buf))) > 0) {
+            if(zs->write(buf, rt) < 0) {
+                break;
             }
         }
+        if(rt < 0 || !stream.isFinished() || zs->flush() < 0) {
+            MS_LOG_WARN(g_logger) << "recv " << content_encoding << " body fail, in_size="
+                << zs->getInSize() << " out_size=" << zs->getOutSize();
+            m_buffer.clear();
+            close();
+            return false;
+        }
+        body = zs->getResult();
+        // 已经透明解压, 去掉编码相关的头部
+        rsp->delHeader("content-encoding");
+        rsp->delHeader("content-length");
     }
     if(!body.empty()) {
-        auto content_encoding = parser->getData()->getHeader("content-encoding");
-        MS_LOG_DEBUG(g_logger) << "content_encoding: " << content_encoding
-            << " size=" << body.size();
-		// TODO
-#if 0
-        if(strcasecmp(content_encoding.c_str(), "gzip") == 0) {
-            auto zs = ZlibStream::CreateGzip(false);
-            zs->write(body.c_str(), body.size());
-            zs->flush();
-            zs->getResult().swap(body);
-        } else if(strcasecmp(content_encoding.c_str(), "deflate") == 0) {
-            auto zs = ZlibStream::CreateDeflate(false);
-            zs->write(body.c_str(), body.size());
-            zs->flush();
-            zs->getResult().swap(body);
-        }
-#endif
-        parser->getData()->setBody(body);
+        rsp->setBody(body);
     }
-    return parser->getData();
+    return true;
+}
+
+std::string HttpConnection::takeBuffer() {
+    std::string rt;
+    rt.swap(m_buffer);
+    return rt;
 }
 
 int HttpConnection::sendRequest(HttpRequest::ptr rsp) {
@@ -164,6 +182,15 @@ int HttpConnection::sendRequest(HttpRequest::ptr rsp) {
     return writeFixSize(data.c_str(), data.size());
 }
 
+int HttpConnection::sendRequests(const std::vector<HttpRequest::ptr>& reqs) {
+    std::stringstream ss;
+    for(auto& i : reqs) {
+        ss << *i;
+    }
+    std::string data = ss.str();
+    return writeFixSize(data.c_str(), data.size());
+}
+
 HttpResult::ptr HttpConnection::DoGet(const std::string& url
                             , uint64_t timeout_ms
                             , const std::map<std::string, std::string>& headers
@@ -246,6 +273,10 @@ HttpResult::ptr HttpConnection::DoRequest(HttpMethod method
     if(!has_host) {
         req->setHeader("Host", uri->getHost());
     }
+    // 响应的 gzip/deflate 编码在 recvResponse 中透明解压
+    if(req->getHeader("accept-encoding").empty()) {
+        req->setHeader("Accept-Encoding", "gzip, deflate");
+    }
     req->setBody(body);
     return DoRequest(req, uri, timeout_ms);
 }
@@ -260,9 +291,14 @@ HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req
         return std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_HOST
                 , nullptr, "invalid host: " + uri->getHost());
     }
-	// TODO
-    //Socket::ptr sock = is_ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-    Socket::ptr sock = Socket::CreateTCP(addr);
+    Socket::ptr sock;
+    if(is_ssl) {
+        SSLSocket::ptr ssl_sock = SSLSocket::CreateTCP(addr);
+        ssl_sock->setHostName(uri->getHost());
+        sock = ssl_sock;
+    } else {
+        sock = Socket::CreateTCP(addr);
+    }
     if(!sock) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::CREATE_SOCKET_ERROR
                 , nullptr, "create socket fail: " + addr->toString()
@@ -286,7 +322,7 @@ HttpResult::ptr HttpConnection::DoRequest(HttpRequest::ptr req
                     , nullptr, "send request socket error errno=" + std::to_string(errno)
                     + " errstr=" + std::string(strerror(errno)));
     }
-    auto rsp = conn->recvResponse();
+    auto rsp = conn->recvResponse(req->getMethod());
     if(!rsp) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
                     , nullptr, "recv response timeout: " + addr->toString()
@@ -309,6 +345,77 @@ HttpConnectionPool::ptr HttpConnectionPool::Create(const std::string& uri
             , max_size, max_alive_time, max_request);
 }
 
+// 空闲连接淘汰定时器的间隔
+static MNSER::ConfigVar<uint64_t>::ptr g_http_pool_evict_interval =
+    MNSER::Config::Lookup("http.connection_pool.evict_interval"
+                ,(uint64_t)1000, "http connection pool evict interval(ms)");
+
+// 有线程缓存槽的最大线程数, 超过的线程只使用共享空闲栈
+static const uint32_t s_pool_cache_threads = 64;
+static const uint32_t s_pool_nil = 0xFFFFFFFF;
+
+// 线程缓存槽的下标分配, 线程退出时归还, 之后的线程复用
+// 同时存在的线程超过 s_pool_cache_threads 时, 多出的线程没有缓存槽
+static Mutex s_pool_index_mutex;
+static std::vector<uint32_t> s_pool_free_index;
+static uint32_t s_pool_next_index = 0;
+
+struct PoolThreadIndex {
+    uint32_t index = s_pool_nil;
+    bool alloced = false;
+
+    ~PoolThreadIndex() {
+        if(index != s_pool_nil) {
+            Mutex::Lock lock(s_pool_index_mutex);
+            s_pool_free_index.push_back(index);
+        }
+    }
+};
+
+static thread_local PoolThreadIndex t_pool_thread_index;
+
+// 当前线程在线程缓存中的下标, 第一次调用时分配, 没有空闲下标时返回 s_pool_nil
+static uint32_t GetPoolThreadIndex() {
+    if(!t_pool_thread_index.alloced) {
+        t_pool_thread_index.alloced = true;
+        Mutex::Lock lock(s_pool_index_mutex);
+        if(!s_pool_free_index.empty()) {
+            t_pool_thread_index.index = s_pool_free_index.back();
+            s_pool_free_index.pop_back();
+        } else if(s_pool_next_index < s_pool_cache_threads) {
+            t_pool_thread_index.index = s_pool_next_index++;
+        }
+    }
+    return t_pool_thread_index.index;
+}
+
+// 基于下标的无锁栈, 栈顶的高 32 位是版本号, 每次修改加一, 避免 ABA
+template<class NodeType>
+static void StackPush(std::atomic<uint64_t>& head, NodeType* nodes, uint32_t idx) {
+    uint64_t old = head.load(std::memory_order_relaxed);
+    uint64_t now = 0;
+    do {
+        nodes[idx].next.store((uint32_t)old, std::memory_order_relaxed);
+        now = (((old >> 32) + 1) << 32) | idx;
+    } while(!head.compare_exchange_weak(old, now
+                , std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<class NodeType>
+static uint32_t StackPop(std::atomic<uint64_t>& head, NodeType* nodes) {
+    uint64_t old = head.load(std::memory_order_acquire);
+    uint64_t now = 0;
+    do {
+        uint32_t idx = (uint32_t)old;
+        if(idx == s_pool_nil) {
+            return s_pool_nil;
+        }
+        now = (((old >> 32) + 1) << 32) | nodes[idx].next.load(std::memory_order_relaxed);
+    } while(!head.compare_exchange_weak(old, now
+                , std::memory_order_acquire, std::memory_order_acquire));
+    return (uint32_t)old;
+}
+
 HttpConnectionPool::HttpConnectionPool(const std::string& host
                                         ,const std::string& vhost
                                         ,uint32_t port
@@ -322,33 +429,142 @@ HttpConnectionPool::HttpConnectionPool(const std::string& host
     ,m_maxSize(max_size)
     ,m_maxAliveTime(max_alive_time)
     ,m_maxRequest(max_request)
-    ,m_isHttps(is_https) {
+    ,m_isHttps(is_https)
+    ,m_nodes(new Node[max_size])
+    ,m_idle(s_pool_nil)
+    ,m_free(s_pool_nil)
+    ,m_caches(new CacheSlot[s_pool_cache_threads])
+    ,m_timerCond(new char) {
+    for(uint32_t i = 0; i < max_size; ++i) {
+        StackPush(m_free, m_nodes.get(), i);
+    }
 }
 
-HttpConnection::ptr HttpConnectionPool::getConnection() {
+HttpConnectionPool::~HttpConnectionPool() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    // 定时回调执行 evict 期间持有条件对象, 条件对象析构后不会再有淘汰在执行, 也不会再开始
+    // evict 不会让出协程, 所以不会在当前线程上等自己
+    std::weak_ptr<char> cond(m_timerCond);
+    m_timerCond.reset();
+    while(!cond.expired()) {
+        sched_yield();
+    }
+    for(uint32_t i = 0; i < s_pool_cache_threads; ++i) {
+        HttpConnection* conn = m_caches[i].conn.exchange(nullptr);
+        if(conn) {
+            destroy(conn);
+        }
+    }
+    while(HttpConnection* conn = popIdle()) {
+        destroy(conn);
+    }
+}
+
+bool HttpConnectionPool::isValid(HttpConnection* conn, uint64_t now_ms) const {
+    return conn->isConnected()
+        && now_ms < conn->m_createTime + m_maxAliveTime
+        && conn->m_request < m_maxRequest;
+}
+
+HttpConnection* HttpConnectionPool::popIdle() {
+    while(true) {
+        uint32_t idx = StackPop(m_idle, m_nodes.get());
+        if(idx == s_pool_nil) {
+            return nullptr;
+        }
+        // 和淘汰定时器竞争, 只有一方能取到连接
+        HttpConnection* conn = m_nodes[idx].conn.exchange(nullptr, std::memory_order_acquire);
+        StackPush(m_free, m_nodes.get(), idx);
+        if(conn) {
+            return conn;
+        }
+    }
+}
+
+bool HttpConnectionPool::pushIdle(HttpConnection* conn) {
+    uint32_t idx = StackPop(m_free, m_nodes.get());
+    if(idx == s_pool_nil) {
+        return false;
+    }
+    m_nodes[idx].expire.store(conn->m_createTime + m_maxAliveTime, std::memory_order_relaxed);
+    m_nodes[idx].conn.store(conn, std::memory_order_release);
+    StackPush(m_idle, m_nodes.get(), idx);
+    return true;
+}
+
+void HttpConnectionPool::destroy(HttpConnection* conn) {
+    delete conn;
+    --m_total;
+}
+
+void HttpConnectionPool::startEvictTimer() {
+    IOManager* iom = IOManager::GetThis();
+    if(!iom || m_timerStarted.exchange(true)) {
+        return;
+    }
+    m_timer = iom->addConditionTimer(*g_http_pool_evict_interval->getValue()
+            , std::bind(&HttpConnectionPool::evict, this)
+            , std::weak_ptr<char>(m_timerCond), true);
+}
+
+bool HttpConnectionPool::evictSlot(std::atomic<HttpConnection*>& slot
+                                   ,const std::atomic<uint64_t>& expire, uint64_t now_ms) {
+    HttpConnection* conn = slot.load(std::memory_order_acquire);
+    if(!conn || expire.load(std::memory_order_relaxed) > now_ms) {
+        return false;
+    }
+    // 取走之后才能访问连接, 期间槽中的连接可能已经换成了别的
+    if(!slot.compare_exchange_strong(conn, nullptr, std::memory_order_acquire)) {
+        return false;
+    }
+    if(isValid(conn, now_ms)) {
+        if(!pushIdle(conn)) {
+            destroy(conn);
+            return true;
+        }
+        return false;
+    }
+    destroy(conn);
+    return true;
+}
+
+void HttpConnectionPool::evict() {
     uint64_t now_ms = MNSER::GetCurrentMS();
-    std::vector<HttpConnection*> invalid_conns;
-    HttpConnection* ptr = nullptr;
-    MutexType::Lock lock(m_mutex);
-    while(!m_conns.empty()) {
-        auto conn = *m_conns.begin();
-        m_conns.pop_front();
-        if(!conn->isConnected()) {
-            invalid_conns.push_back(conn);
-            continue;
+    size_t evicted = 0;
+    for(uint32_t i = 0; i < m_maxSize; ++i) {
+        if(evictSlot(m_nodes[i].conn, m_nodes[i].expire, now_ms)) {
+            ++evicted;
         }
-        if((conn->m_createTime + m_maxAliveTime) > now_ms) {
-            invalid_conns.push_back(conn);
-            continue;
+    }
+    for(uint32_t i = 0; i < s_pool_cache_threads; ++i) {
+        if(evictSlot(m_caches[i].conn, m_caches[i].expire, now_ms)) {
+            ++evicted;
         }
-        ptr = conn;
-        break;
     }
-    lock.unlock();
-    for(auto i : invalid_conns) {
-        delete i;
+    if(evicted) {
+        MS_LOG_DEBUG(g_logger) << "HttpConnectionPool " << m_host << ":" << m_port
+            << " evict " << evicted << " connections, total=" << m_total;
+    }
+}
+
+HttpConnection::ptr HttpConnectionPool::getConnection() {
+    startEvictTimer();
+    uint64_t now_ms = MNSER::GetCurrentMS();
+    HttpConnection* ptr = nullptr;
+    uint32_t tidx = GetPoolThreadIndex();
+    if(tidx < s_pool_cache_threads) {
+        ptr = m_caches[tidx].conn.exchange(nullptr, std::memory_order_acquire);
+    }
+    if(!ptr) {
+        ptr = popIdle();
+    }
+    // 定时器还没来得及淘汰的连接
+    while(ptr && !isValid(ptr, now_ms)) {
+        destroy(ptr);
+        ptr = popIdle();
     }
-    m_total -= invalid_conns.size();
 
     if(!ptr) {
         IPAddress::ptr addr = Address::LookupAnyIPAddress(m_host);
@@ -357,9 +573,14 @@ HttpConnection::ptr HttpConnectionPool::getConnection() {
             return nullptr;
         }
         addr->setPort(m_port);
-		// TODO
-        //Socket::ptr sock = m_isHttps ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
-        Socket::ptr sock = Socket::CreateTCP(addr);
+        Socket::ptr sock;
+        if(m_isHttps) {
+            SSLSocket::ptr ssl_sock = SSLSocket::CreateTCP(addr);
+            ssl_sock->setHostName(m_host);
+            sock = ssl_sock;
+        } else {
+            sock = Socket::CreateTCP(addr);
+        }
         if(!sock) {
             MS_LOG_ERROR(g_logger) << "create sock fail: " << *addr;
             return nullptr;
@@ -370,6 +591,7 @@ HttpConnection::ptr HttpConnectionPool::getConnection() {
         }
 
         ptr = new HttpConnection(sock);
+        ptr->m_createTime = now_ms;
         ++m_total;
     }
     return HttpConnection::ptr(ptr, std::bind(&HttpConnectionPool::ReleasePtr
@@ -378,15 +600,25 @@ HttpConnection::ptr HttpConnectionPool::getConnection() {
 
 void HttpConnectionPool::ReleasePtr(HttpConnection* ptr, HttpConnectionPool* pool) {
     ++ptr->m_request;
-    if(!ptr->isConnected()
-            || ((ptr->m_createTime + pool->m_maxAliveTime) >= MNSER::GetCurrentMS())
-            || (ptr->m_request >= pool->m_maxRequest)) {
-        delete ptr;
-        --pool->m_total;
+    if(!pool->isValid(ptr, MNSER::GetCurrentMS())) {
+        pool->destroy(ptr);
         return;
     }
-    MutexType::Lock lock(pool->m_mutex);
-    pool->m_conns.push_back(ptr);  // 连接释放之后，再加入到池子中
+    // 先放回当前线程的缓存槽, 槽被占用再放到共享空闲栈, 都满了就关闭
+    uint32_t tidx = GetPoolThreadIndex();
+    if(tidx < s_pool_cache_threads) {
+        HttpConnection* expected = nullptr;
+        // 槽被占用时覆盖的过期时间只影响淘汰的时机, 淘汰前会重新检查
+        pool->m_caches[tidx].expire.store(ptr->m_createTime + pool->m_maxAliveTime
+                    , std::memory_order_relaxed);
+        if(pool->m_caches[tidx].conn.compare_exchange_strong(expected, ptr
+                    , std::memory_order_release)) {
+            return;
+        }
+    }
+    if(!pool->pushIdle(ptr)) {
+        pool->destroy(ptr);
+    }
 }
 
 HttpResult::ptr HttpConnectionPool::doGet(const std::string& url
@@ -434,6 +666,13 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
                                     , uint64_t timeout_ms
                                     , const std::map<std::string, std::string>& headers
                                     , const std::string& body) {
+    return doRequest(createRequest(method, url, headers, body), timeout_ms);
+}
+
+HttpRequest::ptr HttpConnectionPool::createRequest(HttpMethod method
+                                    , const std::string& url
+                                    , const std::map<std::string, std::string>& headers
+                                    , const std::string& body) const {
     HttpRequest::ptr req = std::make_shared<HttpRequest>();
     req->setPath(url);
     req->setMethod(method);
@@ -460,8 +699,11 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
             req->setHeader("Host", m_vhost);
         }
     }
+    if(req->getHeader("accept-encoding").empty()) {
+        req->setHeader("Accept-Encoding", "gzip, deflate");
+    }
     req->setBody(body);
-    return doRequest(req, timeout_ms);
+    return req;
 }
 
 HttpResult::ptr HttpConnectionPool::doRequest(HttpMethod method
@@ -501,12 +743,15 @@ HttpResult::ptr HttpConnectionPool::doRequest(HttpRequest::ptr req
                     , nullptr, "send request socket error errno=" + std::to_string(errno)
                     + " errstr=" + std::string(strerror(errno)));
     }
-    auto rsp = conn->recvResponse();
+    auto rsp = conn->recvResponse(req->getMethod());
     if(!rsp) {
         return std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
                     , nullptr, "recv response timeout: " + sock->getRemoteAddress()->toString()
                     + " timeout_ms:" + std::to_string(timeout_ms));
     }
+    if(rsp->isClose()) {
+        conn->close();
+    }
     return std::make_shared<HttpResult>((int)HttpResult::Error::OK, rsp, "ok");
 }
 
@@ -0,0 +1,351 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "http/http_file_servlet.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 文件 fd 和 stat 缓存的有效时间, 默认 5 秒
+static MNSER::ConfigVar<uint64_t>::ptr g_static_file_cache_ttl =
+    MNSER::Config::Lookup("http.static_file.cache_ttl"
+                ,(uint64_t)5000, "http static file fd/stat cache ttl(ms)");
+
+// 文件缓存的最大条目数
+static MNSER::ConfigVar<uint64_t>::ptr g_static_file_cache_size =
+    MNSER::Config::Lookup("http.static_file.cache_size"
+                ,(uint64_t)1024, "http static file fd/stat cache max entries");
+
+// 文件扩展名对应的 Content-Type
+static const char* GetContentType(const std::string& path) {
+    static const struct {
+        const char* ext;
+        const char* type;
+    } s_types[] = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm",  "text/html; charset=utf-8"},
+        {"css",  "text/css; charset=utf-8"},
+        {"js",   "application/javascript"},
+        {"json", "application/json"},
+        {"txt",  "text/plain; charset=utf-8"},
+        {"xml",  "application/xml"},
+        {"png",  "image/png"},
+        {"jpg",  "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif",  "image/gif"},
+        {"svg",  "image/svg+xml"},
+        {"ico",  "image/x-icon"},
+        {"webp", "image/webp"},
+        {"pdf",  "application/pdf"},
+        {"zip",  "application/zip"},
+        {"gz",   "application/gzip"},
+        {"mp4",  "video/mp4"},
+        {"mp3",  "audio/mpeg"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"wasm", "application/wasm"},
+    };
+    size_t pos = path.rfind('.');
+    if(pos != std::string::npos && path.find('/', pos) == std::string::npos) {
+        const char* ext = path.c_str() + pos + 1;
+        for(auto& i : s_types) {
+            if(strcasecmp(i.ext, ext) == 0) {
+                return i.type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+// HTTP 日期格式: Sun, 06 Nov 1994 08:49:37 GMT
+static std::string HttpDate(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buf, n);
+}
+
+static bool ParseHttpDate(const std::string& str, time_t& t) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(str.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if(!end) {
+        return false;
+    }
+    t = timegm(&tm);
+    return true;
+}
+
+static int FromHex(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 解析 Range: bytes=start-end, 只支持单段, 返回 -1 格式不支持(忽略 Range), 0 不可满足, 1 成功
+static int ParseRange(const std::string& range, uint64_t size
+                      ,uint64_t& start, uint64_t& end) {
+    if(strncasecmp(range.c_str(), "bytes=", 6) != 0
+            || range.find(',') != std::string::npos) {
+        return -1;
+    }
+    const char* p = range.c_str() + 6;
+    const char* dash = strchr(p, '-');
+    if(!dash) {
+        return -1;
+    }
+    char* e = nullptr;
+    if(p == dash) {
+        // bytes=-N 最后 N 个字节
+        uint64_t n = strtoull(dash + 1, &e, 10);
+        if(e == dash + 1 || *e) {
+            return -1;
+        }
+        if(n == 0 || size == 0) {
+            return 0;
+        }
+        start = n >= size ? 0 : size - n;
+        end = size - 1;
+        return 1;
+    }
+    start = strtoull(p, &e, 10);
+    if(e != dash) {
+        return -1;
+    }
+    if(*(dash + 1) == '\0') {
+        end = size - 1;
+    } else {
+        end = strtoull(dash + 1, &e, 10);
+        if(*e || end < start) {
+            return -1;
+        }
+        if(end >= size) {
+            end = size - 1;
+        }
+    }
+    if(start >= size) {
+        return 0;
+    }
+    return 1;
+}
+
+StaticFileServlet::FileInfo::~FileInfo() {
+    if(fd >= 0) {
+        ::close(fd);
+    }
+}
+
+StaticFileServlet::StaticFileServlet(const std::string& root, const std::string& prefix)
+    :Servlet("StaticFileServlet")
+    ,m_prefix(prefix) {
+    if(!FSUtil::Realpath(root, m_root)) {
+        MS_LOG_ERROR(g_logger) << "StaticFileServlet invalid root=" << root;
+        m_root = root;
+    }
+    while(m_root.size() > 1 && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+}
+
+void StaticFileServlet::clearCache() {
+    Mutex::Lock lock(m_mutex);
+    m_cache.clear();
+}
+
+bool StaticFileServlet::toLocalPath(const std::string& uri, std::string& path) const {
+    if(uri.compare(0, m_prefix.size(), m_prefix) != 0) {
+        return false;
+    }
+    std::string rel;
+    rel.reserve(uri.size() - m_prefix.size() + 1);
+    rel.push_back('/');
+    for(size_t i = m_prefix.size(); i < uri.size(); ++i) {
+        char c = uri[i];
+        if(c == '%' && i + 2 < uri.size()) {
+            int h = FromHex(uri[i + 1]);
+            int l = FromHex(uri[i + 2]);
+            if(h < 0 || l < 0) {
+                return false;
+            }
+            c = (char)(h * 16 + l);
+            i += 2;
+        }
+        if(c == '\0') {
+            return false;
+        }
+        rel.push_back(c);
+    }
+    // 不允许出现 .. 路径段
+    size_t pos = 0;
+    while((pos = rel.find("/..", pos)) != std::string::npos) {
+        if(pos + 3 == rel.size() || rel[pos + 3] == '/') {
+            return false;
+        }
+        pos += 3;
+    }
+    path = m_root + rel;
+    if(path.back() == '/') {
+        path += "index.html";
+    }
+    return true;
+}
+
+StaticFileServlet::FileInfo::ptr StaticFileServlet::getFile(const std::string& path
+                                                            ,HttpStatus& status) {
+    uint64_t now = MNSER::GetCurrentMS();
+    {
+        Mutex::Lock lock(m_mutex);
+        auto it = m_cache.find(path);
+        if(it != m_cache.end() && it->second->expire > now) {
+            return it->second;
+        }
+    }
+
+    status = HttpStatus::NOT_FOUND;
+    FileInfo::ptr info(new FileInfo);
+    info->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(info->fd < 0) {
+        if(errno == EACCES) {
+            status = HttpStatus::FORBIDDEN;
+        }
+        return nullptr;
+    }
+    if(fstat(info->fd, &info->st) != 0) {
+        return nullptr;
+    }
+    if(S_ISDIR(info->st.st_mode)) {
+        return getFile(path + "/index.html", status);
+    }
+    if(!S_ISREG(info->st.st_mode)) {
+        status = HttpStatus::FORBIDDEN;
+        return nullptr;
+    }
+    // 符号链接不能指向根目录之外
+    std::string real;
+    if(!FSUtil::Realpath(path, real) || real.compare(0, m_root.size(), m_root) != 0
+            || (real.size() > m_root.size() && real[m_root.size()] != '/')) {
+        status = HttpStatus::FORBIDDEN;
+        return nullptr;
+    }
+
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)info->st.st_mtime
+             ,(unsigned long)info->st.st_size);
+    info->etag = etag;
+    info->lastModified = HttpDate(info->st.st_mtime);
+    info->contentType = GetContentType(path);
+    uint64_t ttl = *g_static_file_cache_ttl->getValue();
+    uint64_t cache_size = *g_static_file_cache_size->getValue();
+    info->expire = now + ttl;
+
+    Mutex::Lock lock(m_mutex);
+    if(m_cache.size() >= cache_size) {
+        // 先清掉过期的, 还是放不下就全部清空
+        for(auto it = m_cache.begin(); it != m_cache.end();) {
+            if(it->second->expire <= now) {
+                it = m_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if(m_cache.size() >= cache_size) {
+            m_cache.clear();
+        }
+    }
+    if(ttl > 0) {
+        m_cache[path] = info;
+    }
+    return info;
+}
+
+int32_t StaticFileServlet::handle(MNSER::http::HttpRequest::ptr request
+                   , MNSER::http::HttpResponse::ptr response
+                   , MNSER::http::HttpSession::ptr session) {
+    HttpMethod method = request->getMethod();
+    if(method != HttpMethod::GET && method != HttpMethod::HEAD) {
+        response->setStatus(HttpStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+
+    std::string path;
+    if(!toLocalPath(request->getPath(), path)) {
+        response->setStatus(HttpStatus::FORBIDDEN);
+        return 0;
+    }
+    HttpStatus status = HttpStatus::NOT_FOUND;
+    FileInfo::ptr info = getFile(path, status);
+    if(!info) {
+        response->setStatus(status);
+        response->setBody(HttpStatusToString(status));
+        return 0;
+    }
+
+    response->setHeader("Content-Type", info->contentType);
+    response->setHeader("Accept-Ranges", "bytes");
+    response->setHeader("ETag", info->etag);
+    response->setHeader("Last-Modified", info->lastModified);
+
+    // 条件请求, If-None-Match 优先于 If-Modified-Since
+    std::string inm = request->getHeader("if-none-match");
+    if(!inm.empty()) {
+        if(inm == "*" || inm.find(info->etag) != std::string::npos) {
+            response->setStatus(HttpStatus::NOT_MODIFIED);
+            return 0;
+        }
+    } else {
+        time_t since = 0;
+        std::string ims = request->getHeader("if-modified-since");
+        if(!ims.empty() && ParseHttpDate(ims, since) && info->st.st_mtime <= since) {
+            response->setStatus(HttpStatus::NOT_MODIFIED);
+            return 0;
+        }
+    }
+
+    uint64_t size = info->st.st_size;
+    uint64_t start = 0;
+    uint64_t length = size;
+    std::string range = request->getHeader("range");
+    std::string if_range = request->getHeader("if-range");
+    if(!range.empty() && (if_range.empty() || if_range == info->etag
+                || if_range == info->lastModified)) {
+        uint64_t end = 0;
+        int rt = ParseRange(range, size, start, end);
+        if(rt == 0) {
+            response->setStatus(HttpStatus::RANGE_NOT_SATISFIABLE);
+            response->setHeader("Content-Range", "bytes */" + std::to_string(size));
+            return 0;
+        } else if(rt > 0) {
+            length = end - start + 1;
+            response->setStatus(HttpStatus::PARTIAL_CONTENT);
+            response->setHeader("Content-Range", "bytes " + std::to_string(start)
+                    + "-" + std::to_string(end) + "/" + std::to_string(size));
+        } else {
+            start = 0;
+        }
+    }
+
+    if(method == HttpMethod::HEAD) {
+        response->setHeader("content-length", std::to_string(length));
+        return 0;
+    }
+
+    auto writer = session->createResponseWriter(response, length);
+    if(writer->sendFile(info->fd, start, length) < 0) {
+        MS_LOG_DEBUG(g_logger) << "StaticFileServlet sendfile fail path=" << path
+            << " errno=" << errno << " errstr=" << strerror(errno);
+    }
+    return 0;
+}
+
+}
+}
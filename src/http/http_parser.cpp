@@ -28,59 +28,21 @@ static MNSER::ConfigVar<uint64_t>::ptr g_http_response_max_body_size =
     MNSER::Config::Lookup("http.response.max_body_size"
                 ,(uint64_t)(64 * 1024 * 1024), "http response max body size");
 
-// 因为Config::getValue要加锁，为了性能上考虑，就设置成静态变量
-static uint64_t s_http_request_buffer_size = 0;
-static uint64_t s_http_request_max_body_size = 0;
-static uint64_t s_http_response_buffer_size = 0;
-static uint64_t s_http_response_max_body_size = 0;
-
+// getValue 只是一次原子读取, 不需要再用静态变量缓存
 uint64_t HttpRequestParser::GetHttpRequestBufferSize() {
-    return s_http_request_buffer_size;
+    return *g_http_request_buffer_size->getValue();
 }
 
 uint64_t HttpRequestParser::GetHttpRequestMaxBodySize() {
-    return s_http_request_max_body_size;
+    return *g_http_request_max_body_size->getValue();
 }
 
 uint64_t HttpResponseParser::GetHttpResponseBufferSize() {
-    return s_http_response_buffer_size;
+    return *g_http_response_buffer_size->getValue();
 }
 
 uint64_t HttpResponseParser::GetHttpResponseMaxBodySize() {
-    return s_http_response_max_body_size;
-}
-
-namespace {
-struct _RequestSizeIniter {
-    _RequestSizeIniter() {
-        s_http_request_buffer_size = g_http_request_buffer_size->getValue();
-        s_http_request_max_body_size = g_http_request_max_body_size->getValue();
-        s_http_response_buffer_size = g_http_response_buffer_size->getValue();
-        s_http_response_max_body_size = g_http_response_max_body_size->getValue();
-
-        g_http_request_buffer_size->addListener(
-                [](const uint64_t& ov, const uint64_t& nv){
-                s_http_request_buffer_size = nv;
-        });
-
-        g_http_request_max_body_size->addListener(
-                [](const uint64_t& ov, const uint64_t& nv){
-                s_http_request_max_body_size = nv;
-        });
-
-        g_http_response_buffer_size->addListener(
-                [](const uint64_t& ov, const uint64_t& nv){
-                s_http_response_buffer_size = nv;
-        });
-
-        g_http_response_max_body_size->addListener(
-                [](const uint64_t& ov, const uint64_t& nv){
-                s_http_response_max_body_size = nv;
-        });
-    }
-};
-
-static _RequestSizeIniter _init;
+    return *g_http_response_max_body_size->getValue();
 }
 
 void on_request_method(void *data, const char *at, size_t length) {
@@ -1,4 +1,8 @@
 #include "http_server.h"
+#include "http_parser.h"
+#include "http2_session.h"
+#include "config.h"
+#include "log.h"
 
 
 namespace MNSER {
@@ -10,6 +14,7 @@ HttpServer::HttpServer(bool keepalive, MNSER::IOManager* worker, MNSER::IOManage
 	, m_isKeepalive(keepalive) {
 
 	m_dispatch.reset(new ServletDispatch);
+	m_wsDispatch.reset(new WSServletDispatch);
 
     m_type = "http";
 #if 0
@@ -20,6 +25,44 @@ HttpServer::HttpServer(bool keepalive, MNSER::IOManager* worker, MNSER::IOManage
 
 static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
 
+// WebSocket 心跳间隔, 0 表示不发送 ping
+static MNSER::ConfigVar<uint64_t>::ptr g_ws_ping_interval =
+    MNSER::Config::Lookup("ws.ping_interval"
+                ,(uint64_t)(30 * 1000), "websocket ping interval(ms)");
+
+// WebSocket 连接在这段时间内没有收到任何数据则关闭
+static MNSER::ConfigVar<uint64_t>::ptr g_ws_idle_timeout =
+    MNSER::Config::Lookup("ws.idle_timeout"
+                ,(uint64_t)(90 * 1000), "websocket idle timeout(ms)");
+
+// 配置中 type 为 http 的服务器由 TcpServer::Create 创建
+namespace {
+struct _HttpServerIniter {
+    _HttpServerIniter() {
+        TcpServer::RegisterCreator("http", [](const TcpServerConf& conf, IOManager* worker
+                    ,IOManager* io_worker, IOManager* accept_worker) {
+            return TcpServer::ptr(new HttpServer(conf.keepalive, worker, io_worker, accept_worker));
+        });
+    }
+};
+
+static _HttpServerIniter _init;
+}
+
+// 是否为 WebSocket 升级请求
+static bool IsWebsocketUpgrade(HttpRequest::ptr req) {
+    return req->getMethod() == HttpMethod::GET
+        && strcasestr(req->getHeader("upgrade").c_str(), "websocket")
+        && strcasestr(req->getHeader("connection").c_str(), "upgrade");
+}
+
+// 是否为 h2c 升级请求(RFC 7540 3.2)
+static bool IsH2cUpgrade(HttpRequest::ptr req) {
+    return strcasestr(req->getHeader("upgrade").c_str(), "h2c")
+        && strcasestr(req->getHeader("connection").c_str(), "upgrade")
+        && req->hasHeader("http2-settings");
+}
+
 void HttpServer::setName(const std::string& v) {
     TcpServer::setName(v);
     m_dispatch->setDefault(std::make_shared<NotFoundServlet>());
@@ -28,27 +71,160 @@ void HttpServer::setName(const std::string& v) {
 void HttpServer::handleClient(Socket::ptr client)  {
     MS_LOG_DEBUG(g_logger) << "handleClient " << *client;
     HttpSession::ptr session(new HttpSession(client));
+    // 以连接前言开头的是直接使用 HTTP/2 的客户端(prior knowledge)
+    if(Http2Session::IsEnabled() && session->peekHttp2Preface()) {
+        handleHttp2(session);
+        session->close();
+        return;
+    }
     do {
-        auto req = session->recvRequest();
+        auto req = session->recvRequestHeader();
         if(!req) {
-            MS_LOG_DEBUG(g_logger) << "recv http request fail, errno="
+            // 上游出问题时每个请求都会失败, 限制日志量
+            MS_LOG_DEBUG_LIMIT(g_logger, 10, 20) << "recv http request fail, errno="
                 << errno << " errstr=" << strerror(errno)
                 << " cliet:" << *client << " keep_alive=" << m_isKeepalive;
             break;
         }
+        // WebSocket 握手, 连接之后不再处理 http 请求
+        if(IsWebsocketUpgrade(req)) {
+            WSServlet::ptr wslt = m_wsDispatch->getWSServlet(req);
+            if(wslt) {
+                handleWebsocket(req, session, wslt);
+                break;
+            }
+        }
+        // 消息体照常按 HTTP/1.1 读取, 之后切换到 HTTP/2
+        if(Http2Session::IsEnabled() && IsH2cUpgrade(req)
+                && req->getHeaderAs<uint64_t>("content-length", 0)
+                    <= HttpRequestParser::GetHttpRequestMaxBodySize()) {
+            if(session->recvRequestBody(req)) {
+                handleHttp2(session, req);
+            }
+            break;
+        }
+        session->negotiateEncoding(req);
+
+        // 声明的消息体超过上限, 直接回复 413 并关闭连接
+        if(req->getHeaderAs<uint64_t>("content-length", 0)
+                > HttpRequestParser::GetHttpRequestMaxBodySize()) {
+            HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), true));
+            rsp->setStatus(HttpStatus::PAYLOAD_TOO_LARGE);
+            rsp->setHeader("Server", getName());
+            session->sendResponse(rsp);
+            break;
+        }
+
+        // 先匹配 servlet, 需要流式消息体的请求不预先读入消息体
+        Servlet::ptr slt = m_dispatch->getMatchedServlet(req);
+        HttpBodyStream::ptr body;
+        if(slt && slt->isStreamBody()) {
+            body = session->createBodyStream(req);
+            if(!body) {
+                break;
+            }
+            req->setBodyStream(body);
+        } else if(!session->recvRequestBody(req)) {
+            MS_LOG_DEBUG_LIMIT(g_logger, 10, 20) << "recv http request body fail, errno="
+                << errno << " errstr=" << strerror(errno)
+                << " cliet:" << *client;
+            break;
+        }
 
         HttpResponse::ptr rsp(new HttpResponse(req->getVersion()
                             ,req->isClose() || !m_isKeepalive));
         rsp->setHeader("Server", getName());
-        m_dispatch->handle(req, rsp, session);
-        session->sendResponse(rsp);
+        if(slt) {
+            // 配置了独立的处理调度器时, servlet 在处理调度器中执行, 结束后切换回 io 调度器
+            SchedulerSwitcher sw(m_worker != m_ioWorker ? m_worker : nullptr);
+            slt->handle(req, rsp, session);
+        }
+        // servlet 没有读完的消息体要丢弃掉, 连接才能继续处理下一个请求
+        if(body && !body->discard()) {
+            rsp->setClose(true);
+        }
+        // servlet 用写入器发送了响应时结束写入器, 否则发送整个响应,
+        // HEAD 请求的响应只有头部, 否则客户端会把消息体当成下一个响应
+        if(!session->finishResponse(rsp, req->getMethod() == HttpMethod::HEAD)) {
+            break;
+        }
 
-        if(!m_isKeepalive || req->isClose()) {
+        if(!m_isKeepalive || req->isClose() || rsp->isClose()) {
             break;
         }
     } while(true);
     session->close();
 }
 
+void HttpServer::handleWebsocket(HttpRequest::ptr req, HttpSession::ptr session, WSServlet::ptr slt) {
+    HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), true));
+    rsp->setHeader("Server", getName());
+    std::string key = req->getHeader("sec-websocket-key");
+    if(req->getHeader("sec-websocket-version") != "13") {
+        rsp->setStatus(HttpStatus::UPGRADE_REQUIRED);
+        rsp->setHeader("Sec-WebSocket-Version", "13");
+        session->sendResponse(rsp);
+        return;
+    }
+    if(key.empty()) {
+        rsp->setStatus(HttpStatus::BAD_REQUEST);
+        session->sendResponse(rsp);
+        return;
+    }
+
+    rsp->setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+    rsp->setWebsocket(true);
+    rsp->setHeader("Upgrade", "websocket");
+    rsp->setHeader("Connection", "Upgrade");
+    rsp->setHeader("Sec-WebSocket-Accept", WSAcceptKey(key));
+    if(session->sendResponse(rsp) <= 0) {
+        return;
+    }
+    req->setWebsocket(true);
+
+    // socket 仍由 HttpSession 持有, 握手后多读到的数据交给 WSSession
+    WSSession::ptr ws(new WSSession(session->getSocket(), false, false));
+    ws->setPending(session->takeBuffer());
+    if(slt->onConnect(req, ws) == 0) {
+        ws->startKeepalive(*g_ws_ping_interval->getValue(), *g_ws_idle_timeout->getValue());
+        while(true) {
+            WSMessage::ptr msg = ws->recvMessage();
+            if(!msg || slt->handle(req, msg, ws) != 0) {
+                break;
+            }
+        }
+        slt->onClose(req, ws);
+    }
+    ws->close();
+}
+void HttpServer::handleHttp2(HttpSession::ptr session, HttpRequest::ptr req) {
+    Http2Session::ptr h2(new Http2Session(session->getSocket(), m_dispatch, getName(), false));
+    if(m_worker) {
+        h2->setWorker(m_worker);
+    }
+    if(req) {
+        HttpResponse::ptr rsp(new HttpResponse(req->getVersion(), false));
+        rsp->setStatus(HttpStatus::SWITCHING_PROTOCOLS);
+        // 和 WebSocket 一样, Connection 头原样输出
+        rsp->setWebsocket(true);
+        rsp->setHeader("Connection", "Upgrade");
+        rsp->setHeader("Upgrade", "h2c");
+        if(!h2->setUpgrade(req, req->getHeader("http2-settings"))) {
+            rsp->setStatus(HttpStatus::BAD_REQUEST);
+            rsp->setWebsocket(false);
+            rsp->setClose(true);
+            rsp->delHeader("Connection");
+            rsp->delHeader("Upgrade");
+            session->sendResponse(rsp);
+            return;
+        }
+        if(session->sendResponse(rsp) <= 0) {
+            return;
+        }
+    }
+    h2->setPending(session->takeBuffer());
+    h2->run();
+}
+
 }
 }
@@ -1,9 +1,12 @@
 #include <fnmatch.h>
 #include "http_servlet.h"
+#include "log.h"
 
 namespace MNSER {
 namespace http {
 
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
 FunctionServlet::FunctionServlet(callback cb)
 	: Servlet("FunctionServlet")
 	, m_cb(cb) {
@@ -15,16 +18,237 @@ int32_t FunctionServlet::handle(MNSER::http::HttpRequest::ptr request
 	return m_cb(request, response, session);	
 }
 
+// 编译好的路由表, 发布之后只读
+struct ServletDispatch::RouteTable {
+    typedef std::vector<std::pair<std::string, std::string> > ParamList;
+
+    // 路由树节点, 每个节点对应路径中的一段
+    struct RouteNode {
+        std::unordered_map<std::string, std::unique_ptr<RouteNode> > children;  // 静态段
+        std::unique_ptr<RouteNode> param;       // ":name" 参数段
+        std::string paramName;
+        IServletCreator::ptr wildcard;          // "*name" 匹配剩余路径
+        std::string wildcardName;
+        IServletCreator::ptr creator;           // 路径在此结束时的servlet
+    };
+
+    // 前缀基数树节点, 存放形如 "prefix*" 的模糊匹配
+    struct PrefixNode {
+        std::string label;                      // 父节点到本节点的边
+        int index = -1;                         // 模糊匹配在 m_globs 中的序号, -1 表示没有
+        std::vector<std::unique_ptr<PrefixNode> > children;
+    };
+
+    RouteTable()
+        :routes(new RouteNode)
+        ,prefixes(new PrefixNode) {
+    }
+
+    // 编译路由规则
+    void addRoute(const std::string& pattern, IServletCreator::ptr creator) {
+        RouteNode* node = routes.get();
+        size_t pos = pattern.empty() || pattern[0] != '/' ? 0 : 1;
+        while(true) {
+            size_t end = pattern.find('/', pos);
+            if(end == std::string::npos) {
+                end = pattern.size();
+            }
+            std::string seg = pattern.substr(pos, end - pos);
+            if(!seg.empty() && seg[0] == '*') {
+                if(end != pattern.size()) {
+                    MS_LOG_ERROR(g_logger) << "route wildcard must be the last segment: " << pattern;
+                    return;
+                }
+                node->wildcard = creator;
+                node->wildcardName = seg.size() > 1 ? seg.substr(1) : seg;
+                return;
+            }
+            if(!seg.empty() && seg[0] == ':') {
+                if(!node->param) {
+                    node->param.reset(new RouteNode);
+                    node->paramName = seg.substr(1);
+                } else if(node->paramName != seg.substr(1)) {
+                    MS_LOG_WARN(g_logger) << "route " << pattern << " param " << seg
+                        << " conflicts with :" << node->paramName << ", use :" << node->paramName;
+                }
+                node = node->param.get();
+            } else {
+                std::unique_ptr<RouteNode>& child = node->children[seg];
+                if(!child) {
+                    child.reset(new RouteNode);
+                }
+                node = child.get();
+            }
+            if(end == pattern.size()) {
+                break;
+            }
+            pos = end + 1;
+        }
+        node->creator = creator;
+    }
+
+    // 编译模糊匹配, 只有末尾一个 * 的规则放进前缀树, 其他的保留给 fnmatch
+    void addGlob(size_t idx, const std::string& pattern, IServletCreator::ptr creator) {
+        globs.push_back(std::make_pair(pattern, creator));
+        if(pattern.empty() || pattern.back() != '*'
+                || pattern.find_first_of("*?[\\") != pattern.size() - 1) {
+            fallback.push_back(idx);
+            return;
+        }
+        std::string prefix = pattern.substr(0, pattern.size() - 1);
+        PrefixNode* node = prefixes.get();
+        size_t pos = 0;
+        while(pos < prefix.size()) {
+            PrefixNode* next = nullptr;
+            for(auto& c : node->children) {
+                if(c->label[0] == prefix[pos]) {
+                    next = c.get();
+                    break;
+                }
+            }
+            if(!next) {
+                std::unique_ptr<PrefixNode> leaf(new PrefixNode);
+                leaf->label = prefix.substr(pos);
+                next = leaf.get();
+                node->children.push_back(std::move(leaf));
+                node = next;
+                pos = prefix.size();
+                break;
+            }
+            // 公共前缀长度
+            size_t n = 0;
+            while(n < next->label.size() && pos + n < prefix.size()
+                    && next->label[n] == prefix[pos + n]) {
+                ++n;
+            }
+            if(n < next->label.size()) {
+                // 分裂边: next 变成 mid 的子节点
+                std::unique_ptr<PrefixNode> mid(new PrefixNode);
+                mid->label = next->label.substr(0, n);
+                for(auto& c : node->children) {
+                    if(c.get() == next) {
+                        next->label = next->label.substr(n);
+                        mid->children.push_back(std::move(c));
+                        c = std::move(mid);
+                        next = c.get();
+                        break;
+                    }
+                }
+            }
+            node = next;
+            pos += n;
+        }
+        if(node->index < 0) {
+            node->index = idx;
+        }
+    }
+
+    // 按 精确 > 路由 > 模糊 的顺序匹配, 返回匹配到的 creator, 没有返回 nullptr
+    const IServletCreator::ptr* match(const std::string& uri, ParamList* params) const {
+        auto it = exact.find(uri);
+        if(it != exact.end()) {
+            return &it->second;
+        }
+
+        ParamList tmp;
+        const IServletCreator::ptr* c = matchRoute(routes.get(), uri
+                    ,uri.empty() || uri[0] != '/' ? 0 : 1, params ? params : &tmp);
+        if(c) {
+            return c;
+        }
+
+        // 前缀树中找序号最小的匹配, 再用 fnmatch 检查序号更小的复杂规则, 和按顺序逐个匹配的结果一致
+        size_t best = globs.size();
+        const PrefixNode* node = prefixes.get();
+        size_t pos = 0;
+        while(node) {
+            if(node->index >= 0 && (size_t)node->index < best) {
+                best = node->index;
+            }
+            if(pos >= uri.size()) {
+                break;
+            }
+            const PrefixNode* next = nullptr;
+            for(auto& i : node->children) {
+                if(i->label[0] == uri[pos]) {
+                    if(uri.compare(pos, i->label.size(), i->label) == 0) {
+                        next = i.get();
+                    }
+                    break;
+                }
+            }
+            if(next) {
+                pos += next->label.size();
+            }
+            node = next;
+        }
+        for(auto idx : fallback) {
+            if(idx >= best) {
+                break;
+            }
+            if(!fnmatch(globs[idx].first.c_str(), uri.c_str(), 0)) {
+                best = idx;
+                break;
+            }
+        }
+        return best < globs.size() ? &globs[best].second : nullptr;
+    }
+
+    // 从 pos 开始匹配 node 下的路由, 静态段优先, 其次参数段, 最后通配
+    static const IServletCreator::ptr* matchRoute(const RouteNode* node, const std::string& uri
+                                            ,size_t pos, ParamList* params) {
+        if(pos > uri.size()) {
+            return node->creator ? &node->creator : nullptr;
+        }
+        size_t end = uri.find('/', pos);
+        if(end == std::string::npos) {
+            end = uri.size();
+        }
+        if(!node->children.empty()) {
+            auto it = node->children.find(uri.substr(pos, end - pos));
+            if(it != node->children.end()) {
+                const IServletCreator::ptr* c = matchRoute(it->second.get(), uri, end + 1, params);
+                if(c) {
+                    return c;
+                }
+            }
+        }
+        if(node->param && end > pos) {
+            params->push_back(std::make_pair(node->paramName, uri.substr(pos, end - pos)));
+            const IServletCreator::ptr* c = matchRoute(node->param.get(), uri, end + 1, params);
+            if(c) {
+                return c;
+            }
+            params->pop_back();
+        }
+        if(node->wildcard) {
+            params->push_back(std::make_pair(node->wildcardName, uri.substr(pos)));
+            return &node->wildcard;
+        }
+        return nullptr;
+    }
+
+    std::unordered_map<std::string, IServletCreator::ptr> exact;    // 精确匹配
+    std::unique_ptr<RouteNode> routes;                              // 路由树
+    std::unique_ptr<PrefixNode> prefixes;                           // 前缀模糊匹配树
+    std::vector<std::pair<std::string, IServletCreator::ptr> > globs;   // 全部模糊匹配, 下标即添加顺序
+    std::vector<size_t> fallback;                                   // 需要 fnmatch 的模糊匹配序号, 升序
+};
+
 ServletDispatch::ServletDispatch()
-	: Servlet("ServletDispathc") {
+	: Servlet("ServletDispathc")
+	, m_table(new RouteTable) {
 	m_default.reset(new NotFoundServlet());
 }
 
+ServletDispatch::~ServletDispatch() {
+}
+
 int32_t ServletDispatch::handle(MNSER::http::HttpRequest::ptr request
                    , MNSER::http::HttpResponse::ptr response
                    , MNSER::http::HttpSession::ptr session) {
 	// 找到匹配的servlet，然后让其执行
-    auto slt = getMatchedServlet(request->getPath());
+    auto slt = getMatchedServlet(request);
     if(slt) {
         slt->handle(request, response, session);
     }
@@ -34,12 +258,14 @@ int32_t ServletDispatch::handle(MNSER::http::HttpRequest::ptr request
 void ServletDispatch::addServlet(const std::string& uri, Servlet::ptr slt) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uri] = std::make_shared<HoldServletCreator>(slt);
+    rebuild();
 }
 
 void ServletDispatch::addServlet(const std::string& uri, FunctionServlet::callback cb) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uri] = std::make_shared<HoldServletCreator>(
                         std::make_shared<FunctionServlet>(cb));
+    rebuild();
 }
 
 void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
@@ -53,6 +279,7 @@ void ServletDispatch::addGlobServlet(const std::string& uri, Servlet::ptr slt) {
     }
     m_globs.push_back(std::make_pair(uri
                 , std::make_shared<HoldServletCreator>(slt)));
+    rebuild();
 }
 
 void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::callback cb) {
@@ -62,6 +289,7 @@ void ServletDispatch::addGlobServlet(const std::string& uri, FunctionServlet::ca
 void ServletDispatch::addServletCreator(const std::string& uri, IServletCreator::ptr creator) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas[uri] = creator;
+    rebuild();
 }
 
 void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCreator::ptr creator) {
@@ -74,11 +302,13 @@ void ServletDispatch::addGlobServletCreator(const std::string& uri, IServletCrea
         }
     }
     m_globs.push_back(std::make_pair(uri, creator));
+    rebuild();
 }
 
 void ServletDispatch::delServlet(const std::string& uri) {
     RWMutexType::WriteLock lock(m_mutex);
     m_datas.erase(uri);
+    rebuild();
 }
 
 void ServletDispatch::delGlobServlet(const std::string& uri) {
@@ -90,6 +320,40 @@ void ServletDispatch::delGlobServlet(const std::string& uri) {
             break;
         }
     }
+    rebuild();
+}
+
+void ServletDispatch::addRouteServlet(const std::string& pattern, Servlet::ptr slt) {
+    addRouteServletCreator(pattern, std::make_shared<HoldServletCreator>(slt));
+}
+
+void ServletDispatch::addRouteServlet(const std::string& pattern, FunctionServlet::callback cb) {
+    addRouteServlet(pattern, std::make_shared<FunctionServlet>(cb));
+}
+
+void ServletDispatch::addRouteServletCreator(const std::string& pattern, IServletCreator::ptr creator) {
+    RWMutexType::WriteLock lock(m_mutex);
+    for(auto it = m_routes.begin();
+            it != m_routes.end(); ++it) {
+        if(it->first == pattern) {
+            m_routes.erase(it);
+            break;
+        }
+    }
+    m_routes.push_back(std::make_pair(pattern, creator));
+    rebuild();
+}
+
+void ServletDispatch::delRouteServlet(const std::string& pattern) {
+    RWMutexType::WriteLock lock(m_mutex);
+    for(auto it = m_routes.begin();
+            it != m_routes.end(); ++it) {
+        if(it->first == pattern) {
+            m_routes.erase(it);
+            break;
+        }
+    }
+    rebuild();
 }
 
 void ServletDispatch::listAllServletCreator(std::map<std::string, IServletCreator::ptr>& infos) {
@@ -106,6 +370,13 @@ void ServletDispatch::listAllGlobServletCreator(std::map<std::string, IServletCr
     }
 }
 
+void ServletDispatch::listAllRouteServletCreator(std::map<std::string, IServletCreator::ptr>& infos) {
+    RWMutexType::ReadLock lock(m_mutex);
+    for(auto& i : m_routes) {
+        infos[i.first] = i.second;
+    }
+}
+
 Servlet::ptr ServletDispatch::getServlet(const std::string& uri) {
     RWMutexType::ReadLock lock(m_mutex);
     auto it = m_datas.find(uri);
@@ -124,18 +395,42 @@ Servlet::ptr ServletDispatch::getGlobServlet(const std::string& uri) {
 }
 
 Servlet::ptr ServletDispatch::getMatchedServlet(const std::string& uri) {
-    RWMutexType::ReadLock lock(m_mutex);
-    auto mit = m_datas.find(uri);
-    if(mit != m_datas.end()) {
-        return mit->second->get();
+    return match(uri, nullptr);
+}
+
+Servlet::ptr ServletDispatch::getMatchedServlet(HttpRequest::ptr request) {
+    std::vector<std::pair<std::string, std::string> > params;
+    Servlet::ptr slt = match(request->getPath(), &params);
+    for(auto& i : params) {
+        request->setParam(i.first, i.second);
     }
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
-        if(!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
-            return it->second->get();
+    return slt;
+}
+
+Servlet::ptr ServletDispatch::match(const std::string& uri
+                   ,std::vector<std::pair<std::string, std::string> >* params) {
+    IServletCreator::ptr creator;
+    {
+        auto table = m_table.read();
+        const IServletCreator::ptr* c = table->match(uri, params);
+        if(c) {
+            creator = *c;
         }
     }
-    return m_default;
+    // 创建 servlet 可能比较耗时, 放在读快照之外
+    return creator ? creator->get() : m_default;
+}
+
+void ServletDispatch::rebuild() {
+    RouteTable* table = new RouteTable;
+    table->exact = m_datas;
+    for(auto& i : m_routes) {
+        table->addRoute(i.first, i.second);
+    }
+    for(size_t i = 0; i < m_globs.size(); ++i) {
+        table->addGlob(i, m_globs[i].first, m_globs[i].second);
+    }
+    m_table.update(table);
 }
 
 NotFoundServlet::NotFoundServlet()
@@ -1,37 +1,201 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "http2_frame.h"
+#include "config.h"
+#include "log.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <sys/uio.h>
 
 namespace MNSER {
 namespace http {
 
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 每个线程缓存的响应头缓冲区数量和单个缓冲区保留的最大容量
+static const size_t s_header_pool_size = 16;
+static const size_t s_header_buffer_max = 64 * 1024;
+static thread_local std::vector<std::string> t_header_pool;
+
+// 从线程本地缓冲池取一个空的头部缓冲区
+static std::string TakeHeaderBuffer() {
+    std::string buf;
+    if(!t_header_pool.empty()) {
+        buf.swap(t_header_pool.back());
+        t_header_pool.pop_back();
+    } else {
+        buf.reserve(1024);
+    }
+    return buf;
+}
+
+// 归还头部缓冲区, 过大或池已满的直接释放
+static void ReturnHeaderBuffer(std::string& buf) {
+    if(buf.capacity() > s_header_buffer_max) {
+        return;
+    }
+    if(t_header_pool.size() < s_header_pool_size) {
+        buf.clear();
+        t_header_pool.push_back(std::move(buf));
+    }
+}
+
+// 是否按 Accept-Encoding 压缩响应
+static MNSER::ConfigVar<bool>::ptr g_http_gzip_enable =
+    MNSER::Config::Lookup("http.gzip.enable", true, "http response compression enable");
+
+// 消息体小于这个长度的响应不压缩, 默认 1K
+static MNSER::ConfigVar<uint64_t>::ptr g_http_gzip_min_length =
+    MNSER::Config::Lookup("http.gzip.min_length"
+                ,(uint64_t)1024, "http response compression min length");
+
+// 压缩级别 1~9, 默认 6
+static MNSER::ConfigVar<int32_t>::ptr g_http_gzip_level =
+    MNSER::Config::Lookup("http.gzip.level", (int32_t)6, "http response compression level");
+
+// 去掉两端的空白
+static std::string TrimSpace(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if(begin == std::string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+// 按 Accept-Encoding 选择编码, 优先 gzip, q=0 表示不接受
+static std::string NegotiateEncoding(const std::string& accept) {
+    bool gzip = false;
+    bool deflate = false;
+    size_t pos = 0;
+    while(pos < accept.size()) {
+        size_t end = accept.find(',', pos);
+        if(end == std::string::npos) {
+            end = accept.size();
+        }
+        std::string item = TrimSpace(accept.substr(pos, end - pos));
+        pos = end + 1;
+        std::string coding = item;
+        double q = 1;
+        size_t semi = item.find(';');
+        if(semi != std::string::npos) {
+            coding = TrimSpace(item.substr(0, semi));
+            size_t qpos = item.find("q=", semi);
+            if(qpos != std::string::npos) {
+                q = atof(item.c_str() + qpos + 2);
+            }
+        }
+        if(q <= 0) {
+            continue;
+        }
+        if(strcasecmp(coding.c_str(), "gzip") == 0
+                || strcasecmp(coding.c_str(), "x-gzip") == 0
+                || coding == "*") {
+            gzip = true;
+        } else if(strcasecmp(coding.c_str(), "deflate") == 0) {
+            deflate = true;
+        }
+    }
+    return gzip ? "gzip" : (deflate ? "deflate" : "");
+}
+
+// 响应是否值得压缩: 有消息体, 没有编码过, 内容是文本类
+static bool IsCompressible(HttpResponse::ptr rsp) {
+    int status = (int)rsp->getStatus();
+    if(status < 200 || status == 204 || status == 206 || status == 304) {
+        return false;
+    }
+    if(!rsp->getHeader("content-encoding").empty()) {
+        return false;
+    }
+    std::string type = rsp->getHeader("content-type");
+    if(type.empty()) {
+        return true;
+    }
+    static const char* s_types[] = {"text/", "json", "javascript", "xml", "svg"
+        , "x-www-form-urlencoded"};
+    for(auto i : s_types) {
+        if(strcasestr(type.c_str(), i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static ZlibStream::ptr CreateEncoder(const std::string& encoding) {
+    return ZlibStream::Create(true, 4096
+            ,encoding == "gzip" ? ZlibStream::GZIP : ZlibStream::ZLIB, *g_http_gzip_level->getValue());
+}
+
 HttpSession::HttpSession(Socket::ptr sock, bool owner)
 	: SocketStream(sock, owner) {
 }
 
+void HttpSession::negotiateEncoding(HttpRequest::ptr req) {
+    m_encoding.clear();
+    if(*g_http_gzip_enable->getValue() && req->getMethod() != HttpMethod::HEAD) {
+        m_encoding = NegotiateEncoding(req->getHeader("accept-encoding"));
+    }
+}
+
+bool HttpSession::encodeBody(HttpResponse::ptr rsp) {
+    const std::string& body = rsp->getBody();
+    if(m_encoding.empty() || body.size() < *g_http_gzip_min_length->getValue() || !IsCompressible(rsp)) {
+        return true;
+    }
+    ZlibStream::ptr zs = CreateEncoder(m_encoding);
+    if(!zs || zs->write(body.data(), body.size()) < 0 || zs->flush() < 0) {
+        return false;
+    }
+    rsp->setBody(zs->getResult());
+    rsp->setHeader("Content-Encoding", m_encoding);
+    rsp->setHeader("Vary", "Accept-Encoding");
+    return true;
+}
+
 HttpRequest::ptr HttpSession::recvRequest() {
+    HttpRequest::ptr req = recvRequestHeader();
+    if(!req || !recvRequestBody(req)) {
+        return nullptr;
+    }
+    return req;
+}
+
+HttpRequest::ptr HttpSession::recvRequestHeader() {
     HttpRequestParser::ptr parser(new HttpRequestParser);
     uint64_t buff_size = HttpRequestParser::GetHttpRequestBufferSize();
     //uint64_t buff_size = 100;
-    std::shared_ptr<char> buffer(
-            new char[buff_size], [](char* ptr){
-                delete[] ptr;
-            });
-    char* data = buffer.get();
-    int offset = 0;
+    // 上一个请求多读的数据先参与解析
+    size_t offset = m_buffer.size();
+    if(offset > buff_size) {
+        close();
+        return nullptr;
+    }
+    m_buffer.resize(buff_size);
+    char* data = &m_buffer[0];
+    bool need_read = (offset == 0);
     do {
-        int len = read(data + offset, buff_size - offset);  // 读缓存的数据
-        if(len <= 0) {
-            close();
-            return nullptr;
+        if(need_read) {
+            int len = read(data + offset, buff_size - offset);  // 读缓存的数据
+            if(len <= 0) {
+                m_buffer.clear();
+                close();
+                return nullptr;
+            }
+            offset += len;
         }
-        len += offset;
-        size_t nparse = parser->execute(data, len);  // 解析请求
+        need_read = true;
+        size_t nparse = parser->execute(data, offset);  // 解析请求
         if(parser->hasError()) {
+            m_buffer.clear();
             close();
             return nullptr;
         }
-        offset = len - nparse;
-        if(offset == (int)buff_size) { 	// 缓冲区满了
+        offset -= nparse;
+        if(offset == buff_size) { 	// 缓冲区满了
+            m_buffer.clear();
             close();
             return nullptr;
         }
@@ -39,39 +203,328 @@ HttpRequest::ptr HttpSession::recvRequest() {
             break;
         }
     } while(true);
-    int64_t length = parser->getContentLength();
-    if(length > 0) {
-        std::string body;
-        body.resize(length);
-
-        int len = 0;
-        if(length >= offset) {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-            len = length;
+    m_buffer.resize(offset);    // 剩下的是消息体或下一个请求的数据
+
+    parser->getData()->init();
+    return parser->getData();
+}
+
+HttpBodyStream::ptr HttpSession::createBodyStream(HttpRequest::ptr req) {
+    uint64_t max_size = HttpRequestParser::GetHttpRequestMaxBodySize();
+    HttpBodyStream::ptr stream;
+    std::string te = req->getHeader("transfer-encoding");
+    if(!te.empty() && strcasestr(te.c_str(), "chunked")) {
+        stream.reset(new HttpBodyStream(this, &m_buffer
+                    ,HttpBodyStream::CHUNKED, 0, max_size));
+    } else {
+        uint64_t length = req->getHeaderAs<uint64_t>("content-length", 0);
+        stream.reset(new HttpBodyStream(this, &m_buffer
+                    ,HttpBodyStream::LENGTH, length, max_size));
+    }
+    if(stream->hasError()) {
+        return nullptr;
+    }
+    if(!stream->isFinished() && !sendContinue(req)) {
+        return nullptr;
+    }
+    return stream;
+}
+
+bool HttpSession::recvRequestBody(HttpRequest::ptr req) {
+    HttpBodyStream::ptr stream = createBodyStream(req);
+    std::string body;
+    if(!stream || !stream->readAll(body)) {
+        m_buffer.clear();
+        close();
+        return false;
+    }
+    if(!body.empty()) {
+        req->setBody(body);
+    }
+    return true;
+}
+
+bool HttpSession::sendContinue(HttpRequest::ptr req) {
+    if(req->getVersion() < 0x11
+            || strcasecmp(req->getHeader("expect").c_str(), "100-continue") != 0) {
+        return true;
+    }
+    static const char s_continue[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    return writeFixSize(s_continue, sizeof(s_continue) - 1) > 0;
+}
+
+int HttpSession::sendResponse(HttpResponse::ptr rsp, bool head) {
+    // 头部写入线程本地缓冲池中取出的缓冲区, 消息体直接引用 rsp 的内存, 通过 writev 一次发出
+    // 发送过程中协程可能让出, 所以缓冲区在使用期间独占, 用完再归还
+    if(!encodeBody(rsp)) {
+        MS_LOG_WARN(g_logger) << "encode response body fail, encoding=" << m_encoding;
+    }
+    std::string header = TakeHeaderBuffer();
+    rsp->dumpHeader(header);
+
+    const std::string& body = rsp->getBody();
+    struct iovec iovs[2];
+    iovs[0].iov_base = (void*)header.data();
+    iovs[0].iov_len = header.size();
+    size_t iovcnt = 1;
+    if(!body.empty() && !head) {
+        iovs[1].iov_base = (void*)body.data();
+        iovs[1].iov_len = body.size();
+        iovcnt = 2;
+    }
+    int rt = writevFixSize(iovs, iovcnt);
+    ReturnHeaderBuffer(header);
+    return rt;
+}
+
+HttpResponseWriter::ptr HttpSession::createResponseWriter(HttpResponse::ptr rsp
+                                                          ,int64_t content_length) {
+    m_writer.reset(new HttpResponseWriter(this, rsp, content_length));
+    return m_writer;
+}
+
+bool HttpSession::finishResponse(HttpResponse::ptr rsp, bool head) {
+    if(m_writer) {
+        HttpResponseWriter::ptr writer;
+        writer.swap(m_writer);
+        return writer->finish();
+    }
+    return sendResponse(rsp, head) > 0;
+}
+
+std::string HttpSession::takeBuffer() {
+    std::string rt;
+    rt.swap(m_buffer);
+    return rt;
+}
+
+bool HttpSession::peekHttp2Preface() {
+    static const char s_preface[] = HTTP2_PREFACE;
+    while(true) {
+        size_t n = std::min(m_buffer.size(), (size_t)HTTP2_PREFACE_SIZE);
+        if(memcmp(m_buffer.data(), s_preface, n) != 0) {
+            return false;
         }
-        length -= offset;
-        if(length > 0) {
-            if(readFixSize(&body[len], length) <= 0) {
-                close();
-                return nullptr;
-            }
+        if(n == HTTP2_PREFACE_SIZE) {
+            return true;
+        }
+        // 前言的前缀, 还要继续读; 出错时交给后面的 recvRequestHeader 处理
+        size_t old = m_buffer.size();
+        m_buffer.resize(old + 4096);
+        int rt = read(&m_buffer[old], 4096);
+        m_buffer.resize(old + (rt > 0 ? rt : 0));
+        if(rt <= 0) {
+            return false;
         }
-        parser->getData()->setBody(body);
     }
+}
 
-    parser->getData()->init();
-    return parser->getData();
+HttpResponseWriter::HttpResponseWriter(HttpSession* session, HttpResponse::ptr rsp
+                                       ,int64_t content_length)
+    :m_session(session)
+    ,m_response(rsp)
+    ,m_contentLength(content_length)
+    ,m_writeSize(0)
+    ,m_chunked(false)
+    ,m_headerSent(false)
+    ,m_finished(false)
+    ,m_error(false)
+    ,m_allowEncode(true) {
+}
+
+bool HttpResponseWriter::sendHeader() {
+    if(m_headerSent) {
+        return !m_error;
+    }
+    m_headerSent = true;
+    // 消息体由写入器发送, 响应自带的 body 不再使用
+    m_response->setBody("");
+    m_response->delHeader("content-length");
+    m_response->delHeader("transfer-encoding");
+    const std::string& encoding = m_session->getContentEncoding();
+    if(m_allowEncode && !encoding.empty() && IsCompressible(m_response)
+            && (m_contentLength < 0 || (uint64_t)m_contentLength >= *g_http_gzip_min_length->getValue())) {
+        // 边写边压缩, 压缩后的长度未知, 改用 chunked(HTTP/1.0 关闭连接)
+        m_zs = CreateEncoder(encoding);
+        if(m_zs) {
+            m_zs->setOutputCallback(std::bind(&HttpResponseWriter::writeRaw, this
+                        ,std::placeholders::_1, std::placeholders::_2));
+            m_response->setHeader("Content-Encoding", encoding);
+            m_response->setHeader("Vary", "Accept-Encoding");
+            m_contentLength = -1;
+        }
+    }
+    if(m_contentLength >= 0) {
+        m_response->setHeader("content-length", std::to_string(m_contentLength));
+    } else if(m_response->getVersion() == 0x11) {
+        m_response->setHeader("transfer-encoding", "chunked");
+        m_chunked = true;
+    } else if(m_response->getVersion() < 0x11) {
+        // HTTP/1.0 不支持 chunked, 以关闭连接作为消息体结束
+        m_response->setClose(true);
+    }
+    // HTTP/2 由 DATA 帧分帧, 不需要 chunked
+    if(!writeHeader()) {
+        m_error = true;
+    }
+    return !m_error;
+}
+
+bool HttpResponseWriter::writeHeader() {
+    bool rt = true;
+    std::string header = TakeHeaderBuffer();
+    // 长度已经由 sendHeader 决定, HTTP/1.0 未知长度时以关闭连接结束
+    m_response->dumpHeader(header, false);
+    if(m_session->writeFixSize(header.data(), header.size()) <= 0) {
+        rt = false;
+    }
+    ReturnHeaderBuffer(header);
+    return rt;
+}
+
+int HttpResponseWriter::write(const void* buffer, size_t length) {
+    if(m_finished || !sendHeader()) {
+        return -1;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    if(m_zs) {
+        // 压缩后的数据通过 writeRaw 写出
+        if(m_zs->write(buffer, length) < 0) {
+            m_error = true;
+            return -1;
+        }
+        return length;
+    }
+    return writeRaw(buffer, length);
+}
 
+int HttpResponseWriter::writeRaw(const void* buffer, size_t length) {
+    if(m_contentLength >= 0 && m_writeSize + length > (uint64_t)m_contentLength) {
+        MS_LOG_ERROR(g_logger) << "HttpResponseWriter write more than content-length="
+            << m_contentLength << " write_size=" << (m_writeSize + length);
+        m_error = true;
+        return -1;
+    }
+
+    int rt = 0;
+    if(m_chunked) {
+        // chunk-size\r\n data \r\n
+        char size_line[24];
+        int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+        struct iovec iovs[3];
+        iovs[0].iov_base = size_line;
+        iovs[0].iov_len = n;
+        iovs[1].iov_base = (void*)buffer;
+        iovs[1].iov_len = length;
+        iovs[2].iov_base = (void*)"\r\n";
+        iovs[2].iov_len = 2;
+        rt = m_session->writevFixSize(iovs, 3);
+    } else {
+        rt = m_session->writeFixSize(buffer, length);
+    }
+    if(rt <= 0) {
+        m_error = true;
+        return rt;
+    }
+    m_writeSize += length;
+    return length;
+}
+
+int HttpResponseWriter::write(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getReadBuffers(iovs, length);
+    size_t total = 0;
+    for(auto& i : iovs) {
+        int rt = write(i.iov_base, i.iov_len);
+        if(rt <= 0) {
+            return rt;
+        }
+        total += rt;
+    }
+    ba->setPosition(ba->getPosition() + total);
+    return total;
+}
+
+int64_t HttpResponseWriter::sendFile(int fd, off_t offset, size_t length) {
+    // sendfile 不经过用户态, 不能压缩
+    if(!m_headerSent) {
+        m_allowEncode = false;
+    }
+    if(m_finished || !sendHeader()) {
+        return -1;
+    }
+    if(m_chunked || m_zs || (m_contentLength >= 0
+                && m_writeSize + length > (uint64_t)m_contentLength)) {
+        MS_LOG_ERROR(g_logger) << "HttpResponseWriter sendFile need known content-length"
+            << " content-length=" << m_contentLength << " write_size=" << (m_writeSize + length);
+        m_error = true;
+        return -1;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    int64_t rt = writeFile(fd, offset, length);
+    if(rt <= 0) {
+        m_error = true;
+        return rt;
+    }
+    m_writeSize += length;
+    return rt;
+}
+
+int64_t HttpResponseWriter::writeFile(int fd, off_t offset, size_t length) {
+    return m_session->sendFileFixSize(fd, offset, length);
+}
+
+int HttpResponseWriter::read(void* buffer, size_t length) {
+    return -1;
+}
+
+int HttpResponseWriter::read(ByteArray::ptr ba, size_t length) {
+    return -1;
+}
+
+bool HttpResponseWriter::finish() {
+    if(m_finished) {
+        return !m_error;
+    }
+    if(!sendHeader()) {
+        m_finished = true;
+        return false;
+    }
+    m_finished = true;
+    // 压缩流中剩余的数据在结束块之前写出
+    if(m_zs && m_zs->flush() < 0) {
+        m_error = true;
+    }
+    if(m_error) {
+        // 已经出错的响应不再发送结束块, 下面关闭连接
+    } else if(m_contentLength >= 0 && m_writeSize != (uint64_t)m_contentLength) {
+        // 实际长度和声明的不一致, 连接上的数据已经无法分帧, 只能关闭
+        MS_LOG_ERROR(g_logger) << "HttpResponseWriter finish with write_size="
+            << m_writeSize << " content-length=" << m_contentLength;
+        m_error = true;
+    } else if(!writeEnd()) {
+        m_error = true;
+    }
+    if(m_error) {
+        m_response->setClose(true);
+    }
+    return !m_error;
+}
+
+bool HttpResponseWriter::writeEnd() {
+    if(!m_chunked) {
+        return true;
+    }
+    static const char s_last_chunk[] = "0\r\n\r\n";
+    return m_session->writeFixSize(s_last_chunk, sizeof(s_last_chunk) - 1) > 0;
 }
 
-int HttpSession::sendResponse(HttpResponse::ptr rsp) {
-    std::stringstream ss;
-    ss << *rsp;
-    std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+void HttpResponseWriter::close() {
+    finish();
 }
 
 }
@@ -0,0 +1,114 @@
+#include <random>
+
+#include "ws_connection.h"
+#include "log.h"
+#include "util.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+WSConnection::WSConnection(Socket::ptr sock, bool owner)
+    :WSSession(sock, true, owner) {
+}
+
+std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(const std::string& url
+                                    ,uint64_t timeout_ms
+                                    ,const std::map<std::string, std::string>& headers) {
+    Uri::ptr uri = Uri::Create(url);
+    if(!uri) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_URL
+                , nullptr, "invalid url: " + url), nullptr);
+    }
+    return Create(uri, timeout_ms, headers);
+}
+
+std::pair<HttpResult::ptr, WSConnection::ptr> WSConnection::Create(Uri::ptr uri
+                                    ,uint64_t timeout_ms
+                                    ,const std::map<std::string, std::string>& headers) {
+    Address::ptr addr = uri->createAddress();
+    if(!addr) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::INVALID_HOST
+                , nullptr, "invalid host: " + uri->getHost()), nullptr);
+    }
+    Socket::ptr sock;
+    if(uri->getScheme() == "wss" || uri->getScheme() == "https") {
+        SSLSocket::ptr ssl_sock = SSLSocket::CreateTCP(addr);
+        ssl_sock->setHostName(uri->getHost());
+        sock = ssl_sock;
+    } else {
+        sock = Socket::CreateTCP(addr);
+    }
+    if(!sock) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::CREATE_SOCKET_ERROR
+                , nullptr, "create socket fail: " + addr->toString()
+                        + " errno=" + std::to_string(errno)
+                        + " errstr=" + std::string(strerror(errno))), nullptr);
+    }
+    if(!sock->connect(addr, timeout_ms)) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::CONNECT_FAIL
+                , nullptr, "connect fail: " + addr->toString()), nullptr);
+    }
+    sock->setRecvTimeout(timeout_ms);
+
+    // 16 字节随机数的 base64 作为 Sec-WebSocket-Key
+    static thread_local std::mt19937 s_rand(std::random_device{}());
+    std::string nonce(16, '\0');
+    for(auto& c : nonce) {
+        c = (char)s_rand();
+    }
+    std::string key = MNSER::Base64Encode(nonce);
+
+    HttpRequest::ptr req = std::make_shared<HttpRequest>();
+    req->setPath(uri->getPath());
+    req->setQuery(uri->getQuery());
+    req->setFragment(uri->getFragment());
+    req->setMethod(HttpMethod::GET);
+    req->setWebsocket(true);
+    bool has_host = false;
+    for(auto& i : headers) {
+        if(!has_host && strcasecmp(i.first.c_str(), "host") == 0) {
+            has_host = !i.second.empty();
+        }
+        req->setHeader(i.first, i.second);
+    }
+    if(!has_host) {
+        req->setHeader("Host", uri->getHost());
+    }
+    req->setHeader("Upgrade", "websocket");
+    req->setHeader("Connection", "Upgrade");
+    req->setHeader("Sec-WebSocket-Version", "13");
+    req->setHeader("Sec-WebSocket-Key", key);
+
+    // 握手借用 HttpConnection 收发, socket 之后交给 WSConnection
+    HttpConnection::ptr conn(new HttpConnection(sock, false));
+    int rt = conn->sendRequest(req);
+    if(rt <= 0) {
+        return std::make_pair(std::make_shared<HttpResult>(rt == 0
+                    ? (int)HttpResult::Error::SEND_CLOSE_BY_PEER
+                    : (int)HttpResult::Error::SEND_SOCKET_ERROR
+                    , nullptr, "send request fail errno=" + std::to_string(errno)
+                    + " errstr=" + std::string(strerror(errno))), nullptr);
+    }
+    HttpResponse::ptr rsp = conn->recvResponse(HttpMethod::GET);
+    if(!rsp) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::TIMEOUT
+                    , nullptr, "recv response timeout: " + addr->toString()
+                    + " timeout_ms:" + std::to_string(timeout_ms)), nullptr);
+    }
+    if(rsp->getStatus() != HttpStatus::SWITCHING_PROTOCOLS
+            || rsp->getHeader("sec-websocket-accept") != WSAcceptKey(key)) {
+        return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::HANDSHAKE_FAIL
+                    , rsp, "websocket handshake fail"), nullptr);
+    }
+
+    sock->setRecvTimeout(0);
+    WSConnection::ptr ws(new WSConnection(sock));
+    ws->setPending(conn->takeBuffer());
+    return std::make_pair(std::make_shared<HttpResult>((int)HttpResult::Error::OK
+                , rsp, "ok"), ws);
+}
+
+}
+}
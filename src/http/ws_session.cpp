@@ -0,0 +1,435 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <random>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ws_session.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+namespace MNSER {
+namespace http {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 单条消息(分片拼接后)的最大长度, 默认 32M
+static MNSER::ConfigVar<uint64_t>::ptr g_ws_message_max_size =
+    MNSER::Config::Lookup("ws.message.max_size"
+                ,(uint64_t)(32 * 1024 * 1024), "websocket message max size");
+
+// 发送队列的最大长度, 超过时认为对方消费太慢, 关闭连接, 默认 8M
+static MNSER::ConfigVar<uint64_t>::ptr g_ws_send_queue_max_size =
+    MNSER::Config::Lookup("ws.send_queue.max_size"
+                ,(uint64_t)(8 * 1024 * 1024), "websocket send queue max size");
+
+// 每次从 socket 读取的块大小
+static const size_t s_ws_read_size = 4096;
+
+// 一次 writev 最多发送的帧数
+static const size_t s_ws_writev_frames = 64;
+
+void WSMask(char* data, size_t len, const uint8_t key[4], size_t offset) {
+    // 按 data[0] 在载荷中的位置旋转掩码, 之后每 4 字节对齐循环
+    uint8_t k[4];
+    for(int i = 0; i < 4; ++i) {
+        k[i] = key[(offset + i) & 3];
+    }
+    uint32_t k32 = 0;
+    memcpy(&k32, k, 4);
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i m128 = _mm_set1_epi32(k32);
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(v, m128));
+    }
+#endif
+    uint64_t k64 = ((uint64_t)k32 << 32) | k32;
+    for(; i + 8 <= len; i += 8) {
+        uint64_t v = 0;
+        memcpy(&v, data + i, 8);
+        v ^= k64;
+        memcpy(data + i, &v, 8);
+    }
+    for(; i < len; ++i) {
+        data[i] ^= k[i & 3];
+    }
+}
+
+std::string WSAcceptKey(const std::string& key) {
+    return MNSER::Base64Encode(MNSER::Sha1Sum(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"));
+}
+
+// 编码帧头, key 非空时带掩码, 返回帧头长度
+static size_t EncodeHead(char* head, WSOpcode opcode, uint64_t len, bool fin, const uint8_t* key) {
+    uint8_t* h = (uint8_t*)head;
+    h[0] = (fin ? 0x80 : 0) | ((int)opcode & 0x0f);
+    uint8_t mask = key ? 0x80 : 0;
+    size_t n = 2;
+    if(len < 126) {
+        h[1] = mask | len;
+    } else if(len <= 0xffff) {
+        h[1] = mask | 126;
+        h[2] = len >> 8;
+        h[3] = len & 0xff;
+        n = 4;
+    } else {
+        h[1] = mask | 127;
+        for(int i = 0; i < 8; ++i) {
+            h[2 + i] = (len >> (56 - 8 * i)) & 0xff;
+        }
+        n = 10;
+    }
+    if(key) {
+        memcpy(h + n, key, 4);
+        n += 4;
+    }
+    return n;
+}
+
+WSFrame::ptr WSFrame::Create(WSOpcode opcode, std::string data, bool fin, bool mask) {
+    WSFrame::ptr frame(new WSFrame);
+    frame->m_opcode = opcode;
+    if(mask) {
+        static thread_local std::mt19937 s_rand(std::random_device{}());
+        uint32_t k = s_rand();
+        uint8_t key[4];
+        memcpy(key, &k, 4);
+        frame->m_headSize = EncodeHead(frame->m_head, opcode, data.size(), fin, key);
+        WSMask(&data[0], data.size(), key);
+    } else {
+        frame->m_headSize = EncodeHead(frame->m_head, opcode, data.size(), fin, nullptr);
+    }
+    frame->m_payload = std::make_shared<const std::string>(std::move(data));
+    return frame;
+}
+
+WSFrame::ptr WSFrame::Create(WSOpcode opcode, std::shared_ptr<const std::string> data, bool fin) {
+    WSFrame::ptr frame(new WSFrame);
+    frame->m_opcode = opcode;
+    frame->m_headSize = EncodeHead(frame->m_head, opcode, data->size(), fin, nullptr);
+    frame->m_payload = data;
+    return frame;
+}
+
+WSSession::WSSession(Socket::ptr sock, bool client, bool owner)
+    :SocketStream(sock, owner)
+    ,m_client(client)
+    ,m_iom(IOManager::GetThis())
+    ,m_lastRecv(MNSER::GetCurrentMS()) {
+}
+
+WSSession::~WSSession() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+}
+
+bool WSSession::fill(size_t n) {
+    while(m_recvBuf.size() - m_recvPos < n) {
+        // 只有需要继续读时才把已处理的部分去掉
+        if(m_recvPos > 0) {
+            m_recvBuf.erase(0, m_recvPos);
+            m_recvPos = 0;
+        }
+        size_t old = m_recvBuf.size();
+        m_recvBuf.resize(old + std::max(s_ws_read_size, n));
+        int rt = read(&m_recvBuf[old], m_recvBuf.size() - old);
+        if(rt <= 0) {
+            m_recvBuf.resize(old);
+            return false;
+        }
+        m_recvBuf.resize(old + rt);
+        m_lastRecv = MNSER::GetCurrentMS();
+    }
+    return true;
+}
+
+bool WSSession::readPayload(std::string& out, uint64_t len, bool masked, const uint8_t key[4]) {
+    if(len == 0) {
+        return true;
+    }
+    size_t offset = out.size();
+    out.resize(offset + len);
+    char* dst = &out[offset];
+    size_t buffered = std::min(len, (uint64_t)(m_recvBuf.size() - m_recvPos));
+    memcpy(dst, m_recvBuf.data() + m_recvPos, buffered);
+    m_recvPos += buffered;
+    if(m_recvPos == m_recvBuf.size()) {
+        m_recvBuf.clear();
+        m_recvPos = 0;
+    }
+    if(buffered < len) {
+        // 剩下的载荷直接读进消息, 不经过接收缓冲
+        if(readFixSize(dst + buffered, len - buffered) <= 0) {
+            return false;
+        }
+        m_lastRecv = MNSER::GetCurrentMS();
+    }
+    if(masked) {
+        WSMask(dst, len, key);
+    }
+    return true;
+}
+
+WSMessage::ptr WSSession::recvMessage() {
+    WSMessage::ptr msg;     // 正在拼接的分片消息
+    uint16_t error = 0;
+    while(true) {
+        if(!fill(2)) {
+            return nullptr;
+        }
+        const uint8_t* p = (const uint8_t*)m_recvBuf.data() + m_recvPos;
+        bool fin = p[0] & 0x80;
+        bool rsv = p[0] & 0x70;
+        WSOpcode opcode = (WSOpcode)(p[0] & 0x0f);
+        bool masked = p[1] & 0x80;
+        uint64_t len = p[1] & 0x7f;
+        size_t head = 2 + (len == 126 ? 2 : (len == 127 ? 8 : 0)) + (masked ? 4 : 0);
+        if(!fill(head)) {
+            return nullptr;
+        }
+        // fill 可能移动了缓冲区
+        p = (const uint8_t*)m_recvBuf.data() + m_recvPos;
+        if(len == 126) {
+            len = (p[2] << 8) | p[3];
+        } else if(len == 127) {
+            len = 0;
+            for(int i = 0; i < 8; ++i) {
+                len = (len << 8) | p[2 + i];
+            }
+        }
+        uint8_t key[4] = {0};
+        if(masked) {
+            memcpy(key, p + head - 4, 4);
+        }
+        m_recvPos += head;
+
+        // 客户端发出的帧必须带掩码, 服务端发出的不能带, 不支持扩展
+        if(rsv || masked == m_client) {
+            error = 1002;
+            break;
+        }
+        if((int)opcode & 0x08) {
+            // 控制帧不能分片, 载荷不超过 125 字节, 可以夹在分片消息中间
+            if(!fin || len > 125) {
+                error = 1002;
+                break;
+            }
+            std::string payload;
+            if(!readPayload(payload, len, masked, key)) {
+                return nullptr;
+            }
+            if(opcode == WSOpcode::PING) {
+                pong(payload);
+                continue;
+            } else if(opcode == WSOpcode::PONG) {
+                continue;
+            } else if(opcode == WSOpcode::CLOSE) {
+                uint16_t code = 1000;
+                if(payload.size() >= 2) {
+                    code = ((uint8_t)payload[0] << 8) | (uint8_t)payload[1];
+                }
+                MS_LOG_DEBUG(g_logger) << "websocket recv close code=" << code;
+                sendClose(code);
+                return nullptr;
+            }
+            error = 1002;
+            break;
+        }
+
+        if(opcode == WSOpcode::CONTINUE) {
+            if(!msg) {
+                error = 1002;
+                break;
+            }
+        } else if(opcode == WSOpcode::TEXT || opcode == WSOpcode::BIN) {
+            if(msg) {
+                error = 1002;
+                break;
+            }
+            msg = std::make_shared<WSMessage>(opcode);
+        } else {
+            error = 1002;
+            break;
+        }
+        uint64_t max_size = *g_ws_message_max_size->getValue();
+        if(msg->getData().size() + len > max_size) {
+            MS_LOG_WARN(g_logger) << "websocket message too large, size="
+                << (msg->getData().size() + len) << " max_size=" << max_size;
+            error = 1009;
+            break;
+        }
+        if(!readPayload(msg->getData(), len, masked, key)) {
+            return nullptr;
+        }
+        if(fin) {
+            return msg;
+        }
+    }
+    MS_LOG_DEBUG(g_logger) << "websocket protocol error, close code=" << error;
+    sendClose(error);
+    return nullptr;
+}
+
+int32_t WSSession::sendMessage(WSMessage::ptr msg, bool fin) {
+    return sendMessage(msg->getData(), msg->getOpcode(), fin);
+}
+
+int32_t WSSession::sendMessage(const std::string& data, WSOpcode opcode, bool fin) {
+    return sendFrame(WSFrame::Create(opcode, data, fin, m_client));
+}
+
+int32_t WSSession::ping() {
+    return sendFrame(WSFrame::Create(WSOpcode::PING, "", true, m_client));
+}
+
+int32_t WSSession::pong(const std::string& data) {
+    return sendFrame(WSFrame::Create(WSOpcode::PONG, data, true, m_client));
+}
+
+int32_t WSSession::sendClose(uint16_t code, const std::string& reason) {
+    std::string payload;
+    payload.push_back((char)(code >> 8));
+    payload.push_back((char)(code & 0xff));
+    payload += reason.substr(0, 123);
+    return sendFrame(WSFrame::Create(WSOpcode::CLOSE, payload, true, m_client));
+}
+
+int32_t WSSession::sendFrame(WSFrame::ptr frame, bool async) {
+    bool overflow = false;
+    uint64_t max_size = *g_ws_send_queue_max_size->getValue();
+    {
+        MutexType::Lock lock(m_mutex);
+        if(m_sendError || m_closeSent) {
+            return -1;
+        }
+        if(!m_sendQueue.empty() && m_sendQueueSize + frame->size() > max_size) {
+            m_sendError = true;
+            overflow = true;
+        } else {
+            if(frame->getOpcode() == WSOpcode::CLOSE) {
+                m_closeSent = true;
+            }
+            m_sendQueue.push_back(frame);
+            m_sendQueueSize += frame->size();
+            if(m_sending) {
+                // 正在发送的协程会把它一起发出
+                return frame->size();
+            }
+            m_sending = true;
+        }
+    }
+    if(overflow) {
+        MS_LOG_WARN(g_logger) << "websocket send queue overflow, queue_size=" << m_sendQueueSize
+            << " max_size=" << max_size << ", close slow consumer";
+        shutdown();
+        return -1;
+    }
+    if(async && m_iom) {
+        m_iom->schedule(std::bind(&WSSession::flush, shared_from_this()));
+        return frame->size();
+    }
+    return flush() < 0 ? -1 : frame->size();
+}
+
+int32_t WSSession::flush() {
+    std::vector<WSFrame::ptr> frames;
+    std::vector<iovec> iovs;
+    int32_t total = 0;
+    while(true) {
+        frames.clear();
+        {
+            MutexType::Lock lock(m_mutex);
+            if(m_sendQueue.empty()) {
+                m_sending = false;
+                return total;
+            }
+            while(!m_sendQueue.empty() && frames.size() < s_ws_writev_frames) {
+                frames.push_back(m_sendQueue.front());
+                m_sendQueueSize -= m_sendQueue.front()->size();
+                m_sendQueue.pop_front();
+            }
+        }
+        iovs.clear();
+        for(auto& i : frames) {
+            iovec iov;
+            iov.iov_base = (void*)i->getHead();
+            iov.iov_len = i->getHeadSize();
+            iovs.push_back(iov);
+            if(!i->getPayload().empty()) {
+                iov.iov_base = (void*)i->getPayload().data();
+                iov.iov_len = i->getPayload().size();
+                iovs.push_back(iov);
+            }
+        }
+        int rt = writevFixSize(&iovs[0], iovs.size());
+        if(rt <= 0) {
+            MutexType::Lock lock(m_mutex);
+            m_sendError = true;
+            m_sendQueue.clear();
+            m_sendQueueSize = 0;
+            m_sending = false;
+            return -1;
+        }
+        total += rt;
+    }
+}
+
+size_t WSSession::Broadcast(const std::vector<WSSession::ptr>& sessions, WSFrame::ptr frame) {
+    size_t count = 0;
+    for(auto& i : sessions) {
+        if(i->sendFrame(frame, true) > 0) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void WSSession::startKeepalive(uint64_t interval_ms, uint64_t timeout_ms) {
+    IOManager* iom = IOManager::GetThis();
+    if(!iom || interval_ms == 0) {
+        return;
+    }
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    std::weak_ptr<WSSession> weak_self(shared_from_this());
+    m_timer = iom->addConditionTimer(interval_ms, [weak_self, timeout_ms](){
+        WSSession::ptr self = weak_self.lock();
+        if(!self) {
+            return;
+        }
+        if(MNSER::GetCurrentMS() - self->m_lastRecv > timeout_ms) {
+            MS_LOG_DEBUG(g_logger) << "websocket keepalive timeout, timeout_ms=" << timeout_ms;
+            self->shutdown();
+            return;
+        }
+        self->ping();
+    }, weak_self, true);
+}
+
+void WSSession::close() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    SocketStream::close();
+}
+
+size_t WSSession::getSendQueueSize() {
+    MutexType::Lock lock(m_mutex);
+    return m_sendQueueSize;
+}
+
+void WSSession::shutdown() {
+    Socket::ptr sock = getSocket();
+    if(sock) {
+        ::shutdown(sock->getSocket(), SHUT_RDWR);
+    }
+}
+
+}
+}
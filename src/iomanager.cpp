@@ -317,7 +317,7 @@ bool IOManager::stopping() {
 }
 
 void IOManager::idle() {
-    MS_LOG_DEBUG(g_logger) << "iomanager idle";
+    MS_LOG_BIN_DEBUG(g_logger, "iomanager idle");
     const uint64_t MAX_EVENTS = 256;  // 最大等待事件
     epoll_event* events = new epoll_event[MAX_EVENTS](); // 加 () 表示调用构造函数
     std::shared_ptr<epoll_event> shared_events(events, [](epoll_event* ptr){
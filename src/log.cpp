@@ -1,3 +1,14 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <dirent.h>
+#include <zlib.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <deque>
+
 #include "log.h"
 #include "config.h"
 
@@ -43,10 +54,193 @@ LogLevel::Level LogLevel::FromString(const std::string& str) {
 #undef TMP_FUNC
 }
 
-LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, 
+LogStream::~LogStream() {
+	delete m_ss;
+}
+
+char* LogStream::reserve(size_t len) {
+	if (!m_useOverflow) {
+		if (m_size + len <= INLINE_SIZE) {
+			char* p = m_buf + m_size;
+			m_size += len;
+			return p;
+		}
+		m_overflow.reserve(INLINE_SIZE * 2 + len);
+		m_overflow.assign(m_buf, m_size);
+		m_useOverflow = true;
+	}
+	size_t old = m_overflow.size();
+	m_overflow.resize(old + len);
+	return &m_overflow[old];
+}
+
+void LogStream::append(const char* data, size_t len) {
+	if (len) {
+		memcpy(reserve(len), data, len);
+	}
+}
+
+template<class T>
+LogStream& LogStream::appendNumber(T v, const char* fmt) {
+	if (m_ss) {
+		*m_ss << v;
+		return *this;
+	}
+	char buf[32];
+	int n = snprintf(buf, sizeof(buf), fmt, v);
+	append(buf, n);
+	return *this;
+}
+
+LogStream& LogStream::operator<<(bool v) {
+	if (m_ss) {
+		*m_ss << v;
+		return *this;
+	}
+	return *this << (v ? '1' : '0');
+}
+
+LogStream& LogStream::operator<<(char v) {
+	if (m_ss) {
+		*m_ss << v;
+	} else {
+		*reserve(1) = v;
+	}
+	return *this;
+}
+
+LogStream& LogStream::operator<<(short v) {
+	return appendNumber((int)v, "%d");
+}
+
+LogStream& LogStream::operator<<(unsigned short v) {
+	return appendNumber((unsigned int)v, "%u");
+}
+
+LogStream& LogStream::operator<<(int v) {
+	return appendNumber(v, "%d");
+}
+
+LogStream& LogStream::operator<<(unsigned int v) {
+	return appendNumber(v, "%u");
+}
+
+LogStream& LogStream::operator<<(long v) {
+	return appendNumber(v, "%ld");
+}
+
+LogStream& LogStream::operator<<(unsigned long v) {
+	return appendNumber(v, "%lu");
+}
+
+LogStream& LogStream::operator<<(long long v) {
+	return appendNumber(v, "%lld");
+}
+
+LogStream& LogStream::operator<<(unsigned long long v) {
+	return appendNumber(v, "%llu");
+}
+
+LogStream& LogStream::operator<<(double v) {
+	// 和 std::ostream 默认的输出一致
+	return appendNumber(v, "%g");
+}
+
+LogStream& LogStream::operator<<(const char* v) {
+	if (m_ss) {
+		*m_ss << v;
+	} else if (v) {
+		append(v, strlen(v));
+	}
+	return *this;
+}
+
+LogStream& LogStream::operator<<(const std::string& v) {
+	if (m_ss) {
+		*m_ss << v;
+	} else {
+		append(v.data(), v.size());
+	}
+	return *this;
+}
+
+LogStream& LogStream::operator<<(const void* v) {
+	if (m_ss) {
+		*m_ss << v;
+		return *this;
+	}
+	if (!v) {
+		return *this << '0';
+	}
+	return appendNumber((unsigned long)v, "0x%lx");
+}
+
+LogStream& LogStream::operator<<(std::ostream& (*f)(std::ostream&)) {
+	if (!m_ss && f == static_cast<std::ostream& (*)(std::ostream&)>(std::endl)) {
+		return *this << '\n';
+	}
+	f(getStream());
+	return *this;
+}
+
+LogStream& LogStream::operator<<(std::ios_base& (*f)(std::ios_base&)) {
+	f(getStream());
+	return *this;
+}
+
+void LogStream::format(const char* fmt, va_list al) {
+	flushStream();
+	va_list copy;
+	va_copy(copy, al);
+	char buf[512];
+	int len = vsnprintf(buf, sizeof(buf), fmt, copy);
+	va_end(copy);
+	if (len < 0) {
+		return;
+	}
+	if ((size_t)len < sizeof(buf)) {
+		append(buf, len);
+		return;
+	}
+	// 直接格式化到缓冲区中, vsnprintf 需要多一个字节放 '\0'
+	char* p = reserve(len + 1);
+	vsnprintf(p, len + 1, fmt, al);
+	if (m_useOverflow) {
+		m_overflow.resize(m_overflow.size() - 1);
+	} else {
+		--m_size;
+	}
+}
+
+std::ostream& LogStream::getStream() {
+	if (!m_ss) {
+		m_ss = new std::stringstream;
+	}
+	return *m_ss;
+}
+
+void LogStream::flushStream() {
+	if (m_ss && m_ss->tellp() > 0) {
+		std::string str = m_ss->str();
+		m_ss->str("");
+		append(str.data(), str.size());
+	}
+}
+
+const char* LogStream::data() {
+	flushStream();
+	return m_useOverflow ? m_overflow.data() : m_buf;
+}
+
+size_t LogStream::size() {
+	flushStream();
+	return m_useOverflow ? m_overflow.size() : m_size;
+}
+
+LogEvent::LogEvent(const std::shared_ptr<Logger>& logger, LogLevel::Level level, 
 		const char *file, int32_t line, uint32_t elapse, 
 		uint32_t threadId, uint32_t fiberId, uint64_t time
-		, const std::string threadName): 
+		, const char* threadName): 
 		m_logger(logger), 
 		m_level(level),
 		m_file(file), 
@@ -56,12 +250,9 @@ LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level,
 		m_fiberId(fiberId), 
 		m_time(time), 
 		m_threadName(threadName) {
-		//std::cout << "m_file= " << m_file << "__FILE__ = " << __FILE__ << std::endl;
-	
 }
 
 void LogEvent::format(const char * fmt, ...) {
-	// 这个函数没有往日志里面写入啊
 	va_list va;
 	va_start(va, fmt);
 	format(fmt, va);
@@ -69,166 +260,339 @@ void LogEvent::format(const char * fmt, ...) {
 }
 
 void LogEvent::format(const char * fmt, va_list al) {
-	char *buf = nullptr;
-	int len = vasprintf(&buf, fmt, al);
-	if (len != -1) {
-		m_ss << std::string(buf, len);
-		free(buf);
-	}
+	m_ss.format(fmt, al);
 }
 
-LogEventWarp::LogEventWarp(std::shared_ptr<LogEvent> e)
-	: m_event(e) {
+LogEventWarp::LogEventWarp(const std::shared_ptr<Logger>& logger, LogLevel::Level level, 
+		const char *file, int32_t line, uint32_t elapse, 
+		uint32_t threadId, uint32_t fiberId, uint64_t time
+		, const char* threadName)
+	:m_event(logger, level, file, line, elapse, threadId, fiberId, time, threadName) {
 }
 
 LogEventWarp::~LogEventWarp() {
-	m_event->getLogger()->log(m_event->getLevel(), m_event);
+	// 二进制日志的内容是编码后的参数, 不能追加文本
+	if (m_suppressed && !m_event.getSite()) {
+		m_event.getSS() << " [suppressed " << m_suppressed << " messages]";
+	}
+	m_event.getLogger()->log(m_event.getLevel(), m_event);
 }
 
-std::stringstream& LogEventWarp::getSS() {
-	return m_event->getSS();
+static uint64_t MonotonicUS() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
 }
 
-
-class MessageFormatItem: public LogFormatter::FormatItem {
-public:
-	MessageFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getContent();	
+uint64_t LogEveryMs::check(uint64_t ms) {
+	uint64_t now = MonotonicUS() / 1000 + 1;
+	uint64_t last = m_last.load(std::memory_order_relaxed);
+	// 多个线程同时到期时只有一个输出
+	if ((last && now < last + ms)
+			|| !m_last.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+		m_suppressed.fetch_add(1, std::memory_order_relaxed);
+		return 0;
 	}
-};
-
-class LevelFormatItem: public LogFormatter::FormatItem {
-public:
-	LevelFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << LogLevel::ToString(level);	
-	}
-};
-
-class ElapseFormatItem: public LogFormatter::FormatItem {
-public:
-	ElapseFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getElapse();	
-	}
-};
+	return 1 + m_suppressed.exchange(0, std::memory_order_relaxed);
+}
 
-class NameFormatItem: public LogFormatter::FormatItem {
-public:
-	NameFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getLogger()->getName();
+uint64_t LogTokenBucket::check(double rate, uint32_t burst) {
+	if (rate <= 0) {
+		m_suppressed.fetch_add(1, std::memory_order_relaxed);
+		return 0;
 	}
-};
-
-class ThreadIdFormatItem: public LogFormatter::FormatItem {
-public:
-	ThreadIdFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getThreadId();	
+	// 每条消耗 interval 微秒, 允许提前 (burst - 1) * interval 到达
+	uint64_t interval = 1000000 / rate;
+	uint64_t tolerance = interval * (burst ? burst - 1 : 0);
+	uint64_t now = MonotonicUS();
+	uint64_t tat = m_tat.load(std::memory_order_relaxed);
+	while (true) {
+		uint64_t base = tat > now ? tat : now;
+		if (base - now > tolerance) {
+			m_suppressed.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+		if (m_tat.compare_exchange_weak(tat, base + interval, std::memory_order_relaxed)) {
+			break;
+		}
 	}
-};
+	return 1 + m_suppressed.exchange(0, std::memory_order_relaxed);
+}
 
-class NewLineFormatItem: public LogFormatter::FormatItem {
-public:
-	NewLineFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << std::endl;	
+const std::string& LogEvent::getText() {
+	if (!m_hasText) {
+		LogBinArgs::Format(m_text, m_site->fmt, m_ss.data(), m_ss.size());
+		m_hasText = true;
 	}
-};
+	return m_text;
+}
 
-class DateTimeFormatItem: public LogFormatter::FormatItem {
-public:
-	DateTimeFormatItem(const std::string & fmt = "%Y-%m-%d %H:%M:%S"): m_fmt(fmt) {
-		if (m_fmt.empty()) {
-			m_fmt = "%Y-%m-%d %H:%M:%S";
-		}
-	}
+// 调用点只增不减, 编号即下标
+static Mutex& GetLogBinSiteMutex() {
+	static Mutex s_mutex;
+	return s_mutex;
+}
 
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		struct tm tm;
-		time_t time = event->getTime();
-		localtime_r(&time, &tm);
-		char buf[64];
-			strftime(buf, sizeof(buf), m_fmt.c_str(), &tm);
-		os << buf;
-	}
+static std::vector<const LogBinSite*>& GetLogBinSites() {
+	static std::vector<const LogBinSite*> s_sites(1, nullptr);
+	return s_sites;
+}
 
-private:
-	std::string m_fmt;
-};
+LogBinSite::LogBinSite(const char* file, int32_t line, LogLevel::Level level, const char* fmt)
+	:file(file), line(line), level(level), fmt(fmt) {
+	Mutex::Lock lock(GetLogBinSiteMutex());
+	id = GetLogBinSites().size();
+	GetLogBinSites().push_back(this);
+}
 
-class FileFormatItem: public LogFormatter::FormatItem {
-public:
-	FileFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getFile();	
-	}
-};
+const LogBinSite* LogBinSite::Get(uint32_t id) {
+	Mutex::Lock lock(GetLogBinSiteMutex());
+	auto& sites = GetLogBinSites();
+	return id < sites.size() ? sites[id] : nullptr;
+}
 
-class LineFormatItem: public LogFormatter::FormatItem {
-public:
-	LineFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getLine();	
+// snprintf 追加到 out
+static void AppendFormat(std::string& out, const char* fmt, ...) {
+	char buf[256];
+	va_list al;
+	va_start(al, fmt);
+	int n = vsnprintf(buf, sizeof(buf), fmt, al);
+	va_end(al);
+	if (n < 0) {
+		return;
 	}
-};
-
-class TabFormatItem: public LogFormatter::FormatItem {
-public:
-	TabFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << '\t';
+	if ((size_t)n < sizeof(buf)) {
+		out.append(buf, n);
+		return;
 	}
-};
+	size_t old = out.size();
+	out.resize(old + n + 1);
+	va_start(al, fmt);
+	vsnprintf(&out[old], n + 1, fmt, al);
+	va_end(al);
+	out.resize(old + n);
+}
 
-class FiberIdFormatItem: public LogFormatter::FormatItem {
-public:
-	FiberIdFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getFiberId();
+void LogBinArgs::Format(std::string& out, const char* fmt, const char* data, size_t len) {
+	const char* end = data + len;
+	while (*fmt) {
+		const char* p = strchr(fmt, '%');
+		if (!p) {
+			out.append(fmt);
+			break;
+		}
+		out.append(fmt, p - fmt);
+		if (p[1] == '%') {
+			out.push_back('%');
+			fmt = p + 2;
+			continue;
+		}
+		// %[flags][width][.precision][length]conversion, 长度修饰符按参数类型重新生成
+		fmt = p + 1;
+		while (*fmt && strchr("-+ #0", *fmt)) {
+			++fmt;
+		}
+		while (isdigit(*fmt)) {
+			++fmt;
+		}
+		if (*fmt == '.') {
+			++fmt;
+			while (isdigit(*fmt)) {
+				++fmt;
+			}
+		}
+		char spec[32];
+		size_t spec_len = std::min((size_t)(fmt - p), sizeof(spec) - 4);
+		memcpy(spec, p, spec_len);
+		while (*fmt && strchr("hlLqjzt", *fmt)) {
+			++fmt;
+		}
+		char conv = *fmt;
+		if (!conv) {
+			out.append(p);
+			break;
+		}
+		++fmt;
+		// 参数不够或者不完整, 原样输出
+		if (data >= end) {
+			out.append(p, fmt - p);
+			continue;
+		}
+		char type = *data;
+		size_t need = type == STRING ? 5 : 9;
+		uint32_t str_len = 0;
+		if (type == STRING && data + need <= end) {
+			memcpy(&str_len, data + 1, sizeof(str_len));
+			need += str_len;
+		}
+		if (data + need > end) {
+			out.append(p, fmt - p);
+			data = end;
+			continue;
+		}
+		uint64_t u = 0;
+		double d = 0;
+		if (type == DOUBLE) {
+			memcpy(&d, data + 1, sizeof(d));
+		} else if (type != STRING) {
+			memcpy(&u, data + 1, sizeof(u));
+		}
+		switch (type) {
+		case INT:
+		case UINT:
+			if (conv == 'c') {
+				strcpy(spec + spec_len, "c");
+				AppendFormat(out, spec, (int)u);
+			} else if (conv == 'o' || conv == 'u' || conv == 'x' || conv == 'X') {
+				spec[spec_len] = 'l';
+				spec[spec_len + 1] = 'l';
+				spec[spec_len + 2] = conv;
+				spec[spec_len + 3] = '\0';
+				AppendFormat(out, spec, (unsigned long long)u);
+			} else if (type == INT) {
+				strcpy(spec + spec_len, "lld");
+				AppendFormat(out, spec, (long long)u);
+			} else {
+				strcpy(spec + spec_len, "llu");
+				AppendFormat(out, spec, (unsigned long long)u);
+			}
+			break;
+		case DOUBLE:
+			spec[spec_len] = strchr("fFeEgGaA", conv) ? conv : 'g';
+			spec[spec_len + 1] = '\0';
+			AppendFormat(out, spec, d);
+			break;
+		case STRING:
+			if (spec_len == 1) {
+				out.append(data + 5, str_len);
+			} else {
+				strcpy(spec + spec_len, "s");
+				AppendFormat(out, spec, std::string(data + 5, str_len).c_str());
+			}
+			break;
+		case POINTER:
+			strcpy(spec + spec_len, "p");
+			AppendFormat(out, spec, (void*)(uintptr_t)u);
+			break;
+		default:
+			// 无法识别的类型, 之后的参数都无法解析
+			out.append(p, fmt - p);
+			data = end;
+			continue;
+		}
+		data += need;
 	}
-};
+}
 
-class ThreadNameFormatItem: public LogFormatter::FormatItem {
-public:
-	ThreadNameFormatItem(const std::string & str = "")	 {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << event->getThreadName();
-	}
-};
 
-class StringFormatItem: public LogFormatter::FormatItem {
-public:
-	StringFormatItem(const std::string & str = ""):m_str(str) {}
-	void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)  {
-		os << m_str;
+// 整数追加到 out, 比 snprintf 快
+template<class T>
+static void AppendInt(std::string& out, T v) {
+	char buf[24];
+	char* end = buf + sizeof(buf);
+	char* p = end;
+	bool neg = v < 0;
+	uint64_t u = neg ? -(uint64_t)v : (uint64_t)v;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (neg) {
+		*--p = '-';
 	}
+	out.append(p, end - p);
+}
 
-private:
-	std::string m_str;
+// 线程本地的时间缓存, 按格式项的编号直接映射
+struct DateTimeCache {
+	uint32_t id = 0;
+	time_t time = -1;
+	size_t len = 0;
+	char buf[64];
 };
 
+static const size_t DATETIME_CACHE_SIZE = 8;
+static thread_local DateTimeCache t_datetime_cache[DATETIME_CACHE_SIZE];
+static std::atomic<uint32_t> s_datetime_id{0};
+
 LogFormatter::LogFormatter(const std::string &pattern): m_pattern(pattern) {
 	init();
 }
 
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-	std::stringstream ss;
-	//std::cout << "LogFormatter::format " << __LINE__ << std::endl;
-	for (auto &it: m_items) {
-		it->format(ss, logger, level, event);
+void LogFormatter::appendDateTime(std::string& out, const Item& item, time_t time) {
+	DateTimeCache& cache = t_datetime_cache[item.id % DATETIME_CACHE_SIZE];
+	if (cache.id != item.id || cache.time != time) {
+		struct tm tm;
+		localtime_r(&time, &tm);
+		cache.len = strftime(cache.buf, sizeof(cache.buf), item.str.c_str(), &tm);
+		cache.id = item.id;
+		cache.time = time;
 	}
-	return ss.str();
+	out.append(cache.buf, cache.len);
 }
 
-std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-	//std::cout << "LogFormatter::format " << __LINE__ << std::endl;
-	for (auto &it: m_items) {
-		it->format(ofs, logger, level, event);
+void LogFormatter::format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event) {
+	for (auto& i: m_items) {
+		switch (i.type) {
+		case Item::STRING:
+			out.append(i.str);
+			break;
+		case Item::MESSAGE:
+			out.append(event.getContentData(), event.getContentSize());
+			break;
+		case Item::LEVEL:
+			out.append(LogLevel::ToString(level));
+			break;
+		case Item::ELAPSE:
+			AppendInt(out, event.getElapse());
+			break;
+		case Item::NAME:
+			out.append(event.getLogger()->getName());
+			break;
+		case Item::THREAD_ID:
+			AppendInt(out, event.getThreadId());
+			break;
+		case Item::DATETIME:
+			appendDateTime(out, i, event.getTime());
+			break;
+		case Item::FILE:
+			out.append(event.getFile());
+			break;
+		case Item::LINE:
+			AppendInt(out, event.getLine());
+			break;
+		case Item::FIBER_ID:
+			AppendInt(out, event.getFiberId());
+			break;
+		case Item::THREAD_NAME:
+			out.append(event.getThreadName());
+			break;
+		}
 	}
-	return ofs;
+}
+
+std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event) {
+	std::string str;
+	format(str, logger, level, event);
+	return str;
+}
+
+std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent& event) {
+	std::string str;
+	format(str, logger, level, event);
+	return ofs << str;
+}
+
+void LogFormatter::addString(const std::string& str) {
+	if (!m_items.empty() && m_items.back().type == Item::STRING) {
+		m_items.back().str += str;
+		return;
+	}
+	Item item;
+	item.type = Item::STRING;
+	item.str = str;
+	item.id = 0;
+	m_items.push_back(item);
 }
 
 void LogFormatter::init() {
@@ -308,243 +672,1226 @@ void LogFormatter::init() {
 		vec.push_back(std::make_tuple(str, std::string(), 0));
 	}
 
-	static std::map<std::string, std::function<FormatItem::ptr(const std::string& str)> > map_s_items = {
-#define TMP_FUNC(str, C) \
-	{#str, [](const std::string& fmt) { return FormatItem::ptr(new C(fmt)); }}
-
-	TMP_FUNC(m, MessageFormatItem),
-	TMP_FUNC(p, LevelFormatItem),
-	TMP_FUNC(r, ElapseFormatItem),
-	TMP_FUNC(c, NameFormatItem),
-	TMP_FUNC(t, ThreadIdFormatItem),
-	TMP_FUNC(n, NewLineFormatItem),
-	TMP_FUNC(d, DateTimeFormatItem),
-	TMP_FUNC(f, FileFormatItem),
-	TMP_FUNC(l, LineFormatItem),
-	TMP_FUNC(T, TabFormatItem),
-	TMP_FUNC(F, FiberIdFormatItem),
-	TMP_FUNC(N, ThreadNameFormatItem),
+	static std::map<std::string, Item::Type> s_items = {
+#define TMP_FUNC(str, type) \
+	{#str, Item::type}
+
+	TMP_FUNC(m, MESSAGE),
+	TMP_FUNC(p, LEVEL),
+	TMP_FUNC(r, ELAPSE),
+	TMP_FUNC(c, NAME),
+	TMP_FUNC(t, THREAD_ID),
+	TMP_FUNC(d, DATETIME),
+	TMP_FUNC(f, FILE),
+	TMP_FUNC(l, LINE),
+	TMP_FUNC(F, FIBER_ID),
+	TMP_FUNC(N, THREAD_NAME),
 #undef TMP_FUNC
 	};
 
-	//std::cout << vec.size() << std::endl;
-	
+	m_items.clear();
 	for(auto &i: vec) {
-		//std::cout << std::get<0>(i) << " :<==>: " << std::get<1>(i) << " :<==>: " << std::get<2>(i) << std::endl;
 		if (std::get<2>(i) == 0) {
-			m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+			addString(std::get<0>(i));
+		} else if (std::get<0>(i) == "n") {
+			addString("\n");
+		} else if (std::get<0>(i) == "T") {
+			addString("\t");
 		} else {
-			auto it = map_s_items.find(std::get<0>(i));
-			if (it == map_s_items.end()) {
-				m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error-format" + std::get<0>(i) + ">>")));
+			auto it = s_items.find(std::get<0>(i));
+			if (it == s_items.end()) {
+				addString("<<error-format" + std::get<0>(i) + ">>");
 				m_error = true;
-			} else {
-				m_items.push_back(it->second(std::get<1>(i)));
+				continue;
+			}
+			Item item;
+			item.type = it->second;
+			item.id = 0;
+			if (item.type == Item::DATETIME) {
+				item.str = std::get<1>(i).empty() ? "%Y-%m-%d %H:%M:%S" : std::get<1>(i);
+				item.id = ++s_datetime_id;
+			}
+			m_items.push_back(item);
+		}
+	}
+}
+
+const char* LogAppender::OverflowToString(Overflow v) {
+	switch (v) {
+	case DROP:
+		return "drop";
+	case DROP_DEBUG:
+		return "drop_debug";
+	default:
+		return "block";
+	}
+}
+
+LogAppender::Overflow LogAppender::OverflowFromString(const std::string& str) {
+	if (str == "drop") {
+		return DROP;
+	}
+	if (str == "drop_debug") {
+		return DROP_DEBUG;
+	}
+	return BLOCK;
+}
+
+void LogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event) {
+	if (level < getLevel()) {
+		return;
+	}
+	// 格式化到线程本地的缓冲区, 不需要持锁
+	static thread_local std::string t_buf;
+	std::string& msg = t_buf;
+	msg.clear();
+	{
+		// 只在格式化期间持有快照, 写出可能阻塞, 不能让替换 formatter 的线程一直等待
+		RcuPtr<LogFormatter::ptr>::ReadGuard formatter = m_logFormatter.read();
+		if (!formatter.get()) {
+			return;
+		}
+		(*formatter)->format(msg, logger, level, event);
+	}
+	submit(level, msg);
+}
+
+void LogAppender::submit(LogLevel::Level level, const std::string& msg) {
+	if (m_async && AsyncLogWriter::GetInstance()->append(this, level, msg)) {
+		// FATAL 之后进程可能马上退出, 等所有缓冲区写出再返回
+		if (level >= LogLevel::FATAL) {
+			AsyncLogWriter::GetInstance()->flush();
+		}
+		return;
+	}
+	struct iovec iov;
+	iov.iov_base = (void*)msg.data();
+	iov.iov_len = msg.size();
+	Mutex::Lock lock(m_writeMutex);
+	write(&iov, 1);
+}
+
+void LogAppender::formatDropped(std::string& out, uint64_t count) {
+	out = "[async log] dropped " + std::to_string(count) + " messages\n";
+}
+
+void LogAppender::flushAsync() {
+	if (m_async) {
+		AsyncLogWriter::GetInstance()->flush();
+	}
+}
+
+void LogAppender::setFormatter(LogFormatter::ptr val) {
+	MutexType::Lock lock(m_mutex);
+	resetFormatter(val);
+	if (m_formatter) {
+		m_hasFormatter = true;
+	} else {
+		m_hasFormatter = false;
+	}
+}
+
+void LogAppender::resetFormatter(LogFormatter::ptr val) {
+	m_formatter = val;
+	m_logFormatter.update(val ? new LogFormatter::ptr(val) : nullptr);
+}
+
+LogFormatter::ptr LogAppender::getFormatter() { 
+	MutexType::Lock lock(m_mutex);
+	return m_formatter; 
+}
+
+Logger::Logger(const std::string& name) 
+	:m_name(name), m_level(LogLevel::DEBUG) {
+	m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+	m_appenders.update(new AppenderList);
+}
+
+std::string Logger::toYamlString() {
+	MutexType::Lock lock(m_mutex);
+	YAML::Node node;
+	node["name"] = m_name;
+	if (m_level != LogLevel::UNKNOWN && m_level != LogLevel::INVALID) {
+		node["level"] = LogLevel::ToString(m_level);
+	}
+	if (m_formatter) {
+		node["formatter"] = m_formatter->getPattern();
+	}
+	for (auto& it: *m_appenders.read()) {
+		node["appenders"].push_back(YAML::Load(it->toYamlString()));
+	}
+	std::stringstream ss;
+	ss << node;
+	//std::cout << ss.str() << "=============" << std::endl;
+	return ss.str();
+}
+
+void Logger::clearAppender() {
+	MutexType::Lock lock(m_mutex);
+	setAppenders(new AppenderList);
+}
+
+void Logger::setAppenders(AppenderList* list) {
+	m_appenders.update(list);
+}
+
+void Logger::log(LogLevel::Level level, LogEvent& event) {
+	if (level < getLevel()) {
+		return;
+	}
+	// 没有 Appender 时交给 root, 同样检查 root 的级别
+	Logger* logger = this;
+	while (true) {
+		// 持有快照期间不能让出协程, Appender 的写出不会让出
+		RcuPtr<AppenderList>::ReadGuard appenders = logger->m_appenders.read();
+		if (!appenders->empty()) {
+			for (auto& it: *appenders) {
+				it->log(event.getLogger(), level, event);
 			}
+			return;
+		}
+		logger = logger->m_root.get();
+		if (!logger || level < logger->getLevel()) {
+			return;
 		}
 	}
-	//std::cout << __LINE__ << " : " << m_items.size() << std::endl;
 }
 
-void LogAppender::setFormatter(LogFormatter::ptr val) {
+void Logger::debug(LogEvent& event) {
+	log(LogLevel::DEBUG, event);
+}
+
+void Logger::info(LogEvent& event) {
+	log(LogLevel::INFO, event);
+}
+
+void Logger::warn(LogEvent& event) {
+	log(LogLevel::WARN, event);
+}
+
+void Logger::error(LogEvent& event) {
+	log(LogLevel::ERROR, event);
+}
+
+void Logger::fatal(LogEvent& event) {
+	log(LogLevel::FATAL, event);
+}
+
+
+LogFormatter::ptr Logger::getFormatter() {
+	MutexType::Lock lock(m_mutex);
+	return m_formatter;
+}
+
+void Logger::setFormatter(LogFormatter::ptr formatter) {
+	MutexType::Lock lock(m_mutex);
+	m_formatter = formatter;
+	for (auto &it: *m_appenders.read()) {
+		MutexType::Lock lock(it->m_mutex);
+		if (it->m_hasFormatter) {
+			it->resetFormatter(m_formatter);
+		}
+	}
+}
+
+void Logger::setFormatter(const std::string& str) {
+	MNSER::LogFormatter::ptr new_formatter(new MNSER::LogFormatter(str));
+	if (new_formatter->isError()) {
+		std::cout << "Logger setFormatter name=" << m_name << " value="
+		<< str << " invalid formatter." << std::endl;
+		return ;
+	}
+	setFormatter(new_formatter);
+}
+
+void Logger::addAppender(LogAppender::ptr appender) {
+	MutexType::Lock lock(m_mutex);
+	if (!appender->getFormatter()) {
+		MutexType::Lock lock(appender->m_mutex);
+		appender->resetFormatter(m_formatter);
+	}
+	AppenderList* list = new AppenderList(*m_appenders.read());
+	list->push_back(appender);
+	setAppenders(list);
+};
+
+void Logger::delAppender(LogAppender::ptr appender) {
+	MutexType::Lock lock(m_mutex);
+	AppenderList list(*m_appenders.read());
+	for (auto it = list.begin(); 
+		it != list.end(); ++it) {
+		if (*it == appender) {
+			list.erase(it);
+			setAppenders(new AppenderList(std::move(list)));
+			break;
+		}
+	}
+};
+
+// 写出全部内容, 处理 writev 只写了一部分的情况
+static void WriteFully(int fd, const struct iovec* iov, int cnt) {
+	std::vector<struct iovec> rest;
+	while (cnt > 0) {
+		ssize_t n = ::writev(fd, iov, cnt > IOV_MAX ? IOV_MAX : cnt);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		while (cnt > 0 && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			++iov;
+			--cnt;
+		}
+		if (cnt > 0 && n > 0) {
+			rest.assign(iov, iov + cnt);
+			rest[0].iov_base = (char*)rest[0].iov_base + n;
+			rest[0].iov_len -= n;
+			iov = &rest[0];
+		}
+	}
+}
+
+static MNSER::ConfigVar<uint32_t>::ptr g_log_file_check_interval =
+	MNSER::Config::Lookup("log.file.check_interval", (uint32_t)1, "log file check interval second");
+
+const char* FileLogAppender::RotateToString(Rotate v) {
+	switch (v) {
+	case HOURLY:
+		return "hourly";
+	case DAILY:
+		return "daily";
+	default:
+		return "none";
+	}
+}
+
+FileLogAppender::Rotate FileLogAppender::RotateFromString(const std::string& str) {
+	if (str == "hourly") {
+		return HOURLY;
+	}
+	if (str == "daily") {
+		return DAILY;
+	}
+	return NONE;
+}
+
+// 删除 filename 切出去的最旧的文件, 只保留 max_files 个
+// only_gz 为 true 时还没压缩完的文件不算在内
+static void RemoveOldLogFiles(const std::string& filename, uint32_t max_files, bool only_gz) {
+	if (max_files == 0) {
+		return;
+	}
+	std::string dir = ".";
+	std::string prefix = filename;
+	size_t pos = filename.rfind('/');
+	if (pos != std::string::npos) {
+		dir = pos == 0 ? "/" : filename.substr(0, pos);
+		prefix = filename.substr(pos + 1);
+	}
+	prefix += ".";
+
+	DIR* d = opendir(dir.c_str());
+	if (!d) {
+		return;
+	}
+	// 按最后修改时间排序, 删除最旧的
+	std::vector<std::pair<std::pair<time_t, long>, std::string> > files;
+	struct dirent* dp;
+	while ((dp = readdir(d)) != nullptr) {
+		std::string name = dp->d_name;
+		if (name.compare(0, prefix.size(), prefix) != 0
+				|| (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+				|| (only_gz && (name.size() < 3 || name.compare(name.size() - 3, 3, ".gz") != 0))) {
+			continue;
+		}
+		std::string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+			files.push_back(std::make_pair(std::make_pair(st.st_mtim.tv_sec, st.st_mtim.tv_nsec), path));
+		}
+	}
+	closedir(d);
+	if (files.size() <= max_files) {
+		return;
+	}
+	std::sort(files.begin(), files.end());
+	for (size_t i = 0; i < files.size() - max_files; ++i) {
+		unlink(files[i].second.c_str());
+	}
+}
+
+// 把 file 压缩为 file.gz, 修改时间不变, 成功后删除 file
+static bool CompressLogFile(const std::string& file) {
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	std::string tmp = file + ".gz.tmp";
+	gzFile gz = gzopen(tmp.c_str(), "wb");
+	if (!gz) {
+		::close(fd);
+		return false;
+	}
+	bool ok = true;
+	char buf[64 * 1024];
+	ssize_t n;
+	while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+		if (gzwrite(gz, buf, n) != n) {
+			ok = false;
+			break;
+		}
+	}
+	::close(fd);
+	ok = gzclose(gz) == Z_OK && ok && n == 0;
+	struct timespec times[2] = {st.st_atim, st.st_mtim};
+	if (ok && utimensat(AT_FDCWD, tmp.c_str(), times, 0) == 0
+			&& rename(tmp.c_str(), (file + ".gz").c_str()) == 0) {
+		unlink(file.c_str());
+		return true;
+	}
+	unlink(tmp.c_str());
+	return false;
+}
+
+static void LogCompressorAtExit();
+
+// 压缩轮转后日志的后台线程, 第一次提交任务时启动, 按提交的顺序依次执行
+// 和异步日志的写线程分开, 压缩大文件时不会耽误缓冲区中日志的写出
+class LogCompressor {
+public:
+	static LogCompressor* GetInstance();
+
+	// 后台线程已停止时在调用线程执行
+	void post(std::function<void()> task) {
+		{
+			Mutex::Lock lock(m_mutex);
+			if (!m_stopping) {
+				if (!m_thread) {
+					m_thread.reset(new Thread(std::bind(&LogCompressor::run, this), "log_compress"));
+				}
+				m_tasks.push_back(task);
+				m_sem.notify();
+				return;
+			}
+		}
+		task();
+	}
+
+	// 执行完已提交的任务后停止后台线程, 进程退出时自动调用
+	void stop() {
+		Thread::ptr thread;
+		{
+			Mutex::Lock lock(m_mutex);
+			if (m_stopping) {
+				return;
+			}
+			m_stopping = true;
+			thread = m_thread;
+			m_sem.notify();
+		}
+		if (thread) {
+			thread->join();
+		}
+	}
+
+private:
+	LogCompressor() {
+		atexit(LogCompressorAtExit);
+	}
+
+	// 每个任务和停止各通知一次, 最后一次醒来时队列为空
+	void run() {
+		while (true) {
+			m_sem.wait();
+			std::function<void()> task;
+			{
+				Mutex::Lock lock(m_mutex);
+				if (m_tasks.empty()) {
+					if (m_stopping) {
+						break;
+					}
+					continue;
+				}
+				task.swap(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+private:
+	Mutex m_mutex;
+	Semaphore m_sem;
+	std::deque<std::function<void()> > m_tasks;	// m_mutex 保护
+	bool m_stopping = false;		// m_mutex 保护
+	Thread::ptr m_thread;
+};
+
+static void LogCompressorAtExit() {
+	LogCompressor::GetInstance()->stop();
+}
+
+LogCompressor* LogCompressor::GetInstance() {
+	// 不析构, 进程退出时由 atexit 等待剩余的压缩完成
+	static LogCompressor* s_compressor = new LogCompressor;
+	return s_compressor;
+}
+
+bool FileLogAppender::reopen() {
+	Mutex::Lock lock(m_writeMutex);
+	return openFile();
+}
+
+bool FileLogAppender::openFile() {
+	int fd = ::open(m_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (m_fd >= 0) {
+		::close(m_fd);
+	}
+	m_fd = fd;
+	m_size = 0;
+	++m_openCount;
+	time_t now = time(0);
+	m_lastCheck = now;
+	m_periodEnd = getPeriodEnd(now);
+	struct stat st;
+	if (m_fd >= 0 && fstat(m_fd, &st) == 0) {
+		m_size = st.st_size;
+		// 文件里已经有内容, 按最后修改时间确定所属的时间段
+		if (m_size > 0) {
+			m_periodEnd = getPeriodEnd(st.st_mtime);
+		}
+	}
+	return m_fd >= 0;
+}
+
+time_t FileLogAppender::getPeriodEnd(time_t t) const {
+	if (m_rotate == NONE) {
+		return 0;
+	}
+	struct tm tm;
+	localtime_r(&t, &tm);
+	tm.tm_min = 0;
+	tm.tm_sec = 0;
+	if (m_rotate == HOURLY) {
+		tm.tm_hour += 1;
+	} else {
+		tm.tm_hour = 0;
+		tm.tm_mday += 1;
+	}
+	tm.tm_isdst = -1;
+	return mktime(&tm);
+}
+
+void FileLogAppender::checkFile(time_t now) {
+	m_lastCheck = now;
+	struct stat st;
+	struct stat fst;
+	// 文件被删除或者被移走(比如 logrotate), 重新打开
+	if (m_fd < 0 || stat(m_filename.c_str(), &st) != 0
+			|| fstat(m_fd, &fst) != 0
+			|| st.st_ino != fst.st_ino || st.st_dev != fst.st_dev) {
+		openFile();
+	}
+}
+
+void FileLogAppender::rotate(time_t now) {
+	struct tm tm;
+	localtime_r(&now, &tm);
+	char buf[64];
+	strftime(buf, sizeof(buf), "%Y%m%d-%H%M%S", &tm);
+	std::string name = m_filename + "." + buf;
+	std::string target = name;
+	struct stat st;
+	for (int i = 1; stat(target.c_str(), &st) == 0 || stat((target + ".gz").c_str(), &st) == 0; ++i) {
+		target = name + "." + std::to_string(i);
+	}
+	if (rename(m_filename.c_str(), target.c_str()) != 0) {
+		// 持有 m_writeMutex, 写日志可能回到本 Appender, 直接输出到 stderr
+		std::cerr << "log file rotate " << m_filename << " to " << target
+			<< " fail, errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+	}
+	openFile();
+	if (m_compress) {
+		// 压缩放到单独的后台线程, 按轮转的顺序依次执行, 不阻塞写日志
+		std::string filename = m_filename;
+		uint32_t max_files = m_maxFiles;
+		LogCompressor::GetInstance()->post([filename, target, max_files]() {
+			CompressLogFile(target);
+			RemoveOldLogFiles(filename, max_files, true);
+		});
+	} else {
+		RemoveOldLogFiles(m_filename, m_maxFiles, false);
+	}
+}
+
+void FileLogAppender::setMaxSize(uint64_t v) {
+	Mutex::Lock lock(m_writeMutex);
+	m_maxSize = v;
+}
+
+void FileLogAppender::setRotate(Rotate v) {
+	Mutex::Lock lock(m_writeMutex);
+	m_rotate = v;
+	m_periodEnd = getPeriodEnd(time(0));
+	struct stat st;
+	if (m_fd >= 0 && fstat(m_fd, &st) == 0 && st.st_size > 0) {
+		m_periodEnd = getPeriodEnd(st.st_mtime);
+	}
+}
+
+void FileLogAppender::setMaxFiles(uint32_t v) {
+	Mutex::Lock lock(m_writeMutex);
+	m_maxFiles = v;
+}
+
+void FileLogAppender::setCompress(bool v) {
+	Mutex::Lock lock(m_writeMutex);
+	m_compress = v;
+}
+
+std::string FileLogAppender::toYamlString() {
 	MutexType::Lock lock(m_mutex);
-	m_formatter = val;
-	if (m_formatter) {
-		m_hasFormatter = true;
-	} else {
-		m_hasFormatter = false;
+	YAML::Node node;
+	node["type"] = "FileLogAppender";
+	node["file"] = m_filename;
+	if (m_maxSize) {
+		node["max_size"] = m_maxSize;
+	}
+	if (m_rotate != NONE) {
+		node["rotate"] = RotateToString(m_rotate);
+	}
+	if (m_maxFiles) {
+		node["max_files"] = m_maxFiles;
 	}
+	if (m_compress) {
+		node["compress"] = true;
+	}
+	if (m_level != LogLevel::UNKNOWN && m_level != LogLevel::INVALID) {
+		node["level"] = LogLevel::ToString(m_level);
+	}
+	if (m_async) {
+		node["async"] = true;
+		node["overflow"] = OverflowToString(m_overflow);
+	}
+	if (m_hasFormatter && m_formatter) {
+		node["formatter"] = m_formatter->getPattern();
+	}
+	std::stringstream ss;
+	ss << node;
+	return ss.str();
 }
 
-LogFormatter::ptr LogAppender::getFormatter() { 
-	MutexType::Lock lock(m_mutex);
-	return m_formatter; 
+StdoutLogAppender::~StdoutLogAppender() {
+	flushAsync();
 }
 
-Logger::Logger(const std::string& name) 
-	:m_name(name), m_level(LogLevel::DEBUG) {
-	m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+void StdoutLogAppender::write(const struct iovec* iov, int cnt) {
+	WriteFully(STDOUT_FILENO, iov, cnt);
 }
 
-std::string Logger::toYamlString() {
+std::string StdoutLogAppender::toYamlString() {
 	MutexType::Lock lock(m_mutex);
 	YAML::Node node;
-	node["name"] = m_name;
+	node["type"] = "StdoutLogAppender";
 	if (m_level != LogLevel::UNKNOWN && m_level != LogLevel::INVALID) {
 		node["level"] = LogLevel::ToString(m_level);
 	}
-	if (m_formatter) {
-		node["formatter"] = m_formatter->getPattern();
+	if (m_async) {
+		node["async"] = true;
+		node["overflow"] = OverflowToString(m_overflow);
 	}
-	for (auto& it: m_appenders) {
-		node["appenders"].push_back(YAML::Load(it->toYamlString()));
+	if (m_hasFormatter && m_formatter) {
+		node["formatter"] = m_formatter->getPattern();
 	}
 	std::stringstream ss;
 	ss << node;
-	//std::cout << ss.str() << "=============" << std::endl;
 	return ss.str();
+	
 }
 
-void Logger::clearAppender() {
-	MutexType::Lock lock(m_mutex);
-	m_appenders.clear();
+FileLogAppender::FileLogAppender(const std::string &filename): m_filename(filename) {
+	reopen();
 }
 
-void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
-	//std::cout << "m_levle: " <<  LogLevel::ToString(m_level) << std::endl;
-	//std::cout << "level: " << LogLevel::ToString(level) << std::endl;
-	
-	if (level >= m_level) {
-		MutexType::Lock lock(m_mutex);
-		auto self = shared_from_this();
-		//std::cout << __FILE__ << "  " << __LINE__ << "My appenders  size is " << m_appenders.size() << std::endl;
-		if (!m_appenders.empty()) {
-			for (auto& it: m_appenders) {
-				//std::cout << __LINE__ << " : " << event->getContent() << std::endl;
-				it->log(self, level, event);
-			}
-		} else if (m_root) {
-			m_root->log(level, event);
-		}
+FileLogAppender::~FileLogAppender() {
+	flushAsync();
+	if (m_fd >= 0) {
+		::close(m_fd);
 	}
 }
 
-void Logger::debug(LogEvent::ptr event) {
-	log(LogLevel::DEBUG, event);
+void FileLogAppender::write(const struct iovec* iov, int cnt) {
+	size_t len = 0;
+	for (int i = 0; i < cnt; ++i) {
+		len += iov[i].iov_len;
+	}
+	checkWrite(len);
+	writeFile(iov, cnt, len);
 }
 
-void Logger::info(LogEvent::ptr event) {
-	log(LogLevel::INFO, event);
+void FileLogAppender::checkWrite(size_t len) {
+	time_t now = time(0);
+	if (now < m_lastCheck || now - m_lastCheck >= (time_t)*g_log_file_check_interval->getValue()) {
+		checkFile(now);
+	}
+	if (m_fd >= 0 && m_size > 0
+			&& ((m_maxSize && m_size + len > m_maxSize)
+				|| (m_rotate != NONE && now >= m_periodEnd))) {
+		rotate(now);
+	}
 }
 
-void Logger::warn(LogEvent::ptr event) {
-	log(LogLevel::WARN, event);
+void FileLogAppender::writeFile(const struct iovec* iov, int cnt, size_t len) {
+	if (m_fd >= 0) {
+		WriteFully(m_fd, iov, cnt);
+		m_size += len;
+	}
 }
 
-void Logger::error(LogEvent::ptr event) {
-	log(LogLevel::ERROR, event);
+const char BinaryLogAppender::MAGIC[8] = {'M', 'S', 'B', 'L', 'O', 'G', '1', '\n'};
+
+template<class T>
+static void PutBinary(std::string& out, T v) {
+	out.append((const char*)&v, sizeof(v));
 }
 
-void Logger::fatal(LogEvent::ptr event) {
-	log(LogLevel::FATAL, event);
+static void PutBinaryString(std::string& out, const char* str, size_t len) {
+	if (len > UINT16_MAX) {
+		len = UINT16_MAX;
+	}
+	PutBinary(out, (uint16_t)len);
+	out.append(str, len);
 }
 
+// 记录头, 内容写完之后再填长度
+static size_t BeginRecord(std::string& out, BinaryRecord::Type type, LogLevel::Level level) {
+	size_t pos = out.size();
+	BinaryRecord r;
+	r.len = 0;
+	r.type = type;
+	r.level = level;
+	r.reserved = 0;
+	PutBinary(out, r);
+	return pos;
+}
 
-LogFormatter::ptr Logger::getFormatter() {
-	MutexType::Lock lock(m_mutex);
-	return m_formatter;
+static void EndRecord(std::string& out, size_t pos) {
+	uint32_t len = out.size() - pos - sizeof(BinaryRecord);
+	memcpy(&out[pos], &len, sizeof(len));
 }
 
-void Logger::setFormatter(LogFormatter::ptr formatter) {
-	MutexType::Lock lock(m_mutex);
-	m_formatter = formatter;
-	std::cout << " ###" << m_appenders.size() << std::endl;
-	for (auto &it: m_appenders) {
-		MutexType::Lock lock(it->m_mutex);
-		if (it->m_hasFormatter) {
-			it->m_formatter = m_formatter;
+BinaryLogAppender::BinaryLogAppender(const std::string& filename)
+	:FileLogAppender(filename) {
+}
+
+BinaryLogAppender::~BinaryLogAppender() {
+	// 基类析构时才等待异步缓冲区写出, 那时已经不能调用 write
+	flushAsync();
+}
+
+void BinaryLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, LogEvent& event) {
+	if (level < getLevel()) {
+		return;
+	}
+	// 只拷贝参数, 不格式化
+	static thread_local std::string t_buf;
+	std::string& msg = t_buf;
+	msg.clear();
+	const LogBinSite* site = event.getSite();
+	size_t pos = BeginRecord(msg, BinaryRecord::EVENT, level);
+	PutBinary(msg, (uint32_t)(site ? site->id : 0));
+	PutBinary(msg, (uint32_t)event.getThreadId());
+	PutBinary(msg, (uint32_t)event.getFiberId());
+	PutBinary(msg, (uint32_t)event.getElapse());
+	PutBinary(msg, (uint64_t)event.getTime());
+	PutBinaryString(msg, logger->getName().data(), logger->getName().size());
+	PutBinaryString(msg, event.getThreadName(), strlen(event.getThreadName()));
+	if (site) {
+		msg.append(event.getSS().data(), event.getSS().size());
+	} else {
+		PutBinaryString(msg, event.getFile(), strlen(event.getFile()));
+		PutBinary(msg, (int32_t)event.getLine());
+		PutBinary(msg, (char)LogBinArgs::STRING);
+		PutBinary(msg, (uint32_t)event.getContentSize());
+		msg.append(event.getContentData(), event.getContentSize());
+	}
+	EndRecord(msg, pos);
+	submit(level, msg);
+}
+
+void BinaryLogAppender::formatDropped(std::string& out, uint64_t count) {
+	out.clear();
+	size_t pos = BeginRecord(out, BinaryRecord::DROPPED, LogLevel::WARN);
+	PutBinary(out, count);
+	EndRecord(out, pos);
+}
+
+void BinaryLogAppender::write(const struct iovec* iov, int cnt) {
+	size_t len = 0;
+	for (int i = 0; i < cnt; ++i) {
+		len += iov[i].iov_len;
+	}
+	checkWrite(len);
+	m_defs.clear();
+	// 新打开的文件要重新写调用点的定义, 空文件先写文件头
+	if (m_lastOpenCount != getOpenCount()) {
+		m_lastOpenCount = getOpenCount();
+		m_defined.clear();
+		if (getFileSize() == 0) {
+			m_defs.append(MAGIC, sizeof(MAGIC));
+		}
+	}
+	// 每个 iovec 是一条记录, 第一次出现的调用点在记录之前写出定义
+	m_defEnds.clear();
+	for (int i = 0; i < cnt; ++i) {
+		const BinaryRecord* r = (const BinaryRecord*)iov[i].iov_base;
+		uint32_t id = 0;
+		if (iov[i].iov_len >= sizeof(BinaryRecord) + sizeof(id) && r->type == BinaryRecord::EVENT) {
+			memcpy(&id, r + 1, sizeof(id));
+		}
+		if (id && (id >= m_defined.size() || !m_defined[id])) {
+			const LogBinSite* site = LogBinSite::Get(id);
+			if (site) {
+				size_t pos = BeginRecord(m_defs, BinaryRecord::SITE, site->level);
+				PutBinary(m_defs, id);
+				PutBinary(m_defs, (int32_t)site->line);
+				PutBinaryString(m_defs, site->file, strlen(site->file));
+				PutBinaryString(m_defs, site->fmt, strlen(site->fmt));
+				EndRecord(m_defs, pos);
+			}
+			if (id >= m_defined.size()) {
+				m_defined.resize(id + 1, false);
+			}
+			m_defined[id] = true;
 		}
+		m_defEnds.push_back(m_defs.size());
 	}
+	if (m_defs.empty()) {
+		writeFile(iov, cnt, len);
+		return;
+	}
+	m_iovs.clear();
+	size_t begin = 0;
+	for (int i = 0; i < cnt; ++i) {
+		if (m_defEnds[i] > begin) {
+			struct iovec def;
+			def.iov_base = &m_defs[begin];
+			def.iov_len = m_defEnds[i] - begin;
+			m_iovs.push_back(def);
+			begin = m_defEnds[i];
+		}
+		m_iovs.push_back(iov[i]);
+	}
+	writeFile(&m_iovs[0], m_iovs.size(), len + m_defs.size());
 }
 
-void Logger::setFormatter(const std::string& str) {
-	MNSER::LogFormatter::ptr new_formatter(new MNSER::LogFormatter(str));
-	if (new_formatter->isError()) {
-		std::cout << "Logger setFormatter name=" << m_name << " value="
-		<< str << " invalid formatter." << std::endl;
-		return ;
+std::string BinaryLogAppender::toYamlString() {
+	YAML::Node node = YAML::Load(FileLogAppender::toYamlString());
+	node["type"] = "BinaryLogAppender";
+	node.remove("formatter");
+	std::stringstream ss;
+	ss << node;
+	return ss.str();
+}
+
+BinaryLogReader::BinaryLogReader(const std::string& filename) {
+	m_file = gzopen(filename.c_str(), "rb");
+	char magic[sizeof(BinaryLogAppender::MAGIC)];
+	m_valid = m_file && read(magic, sizeof(magic))
+		&& memcmp(magic, BinaryLogAppender::MAGIC, sizeof(magic)) == 0;
+}
+
+BinaryLogReader::~BinaryLogReader() {
+	if (m_file) {
+		gzclose(m_file);
 	}
-	setFormatter(new_formatter);
 }
 
-void Logger::addAppender(LogAppender::ptr appender) {
-	MutexType::Lock lock(m_mutex);
-	if (!appender->getFormatter()) {
-		MutexType::Lock lock(appender->m_mutex);
-		appender->m_formatter = m_formatter;
+bool BinaryLogReader::read(void* buf, size_t len) {
+	return len == 0 || gzread(m_file, buf, len) == (int)len;
+}
+
+Logger::ptr BinaryLogReader::getLogger(const std::string& name) {
+	auto& logger = m_loggers[name];
+	if (!logger) {
+		logger.reset(new Logger(name));
+	}
+	return logger;
+}
+
+// 从记录内容中按顺序读取
+struct BinaryRecordReader {
+	BinaryRecordReader(const std::string& buf)
+		:p(buf.data()), end(buf.data() + buf.size()) {
+	}
+
+	template<class T>
+	bool get(T& v) {
+		if (p + sizeof(T) > end) {
+			return false;
+		}
+		memcpy(&v, p, sizeof(T));
+		p += sizeof(T);
+		return true;
+	}
+
+	bool getString(std::string& v) {
+		uint16_t len = 0;
+		if (!get(len) || p + len > end) {
+			return false;
+		}
+		v.assign(p, len);
+		p += len;
+		return true;
 	}
-	m_appenders.push_back(appender);
+
+	const char* p;
+	const char* end;
 };
 
-void Logger::delAppender(LogAppender::ptr appender) {
-	MutexType::Lock lock(m_mutex);
-	for (auto it = m_appenders.begin(); 
-		it != m_appenders.end(); ++it) {
-		if (*it == appender) {
-			m_appenders.erase(it);
+bool BinaryLogReader::next(LogFormatter::ptr formatter, std::string& out) {
+	if (!m_valid) {
+		return false;
+	}
+	BinaryRecord r;
+	while (read(&r, sizeof(r))) {
+		m_buf.resize(r.len);
+		if (!read(&m_buf[0], r.len)) {
 			break;
 		}
+		BinaryRecordReader rd(m_buf);
+		LogLevel::Level level = (LogLevel::Level)r.level;
+		if (r.type == BinaryRecord::SITE) {
+			uint32_t id = 0;
+			Site site;
+			site.level = level;
+			if (rd.get(id) && rd.get(site.line)
+					&& rd.getString(site.file) && rd.getString(site.fmt)) {
+				m_sites[id] = site;
+			}
+		} else if (r.type == BinaryRecord::DROPPED) {
+			uint64_t count = 0;
+			rd.get(count);
+			out.append("[binary log] dropped " + std::to_string(count) + " messages\n");
+			return true;
+		} else if (r.type == BinaryRecord::EVENT) {
+			uint32_t id = 0, thread_id = 0, fiber_id = 0, elapse = 0;
+			uint64_t time = 0;
+			std::string name, thread_name, file;
+			int32_t line = 0;
+			if (!rd.get(id) || !rd.get(thread_id) || !rd.get(fiber_id) || !rd.get(elapse)
+					|| !rd.get(time) || !rd.getString(name) || !rd.getString(thread_name)) {
+				continue;
+			}
+			const char* fmt = "%s";
+			if (id) {
+				auto it = m_sites.find(id);
+				if (it == m_sites.end()) {
+					fmt = "[unknown site]";
+				} else {
+					fmt = it->second.fmt.c_str();
+					file = it->second.file;
+					line = it->second.line;
+				}
+			} else if (!rd.getString(file) || !rd.get(line)) {
+				continue;
+			}
+			m_content.clear();
+			LogBinArgs::Format(m_content, fmt, rd.p, rd.end - rd.p);
+			Logger::ptr logger = getLogger(name);
+			LogEvent event(logger, level, file.c_str(), line, elapse
+					, thread_id, fiber_id, time, thread_name.c_str());
+			event.getSS().append(m_content.data(), m_content.size());
+			formatter->format(out, logger, level, event);
+			return true;
+		}
+		// 不认识的记录跳过
+	}
+	return false;
+}
+
+static MNSER::ConfigVar<uint32_t>::ptr g_log_async_buffer_size =
+	MNSER::Config::Lookup("log.async.buffer_size", (uint32_t)(256 * 1024), "async log buffer size per thread");
+
+static MNSER::ConfigVar<uint32_t>::ptr g_log_async_flush_interval =
+	MNSER::Config::Lookup("log.async.flush_interval", (uint32_t)20, "async log flush interval ms");
+
+/*
+ * 单生产者单消费者的环形缓冲区
+ * 生产者是写日志的线程, 消费者是 AsyncLogWriter 的后台线程
+ * 每条记录是 Record 头加日志内容, 按 ALIGN 对齐
+ * 尾部剩余空间放不下时写一个 appender 为空的记录, 表示跳到缓冲区开头
+ */
+class LogRing {
+friend class AsyncLogWriter;
+public:
+	typedef std::shared_ptr<LogRing> ptr;
+
+	struct Record {
+		LogAppender* appender;
+		uint32_t len;
+		uint32_t level;
+	};
+
+	static const size_t ALIGN = 16;
+
+	static size_t RecordSize(size_t len) {
+		return (sizeof(Record) + len + ALIGN - 1) & ~(ALIGN - 1);
+	}
+
+	LogRing(size_t capacity) {
+		m_capacity = 4096;
+		while (m_capacity < capacity) {
+			m_capacity <<= 1;
+		}
+		m_mask = m_capacity - 1;
+		m_buf = (char*)malloc(m_capacity);
+	}
+
+	~LogRing() {
+		free(m_buf);
+	}
+
+	size_t capacity() const { return m_capacity; }
+	size_t used() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+	bool empty() const { return used() == 0; }
+
+	// 生产者调用, 空间不够返回 false
+	bool push(LogAppender* appender, LogLevel::Level level, const char* data, size_t len) {
+		size_t need = RecordSize(len);
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		uint64_t tail = m_tail.load(std::memory_order_acquire);
+		size_t pos = head & m_mask;
+		size_t tail_room = m_capacity - pos;
+		size_t total = need <= tail_room ? need : tail_room + need;
+		if (total > m_capacity - (head - tail)) {
+			return false;
+		}
+		if (need > tail_room) {
+			Record* pad = (Record*)(m_buf + pos);
+			pad->appender = nullptr;
+			pad->len = 0;
+			pos = 0;
+		}
+		Record* r = (Record*)(m_buf + pos);
+		r->appender = appender;
+		r->len = len;
+		r->level = level;
+		memcpy(r + 1, data, len);
+		m_head.store(head + total, std::memory_order_release);
+		return true;
 	}
+
+	Record* at(uint64_t pos) const { return (Record*)(m_buf + (pos & m_mask)); }
+
+	void close() { m_closed = true; }
+	bool isClosed() const { return m_closed; }
+
+private:
+	char* m_buf = nullptr;
+	size_t m_capacity = 0;
+	size_t m_mask = 0;
+	std::atomic<bool> m_closed{false};
+	char m_pad1[64];
+	std::atomic<uint64_t> m_head{0};	// 生产者写入的位置
+	char m_pad2[64];
+	std::atomic<uint64_t> m_tail{0};	// 消费者读取的位置, 只有后台线程修改
 };
 
-bool FileLogAppender::reopen() {
-	MutexType::Lock lock(m_mutex);
-	if (m_filestream) {
-		m_filestream.close();
+// 线程退出时标记缓冲区关闭, 后台线程写完后释放
+struct LogRingHolder {
+	~LogRingHolder() {
+		if (ring) {
+			ring->close();
+		}
 	}
-	// unwan
-	m_filestream.open(m_filename, std::ios_base::app);
-	return !!m_filestream;
+	LogRing::ptr ring;
+};
+
+static thread_local LogRingHolder t_log_ring;
+static thread_local bool t_log_writer = false;
+
+AsyncLogWriter* AsyncLogWriter::GetInstance() {
+	// 不析构, 进程退出时由 atexit 停止后台线程, 之后仍然可以安全地同步写日志
+	static AsyncLogWriter* s_writer = new AsyncLogWriter;
+	return s_writer;
 }
 
-std::string FileLogAppender::toYamlString() {
-	MutexType::Lock lock(m_mutex);
-	YAML::Node node;
-	node["type"] = "FileLogAppender";
-	node["file"] = m_filename;
-	if (m_level != LogLevel::UNKNOWN && m_level != LogLevel::INVALID) {
-		node["level"] = LogLevel::ToString(m_level);
-	}
-	if (m_hasFormatter && m_formatter) {
-		node["formatter"] = m_formatter->getPattern();
+static void AsyncLogWriterAtExit() {
+	AsyncLogWriter::GetInstance()->stop();
+}
+
+AsyncLogWriter::AsyncLogWriter() {
+	m_eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	m_thread.reset(new Thread(std::bind(&AsyncLogWriter::run, this), "log_writer"));
+	atexit(AsyncLogWriterAtExit);
+}
+
+void AsyncLogWriter::notify() {
+	eventfd_write(m_eventFd, 1);
+}
+
+LogRing* AsyncLogWriter::getRing() {
+	if (!t_log_ring.ring) {
+		t_log_ring.ring.reset(new LogRing(*g_log_async_buffer_size->getValue()));
+		Mutex::Lock lock(m_mutex);
+		m_rings.push_back(t_log_ring.ring);
 	}
-	std::stringstream ss;
-	ss << node;
-	return ss.str();
+	return t_log_ring.ring.get();
 }
 
-void StdoutLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)  {
-	if (m_level <= level) {
-		//std::cout << __LINE__ << " : " << std::endl;
-		MutexType::Lock lock(m_mutex);
-		m_formatter->format(std::cout, logger, level, event);
+bool AsyncLogWriter::append(LogAppender* appender, LogLevel::Level level, const std::string& msg) {
+	if (m_stopping || t_log_writer) {
+		return false;
+	}
+	LogRing* ring = getRing();
+	size_t need = LogRing::RecordSize(msg.size());
+	if (need > ring->capacity() / 2) {
+		return false;
+	}
+	LogAppender::Overflow overflow = appender->m_overflow;
+	if (overflow == LogAppender::DROP_DEBUG && level <= LogLevel::DEBUG
+			&& ring->used() + need > ring->capacity() / 4 * 3) {
+		++appender->m_dropped;
+		++appender->m_dropCount;
+		return true;
+	}
+
+	size_t half = ring->capacity() / 2;
+	size_t before = ring->used();
+	while (!ring->push(appender, level, msg.data(), msg.size())) {
+		if (overflow == LogAppender::DROP) {
+			++appender->m_dropped;
+			++appender->m_dropCount;
+			return true;
+		}
+		if (m_stopped) {
+			return false;
+		}
+		// 不能让出协程, 调用方可能持有 Logger 的自旋锁
+		notify();
+		poll(nullptr, 0, 1);
+		before = ring->used();
+	}
+	// 超过一半时提前唤醒后台线程
+	if (before < half && before + need >= half) {
+		notify();
 	}
+	return true;
 }
 
-std::string StdoutLogAppender::toYamlString() {
-	MutexType::Lock lock(m_mutex);
-	YAML::Node node;
-	node["type"] = "StdoutLogAppender";
-	if (m_level != LogLevel::UNKNOWN && m_level != LogLevel::INVALID) {
-		node["level"] = LogLevel::ToString(m_level);
+void AsyncLogWriter::flush() {
+	if (t_log_writer) {
+		return;
 	}
-	if (m_hasFormatter && m_formatter) {
-		node["formatter"] = m_formatter->getPattern();
+	// 调用之后开始的一轮处理结束, 之前提交的日志就都写出了
+	uint64_t target = m_round + 2;
+	while (m_round < target && !m_stopped) {
+		notify();
+		poll(nullptr, 0, 1);
 	}
-	std::stringstream ss;
-	ss << node;
-	return ss.str();
-	
 }
 
-FileLogAppender::FileLogAppender(const std::string &filename): m_filename(filename) {
-	reopen();
+void AsyncLogWriter::stop() {
+	if (m_stopping.exchange(true)) {
+		return;
+	}
+	notify();
+	m_thread->join();
+}
+
+void AsyncLogWriter::output(LogAppender* appender, std::vector<struct iovec>& iovs) {
+	if (iovs.empty()) {
+		return;
+	}
+	uint64_t dropped = appender->m_dropped.exchange(0);
+	if (dropped) {
+		appender->formatDropped(m_notice, dropped);
+		struct iovec iov;
+		iov.iov_base = (void*)m_notice.data();
+		iov.iov_len = m_notice.size();
+		iovs.push_back(iov);
+	}
+	Mutex::Lock lock(appender->m_writeMutex);
+	appender->write(&iovs[0], iovs.size());
+	iovs.clear();
 }
 
-void FileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event)  {
-	if (m_level <= level) {
-		uint64_t now = event->getTime();
-		if (now >= m_lastTime) {
-			// 防止把文件删除之后，没有感知到被删，防止占用文件句柄
-			reopen();
-			m_lastTime = now;
+size_t AsyncLogWriter::drain(LogRing* ring) {
+	static const size_t MAX_IOV = 256;
+	uint64_t tail = ring->m_tail.load(std::memory_order_relaxed);
+	uint64_t head = ring->m_head.load(std::memory_order_acquire);
+	LogAppender* cur = nullptr;
+	size_t n = 0;
+	m_iovs.clear();
+	while (tail < head) {
+		LogRing::Record* r = ring->at(tail);
+		if (!r->appender) {
+			tail += ring->capacity() - (tail & (ring->capacity() - 1));
+			continue;
+		}
+		if (r->appender != cur || m_iovs.size() >= MAX_IOV) {
+			if (cur) {
+				output(cur, m_iovs);
+			}
+			// 已经写出的记录才能释放给生产者
+			ring->m_tail.store(tail, std::memory_order_release);
+			cur = r->appender;
 		}
+		struct iovec iov;
+		iov.iov_base = r + 1;
+		iov.iov_len = r->len;
+		m_iovs.push_back(iov);
+		tail += LogRing::RecordSize(r->len);
+		++n;
+	}
+	if (cur) {
+		output(cur, m_iovs);
+	}
+	ring->m_tail.store(tail, std::memory_order_release);
+	return n;
+}
 
-		MutexType::Lock lock(m_mutex);
-		if (!m_formatter->format(m_filestream, logger, level, event)) {
-			std::cout << "error" << std::endl;
+void AsyncLogWriter::run() {
+	t_log_writer = true;
+	struct pollfd pfd;
+	pfd.fd = m_eventFd;
+	pfd.events = POLLIN;
+	while (true) {
+		// 先读标记, 保证停止之前提交的日志在最后一轮中写出
+		bool stopping = m_stopping;
+		std::vector<LogRing::ptr> rings;
+		{
+			Mutex::Lock lock(m_mutex);
+			rings = m_rings;
+		}
+		for (auto& i : rings) {
+			drain(i.get());
 		}
+		{
+			Mutex::Lock lock(m_mutex);
+			for (auto it = m_rings.begin(); it != m_rings.end();) {
+				// 线程已经退出, 不会再有新的日志
+				if ((*it)->isClosed() && (*it)->empty()) {
+					it = m_rings.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+		++m_round;
+		if (stopping) {
+			break;
+		}
+		poll(&pfd, 1, *g_log_async_flush_interval->getValue());
+		eventfd_t v;
+		eventfd_read(m_eventFd, &v);
 	}
+	m_stopped = true;
 }
 
 LoggerManager::LoggerManager() {
@@ -552,36 +1899,54 @@ LoggerManager::LoggerManager() {
 	m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
 
 	m_loggers[m_root->m_name] = m_root;
+	publish();
 	//std::cout << " ### LoggerManager m_root->m_name = " << m_root->m_name << std::endl;
 	init();
 }
 
+void LoggerManager::publish() {
+	m_snapshot.update(new LoggerMap(m_loggers));
+}
+
 void LoggerManager::addLogger(MNSER::Logger::ptr logger) {
+	MutexType::Lock lock(m_mutex);
 	auto it = m_loggers.find(logger->m_name);
 	if (it != m_loggers.end()) {
 		return ;
 	}
 	m_loggers[logger->m_name] = logger;
+	publish();
 }
 
 void LoggerManager::addLogger(const std::string& name) {
-	_addLogger(name);
+	MutexType::Lock lock(m_mutex);
+	if (m_loggers.find(name) == m_loggers.end()) {
+		_addLogger(name);
+	}
 }
 
 Logger::ptr LoggerManager::_addLogger(const std::string& name) {
 	Logger::ptr new_logger(new Logger(name));
 	new_logger->m_root = m_root;
 	m_loggers[name] = new_logger;
+	publish();
 	return new_logger;
 }
 
 Logger::ptr LoggerManager::getLogger(const std::string& name) {
+	{
+		// 加锁前释放快照, 持有 m_mutex 的 publish 会等待快照的读者
+		RcuPtr<LoggerMap>::ReadGuard snapshot = m_snapshot.read();
+		auto it = snapshot->find(name);
+		if (it != snapshot->end()) {
+			return it->second;
+		}
+	}
 	MutexType::Lock lock(m_mutex);
-	// std::cout << "### getLogger for name = " << name << std::endl;
-	auto it = m_loggers.find(name);
-	// std::cout << "### getLogger endl" << std::endl;
-	if (it != m_loggers.end()) {
-		return it->second;
+	// 加锁后再查一次, 其他线程可能刚刚创建
+	auto lit = m_loggers.find(name);
+	if (lit != m_loggers.end()) {
+		return lit->second;
 	}
 	return _addLogger(name);
 }
@@ -607,6 +1972,12 @@ struct LogAppenderItem {
 	LogLevel::Level level = LogLevel::UNKNOWN;
 	std::string formatter;
 	std::string file;
+	bool async = false;
+	int overflow = LogAppender::BLOCK;
+	uint64_t max_size = 0;
+	int rotate = FileLogAppender::NONE;
+	uint32_t max_files = 0;
+	bool compress = false;
 
 	/*
 	 * 重载 == 运算符
@@ -616,14 +1987,26 @@ struct LogAppenderItem {
 		return type == other.type
 			&& level == other.level
 			&& formatter == other.formatter
-			&& file == other.file;
+			&& file == other.file
+			&& async == other.async
+			&& overflow == other.overflow
+			&& max_size == other.max_size
+			&& rotate == other.rotate
+			&& max_files == other.max_files
+			&& compress == other.compress;
 	}
 
 	bool operator!=(const LogAppenderItem& other) const {
 		return type != other.type
 			|| level != other.level
 			|| formatter != other.formatter
-			|| file != other.file;
+			|| file != other.file
+			|| async != other.async
+			|| overflow != other.overflow
+			|| max_size != other.max_size
+			|| rotate != other.rotate
+			|| max_files != other.max_files
+			|| compress != other.compress;
 	}
 
 };
@@ -661,11 +2044,29 @@ struct LogItem {
 	}
 };
 
+// 解析大小, 支持 K/M/G 后缀, 如 100M
+static uint64_t ParseSize(const std::string& str) {
+	char* end = nullptr;
+	uint64_t v = strtoull(str.c_str(), &end, 10);
+	switch (*end) {
+	case 'k':
+	case 'K':
+		return v << 10;
+	case 'm':
+	case 'M':
+		return v << 20;
+	case 'g':
+	case 'G':
+		return v << 30;
+	default:
+		return v;
+	}
+}
+
 template <>
-class LexicalCast<std::string, LogItem > {
+class LexicalCast<YAML::Node, LogItem > {
 public:
-	LogItem operator() (const std::string& from) { 
-		YAML::Node node = YAML::Load(from);
+	LogItem operator() (const YAML::Node& node) { 
 		LogItem lim;
 		if (!node["name"].IsDefined()) {
 			std::cout << "log config error: name is null, " << node 
@@ -687,13 +2088,25 @@ public:
 				}
 				std::string type = ap["type"].as<std::string>();
 				LogAppenderItem lai;
-				if (type == "FileLogAppender") {
+				if (type == "FileLogAppender" || type == "BinaryLogAppender") {
 					if (!ap["file"].IsDefined()) {
 						std::cout << "log config error: fileappender file is null, " << ap << std::endl;
 						continue;
 					}
-					lai.type = LogAppenderItemType_FILE;
+					lai.type = type == "FileLogAppender" ? LogAppenderItemType_FILE : LogAppenderItemType_BINARY;
 					lai.file = ap["file"].as<std::string>();
+					if (ap["max_size"].IsDefined()) {
+						lai.max_size = ParseSize(ap["max_size"].as<std::string>());
+					}
+					if (ap["rotate"].IsDefined()) {
+						lai.rotate = FileLogAppender::RotateFromString(ap["rotate"].as<std::string>());
+					}
+					if (ap["max_files"].IsDefined()) {
+						lai.max_files = ap["max_files"].as<uint32_t>();
+					}
+					if (ap["compress"].IsDefined()) {
+						lai.compress = ap["compress"].as<bool>();
+					}
 				} else if (type == "StdoutLogAppender") {
 					lai.type = LogAppenderItemType_STDOUT;
 				} else {
@@ -703,6 +2116,12 @@ public:
 				if (ap["formatter"].IsDefined()) {
 					lai.formatter = ap["formatter"].as<std::string>();
 				}
+				if (ap["async"].IsDefined()) {
+					lai.async = ap["async"].as<bool>();
+				}
+				if (ap["overflow"].IsDefined()) {
+					lai.overflow = LogAppender::OverflowFromString(ap["overflow"].as<std::string>());
+				}
 				lim.appenders.push_back(lai);
 			}
 		}
@@ -710,6 +2129,14 @@ public:
 	}
 };
 
+template <>
+class LexicalCast<std::string, LogItem > {
+public:
+	LogItem operator() (const std::string& from) { 
+		return LexicalCast<YAML::Node, LogItem>()(YAML::Load(from));
+	}
+};
+
 template <>
 class LexicalCast<LogItem, std::string> {
 public:
@@ -728,9 +2155,21 @@ public:
 		
 		for (auto& it: from.appenders) {
 			YAML::Node n;
-			if (it.type == LogAppenderItemType_FILE) {
-				n["type"] = "FileLogAppender";
+			if (it.type == LogAppenderItemType_FILE || it.type == LogAppenderItemType_BINARY) {
+				n["type"] = it.type == LogAppenderItemType_FILE ? "FileLogAppender" : "BinaryLogAppender";
 				n["file"] = it.file;
+				if (it.max_size) {
+					n["max_size"] = it.max_size;
+				}
+				if (it.rotate != FileLogAppender::NONE) {
+					n["rotate"] = FileLogAppender::RotateToString((FileLogAppender::Rotate)it.rotate);
+				}
+				if (it.max_files) {
+					n["max_files"] = it.max_files;
+				}
+				if (it.compress) {
+					n["compress"] = true;
+				}
 			} else if (it.type == LogAppenderItemType_STDOUT) {
 				n["type"] = "StdoutLogAppender";
 			} else {
@@ -744,6 +2183,10 @@ public:
 			if (!from.formatter.empty()) {
 				n["formatter"] = from.formatter;
 			}
+			if (it.async) {
+				n["async"] = true;
+				n["overflow"] = LogAppender::OverflowToString((LogAppender::Overflow)it.overflow);
+			}
 			node["appenders"].push_back(n);
 		}
 		
@@ -793,8 +2236,18 @@ struct LogInit {
 				logger->clearAppender();
 				for (auto& a: it.appenders) {
 					MNSER::LogAppender::ptr aPtr;
-					if (a.type == LogAppenderItemType_FILE) {
-						aPtr.reset(new FileLogAppender(a.file));
+					if (a.type == LogAppenderItemType_FILE || a.type == LogAppenderItemType_BINARY) {
+						FileLogAppender::ptr fa;
+						if (a.type == LogAppenderItemType_FILE) {
+							fa.reset(new FileLogAppender(a.file));
+						} else {
+							fa.reset(new BinaryLogAppender(a.file));
+						}
+						fa->setMaxSize(a.max_size);
+						fa->setRotate((FileLogAppender::Rotate)a.rotate);
+						fa->setMaxFiles(a.max_files);
+						fa->setCompress(a.compress);
+						aPtr = fa;
 					} else if (a.type == LogAppenderItemType_STDOUT) {
 						// nowan
 						aPtr.reset(new StdoutLogAppender);
@@ -803,6 +2256,7 @@ struct LogInit {
 					}
 
 					aPtr->setLevel(a.level);
+					aPtr->setAsync(a.async, (LogAppender::Overflow)a.overflow);
 
 					if (!a.formatter.empty()) {
 						MNSER::LogFormatter::ptr fmt(new MNSER::LogFormatter(a.formatter));
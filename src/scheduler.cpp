@@ -11,6 +11,8 @@ static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
 
 static thread_local Scheduler* t_scheduler = nullptr;  // 指向当前调度器
 static thread_local Fiber* t_scheduler_fiber = nullptr;  // 指向调度器的协程
+static thread_local Scheduler* t_switch_target = nullptr;  // 让出的协程要切换到的调度器
+static thread_local int t_switch_thread = -1;
 
 Scheduler::Scheduler(size_t n_threads, bool use_caller, const std::string name)
 	:m_name(name) {
@@ -137,10 +139,24 @@ void Scheduler::switchTo(int thread_id) {
             return;
         }
     }
-    schedule(Fiber::GetThis(), thread_id);
+    // 协程切出之后再由原来的线程把它加入目标调度器, 否则目标线程可能在它还没有切出时取到它
+    t_switch_target = this;
+    t_switch_thread = thread_id;
     Fiber::YieldToHold();
 }
 
+bool Scheduler::setCpuAffinity(const std::vector<int>& cpus) {
+    if(cpus.empty()) {
+        return true;
+    }
+    MutexType::Lock lock(m_mutex);
+    bool rt = true;
+    for(size_t i = 0; i < m_threads.size(); ++i) {
+        rt = m_threads[i]->setAffinity(cpus[i % cpus.size()]) && rt;
+    }
+    return rt;
+}
+
 // 输出调度器信息
 std::ostream& Scheduler::dump(std::ostream& os) {
     os << "[Scheduler name=" << m_name
@@ -175,7 +191,7 @@ void Scheduler::tickle() {
 
 // 协程调度函数
 void Scheduler::run() {
-    MS_LOG_DEBUG(g_logger) << m_name << " run";
+    MS_LOG_BIN_DEBUG(g_logger, "%s run", m_name);
     set_hook_enable(true);
     setThis();  // 让调度器切换过来
     if(MNSER::GetThreadId() != m_rootThread) { // 就是run线程
@@ -236,6 +252,7 @@ void Scheduler::run() {
             } else if(ft.fiber->getState() != Fiber::TERM
                     && ft.fiber->getState() != Fiber::EXCEPT) { // 如果执行结束或者执行出现异常
                 ft.fiber->m_state = Fiber::HOLD;  
+                switchFiber(ft.fiber);
             }
             ft.reset();
         } else if(ft.func) {
@@ -256,6 +273,7 @@ void Scheduler::run() {
                 cb_fiber->reset(nullptr);
             } else {// 其他状态 EXEC HOLD
                 cb_fiber->m_state = Fiber::HOLD;
+                switchFiber(cb_fiber);
                 cb_fiber.reset();
             }
         } else {  // ft 没有 fiber 也没有 func，表示没有需要执行的了
@@ -279,6 +297,18 @@ void Scheduler::run() {
     }
 }
 
+// 协程通过 switchTo 让出时, 把它加入目标调度器
+void Scheduler::switchFiber(Fiber::ptr fiber) {
+    if(!t_switch_target) {
+        return;
+    }
+    Scheduler* target = t_switch_target;
+    int thread_id = t_switch_thread;
+    t_switch_target = nullptr;
+    t_switch_thread = -1;
+    target->schedule(fiber, thread_id);
+}
+
 // 协程是否可以停止
 bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
@@ -300,4 +330,17 @@ void Scheduler::setThis() {
 	t_scheduler = this;
 }
 
+SchedulerSwitcher::SchedulerSwitcher(Scheduler* target) {
+    m_caller = Scheduler::GetThis();
+    if(target) {
+        target->switchTo();
+    }
+}
+
+SchedulerSwitcher::~SchedulerSwitcher() {
+    if(m_caller) {
+        m_caller->switchTo();
+    }
+}
+
 }
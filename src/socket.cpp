@@ -1,4 +1,10 @@
+#include <map>
 #include <sstream>
+#include <signal.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+#include <openssl/err.h>
 
 #include "socket.h"
 #include "iomanager.h"
@@ -6,11 +12,23 @@
 #include "log.h"
 #include "fd_manager.h"
 #include "hook.h"
+#include "config.h"
 
 namespace MNSER {
 
 static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
 
+// 对端关闭后继续写 socket 会收到 SIGPIPE, 默认处理是退出进程, 这里忽略它, 让写操作返回 EPIPE
+namespace {
+struct _SigPipeIniter {
+	_SigPipeIniter() {
+		signal(SIGPIPE, SIG_IGN);
+	}
+};
+
+static _SigPipeIniter _init;
+}
+
 // Socket 构造函数
 Socket::Socket(int family, int type, int protocol)
 	: m_sock(-1),
@@ -278,6 +296,14 @@ int Socket::send(const struct iovec* buffers, size_t length, int flags) {
     return -1;
 }
 
+// 用 sendfile 发送文件内容, 数据不经过用户态
+int Socket::sendFile(int in_fd, off_t* offset, size_t length) {
+    if(isConnected()) {
+        return ::sendfile(m_sock, in_fd, offset, length);
+    }
+    return -1;
+}
+
 // 发送数据, buffer 接收数据的内存, length 接收数据的大小, to 段地址, flags 标志字, 返回 >0 接收的数据大小 =0 socket被关闭 <0 出错
 int Socket::sendTo(const void* buffer, size_t length, const Address::ptr to, int flags) {
     if(isConnected()) {
@@ -508,6 +534,496 @@ bool Socket::init(int sock) {
     return false;
 }
 
+static MNSER::ConfigVar<uint32_t>::ptr g_ssl_session_cache_size =
+	MNSER::Config::Lookup("ssl.session_cache_size", (uint32_t)20480, "ssl server session cache size");
+
+static MNSER::ConfigVar<uint32_t>::ptr g_ssl_session_timeout =
+	MNSER::Config::Lookup("ssl.session_timeout", (uint32_t)300, "ssl session timeout(s)");
+
+static MNSER::ConfigVar<uint32_t>::ptr g_ssl_read_buffer_size =
+	MNSER::Config::Lookup("ssl.read_buffer_size", (uint32_t)(64 * 1024), "ssl read ahead buffer size");
+
+static MNSER::ConfigVar<bool>::ptr g_ssl_verify_peer =
+	MNSER::Config::Lookup("ssl.verify_peer", true, "ssl client verify server certificate");
+
+static MNSER::ConfigVar<std::string>::ptr g_ssl_ca_file =
+	MNSER::Config::Lookup("ssl.ca_file", std::string(""), "ssl client ca file, empty for system default");
+
+// 拼接聚集写和读文件时的单次最大长度
+static const size_t s_ssl_write_chunk = 64 * 1024;
+
+// 客户端会话缓存的最大条目数
+static const size_t s_ssl_client_sessions = 1024;
+
+static std::string SSLErrorString() {
+	std::string rt;
+	unsigned long err = 0;
+	while((err = ERR_get_error()) != 0) {
+		char buf[256];
+		ERR_error_string_n(err, buf, sizeof(buf));
+		if(!rt.empty()) {
+			rt += "; ";
+		}
+		rt += buf;
+	}
+	return rt;
+}
+
+// 服务端和客户端共同的 SSL_CTX 设置
+static void InitSSLContext(SSL_CTX* ctx) {
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	long options = SSL_OP_NO_COMPRESSION;
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+	// 对端不发 close_notify 直接关闭时当作正常结束
+	options |= SSL_OP_IGNORE_UNEXPECTED_EOF;
+#endif
+	SSL_CTX_set_options(ctx, options);
+	// 重试时缓冲区地址可以变化; 不开 PARTIAL_WRITE, 一次 SSL_write 写完所有记录
+	SSL_CTX_set_mode(ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_AUTO_RETRY);
+	// 预读: 一次 read 尽量读入多个记录, 减少系统调用
+	SSL_CTX_set_read_ahead(ctx, 1);
+	SSL_CTX_set_default_read_buffer_len(ctx, *g_ssl_read_buffer_size->getValue());
+	// 记录使用最大长度, 大块数据不会被切成小记录
+	SSL_CTX_set_max_send_fragment(ctx, SSL3_RT_MAX_PLAIN_LENGTH);
+}
+
+static void SetUserNonblock(int fd) {
+	FdCtx::ptr ctx = FdMgr::GetInstance()->get(fd);
+	if(ctx) {
+		ctx->setUserNonblock(true);
+	}
+}
+
+static bool IsIPAddress(const std::string& host) {
+	unsigned char buf[sizeof(struct in6_addr)];
+	return inet_pton(AF_INET, host.c_str(), buf) == 1
+		|| inet_pton(AF_INET6, host.c_str(), buf) == 1;
+}
+
+namespace {
+// 客户端会话缓存, key 为 主机名@地址
+struct SSLSessionCache {
+	Mutex mutex;
+	std::map<std::string, SSL_SESSION*> sessions;
+
+	~SSLSessionCache() {
+		for(auto& i : sessions) {
+			SSL_SESSION_free(i.second);
+		}
+	}
+};
+
+static SSLSessionCache& GetSessionCache() {
+	static SSLSessionCache s_cache;
+	return s_cache;
+}
+}
+
+SSLSocket::ptr SSLSocket::CreateTCP(MNSER::Address::ptr address) {
+	SSLSocket::ptr sock(new SSLSocket(address->getFamily(), TCP, 0));
+	return sock;
+}
+
+SSLSocket::ptr SSLSocket::CreateTCPSocket() {
+	SSLSocket::ptr sock(new SSLSocket(IPv4, TCP, 0));
+	return sock;
+}
+
+SSLSocket::ptr SSLSocket::CreateTCPSocket6() {
+	SSLSocket::ptr sock(new SSLSocket(IPv6, TCP, 0));
+	return sock;
+}
+
+std::shared_ptr<SSL_CTX> SSLSocket::CreateServerContext(const std::string& cert_file
+							,const std::string& key_file) {
+	SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+	if(!ctx) {
+		MS_LOG_ERROR(g_logger) << "SSL_CTX_new fail: " << SSLErrorString();
+		return nullptr;
+	}
+	std::shared_ptr<SSL_CTX> rt(ctx, SSL_CTX_free);
+	InitSSLContext(ctx);
+	if(SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1
+			|| SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1
+			|| SSL_CTX_check_private_key(ctx) != 1) {
+		MS_LOG_ERROR(g_logger) << "load certificates fail cert_file=" << cert_file
+			<< " key_file=" << key_file << " " << SSLErrorString();
+		return nullptr;
+	}
+	// 会话 id 缓存和会话票据(默认开启)都属于 SSL_CTX, 共享同一个 SSL_CTX 的连接都可以恢复会话
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_session_id_context(ctx, (const unsigned char*)"mnser", 5);
+	SSL_CTX_sess_set_cache_size(ctx, *g_ssl_session_cache_size->getValue());
+	SSL_CTX_set_timeout(ctx, *g_ssl_session_timeout->getValue());
+	// TLS 1.3 每次握手默认发两张票据, 客户端只用一张
+	SSL_CTX_set_num_tickets(ctx, 1);
+	return rt;
+}
+
+std::shared_ptr<SSL_CTX> SSLSocket::GetClientContext() {
+	static std::shared_ptr<SSL_CTX> s_ctx = []() {
+		std::shared_ptr<SSL_CTX> rt;
+		SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+		if(!ctx) {
+			MS_LOG_ERROR(g_logger) << "SSL_CTX_new fail: " << SSLErrorString();
+			return rt;
+		}
+		rt.reset(ctx, SSL_CTX_free);
+		InitSSLContext(ctx);
+		if(*g_ssl_verify_peer->getValue()) {
+			std::string ca = *g_ssl_ca_file->getValue();
+			int ok = ca.empty() ? SSL_CTX_set_default_verify_paths(ctx)
+						: SSL_CTX_load_verify_locations(ctx, ca.c_str(), nullptr);
+			if(ok != 1) {
+				MS_LOG_ERROR(g_logger) << "load ca fail ca_file=" << ca << " " << SSLErrorString();
+			}
+			SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+		}
+		// 会话只存放在自己的缓存中, 由 connect 按 key 取出
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ctx, &SSLSocket::OnNewSession);
+		return rt;
+	}();
+	return s_ctx;
+}
+
+int SSLSocket::OnNewSession(SSL* ssl, SSL_SESSION* session) {
+	SSLSocket* sock = (SSLSocket*)SSL_get_app_data(ssl);
+	if(!sock || sock->m_sessionKey.empty()) {
+		return 0;
+	}
+	SSLSessionCache& cache = GetSessionCache();
+	Mutex::Lock lock(cache.mutex);
+	auto it = cache.sessions.find(sock->m_sessionKey);
+	if(it != cache.sessions.end()) {
+		SSL_SESSION_free(it->second);
+		it->second = session;
+	} else {
+		if(cache.sessions.size() >= s_ssl_client_sessions) {
+			SSL_SESSION_free(cache.sessions.begin()->second);
+			cache.sessions.erase(cache.sessions.begin());
+		}
+		cache.sessions[sock->m_sessionKey] = session;
+	}
+	// 返回 1 表示持有了 session 的引用
+	return 1;
+}
+
+SSLSocket::SSLSocket(int family, int type, int protocol)
+	: Socket(family, type, protocol) {
+}
+
+SSLSocket::~SSLSocket() {
+	// 基类析构时只会调用 Socket::close, 这里先发送 close_notify
+	close();
+}
+
+Socket::ptr SSLSocket::accept() {
+	SSLSocket::ptr sock(new SSLSocket(m_family, m_type, m_protocol));
+	int newsock = ::accept(m_sock, nullptr, nullptr);
+	if(newsock == -1) {
+		MS_LOG_ERROR(g_logger) << "accept(" << m_sock << ") errno="
+			<< errno << " errstr=" << strerror(errno);
+		return nullptr;
+	}
+	sock->m_ctx = m_ctx;
+	if(sock->init(newsock)) {
+		return sock;
+	}
+	return nullptr;
+}
+
+bool SSLSocket::init(int sock) {
+	if(!Socket::init(sock)) {
+		return false;
+	}
+	if(!m_ctx) {
+		MS_LOG_ERROR(g_logger) << "SSLSocket init without certificates, sock=" << sock;
+		close();
+		return false;
+	}
+	m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
+	if(!m_ssl || SSL_set_fd(m_ssl.get(), m_sock) != 1) {
+		MS_LOG_ERROR(g_logger) << "SSL_new fail: " << SSLErrorString();
+		close();
+		return false;
+	}
+	// 握手推迟到第一次读写, 在处理连接的协程中完成
+	SSL_set_accept_state(m_ssl.get());
+	SetUserNonblock(m_sock);
+	return true;
+}
+
+bool SSLSocket::connect(const Address::ptr addr, uint64_t timeout_ms) {
+	if(!Socket::connect(addr, timeout_ms)) {
+		return false;
+	}
+	m_ctx = GetClientContext();
+	if(m_ctx) {
+		m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
+	}
+	if(!m_ssl || SSL_set_fd(m_ssl.get(), m_sock) != 1) {
+		MS_LOG_ERROR(g_logger) << "SSL_new fail: " << SSLErrorString();
+		close();
+		return false;
+	}
+	SSL* ssl = m_ssl.get();
+	SSL_set_app_data(ssl, this);
+	if(!m_hostName.empty()) {
+		if(IsIPAddress(m_hostName)) {
+			// IP 地址不能用于 SNI, 只校验证书中的 IP
+			X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), m_hostName.c_str());
+		} else {
+			SSL_set_tlsext_host_name(ssl, m_hostName.c_str());
+			SSL_set1_host(ssl, m_hostName.c_str());
+		}
+	}
+
+	m_sessionKey = m_hostName + "@" + addr->toString();
+	{
+		SSLSessionCache& cache = GetSessionCache();
+		Mutex::Lock lock(cache.mutex);
+		auto it = cache.sessions.find(m_sessionKey);
+		if(it != cache.sessions.end() && SSL_SESSION_is_resumable(it->second)) {
+			SSL_set_session(ssl, it->second);
+		}
+	}
+
+	SetUserNonblock(m_sock);
+	int rt = doIO([](SSL* ssl) { return SSL_connect(ssl);}, timeout_ms, timeout_ms);
+	if(rt <= 0) {
+		MS_LOG_ERROR(g_logger) << "sock=" << m_sock << " ssl connect(" << addr->toString()
+			<< ") host=" << m_hostName << " fail errno=" << errno
+			<< " verify=" << X509_verify_cert_error_string(SSL_get_verify_result(ssl));
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool SSLSocket::close() {
+	{
+		Mutex::Lock lock(m_mutex);
+		if(m_ssl) {
+			// 尽量发送 close_notify, 不等待对端回应
+			if(m_sock != -1 && SSL_is_init_finished(m_ssl.get())) {
+				SSL_shutdown(m_ssl.get());
+			}
+			ERR_clear_error();
+			m_ssl.reset();
+		}
+	}
+	return Socket::close();
+}
+
+template<class Fun>
+int SSLSocket::doIO(Fun fun, uint64_t read_timeout, uint64_t write_timeout) {
+	while(true) {
+		bool readable = false;
+		bool claimed = false;
+		bool queued = false;
+		{
+			Mutex::Lock lock(m_mutex);
+			if(!m_ssl || !isConnected()) {
+				errno = EBADF;
+				return -1;
+			}
+			ERR_clear_error();
+			errno = 0;
+			int rt = fun(m_ssl.get());
+			if(rt > 0) {
+				return rt;
+			}
+			int err = SSL_get_error(m_ssl.get(), rt);
+			if(err == SSL_ERROR_ZERO_RETURN) {
+				return 0;
+			}
+			if(err == SSL_ERROR_SYSCALL) {
+				// errno 为 0 表示对端直接关闭了连接
+				return errno ? -1 : 0;
+			}
+			if(err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
+				MS_LOG_DEBUG(g_logger) << "ssl io fail sock=" << m_sock
+					<< " err=" << err << " " << SSLErrorString();
+				errno = EPROTO;
+				return -1;
+			}
+			// 同一个事件只能有一个协程在 IOManager 上等待(例如写时需要读握手数据, 而读协程已经在等)
+			// 其他协程排队, 等它读写之后再重试; 不在协程中时用 poll 等待, 不受限制
+			readable = err == SSL_ERROR_WANT_READ;
+			bool& waiting = readable ? m_readWaiting : m_writeWaiting;
+			if(!waiting) {
+				waiting = true;
+				claimed = true;
+			} else if(IOManager::GetThis() && is_hook_enable()) {
+				(readable ? m_readQueue : m_writeQueue).push_back(
+						std::make_pair(Scheduler::GetThis(), Fiber::GetThis()));
+				queued = true;
+			}
+		}
+		if(queued) {
+			// 唤醒可能发生在 YieldToHold 之前, 调度器会等本协程让出后再执行它
+			Fiber::YieldToHold();
+			continue;
+		}
+		bool ok = waitEvent(readable, readable ? read_timeout : write_timeout);
+		if(claimed) {
+			WaitQueue queue;
+			{
+				Mutex::Lock lock(m_mutex);
+				(readable ? m_readWaiting : m_writeWaiting) = false;
+				queue.swap(readable ? m_readQueue : m_writeQueue);
+			}
+			for(auto& i : queue) {
+				i.first->schedule(i.second);
+			}
+		}
+		if(!ok) {
+			return -1;
+		}
+	}
+}
+
+bool SSLSocket::waitEvent(bool readable, uint64_t timeout_ms) {
+	IOManager* iom = IOManager::GetThis();
+	if(!iom || !is_hook_enable()) {
+		struct pollfd pfd;
+		pfd.fd = m_sock;
+		pfd.events = readable ? POLLIN : POLLOUT;
+		pfd.revents = 0;
+		int rt = ::poll(&pfd, 1, timeout_ms == (uint64_t)-1 ? -1 : (int)timeout_ms);
+		if(rt == 0) {
+			errno = ETIMEDOUT;
+		}
+		return rt > 0;
+	}
+
+	// 与 hook 中的 do_io 相同: 注册事件后让出协程, 超时由条件定时器取消事件
+	IOManager::Event event = readable ? IOManager::READ : IOManager::WRITE;
+	std::shared_ptr<int> cancelled(new int(0));
+	std::weak_ptr<int> wcancelled(cancelled);
+	int fd = m_sock;
+	Timer::ptr timer;
+	if(timeout_ms != (uint64_t)-1) {
+		timer = iom->addConditionTimer(timeout_ms, [wcancelled, fd, iom, event]() {
+			auto c = wcancelled.lock();
+			if(!c || *c) {
+				return;
+			}
+			*c = ETIMEDOUT;
+			iom->cancelEvent(fd, event);
+		}, wcancelled);
+	}
+	if(iom->addEvent(fd, event)) {
+		if(timer) {
+			timer->cancel();
+		}
+		return false;
+	}
+	Fiber::YieldToHold();
+	if(timer) {
+		timer->cancel();
+	}
+	if(*cancelled) {
+		errno = *cancelled;
+		return false;
+	}
+	return true;
+}
+
+int SSLSocket::send(const void* buffer, size_t length, int flags) {
+	if(length == 0) {
+		return 0;
+	}
+	// SSL_write 的长度是 int
+	int len = (int)std::min(length, (size_t)INT32_MAX);
+	return doIO([buffer, len](SSL* ssl) { return SSL_write(ssl, buffer, len);}
+			,getRecvTimeout(), getSendTimeout());
+}
+
+int SSLSocket::send(const iovec* buffers, size_t length, int flags) {
+	size_t i = 0;
+	while(i < length && buffers[i].iov_len == 0) {
+		++i;
+	}
+	if(i == length) {
+		return 0;
+	}
+	if(i + 1 == length || buffers[i].iov_len >= s_ssl_write_chunk) {
+		return send(buffers[i].iov_base, buffers[i].iov_len, flags);
+	}
+	std::string buf;
+	buf.reserve(s_ssl_write_chunk);
+	for(; i < length && buf.size() < s_ssl_write_chunk; ++i) {
+		size_t n = std::min(buffers[i].iov_len, s_ssl_write_chunk - buf.size());
+		buf.append((const char*)buffers[i].iov_base, n);
+	}
+	return send(buf.data(), buf.size(), flags);
+}
+
+int SSLSocket::sendFile(int in_fd, off_t* offset, size_t length) {
+	if(!isConnected()) {
+		return -1;
+	}
+	std::string buf(std::min(length, s_ssl_write_chunk), '\0');
+	ssize_t n = ::pread(in_fd, &buf[0], buf.size(), *offset);
+	if(n <= 0) {
+		return n;
+	}
+	int rt = send(buf.data(), n, 0);
+	if(rt > 0) {
+		*offset += rt;
+	}
+	return rt;
+}
+
+int SSLSocket::recv(void* buffer, size_t length, int flags) {
+	if(length == 0) {
+		return 0;
+	}
+	int len = (int)std::min(length, (size_t)INT32_MAX);
+	return doIO([buffer, len](SSL* ssl) { return SSL_read(ssl, buffer, len);}
+			,getRecvTimeout(), getSendTimeout());
+}
+
+int SSLSocket::recv(iovec* buffers, size_t length, int flags) {
+	// 只读入第一个非空的缓冲区
+	for(size_t i = 0; i < length; ++i) {
+		if(buffers[i].iov_len) {
+			return recv(buffers[i].iov_base, buffers[i].iov_len, flags);
+		}
+	}
+	return 0;
+}
+
+bool SSLSocket::loadCertificates(const std::string& cert_file, const std::string& key_file) {
+	m_ctx = CreateServerContext(cert_file, key_file);
+	return m_ctx != nullptr;
+}
+
+bool SSLSocket::isSessionReused() const {
+	return m_ssl && SSL_session_reused(m_ssl.get());
+}
+
+std::ostream& SSLSocket::dump(std::ostream& os) const {
+	os << "[SSLSocket sock=" << m_sock
+	   << " is_connected=" << m_isConnected
+	   << " family=" << m_family
+	   << " type=" << m_type
+	   << " protocol=" << m_protocol;
+	if(!m_hostName.empty()) {
+		os << " host=" << m_hostName;
+	}
+	if(m_localAddress) {
+		os << " local_address=" << m_localAddress->toString();
+	}
+	if(m_remoteAddress) {
+		os << " remote_address=" << m_remoteAddress->toString();
+	}
+	os << "]";
+	return os;
+}
+
 std::ostream& operator<<(std::ostream& os, const Socket& sock) {
 	return sock.dump(os);
 }
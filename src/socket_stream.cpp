@@ -59,6 +59,52 @@ int SocketStream::write(ByteArray::ptr ba, size_t length){
     return rt;
 }
 
+int SocketStream::writevFixSize(struct iovec* iovs, size_t iovcnt) {
+	size_t total = 0;
+	for (size_t i = 0; i < iovcnt; ++i) {
+		total += iovs[i].iov_len;
+	}
+	size_t left = total;
+	while (left > 0) {
+		if (!isConnected()) {
+			return -1;
+		}
+		int rt = m_socket->send(iovs, iovcnt);
+		if (rt <= 0) {
+			return rt;
+		}
+		left -= rt;
+		// 跳过已经发送完的 iovec, 调整发送了一部分的 iovec
+		size_t n = rt;
+		while (iovcnt > 0 && n >= iovs->iov_len) {
+			n -= iovs->iov_len;
+			++iovs;
+			--iovcnt;
+		}
+		if (n > 0) {
+			iovs->iov_base = (char*)iovs->iov_base + n;
+			iovs->iov_len -= n;
+		}
+	}
+	return total;
+}
+
+int64_t SocketStream::sendFileFixSize(int fd, off_t offset, size_t length) {
+	size_t left = length;
+	while (left > 0) {
+		if (!isConnected()) {
+			return -1;
+		}
+		// 单次最多发送 1G, 避免返回值超出 int 范围
+		int rt = m_socket->sendFile(fd, &offset, std::min(left, (size_t)1 << 30));
+		if (rt <= 0) {
+			return rt;
+		}
+		left -= rt;
+	}
+	return length;
+}
+
 void SocketStream::close(){
     if(m_socket) {
         m_socket->close();
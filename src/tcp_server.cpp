@@ -1,6 +1,7 @@
 #include "tcp_server.h"
 #include "log.h"
 #include "config.h"
+#include "worker.h"
 
 namespace MNSER {
 static MNSER::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout = 
@@ -8,12 +9,27 @@ static MNSER::ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
 
 static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
 
+static MNSER::ConfigVar<std::vector<TcpServerConf> >::ptr g_servers_conf =
+	MNSER::Config::Lookup("servers", std::vector<TcpServerConf>(), "server config");
+
+namespace {
+struct CreatorRegistry {
+	Mutex mutex;
+	std::map<std::string, TcpServer::Creator> creators;
+};
+
+static CreatorRegistry& GetCreatorRegistry() {
+	static CreatorRegistry s_registry;
+	return s_registry;
+}
+}
+
 TcpServer::TcpServer(MNSER::IOManager* worker, MNSER::IOManager* ioWorker
 		 ,MNSER::IOManager* acceptWorker)
 	: m_worker(worker)
 	, m_ioWorker(ioWorker)
 	, m_acceptWorker(acceptWorker)
-	, m_recvTimeout(g_tcp_server_read_timeout->getValue()) 
+	, m_recvTimeout(*g_tcp_server_read_timeout->getValue()) 
 	, m_name("ms v1.0")
 	, m_isStop(true) {
 }
@@ -25,6 +41,87 @@ TcpServer::~TcpServer() {
 	m_socks.clear();
 }
 
+void TcpServer::RegisterCreator(const std::string& type, Creator creator) {
+	CreatorRegistry& registry = GetCreatorRegistry();
+	Mutex::Lock lock(registry.mutex);
+	registry.creators[type] = creator;
+}
+
+TcpServer::ptr TcpServer::Create(const TcpServerConf& conf) {
+	Creator creator;
+	{
+		CreatorRegistry& registry = GetCreatorRegistry();
+		Mutex::Lock lock(registry.mutex);
+		auto it = registry.creators.find(conf.type);
+		if(it != registry.creators.end()) {
+			creator = it->second;
+		}
+	}
+	if(!creator) {
+		MS_LOG_ERROR(g_logger) << "server type=" << conf.type << " not registered";
+		return nullptr;
+	}
+
+	// 没有指定名称的用当前调度器
+	IOManager* workers[3] = {IOManager::GetThis(), IOManager::GetThis(), IOManager::GetThis()};
+	const std::string* names[3] = {&conf.process_worker, &conf.io_worker, &conf.accept_worker};
+	for(int i = 0; i < 3; ++i) {
+		if(!names[i]->empty()) {
+			workers[i] = WorkerMgr::GetInstance()->get(*names[i]);
+		}
+		if(!workers[i]) {
+			MS_LOG_ERROR(g_logger) << "server name=" << conf.name << " worker("
+				<< *names[i] << ") not exists";
+			return nullptr;
+		}
+	}
+
+	std::vector<Address::ptr> addrs;
+	for(auto& i : conf.address) {
+		Address::ptr addr;
+		if(!i.empty() && i[0] == '/') {
+			addr.reset(new UnixAddress(i));
+		} else {
+			addr = Address::LookupAny(i);
+		}
+		if(!addr) {
+			MS_LOG_ERROR(g_logger) << "server name=" << conf.name << " invalid address: " << i;
+			return nullptr;
+		}
+		addrs.push_back(addr);
+	}
+
+	TcpServer::ptr server = creator(conf, workers[0], workers[1], workers[2]);
+	if(!server) {
+		return nullptr;
+	}
+	if(!conf.name.empty()) {
+		server->setName(conf.name);
+	}
+	server->setRecvTimeout(conf.timeout);
+	server->setConf(conf);
+	std::vector<Address::ptr> fails;
+	if(!server->bind(addrs, fails, conf.ssl)) {
+		return nullptr;
+	}
+	if(conf.ssl && !server->loadCertificates(conf.cert_file, conf.key_file)) {
+		return nullptr;
+	}
+	return server;
+}
+
+bool TcpServer::CreateFromConfig(std::vector<TcpServer::ptr>& servers) {
+	auto confs = g_servers_conf->getValue();
+	for(auto& i : *confs) {
+		TcpServer::ptr server = Create(i);
+		if(!server) {
+			return false;
+		}
+		servers.push_back(server);
+	}
+	return true;
+}
+
 bool TcpServer::bind(MNSER::Address::ptr addr, bool ssl) {
 	std::vector<Address::ptr> addrs;
 	std::vector<Address::ptr> fails;
@@ -36,7 +133,7 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs
 		, std::vector<Address::ptr>& fails, bool ssl) {
 	m_ssl = ssl;
 	for (auto& addr: addrs) {
-        Socket::ptr sock = Socket::CreateTCP(addr);
+        Socket::ptr sock = ssl ? SSLSocket::CreateTCP(addr) : Socket::CreateTCP(addr);
         if(!sock->bind(addr)) {
             MS_LOG_ERROR(g_logger) << "bind fail errno="
                 << errno << " errstr=" << strerror(errno)
@@ -73,7 +170,20 @@ bool TcpServer::bind(const std::vector<Address::ptr>& addrs
 }
 
 bool TcpServer::loadCertificates(const std::string& cert_file, const std::string& key_file) {
-	MS_LOG_INFO(g_logger) << "Load Certificates";
+	// 所有监听 socket 共享一个 SSL_CTX, 会话缓存和票据密钥在它们之间通用
+	auto ctx = SSLSocket::CreateServerContext(cert_file, key_file);
+	if(!ctx) {
+		return false;
+	}
+	for(auto& i : m_socks) {
+		SSLSocket::ptr ssl_socket = std::dynamic_pointer_cast<SSLSocket>(i);
+		if(ssl_socket) {
+			ssl_socket->setContext(ctx);
+		}
+	}
+	MS_LOG_INFO(g_logger) << "load certificates cert_file=" << cert_file
+		<< " key_file=" << key_file;
+	return true;
 }
 
 bool TcpServer::start() {
@@ -130,7 +240,8 @@ void TcpServer::startAccept(Socket::ptr sock) {
             m_ioWorker->schedule(std::bind(&TcpServer::handleClient,
                         shared_from_this(), client));  // shared_from_this 是为了说明使用现在自己的 handleCilent
         } else {
-            MS_LOG_ERROR(g_logger) << "accept errno=" << errno
+            // 持续失败(如 fd 用尽)时每秒最多一条
+            MS_LOG_ERROR_EVERY_MS(g_logger, 1000) << "accept errno=" << errno
                 << " errstr=" << strerror(errno);
         }
     }
@@ -41,6 +41,19 @@ void Thread::join() {
 	}
 }
 
+bool Thread::setAffinity(int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int ret = pthread_setaffinity_np(m_thread, sizeof(set), &set);
+	if (ret != 0) {
+		MS_LOG_ERROR(g_logger) << "pthread_setaffinity_np fail, errno = " << ret
+			<< " name = " << m_name << " cpu = " << cpu;
+		return false;
+	}
+	return true;
+}
+
 Thread* Thread::GetThis() {
 	return t_thread;
 }
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <signal.h>
+#include <openssl/sha.h>
 
 #include "util.h"
 #include "log.h"
@@ -89,6 +91,81 @@ time_t Str2Time(const char* str, const char* format) {
     return mktime(&t);
 }
 
+std::string Sha1Sum(const std::string& data) {
+    std::string rt(SHA_DIGEST_LENGTH, '\0');
+    SHA1((const unsigned char*)data.data(), data.size(), (unsigned char*)&rt[0]);
+    return rt;
+}
+
+static const char s_base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string Base64Encode(const std::string& data) {
+    std::string rt;
+    rt.reserve((data.size() + 2) / 3 * 4);
+    const unsigned char* p = (const unsigned char*)data.data();
+    size_t i = 0;
+    for(; i + 3 <= data.size(); i += 3) {
+        uint32_t v = (p[i] << 16) | (p[i + 1] << 8) | p[i + 2];
+        rt.push_back(s_base64_chars[(v >> 18) & 0x3f]);
+        rt.push_back(s_base64_chars[(v >> 12) & 0x3f]);
+        rt.push_back(s_base64_chars[(v >> 6) & 0x3f]);
+        rt.push_back(s_base64_chars[v & 0x3f]);
+    }
+    if(i < data.size()) {
+        uint32_t v = p[i] << 16;
+        if(i + 1 < data.size()) {
+            v |= p[i + 1] << 8;
+        }
+        rt.push_back(s_base64_chars[(v >> 18) & 0x3f]);
+        rt.push_back(s_base64_chars[(v >> 12) & 0x3f]);
+        rt.push_back(i + 1 < data.size() ? s_base64_chars[(v >> 6) & 0x3f] : '=');
+        rt.push_back('=');
+    }
+    return rt;
+}
+
+std::string Base64Decode(const std::string& data) {
+    if(data.size() % 4) {
+        return "";
+    }
+    std::string rt;
+    rt.reserve(data.size() / 4 * 3);
+    uint32_t v = 0;
+    int bits = 0;
+    size_t pad = 0;
+    for(size_t i = 0; i < data.size(); ++i) {
+        char c = data[i];
+        int n = 0;
+        if(c >= 'A' && c <= 'Z') {
+            n = c - 'A';
+        } else if(c >= 'a' && c <= 'z') {
+            n = c - 'a' + 26;
+        } else if(c >= '0' && c <= '9') {
+            n = c - '0' + 52;
+        } else if(c == '+') {
+            n = 62;
+        } else if(c == '/') {
+            n = 63;
+        } else if(c == '=' && i + 2 >= data.size()) {
+            ++pad;
+            continue;
+        } else {
+            return "";
+        }
+        if(pad) {
+            return "";
+        }
+        v = (v << 6) | n;
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            rt.push_back((char)((v >> bits) & 0xff));
+        }
+    }
+    return rt;
+}
+
 void FSUtil::ListAllFile(std::vector<std::string>& files
 						,const std::string& path
 						,const std::string& subfix) {
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+
+#include "worker.h"
+#include "config.h"
+#include "log.h"
+
+namespace MNSER {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+static MNSER::ConfigVar<std::map<std::string, std::map<std::string, std::string> > >::ptr g_worker_config =
+	MNSER::Config::Lookup("workers", std::map<std::string, std::map<std::string, std::string> >()
+			,"worker config");
+
+static std::string GetValue(const std::map<std::string, std::string>& m
+		,const std::string& key, const std::string& def = "") {
+	auto it = m.find(key);
+	return it == m.end() ? def : it->second;
+}
+
+bool ParseCpuList(const std::string& str, std::vector<int>& cpus) {
+	size_t pos = 0;
+	while(pos < str.size()) {
+		size_t next = str.find(',', pos);
+		if(next == std::string::npos) {
+			next = str.size();
+		}
+		std::string part = str.substr(pos, next - pos);
+		pos = next + 1;
+		part.erase(0, part.find_first_not_of(" \t"));
+		part.erase(part.find_last_not_of(" \t") + 1);
+		if(part.empty()) {
+			continue;
+		}
+		char* end = nullptr;
+		long begin = strtol(part.c_str(), &end, 10);
+		long last = begin;
+		if(end == part.c_str()) {
+			return false;
+		}
+		if(*end == '-') {
+			const char* p = end + 1;
+			last = strtol(p, &end, 10);
+			if(end == p) {
+				return false;
+			}
+		}
+		if(*end != '\0' || begin < 0 || last < begin || last >= CPU_SETSIZE) {
+			return false;
+		}
+		for(long c = begin; c <= last; ++c) {
+			cpus.push_back((int)c);
+		}
+	}
+	return true;
+}
+
+bool WorkerManager::init() {
+	return init(*g_worker_config->getValue());
+}
+
+bool WorkerManager::init(const std::map<std::string, std::map<std::string, std::string> >& v) {
+	bool rt = true;
+	for(auto& i : v) {
+		const std::string& name = i.first;
+		if(get(name)) {
+			continue;
+		}
+		int thread_num = atoi(GetValue(i.second, "thread_num", "1").c_str());
+		std::string cpu_list = GetValue(i.second, "cpus");
+		std::vector<int> cpus;
+		if(thread_num <= 0 || !ParseCpuList(cpu_list, cpus)) {
+			MS_LOG_ERROR(g_logger) << "invalid worker config name=" << name
+				<< " thread_num=" << thread_num << " cpus=" << cpu_list;
+			rt = false;
+			continue;
+		}
+
+		std::shared_ptr<IOManager> iom(new IOManager(thread_num, false, name));
+		if(!iom->setCpuAffinity(cpus)) {
+			rt = false;
+		}
+		if(!add(name, iom)) {
+			iom->stop();
+			continue;
+		}
+		MS_LOG_INFO(g_logger) << "worker " << name << " thread_num=" << thread_num
+			<< " cpus=" << cpu_list;
+	}
+	return rt;
+}
+
+bool WorkerManager::add(const std::string& name, std::shared_ptr<IOManager> iom) {
+	RWLockType::WriteLock lock(m_mutex);
+	return m_datas.insert(std::make_pair(name, iom)).second;
+}
+
+IOManager* WorkerManager::get(const std::string& name) {
+	RWLockType::ReadLock lock(m_mutex);
+	auto it = m_datas.find(name);
+	return it == m_datas.end() ? nullptr : it->second.get();
+}
+
+void WorkerManager::stop() {
+	std::map<std::string, std::shared_ptr<IOManager> > datas;
+	{
+		RWLockType::WriteLock lock(m_mutex);
+		datas.swap(m_datas);
+	}
+	// 不能在这些调度器自己的线程中调用, 否则 stop 等不到自己结束
+	for(auto& i : datas) {
+		i.second->stop();
+	}
+}
+
+size_t WorkerManager::getCount() {
+	RWLockType::ReadLock lock(m_mutex);
+	return m_datas.size();
+}
+
+std::ostream& WorkerManager::dump(std::ostream& os) {
+	RWLockType::ReadLock lock(m_mutex);
+	for(auto& i : m_datas) {
+		i.second->dump(os) << std::endl;
+	}
+	return os;
+}
+
+}
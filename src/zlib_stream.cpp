@@ -0,0 +1,276 @@
+#include <string.h>
+#include <map>
+#include <vector>
+
+#include "zlib_stream.h"
+#include "log.h"
+
+namespace MNSER {
+
+static MNSER::Logger::ptr g_logger = MS_LOG_NAME("system");
+
+// 每个线程每种 z_stream 最多缓存的数量
+static const size_t s_zlib_cache_size = 8;
+
+// 线程本地的 z_stream 缓存, 按 压缩/解压 + 格式 + 级别 分类
+// 压缩用的 z_stream 初始化时要分配窗口和哈希表(默认参数下约 256K), 复用时只需要 reset
+struct ZlibCache {
+	~ZlibCache() {
+		for(auto& i : free) {
+			for(auto& zs : i.second) {
+				if(i.first >> 16) {
+					deflateEnd(zs);
+				} else {
+					inflateEnd(zs);
+				}
+				delete zs;
+			}
+		}
+	}
+	std::map<uint32_t, std::vector<z_stream*> > free;
+};
+
+static thread_local ZlibCache t_zlib_cache;
+
+static int WindowBits(bool encode, ZlibStream::Type type) {
+	switch(type) {
+		case ZlibStream::DEFLATE:
+			return -MAX_WBITS;
+		case ZlibStream::GZIP:
+			return encode ? MAX_WBITS + 16 : MAX_WBITS + 32;
+		default:
+			// 解压时 +32 自动识别 zlib/gzip 头
+			return encode ? MAX_WBITS : MAX_WBITS + 32;
+	}
+}
+
+static uint32_t CacheKey(bool encode, ZlibStream::Type type, int level) {
+	return ((uint32_t)encode << 16) | ((uint32_t)type << 8) | (uint32_t)(encode ? level + 1 : 0);
+}
+
+static z_stream* AcquireZStream(bool encode, ZlibStream::Type type, int level, uint32_t key) {
+	auto& free = t_zlib_cache.free[key];
+	if(!free.empty()) {
+		z_stream* zs = free.back();
+		free.pop_back();
+		return zs;
+	}
+	z_stream* zs = new z_stream;
+	memset(zs, 0, sizeof(z_stream));
+	int rt = 0;
+	if(encode) {
+		rt = deflateInit2(zs, level, Z_DEFLATED, WindowBits(encode, type), 8, Z_DEFAULT_STRATEGY);
+	} else {
+		rt = inflateInit2(zs, WindowBits(encode, type));
+	}
+	if(rt != Z_OK) {
+		MS_LOG_ERROR(g_logger) << "zlib init fail, encode=" << encode << " type=" << type
+			<< " level=" << level << " rt=" << rt;
+		delete zs;
+		return nullptr;
+	}
+	return zs;
+}
+
+static void ReleaseZStream(z_stream* zs, uint32_t key) {
+	bool encode = key >> 16;
+	auto& free = t_zlib_cache.free[key];
+	int rt = encode ? deflateReset(zs) : inflateReset(zs);
+	if(rt == Z_OK && free.size() < s_zlib_cache_size) {
+		free.push_back(zs);
+		return;
+	}
+	if(encode) {
+		deflateEnd(zs);
+	} else {
+		inflateEnd(zs);
+	}
+	delete zs;
+}
+
+ZlibStream::ptr ZlibStream::CreateGzip(bool encode, uint32_t buff_size) {
+	return Create(encode, buff_size, GZIP);
+}
+
+ZlibStream::ptr ZlibStream::CreateZlib(bool encode, uint32_t buff_size) {
+	return Create(encode, buff_size, ZLIB);
+}
+
+ZlibStream::ptr ZlibStream::CreateDeflate(bool encode, uint32_t buff_size) {
+	return Create(encode, buff_size, DEFLATE);
+}
+
+ZlibStream::ptr ZlibStream::Create(bool encode, uint32_t buff_size, Type type, int level) {
+	ZlibStream::ptr rt(new ZlibStream(encode, buff_size, type, level));
+	if(rt->hasError()) {
+		return nullptr;
+	}
+	return rt;
+}
+
+ZlibStream::ZlibStream(bool encode, uint32_t buff_size, Type type, int level)
+	:m_key(CacheKey(encode, type, level))
+	,m_buffSize(buff_size ? buff_size : 4096)
+	,m_encode(encode)
+	,m_finished(false)
+	,m_error(false)
+	,m_inSize(0)
+	,m_outSize(0)
+	,m_maxOutSize(0) {
+	m_zstream = AcquireZStream(encode, type, level, m_key);
+	if(!m_zstream) {
+		m_error = true;
+	}
+}
+
+ZlibStream::~ZlibStream() {
+	if(m_zstream) {
+		ReleaseZStream(m_zstream, m_key);
+	}
+}
+
+int ZlibStream::read(void* buffer, size_t length) {
+	return -1;
+}
+
+int ZlibStream::read(ByteArray::ptr ba, size_t length) {
+	return -1;
+}
+
+int ZlibStream::write(const void* buffer, size_t length) {
+	if(m_error) {
+		return -1;
+	}
+	if(m_finished) {
+		// 压缩流结束后不能再写, 解压时忽略结束标记之后的数据
+		return m_encode ? -1 : length;
+	}
+	if(length == 0) {
+		return 0;
+	}
+	m_inSize += length;
+	if(process(buffer, length, Z_NO_FLUSH) < 0) {
+		return -1;
+	}
+	return length;
+}
+
+int ZlibStream::write(ByteArray::ptr ba, size_t length) {
+	std::vector<iovec> iovs;
+	ba->getReadBuffers(iovs, length);
+	size_t total = 0;
+	for(auto& i : iovs) {
+		int rt = write(i.iov_base, i.iov_len);
+		if(rt < 0) {
+			return rt;
+		}
+		total += rt;
+	}
+	ba->setPosition(ba->getPosition() + total);
+	return total;
+}
+
+void ZlibStream::close() {
+	flush();
+}
+
+int ZlibStream::flush() {
+	if(m_error) {
+		return -1;
+	}
+	if(m_finished) {
+		return 0;
+	}
+	if(process(nullptr, 0, Z_FINISH) < 0) {
+		return -1;
+	}
+	if(!m_finished) {
+		MS_LOG_WARN(g_logger) << "zlib inflate data truncated, in_size=" << m_inSize;
+		m_error = true;
+		return -1;
+	}
+	return 0;
+}
+
+int ZlibStream::process(const void* data, size_t length, int flush) {
+	m_zstream->next_in = (Bytef*)data;
+	m_zstream->avail_in = length;
+	std::vector<iovec> iovs;
+	while(true) {
+		char* out = nullptr;
+		if(m_cb) {
+			m_out.resize(m_buffSize);
+			out = &m_out[0];
+		} else {
+			if(!m_result) {
+				m_result.reset(new ByteArray(m_buffSize));
+			}
+			// 直接输出到 ByteArray 当前块的剩余空间
+			iovs.clear();
+			m_result->getWriteBuffers(iovs, m_buffSize);
+			out = (char*)iovs[0].iov_base;
+		}
+		size_t out_len = m_cb ? m_buffSize : iovs[0].iov_len;
+		m_zstream->next_out = (Bytef*)out;
+		m_zstream->avail_out = out_len;
+
+		int rt = m_encode ? deflate(m_zstream, flush) : inflate(m_zstream, flush);
+		if(rt != Z_OK && rt != Z_STREAM_END && rt != Z_BUF_ERROR) {
+			MS_LOG_WARN(g_logger) << "zlib " << (m_encode ? "deflate" : "inflate")
+				<< " fail, rt=" << rt << " msg=" << (m_zstream->msg ? m_zstream->msg : "");
+			m_error = true;
+			return -1;
+		}
+
+		size_t produced = out_len - m_zstream->avail_out;
+		if(produced) {
+			m_outSize += produced;
+			if(m_maxOutSize && m_outSize > m_maxOutSize) {
+				MS_LOG_WARN(g_logger) << "zlib output too large, out_size=" << m_outSize
+					<< " max_out_size=" << m_maxOutSize;
+				m_error = true;
+				return -1;
+			}
+			if(m_cb) {
+				if(m_cb(out, produced) <= 0) {
+					m_error = true;
+					return -1;
+				}
+			} else {
+				m_result->setPosition(m_result->getPosition() + produced);
+			}
+		}
+
+		if(rt == Z_STREAM_END) {
+			m_finished = true;
+			break;
+		}
+		// 输出空间没有用完说明输入已经处理完, Z_FINISH 要一直做到 Z_STREAM_END
+		if(m_zstream->avail_out != 0 && (flush != Z_FINISH || !m_encode)) {
+			break;
+		}
+		if(rt == Z_BUF_ERROR && produced == 0) {
+			break;
+		}
+	}
+	return 0;
+}
+
+std::string ZlibStream::getResult() const {
+	std::string rt;
+	if(m_result && m_result->getSize()) {
+		rt.resize(m_result->getSize());
+		m_result->read(&rt[0], rt.size(), 0);
+	}
+	return rt;
+}
+
+ByteArray::ptr ZlibStream::getByteArray() {
+	if(!m_result) {
+		m_result.reset(new ByteArray(m_buffSize));
+	}
+	m_result->setPosition(0);
+	return m_result;
+}
+
+}
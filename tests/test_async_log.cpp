@@ -0,0 +1,224 @@
+#include <fstream>
+#include <atomic>
+#include <sys/time.h>
+
+#include "log.h"
+#include "config.h"
+#include "thread.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+// 记录写出内容的 Appender, 可以设置每次写出的延迟来制造缓冲区满
+class MemLogAppender : public MNSER::LogAppender {
+public:
+    typedef std::shared_ptr<MemLogAppender> ptr;
+    MemLogAppender(int delay_us = 0)
+        :m_delay(delay_us) {
+    }
+    ~MemLogAppender() {
+        flushAsync();
+    }
+    std::string toYamlString() override { return ""; }
+
+    std::string getData() {
+        MNSER::Mutex::Lock lock(m_writeMutex);
+        return m_data;
+    }
+
+    size_t countOf(const std::string& str) {
+        std::string data = getData();
+        size_t n = 0;
+        for(size_t pos = data.find(str); pos != std::string::npos; pos = data.find(str, pos + 1)) {
+            ++n;
+        }
+        return n;
+    }
+protected:
+    void write(const struct iovec* iov, int cnt) override {
+        if(m_delay) {
+            usleep(m_delay);
+        }
+        for(int i = 0; i < cnt; ++i) {
+            m_data.append((const char*)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+private:
+    int m_delay;
+    std::string m_data;
+};
+
+static std::string read_file(const std::string& name) {
+    std::ifstream ifs(name);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static uint64_t now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec * 1000000ul + tv.tv_usec;
+}
+
+// 多个线程写同一个异步文件, 每个线程内部的顺序不变, 不丢不乱
+static void test_order() {
+    std::string file = "/tmp/test_async_log_" + std::to_string(getpid()) + ".log";
+    unlink(file.c_str());
+    MNSER::Logger::ptr logger(new MNSER::Logger("async_order"));
+    MNSER::FileLogAppender::ptr appender(new MNSER::FileLogAppender(file));
+    appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%m%n")));
+    appender->setAsync(true);
+    logger->addAppender(appender);
+
+    const int threads = 4;
+    const int n = 20000;
+    std::vector<MNSER::Thread::ptr> thrs;
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([logger, t, n]() {
+            for(int i = 0; i < n; ++i) {
+                MS_LOG_INFO(logger) << t << " " << i;
+            }
+        }, "order_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+
+    std::stringstream ss(read_file(file));
+    std::vector<int> next(threads, 0);
+    int lines = 0;
+    bool ok = true;
+    int t, i;
+    while(ss >> t >> i) {
+        ++lines;
+        if(t < 0 || t >= threads || next[t] != i) {
+            ok = false;
+            break;
+        }
+        ++next[t];
+    }
+    CHECK(ok);
+    CHECK(lines == threads * n);
+    CHECK(appender->getDropCount() == 0);
+    unlink(file.c_str());
+}
+
+// 缓冲区满时丢弃, 写出的加上丢弃的等于总数, 并输出丢弃的提示
+static void test_drop() {
+    // 只影响之后新建的线程
+    MNSER::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(4096);
+    MNSER::Logger::ptr logger(new MNSER::Logger("async_drop"));
+    MemLogAppender::ptr appender(new MemLogAppender(2000));
+    appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%m%n")));
+    appender->setAsync(true, MNSER::LogAppender::DROP);
+    logger->addAppender(appender);
+
+    const int n = 5000;
+    MNSER::Thread thr([logger, n]() {
+        for(int i = 0; i < n; ++i) {
+            MS_LOG_INFO(logger) << "drop message " << i;
+        }
+    }, "drop");
+    thr.join();
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+    // 再写一条触发丢弃提示
+    MS_LOG_INFO(logger) << "drop message end";
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+
+    size_t written = appender->countOf("drop message ") - 1;
+    CHECK(appender->getDropCount() > 0);
+    CHECK(written + appender->getDropCount() == n);
+    CHECK(appender->countOf("[async log] dropped") > 0);
+}
+
+// drop_debug 只丢 DEBUG, 其他级别等待
+static void test_drop_debug() {
+    MNSER::Logger::ptr logger(new MNSER::Logger("async_drop_debug"));
+    MemLogAppender::ptr appender(new MemLogAppender(2000));
+    appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%p %m%n")));
+    appender->setAsync(true, MNSER::LogAppender::DROP_DEBUG);
+    logger->addAppender(appender);
+
+    const int n = 3000;
+    MNSER::Thread thr([logger, n]() {
+        for(int i = 0; i < n; ++i) {
+            MS_LOG_DEBUG(logger) << "message " << i;
+            MS_LOG_ERROR(logger) << "message " << i;
+        }
+    }, "drop_debug");
+    thr.join();
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+
+    CHECK(appender->getDropCount() > 0);
+    CHECK(appender->countOf("ERROR message") == n);
+    CHECK(appender->countOf("DEBUG message") + appender->getDropCount() == n);
+    MNSER::Config::Lookup<uint32_t>("log.async.buffer_size")->setValue(256 * 1024);
+}
+
+// FATAL 返回时之前的日志都已经写出
+static void test_fatal() {
+    MNSER::Config::Lookup<uint32_t>("log.async.flush_interval")->setValue(5000);
+    MNSER::Logger::ptr logger(new MNSER::Logger("async_fatal"));
+    MemLogAppender::ptr appender(new MemLogAppender);
+    appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%p %m%n")));
+    appender->setAsync(true);
+    logger->addAppender(appender);
+
+    // 等后台线程进入新的等待周期
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+    usleep(10 * 1000);
+    MS_LOG_INFO(logger) << "before fatal";
+    usleep(50 * 1000);
+    CHECK(appender->countOf("before fatal") == 0);
+    MS_LOG_FATAL(logger) << "fatal";
+    CHECK(appender->getData() == "INFO before fatal\nFATAL fatal\n");
+    MNSER::Config::Lookup<uint32_t>("log.async.flush_interval")->setValue(20);
+}
+
+static void test_config() {
+    std::string yaml =
+        "logs:\n"
+        "    - name: async_conf\n"
+        "      level: info\n"
+        "      appenders:\n"
+        "          - type: StdoutLogAppender\n"
+        "            async: true\n"
+        "            overflow: drop_debug\n";
+    MNSER::Config::LoadFromYaml(YAML::Load(yaml));
+    YAML::Node node = YAML::Load(MS_LOG_NAME("async_conf")->toYamlString());
+    CHECK(node["appenders"][0]["async"].as<bool>());
+    CHECK(node["appenders"][0]["overflow"].as<std::string>() == "drop_debug");
+}
+
+// 对比调用线程上的耗时
+static void bench() {
+    std::string file = "/tmp/test_async_log_bench_" + std::to_string(getpid()) + ".log";
+    const int n = 200000;
+    for(int async = 0; async < 2; ++async) {
+        unlink(file.c_str());
+        MNSER::Logger::ptr logger(new MNSER::Logger("bench"));
+        MNSER::FileLogAppender::ptr appender(new MNSER::FileLogAppender(file));
+        appender->setAsync(async);
+        logger->addAppender(appender);
+        uint64_t start = now_us();
+        for(int i = 0; i < n; ++i) {
+            MS_LOG_INFO(logger) << "bench message " << i;
+        }
+        uint64_t used = now_us() - start;
+        MNSER::AsyncLogWriter::GetInstance()->flush();
+        MS_LOG_INFO(g_logger) << (async ? "async" : "sync") << " " << used * 1000 / n << " ns/line";
+    }
+    unlink(file.c_str());
+}
+
+int main(int argc, char** argv) {
+    test_order();
+    test_drop();
+    test_drop_debug();
+    test_fatal();
+    test_config();
+    bench();
+    return TestResult();
+}
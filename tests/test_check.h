@@ -0,0 +1,24 @@
+#ifndef __MNSER_TEST_CHECK_H__
+#define __MNSER_TEST_CHECK_H__
+
+#include <atomic>
+
+#include "log.h"
+
+// 测试共用的检查, 失败时记录日志并继续执行, 最后由 TestResult 输出结果
+// 计数是原子的, 可以在多个线程和协程中使用
+static std::atomic<int> s_fails{0};
+
+#define CHECK(x) \
+    if(!(x)) { \
+        ++s_fails; \
+        MS_LOG_ERROR(MS_LOG_ROOT()) << "CHECK FAIL: " #x; \
+    }
+
+// 输出 PASS/FAIL, 返回进程的退出码
+static inline int TestResult() {
+    MS_LOG_INFO(MS_LOG_ROOT()) << (s_fails ? "FAIL" : "PASS");
+    return s_fails ? 1 : 0;
+}
+
+#endif
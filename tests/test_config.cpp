@@ -61,12 +61,12 @@ MNSER::ConfigVar<std::unordered_map<std::string, int> >::ptr g_int_umap_value_co
 	MNSER::Config::Lookup("system.str_int_umap", std::unordered_map<std::string, int>{{"k",1000}}, "system str_int_umap");
 
 void test_config() {
-	MS_LOG_INFO(MS_LOG_ROOT()) << "int before: " << g_int_value_config->getValue();
-	MS_LOG_INFO(MS_LOG_ROOT()) << "float before: " << g_float_value_config->getValue();
+	MS_LOG_INFO(MS_LOG_ROOT()) << "int before: " << *g_int_value_config->getValue();
+	MS_LOG_INFO(MS_LOG_ROOT()) << "float before: " << *g_float_value_config->getValue();
 #define PP(var, name, prefix) \
 	{ \
-		auto& v = var->getValue(); \
-		for (auto& it: v) { \
+		auto v = var->getValue(); \
+		for (auto& it: *v) { \
 			MS_LOG_INFO(MS_LOG_ROOT()) << #prefix " " #name " : " << it; \
 		} \
 		MS_LOG_INFO(MS_LOG_ROOT()) << #prefix " " #name "yaml: " << var->toString(); \
@@ -79,8 +79,8 @@ void test_config() {
 
 #define PP_M(var, name, prefix) \
 	{ \
-		auto& v = var->getValue(); \
-		for (auto& it: v) { \
+		auto v = var->getValue(); \
+		for (auto& it: *v) { \
 			MS_LOG_INFO(MS_LOG_ROOT()) << #prefix " " #name " : " << \
 			"{ " << it.first << " : " << it.second << " }"; \
 		} \
@@ -92,8 +92,8 @@ void test_config() {
 
 	YAML::Node root = YAML::LoadFile("/home/lucky/WebServer/tests/log.yml");
 	MNSER::Config::LoadFromYaml(root);
-	MS_LOG_INFO(MS_LOG_ROOT()) << "int after: " << g_int_value_config->getValue();
-	MS_LOG_INFO(MS_LOG_ROOT()) << "float after: " << g_float_value_config->getValue();
+	MS_LOG_INFO(MS_LOG_ROOT()) << "int after: " << *g_int_value_config->getValue();
+	MS_LOG_INFO(MS_LOG_ROOT()) << "float after: " << *g_float_value_config->getValue();
 
 	PP(g_int_vec_value_config, int_vec, after);
 	PP(g_int_list_value_config, int_list, after);
@@ -172,10 +172,10 @@ MNSER::ConfigVar<std::map<std::string, std::vector<Person> > >::ptr g_person_vec
     MNSER::Config::Lookup("class.vec_map", std::map<std::string, std::vector<Person> >(), "system person");
 
 void test_class() {
-    MS_LOG_INFO(MS_LOG_ROOT()) << "before: " << g_person->getValue().toString() << " - " << g_person->toString();
+    MS_LOG_INFO(MS_LOG_ROOT()) << "before: " << g_person->getValue()->toString() << " - " << g_person->toString();
 #define XX_PM(g_var, prefix) \
     { \
-        auto m = g_person_map->getValue(); \
+        auto m = *g_person_map->getValue(); \
         for(auto& i : m) { \
             MS_LOG_INFO(MS_LOG_ROOT()) <<  prefix << ": " << i.first << " - " << i.second.toString(); \
         } \
@@ -195,7 +195,7 @@ void test_class() {
     YAML::Node root = YAML::LoadFile("/home/lucky/WebServer/tests/log.yml");
     MNSER::Config::LoadFromYaml(root);
 
-    MS_LOG_INFO(MS_LOG_ROOT()) << "after: " << g_person->getValue().toString() << " - " << g_person->toString();
+    MS_LOG_INFO(MS_LOG_ROOT()) << "after: " << g_person->getValue()->toString() << " - " << g_person->toString();
     XX_PM(g_person_map, "class.map after");
     MS_LOG_INFO(MS_LOG_ROOT()) << "g_person_vec_map after: " << g_person_vec_map->toString();
 }
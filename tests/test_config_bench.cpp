@@ -0,0 +1,115 @@
+#include <sys/time.h>
+
+#include "config.h"
+#include "log.h"
+#include "tcp_server.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+typedef std::vector<MNSER::TcpServerConf> ServerList;
+
+static MNSER::ConfigVar<ServerList>::ptr g_servers =
+    MNSER::Config::Lookup("bench.servers", ServerList(), "bench servers");
+
+static MNSER::ConfigVar<std::map<std::string, std::vector<int> > >::ptr g_routes =
+    MNSER::Config::Lookup("bench.routes", std::map<std::string, std::vector<int> >(), "bench routes");
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+static std::string make_yaml(int n) {
+    std::stringstream ss;
+    ss << "bench:\n    servers:\n";
+    for(int i = 0; i < n; ++i) {
+        ss << "        - address: [\"0.0.0.0:" << 8000 + i << "\", \"127.0.0.1:" << 9000 + i << "\"]\n"
+           << "          name: server_" << i << "\n"
+           << "          keepalive: 1\n"
+           << "          timeout: " << i << "\n"
+           << "          args:\n"
+           << "              root: /data/" << i << "\n"
+           << "              mode: \"a: b\"\n";
+    }
+    ss << "    routes:\n";
+    for(int i = 0; i < n; ++i) {
+        ss << "        r" << i << ": [" << i << ", " << i + 1 << ", " << i + 2 << "]\n";
+    }
+    return ss.str();
+}
+
+// 原来的方式: 每一层都输出成字符串, 再由下一层重新解析
+static ServerList legacy_servers(const YAML::Node& node) {
+    ServerList rt;
+    std::stringstream ss;
+    for(size_t i = 0; i < node.size(); ++i) {
+        ss.str("");
+        ss << node[i];
+        YAML::Node n = YAML::Load(ss.str());
+        MNSER::TcpServerConf conf;
+        conf.name = n["name"].as<std::string>();
+        conf.keepalive = n["keepalive"].as<int>();
+        conf.timeout = n["timeout"].as<int>();
+        for(size_t j = 0; j < n["address"].size(); ++j) {
+            conf.address.push_back(n["address"][j].as<std::string>());
+        }
+        rt.push_back(conf);
+    }
+    return rt;
+}
+
+static void test_convert() {
+    YAML::Node root = YAML::Load(make_yaml(3));
+    MNSER::Config::LoadFromYaml(root);
+    auto conf = g_servers->getValue();
+    auto& servers = *conf;
+    CHECK(servers.size() == 3);
+    if(servers.size() == 3) {
+        CHECK(servers[2].name == "server_2" && servers[2].timeout == 2 && servers[2].keepalive == 1);
+        CHECK(servers[2].address == std::vector<std::string>({"0.0.0.0:8002", "127.0.0.1:9002"}));
+        // args 是 map 节点, 原来按字符串读取时是空的
+        CHECK(servers[2].args.size() == 2 && servers[2].args.at("mode") == "a: b");
+    }
+    CHECK(g_routes->getValue()->at("r1") == std::vector<int>({1, 2, 3}));
+
+    // 字符串和节点的转换结果一致
+    auto str = MNSER::LexicalCast<ServerList, std::string>()(servers);
+    CHECK((MNSER::LexicalCast<std::string, ServerList>()(str) == servers));
+    CHECK(g_servers->fromString(str) && *g_servers->getValue() == servers);
+
+    // 类型不对时保留原值
+    CHECK(!g_routes->fromNode(YAML::Load("{r1: [a]}")));
+    CHECK(g_routes->getValue()->size() == 3);
+}
+
+static void bench(int n) {
+    std::string yaml = make_yaml(n);
+    uint64_t start = now_us();
+    YAML::Node root = YAML::Load(yaml);
+    uint64_t parse = now_us() - start;
+
+    start = now_us();
+    auto legacy = legacy_servers(root["bench"]["servers"]);
+    uint64_t legacy_used = now_us() - start;
+
+    start = now_us();
+    MNSER::Config::LoadFromYaml(root);
+    uint64_t used = now_us() - start;
+
+    CHECK(g_servers->getValue()->size() == (size_t)n && g_routes->getValue()->size() == (size_t)n);
+    CHECK(legacy.size() == (size_t)n);
+    if(legacy.size() == (size_t)n && g_servers->getValue()->size() == (size_t)n) {
+        CHECK(legacy.back().address == g_servers->getValue()->back().address);
+    }
+    MS_LOG_INFO(g_logger) << n << " entries: yaml parse " << parse / 1000 << "ms"
+        << ", servers by string round trip " << legacy_used / 1000 << "ms"
+        << ", LoadFromYaml servers and routes " << used / 1000 << "ms";
+}
+
+int main(int argc, char** argv) {
+    test_convert();
+    bench(argc > 1 ? atoi(argv[1]) : 10000);
+    return TestResult();
+}
@@ -0,0 +1,179 @@
+#include <fstream>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "log.h"
+#include "iomanager.h"
+#include "test_check.h"
+
+// 记录转换次数的配置类型
+struct Counted {
+    int value = 0;
+    bool operator==(const Counted& oth) const { return value == oth.value; }
+};
+
+static int s_parses = 0;
+
+namespace MNSER {
+
+template<>
+class LexicalCast<std::string, Counted> {
+public:
+    Counted operator()(const std::string& v) {
+        ++s_parses;
+        Counted c;
+        c.value = YAML::Load(v)["value"].as<int>();
+        return c;
+    }
+};
+
+template<>
+class LexicalCast<Counted, std::string> {
+public:
+    std::string operator()(const Counted& c) {
+        return "{value: " + std::to_string(c.value) + "}";
+    }
+};
+
+}
+
+static MNSER::ConfigVar<Counted>::ptr g_a =
+    MNSER::Config::Lookup("reload.a", Counted(), "reload a");
+
+static MNSER::ConfigVar<Counted>::ptr g_b =
+    MNSER::Config::Lookup("reload.b", Counted(), "reload b");
+
+static MNSER::ConfigVar<std::vector<int> >::ptr g_vec =
+    MNSER::Config::Lookup("reload.sub.vec", std::vector<int>(), "reload vec");
+
+static std::string s_dir;
+
+static void write_file(const std::string& name, const std::string& data) {
+    // 先写临时文件再改名, 和编辑器保存的方式一样
+    std::string tmp = s_dir + "/." + name + ".tmp";
+    {
+        std::ofstream ofs(tmp);
+        ofs << data;
+    }
+    rename(tmp.c_str(), (s_dir + "/" + name).c_str());
+}
+
+static std::string yaml_a(int a) {
+    return "reload:\n    a:\n        value: " + std::to_string(a) + "\n";
+}
+
+static std::string yaml_b(int b, const std::string& vec) {
+    return "reload:\n    b:\n        value: " + std::to_string(b) + "\n"
+        "    sub:\n        vec: " + vec + "\n";
+}
+
+// 只有内容改变的配置项会重新转换
+static void test_incremental() {
+    int vec_changes = 0;
+    g_vec->addListener([&vec_changes](const std::vector<int>&, const std::vector<int>&) {
+        ++vec_changes;
+    });
+    write_file("a.yml", yaml_a(1));
+    write_file("b.yml", yaml_b(2, "[1, 2]"));
+    MNSER::Config::LoadFromConfigDir(s_dir);
+    CHECK(g_a->getValue()->value == 1 && g_b->getValue()->value == 2);
+    CHECK(*g_vec->getValue() == std::vector<int>({1, 2}));
+    CHECK(s_parses == 2 && vec_changes == 1);
+
+    // 文件没有修改不解析
+    MNSER::Config::LoadFromConfigDir(s_dir);
+    CHECK(s_parses == 2);
+
+    // 修改 b.yml 中的 vec, b 的值不变
+    usleep(10 * 1000);
+    write_file("b.yml", yaml_b(2, "[1, 2, 3]"));
+    MNSER::Config::LoadFromConfigDir(s_dir);
+    CHECK(*g_vec->getValue() == std::vector<int>({1, 2, 3}));
+    CHECK(s_parses == 2 && vec_changes == 2);
+
+    // 解析失败时保留原来的值
+    write_file("b.yml", "reload: [");
+    CHECK(MNSER::Config::LoadFromConfigFile(s_dir + "/b.yml") == -1);
+    CHECK(g_b->getValue()->value == 2);
+
+    MNSER::Config::LoadFromConfigDir(s_dir, true);
+    CHECK(s_parses == 3);
+    g_vec->clearListener();
+}
+
+template<class Fun>
+static bool wait_for(Fun fun) {
+    for(int i = 0; i < 200; ++i) {
+        if(fun()) {
+            return true;
+        }
+        usleep(10 * 1000);
+    }
+    return false;
+}
+
+// 文件修改后由 IOManager 的协程导入
+static void test_watch() {
+    write_file("b.yml", yaml_b(2, "[1, 2, 3]"));
+    MNSER::IOManager iom(1, false, "config_watch");
+    CHECK(MNSER::Config::WatchConfigDir(s_dir, &iom));
+    CHECK(g_b->getValue()->value == 2);
+    int parses = s_parses;
+
+    write_file("a.yml", yaml_a(5));
+    CHECK(wait_for([]() { return g_a->getValue()->value == 5; }));
+    CHECK(s_parses == parses + 1);
+
+    // 直接写入文件
+    {
+        std::ofstream ofs(s_dir + "/b.yml");
+        ofs << yaml_b(6, "[4]");
+    }
+    CHECK(wait_for([]() { return g_b->getValue()->value == 6; }));
+    CHECK(*g_vec->getValue() == std::vector<int>({4}));
+
+    // 新建的子目录也会监听
+    mkdir((s_dir + "/sub").c_str(), 0755);
+    usleep(50 * 1000);
+    {
+        std::ofstream ofs(s_dir + "/sub/c.yml");
+        ofs << "reload:\n    a:\n        value: 7\n";
+    }
+    CHECK(wait_for([]() { return g_a->getValue()->value == 7; }));
+
+    MNSER::Config::UnwatchConfigDir();
+    write_file("a.yml", yaml_a(8));
+    usleep(100 * 1000);
+    CHECK(g_a->getValue()->value == 7);
+    iom.stop();
+}
+
+static void remove_dir(const std::string& path) {
+    DIR* d = opendir(path.c_str());
+    struct dirent* dp;
+    while(d && (dp = readdir(d)) != nullptr) {
+        std::string name = dp->d_name;
+        if(name == "." || name == "..") {
+            continue;
+        }
+        if(dp->d_type == DT_DIR) {
+            remove_dir(path + "/" + name);
+        } else {
+            unlink((path + "/" + name).c_str());
+        }
+    }
+    if(d) {
+        closedir(d);
+    }
+    rmdir(path.c_str());
+}
+
+int main(int argc, char** argv) {
+    char tmpl[] = "/tmp/test_config_reload_XXXXXX";
+    s_dir = mkdtemp(tmpl);
+    test_incremental();
+    test_watch();
+    remove_dir(s_dir);
+    return TestResult();
+}
@@ -0,0 +1,108 @@
+#include <sys/time.h>
+
+#include "config.h"
+#include "log.h"
+#include "thread.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static MNSER::ConfigVar<int>::ptr g_int =
+    MNSER::Config::Lookup("test.var.int", (int)1, "test int");
+
+static MNSER::ConfigVar<std::vector<int> >::ptr g_vec =
+    MNSER::Config::Lookup("test.var.vec", std::vector<int>{1, 1, 1, 1}, "test vec");
+
+// 监听函数在锁外调用, 可以读到新值, 也可以再修改配置
+static void test_listener() {
+    std::vector<std::pair<int, int> > changes;
+    int seen = 0;
+    uint64_t id = g_int->addListener([&changes, &seen](const int& ov, const int& nv) {
+        changes.push_back(std::make_pair(ov, nv));
+        seen = *g_int->getValue();
+        if(nv == 3) {
+            g_int->setValue(4);
+        }
+    });
+    MNSER::ConfigVar<int>::ValuePtr before = g_int->getValue();
+    g_int->setValue(2);
+    CHECK(seen == 2);
+    g_int->setValue(2);
+    CHECK(changes.size() == 1);
+    g_int->setValue(3);
+    CHECK(*g_int->getValue() == 4);
+    CHECK(changes.size() == 3 && changes[1] == std::make_pair(2, 3) && changes[2] == std::make_pair(3, 4));
+    // 持有的旧快照不变, 释放之后旧快照被析构
+    CHECK(*before == 1);
+    std::weak_ptr<const int> weak = before;
+    before.reset();
+    CHECK(weak.expired());
+    g_int->delListener(id);
+
+    MNSER::Config::LoadFromYaml(YAML::Load("test:\n    var:\n        int: 10\n"));
+    CHECK(*g_int->getValue() == 10);
+    CHECK(g_int->toString() == "10");
+}
+
+// 读取的同时修改, 读到的每个值都是完整的
+static void test_concurrent() {
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::vector<MNSER::Thread::ptr> thrs;
+    for(int t = 0; t < 4; ++t) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([&stop, &bad]() {
+            while(!stop) {
+                auto v = g_vec->getValue();
+                for(auto& i : *v) {
+                    if(i != (*v)[0]) {
+                        ++bad;
+                    }
+                }
+            }
+        }, "config_" + std::to_string(t))));
+    }
+    for(int i = 0; i < 2000; ++i) {
+        g_vec->setValue(std::vector<int>(4 + i % 8, i));
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+    CHECK(bad == 0);
+    CHECK(*g_vec->getValue() == std::vector<int>(4 + 1999 % 8, 1999));
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+// 和读锁对比, 线程缓存的快照不能比只加一次读锁慢
+static void bench(int n) {
+    MNSER::RWLock mutex;
+    int value = 0;
+    uint64_t sum = 0;
+    uint64_t start = now_ns();
+    for(int i = 0; i < n; ++i) {
+        MNSER::RWLock::ReadLock lock(mutex);
+        sum += value;
+    }
+    uint64_t locked = now_ns() - start;
+
+    start = now_ns();
+    for(int i = 0; i < n; ++i) {
+        sum += *g_int->getValue();
+    }
+    uint64_t used = now_ns() - start;
+    MS_LOG_INFO(g_logger) << "rwlock: " << locked / n << " ns/read"
+        << " snapshot: " << used / n << " ns/read sum=" << sum;
+    CHECK(used <= locked);
+}
+
+int main(int argc, char** argv) {
+    test_listener();
+    test_concurrent();
+    bench(argc > 1 ? atoi(argv[1]) : 10000000);
+    return TestResult();
+}
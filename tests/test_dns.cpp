@@ -0,0 +1,245 @@
+#include <fstream>
+
+#include "config.h"
+#include "dns.h"
+#include "iomanager.h"
+#include "log.h"
+#include "socket.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static bool s_stop = false;
+static int s_queries = 0;
+static void Append16(std::string& out, uint16_t v) {
+    out.push_back((char)(v >> 8));
+    out.push_back((char)(v & 0xff));
+}
+
+static void Append32(std::string& out, uint32_t v) {
+    Append16(out, v >> 16);
+    Append16(out, v & 0xffff);
+}
+
+static void AppendName(std::string& out, const std::string& name) {
+    size_t start = 0;
+    while(start < name.size()) {
+        size_t dot = name.find('.', start);
+        if(dot == std::string::npos) {
+            dot = name.size();
+        }
+        out.push_back((char)(dot - start));
+        out.append(name, start, dot - start);
+        start = dot + 1;
+    }
+    out.push_back('\0');
+}
+
+// 本地的 DNS 桩服务器, 只认识几个固定的域名
+//   a.test      A 1.2.3.4 / AAAA 2001:db8::1, TTL 1 秒
+//   cname.test  CNAME a.test
+//   big.test    A 1.2.3.4, TTL 4294968 秒, 换算成毫秒超出 32 位
+//   hi.test     A 1.2.3.4, TTL 最高位为 1
+//   nx.test     NXDOMAIN
+//   slow.test   不应答
+static void stub_server(MNSER::Socket::ptr sock) {
+    MNSER::Address::ptr from(new MNSER::IPv4Address);
+    char buf[1024];
+    sock->setRecvTimeout(100);
+    while(!s_stop) {
+        int rt = sock->recvFrom(buf, sizeof(buf), from);
+        if(rt < 12) {
+            continue;
+        }
+        ++s_queries;
+        std::string name;
+        size_t pos = 12;
+        while(pos < (size_t)rt && buf[pos]) {
+            if(!name.empty()) {
+                name.push_back('.');
+            }
+            name.append(buf + pos + 1, buf[pos]);
+            pos += buf[pos] + 1;
+        }
+        ++pos;
+        uint16_t qtype = (uint8_t)buf[pos] << 8 | (uint8_t)buf[pos + 1];
+        std::string question(buf + 12, pos + 4 - 12);
+
+        if(name == "slow.test") {
+            continue;
+        }
+
+        std::string answers;
+        int ancount = 0;
+        int rcode = 0;
+        std::string owner = name;
+        if(name == "cname.test") {
+            answers.append("\xc0\x0c", 2);
+            Append16(answers, 5);
+            Append16(answers, 1);
+            Append32(answers, 60);
+            std::string target;
+            AppendName(target, "a.test");
+            Append16(answers, target.size());
+            answers += target;
+            ++ancount;
+            owner = "a.test";
+        }
+        uint32_t ttl = 1;
+        if(name == "big.test") {
+            ttl = 4294968;
+        } else if(name == "hi.test") {
+            ttl = 0x80000001;
+        }
+        if(owner == "a.test" || owner == "big.test" || owner == "hi.test") {
+            AppendName(answers, owner);
+            Append16(answers, qtype);
+            Append16(answers, 1);
+            Append32(answers, ttl);
+            if(qtype == 1) {
+                Append16(answers, 4);
+                answers.append("\x01\x02\x03\x04", 4);
+            } else {
+                Append16(answers, 16);
+                answers.append("\x20\x01\x0d\xb8\0\0\0\0\0\0\0\0\0\0\0\x01", 16);
+            }
+            ++ancount;
+        } else if(name != "cname.test") {
+            rcode = 3;
+        }
+
+        std::string rsp;
+        rsp.append(buf, 2);
+        Append16(rsp, 0x8180 | rcode);
+        Append16(rsp, 1);
+        Append16(rsp, ancount);
+        Append16(rsp, 0);
+        Append16(rsp, 0);
+        rsp += question;
+        rsp += answers;
+        sock->sendTo(rsp.data(), rsp.size(), from);
+    }
+}
+
+static std::string Join(const std::vector<MNSER::IPAddress::ptr>& addrs) {
+    std::string rt;
+    for(auto& i : addrs) {
+        if(!rt.empty()) {
+            rt += ",";
+        }
+        rt += i->toString();
+    }
+    return rt;
+}
+
+static void test(MNSER::Address::ptr server) {
+    MNSER::DnsResolver resolver;
+    resolver.setServers({server});
+
+    std::ofstream ofs("/tmp/test_dns_hosts");
+    ofs << "# test hosts" << std::endl
+        << "10.0.0.1  myhost.test  alias.test" << std::endl
+        << "fe80::1   myhost.test" << std::endl;
+    ofs.close();
+    resolver.setHostsFile("/tmp/test_dns_hosts");
+
+    std::vector<MNSER::IPAddress::ptr> addrs;
+    CHECK(resolver.lookup(addrs, "Alias.Test"));
+    CHECK(Join(addrs) == "10.0.0.1:0");
+    addrs.clear();
+    CHECK(resolver.lookup(addrs, "myhost.test", AF_UNSPEC));
+    CHECK(addrs.size() == 2);
+    CHECK(s_queries == 0);
+
+    // 第一次走网络, 第二次命中缓存
+    addrs.clear();
+    CHECK(resolver.lookup(addrs, "a.test"));
+    CHECK(Join(addrs) == "1.2.3.4:0");
+    addrs.clear();
+    CHECK(resolver.lookup(addrs, "a.test"));
+    CHECK(Join(addrs) == "1.2.3.4:0");
+    CHECK(s_queries == 1);
+
+    addrs.clear();
+    CHECK(resolver.lookup(addrs, "a.test", AF_INET6));
+    CHECK(Join(addrs) == "[2001:db8::1]:0");
+    CHECK(s_queries == 2);
+
+    // CNAME 链, TTL 取链上最小的 1 秒
+    addrs.clear();
+    CHECK(resolver.lookup(addrs, "cname.test"));
+    CHECK(Join(addrs) == "1.2.3.4:0");
+    CHECK(s_queries == 3);
+
+    // 否定缓存
+    addrs.clear();
+    CHECK(!resolver.lookup(addrs, "nx.test"));
+    CHECK(!resolver.lookup(addrs, "nx.test"));
+    CHECK(s_queries == 4);
+
+    // TTL 过期后重新查询
+    usleep(1100 * 1000);
+    CHECK(resolver.lookup(addrs, "a.test"));
+    CHECK(s_queries == 5);
+
+    // 服务器不应答时超时失败, 期间其它协程照常运行, 失败结果不缓存
+    int ticks = 0;
+    MNSER::Timer::ptr timer = MNSER::IOManager::GetThis()->addTimer(20, [&ticks](){
+        ++ticks;
+    }, true);
+    MNSER::Config::Lookup<uint64_t>("dns.timeout", 0)->setValue(300);
+    MNSER::Config::Lookup<uint32_t>("dns.attempts", 0)->setValue(1);
+    uint64_t start = MNSER::GetCurrentMS();
+    addrs.clear();
+    CHECK(!resolver.lookup(addrs, "slow.test"));
+    uint64_t used = MNSER::GetCurrentMS() - start;
+    timer->cancel();
+    CHECK(used >= 300 && used < 1000);
+    CHECK(ticks >= 10);
+    CHECK(resolver.getCacheSize() == 4);
+    MS_LOG_INFO(g_logger) << "slow.test used=" << used << "ms ticks=" << ticks;
+
+    // 很大的 TTL 不会溢出成很短的缓存时间, 按 dns.max_ttl 截断
+    int queries = s_queries;
+    addrs.clear();
+    CHECK(resolver.lookup(addrs, "big.test"));
+    usleep(800 * 1000);
+    CHECK(resolver.lookup(addrs, "big.test"));
+    CHECK(s_queries == queries + 1);
+    // 最高位为 1 的 TTL 按 0 处理, 不缓存
+    CHECK(resolver.lookup(addrs, "hi.test"));
+    CHECK(resolver.lookup(addrs, "hi.test"));
+    CHECK(s_queries == queries + 3);
+
+    // Address::Lookup 通过全局解析器解析, 并带上端口
+    MNSER::DnsMgr::GetInstance()->setServers({server});
+    auto addr = MNSER::Address::LookupAnyIPAddress("cname.test:8080");
+    CHECK(addr && addr->toString() == "1.2.3.4:8080");
+
+    MS_LOG_INFO(g_logger) << "queries=" << s_queries << " query_count="
+        << resolver.getQueryCount() << " fails=" << s_fails;
+    s_stop = true;
+    unlink("/tmp/test_dns_hosts");
+}
+
+void run() {
+    // socket 要在 IOManager 线程里创建, 这样才会被 hook 成非阻塞
+    MNSER::Socket::ptr sock = MNSER::Socket::CreateUDPSocket();
+    if(!sock->bind(MNSER::IPv4Address::Create("127.0.0.1", 0))) {
+        MS_LOG_ERROR(g_logger) << "bind fail";
+        ++s_fails;
+        return;
+    }
+    MNSER::Address::ptr server = sock->getLocalAddress();
+    MS_LOG_INFO(g_logger) << "stub dns server: " << *server;
+    MNSER::IOManager::GetThis()->schedule(std::bind(test, server));
+    stub_server(sock);
+}
+
+int main(int argc, char** argv) {
+    MNSER::IOManager iom(1);
+    iom.schedule(run);
+    iom.stop();
+    return TestResult();
+}
@@ -0,0 +1,487 @@
+#include <map>
+
+#include "http2_session.h"
+#include "http_server.h"
+#include "http_connection.h"
+#include "log.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+using MNSER::http::Http2FrameType;
+using MNSER::http::HPackHeaders;
+
+static MNSER::http::HttpServer::ptr s_server;
+
+static std::string HexToBytes(const std::string& hex) {
+    std::string rt;
+    for(size_t i = 0; i + 1 < hex.size(); i += 2) {
+        rt.push_back((char)strtol(hex.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return rt;
+}
+
+static std::string GetHeader(const HPackHeaders& headers, const std::string& name) {
+    for(auto& i : headers) {
+        if(i.first == name) {
+            return i.second;
+        }
+    }
+    return "";
+}
+
+// RFC 7541 C.4 的 Huffman 示例, 以及编码解码往返
+static void test_hpack() {
+    MNSER::http::HPackDecoder dec;
+    const char* blocks[] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"
+    };
+    HPackHeaders headers;
+    for(auto b : blocks) {
+        std::string data = HexToBytes(b);
+        headers.clear();
+        CHECK(dec.decode((const uint8_t*)data.data(), data.size(), headers) == 0);
+    }
+    CHECK(headers.size() == 5);
+    CHECK(GetHeader(headers, ":path") == "/index.html");
+    CHECK(GetHeader(headers, ":authority") == "www.example.com");
+    CHECK(GetHeader(headers, "custom-key") == "custom-value");
+    CHECK(dec.getTable().getSize() == 164);
+
+    std::string all;
+    for(int i = 0; i < 256; ++i) {
+        all.push_back((char)i);
+    }
+    std::string huff;
+    MNSER::http::HuffmanEncode(huff, all);
+    std::string out;
+    CHECK(MNSER::http::HuffmanDecode(out, (const uint8_t*)huff.data(), huff.size()) && out == all);
+
+    // 多个头部块共享动态表
+    MNSER::http::HPackEncoder enc;
+    MNSER::http::HPackDecoder dec2;
+    for(int n = 0; n < 50; ++n) {
+        HPackHeaders in;
+        in.push_back(std::make_pair(std::string(":status"), std::string(n % 2 ? "200" : "404")));
+        in.push_back(std::make_pair(std::string("content-type"), std::string("text/plain")));
+        in.push_back(std::make_pair(std::string("x-seq"), std::to_string(n % 7)));
+        in.push_back(std::make_pair(std::string("set-cookie"), std::string("id=") + std::to_string(n)));
+        std::string block;
+        enc.encode(in, block);
+        HPackHeaders got;
+        CHECK(dec2.decode((const uint8_t*)block.data(), block.size(), got) == 0 && got == in);
+    }
+}
+
+// 测试用的 HTTP/2 客户端, 直接收发帧
+class H2Client {
+public:
+    struct Result {
+        HPackHeaders headers;
+        std::string body;
+        bool done = false;
+        bool reset = false;
+    };
+
+    bool connect(MNSER::Address::ptr addr, const std::string& settings = "") {
+        m_sock = MNSER::Socket::CreateTCP(addr);
+        if(!m_sock->connect(addr)) {
+            return false;
+        }
+        m_stream.reset(new MNSER::SocketStream(m_sock));
+        std::string out = HTTP2_PREFACE;
+        MNSER::http::Http2AppendFrame(out, Http2FrameType::SETTINGS, 0, 0, settings.data(), settings.size());
+        return send(out);
+    }
+
+    bool send(const std::string& data) {
+        return m_stream->writeFixSize(data.data(), data.size()) > 0;
+    }
+
+    uint32_t request(const std::string& method, const std::string& path
+                     ,const std::string& body = "", uint8_t weight = 15
+                     ,const HPackHeaders& extra = HPackHeaders()) {
+        uint32_t id = m_nextId;
+        m_nextId += 2;
+        HPackHeaders headers;
+        headers.push_back(std::make_pair(std::string(":method"), method));
+        headers.push_back(std::make_pair(std::string(":scheme"), std::string("http")));
+        headers.push_back(std::make_pair(std::string(":path"), path));
+        headers.push_back(std::make_pair(std::string(":authority"), std::string("127.0.0.1")));
+        headers.insert(headers.end(), extra.begin(), extra.end());
+        std::string block;
+        // 优先级: 依赖根节点, 非独占
+        block.append(4, '\0');
+        block.push_back((char)weight);
+        m_enc.encode(headers, block);
+        std::string out;
+        MNSER::http::Http2AppendFrame(out, Http2FrameType::HEADERS
+                ,MNSER::http::HTTP2_FLAG_END_HEADERS | MNSER::http::HTTP2_FLAG_PRIORITY
+                    | (body.empty() ? MNSER::http::HTTP2_FLAG_END_STREAM : 0)
+                ,id, block.data(), block.size());
+        // 消息体分成多个 DATA 帧
+        for(size_t pos = 0; pos < body.size(); pos += 10000) {
+            size_t n = std::min(body.size() - pos, (size_t)10000);
+            MNSER::http::Http2AppendFrame(out, Http2FrameType::DATA
+                    ,pos + n == body.size() ? MNSER::http::HTTP2_FLAG_END_STREAM : 0
+                    ,id, body.data() + pos, n);
+        }
+        send(out);
+        return id;
+    }
+
+    // 读一帧并处理, 出错或超时返回 false
+    bool readOne() {
+        char head[HTTP2_FRAME_HEADER_SIZE];
+        if(m_stream->readFixSize(head, sizeof(head)) <= 0) {
+            return false;
+        }
+        MNSER::http::Http2FrameHeader fh;
+        fh.decode((const uint8_t*)head);
+        std::string payload(fh.length, '\0');
+        if(fh.length && m_stream->readFixSize(&payload[0], fh.length) <= 0) {
+            return false;
+        }
+        std::string out;
+        switch(fh.type) {
+            case Http2FrameType::SETTINGS:
+                if(!fh.hasFlag(MNSER::http::HTTP2_FLAG_ACK)) {
+                    MNSER::http::Http2AppendFrame(out, Http2FrameType::SETTINGS
+                            ,MNSER::http::HTTP2_FLAG_ACK, 0, nullptr, 0);
+                }
+                break;
+            case Http2FrameType::PING:
+                m_pingAcked = fh.hasFlag(MNSER::http::HTTP2_FLAG_ACK);
+                break;
+            case Http2FrameType::HEADERS: {
+                Result& r = m_results[fh.streamId];
+                CHECK(m_dec.decode((const uint8_t*)payload.data(), payload.size(), r.headers) == 0);
+                CHECK(fh.hasFlag(MNSER::http::HTTP2_FLAG_END_HEADERS));
+                break;
+            }
+            case Http2FrameType::DATA:
+                m_results[fh.streamId].body.append(payload);
+                m_received[fh.streamId] += payload.size();
+                if(m_autoWindow && fh.length) {
+                    MNSER::http::Http2AppendWindowUpdate(out, 0, fh.length);
+                    MNSER::http::Http2AppendWindowUpdate(out, fh.streamId, fh.length);
+                }
+                break;
+            case Http2FrameType::RST_STREAM:
+                m_results[fh.streamId].reset = true;
+                m_results[fh.streamId].done = true;
+                m_order.push_back(fh.streamId);
+                break;
+            case Http2FrameType::GOAWAY:
+                m_goaway = true;
+                break;
+            default:
+                break;
+        }
+        if((fh.type == Http2FrameType::DATA || fh.type == Http2FrameType::HEADERS)
+                && fh.hasFlag(MNSER::http::HTTP2_FLAG_END_STREAM)) {
+            m_results[fh.streamId].done = true;
+            m_order.push_back(fh.streamId);
+        }
+        if(!out.empty()) {
+            send(out);
+        }
+        return true;
+    }
+
+    bool wait(uint32_t id) {
+        while(!m_results[id].done) {
+            if(!readOne()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Result& result(uint32_t id) { return m_results[id];}
+
+    MNSER::Socket::ptr m_sock;
+    MNSER::SocketStream::ptr m_stream;
+    MNSER::http::HPackEncoder m_enc;
+    MNSER::http::HPackDecoder m_dec;
+    std::map<uint32_t, Result> m_results;
+    std::map<uint32_t, size_t> m_received;
+    std::vector<uint32_t> m_order;          // 流结束的顺序
+    uint32_t m_nextId = 1;
+    bool m_autoWindow = true;               // 收到数据后立即归还窗口
+    bool m_pingAcked = false;
+    bool m_goaway = false;
+};
+
+static std::string BigBody(size_t n) {
+    std::string rt(n, 0);
+    for(size_t i = 0; i < n; ++i) {
+        rt[i] = 'a' + i % 26;
+    }
+    return rt;
+}
+
+static void start_server(uint16_t port) {
+    s_server.reset(new MNSER::http::HttpServer(true));
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto sd = s_server->getServletDispatch();
+    // 下面都是普通的 servlet, 同时服务 HTTP/1.1 和 HTTP/2
+    sd->addServlet("/hello", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setHeader("Content-Type", "text/plain");
+            rsp->setBody("hello " + req->getHeader("host"));
+            return 0;
+    });
+    sd->addServlet("/echo", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(req->getBody());
+            return 0;
+    });
+    sd->addServlet("/header", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(req->getHeader("x-test"));
+            return 0;
+    });
+    sd->addRouteServlet("/sleep/:ms", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            usleep(req->getParamAs<int>("ms", 0) * 1000);
+            rsp->setBody("sleep");
+            return 0;
+    });
+    // 用写入器分块发送
+    sd->addRouteServlet("/big/:n", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            std::string body = BigBody(req->getParamAs<size_t>("n", 0));
+            auto writer = session->createResponseWriter(rsp, body.size());
+            for(size_t pos = 0; pos < body.size(); pos += 10000) {
+                if(writer->write(body.data() + pos, std::min(body.size() - pos, (size_t)10000)) <= 0) {
+                    break;
+                }
+            }
+            return 0;
+    });
+    // 流式读取消息体, 返回长度
+    auto slt = std::make_shared<MNSER::http::FunctionServlet>([](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            auto body = req->getBodyStream();
+            char buf[4096];
+            size_t total = 0;
+            int rt = 0;
+            while((rt = body->read(buf, sizeof(buf))) > 0) {
+                total += rt;
+            }
+            rsp->setBody(rt < 0 ? "error" : std::to_string(total));
+            return 0;
+    });
+    slt->setStreamBody(true);
+    sd->addServlet("/upload", slt);
+    s_server->start();
+}
+
+static void test_basic(MNSER::Address::ptr addr) {
+    H2Client c;
+    CHECK(c.connect(addr));
+    uint32_t id = c.request("GET", "/hello");
+    CHECK(c.wait(id));
+    auto& r = c.result(id);
+    CHECK(GetHeader(r.headers, ":status") == "200");
+    CHECK(GetHeader(r.headers, "content-type") == "text/plain");
+    CHECK(r.body == "hello 127.0.0.1");
+
+    id = c.request("GET", "/none");
+    CHECK(c.wait(id) && GetHeader(c.result(id).headers, ":status") == "404");
+
+    // 多个 DATA 帧的消息体
+    std::string body = BigBody(100000);
+    id = c.request("POST", "/echo", body);
+    CHECK(c.wait(id) && c.result(id).body == body);
+
+    id = c.request("POST", "/upload", body);
+    CHECK(c.wait(id) && c.result(id).body == "100000");
+
+    // PING 立即得到回应
+    std::string ping;
+    MNSER::http::Http2AppendPing(ping, "12345678", false);
+    c.send(ping);
+    while(!c.m_pingAcked && c.readOne());
+    CHECK(c.m_pingAcked);
+}
+
+// 头部过大只拒绝这个流, 被拒绝的头部块中对动态表的修改仍然生效
+static void test_large_header(MNSER::Address::ptr addr) {
+    H2Client c;
+    CHECK(c.connect(addr));
+    HPackHeaders extra;
+    extra.push_back(std::make_pair(std::string("x-big"), std::string(5000, 'x')));
+    extra.push_back(std::make_pair(std::string("x-test"), std::string("indexed")));
+    uint32_t id = c.request("GET", "/header", "", 15, extra);
+    CHECK(c.wait(id) && GetHeader(c.result(id).headers, ":status") == "431");
+
+    // x-test 已经在两端的动态表中, 这次只发送索引
+    extra.erase(extra.begin());
+    id = c.request("GET", "/header", "", 15, extra);
+    CHECK(c.wait(id) && GetHeader(c.result(id).headers, ":status") == "200"
+            && c.result(id).body == "indexed");
+    CHECK(!c.m_goaway);
+}
+
+// 慢请求不会阻塞同一连接上的其它请求
+static void test_multiplex(MNSER::Address::ptr addr) {
+    H2Client c;
+    CHECK(c.connect(addr));
+    uint64_t start = MNSER::GetCurrentMS();
+    uint32_t slow = c.request("GET", "/sleep/300");
+    uint32_t fast1 = c.request("GET", "/hello");
+    uint32_t fast2 = c.request("GET", "/sleep/50");
+    CHECK(c.wait(slow) && c.wait(fast1) && c.wait(fast2));
+    uint64_t used = MNSER::GetCurrentMS() - start;
+    CHECK(c.m_order.size() == 3 && c.m_order.back() == slow);
+    CHECK(used < 600);
+    MS_LOG_INFO(g_logger) << "multiplex used " << used << "ms";
+}
+
+// 不归还窗口时服务端最多发送 65535 字节
+static void test_flow_control(MNSER::Address::ptr addr) {
+    H2Client c;
+    CHECK(c.connect(addr));
+    c.m_autoWindow = false;
+    c.m_sock->setRecvTimeout(300);
+    uint32_t id = c.request("GET", "/big/200000");
+    while(c.readOne());
+    CHECK(c.m_received[id] == HTTP2_DEFAULT_WINDOW_SIZE);
+    CHECK(!c.result(id).done);
+
+    c.m_autoWindow = true;
+    std::string out;
+    MNSER::http::Http2AppendWindowUpdate(out, 0, 1000000);
+    MNSER::http::Http2AppendWindowUpdate(out, id, 1000000);
+    c.send(out);
+    CHECK(c.wait(id) && c.result(id).body == BigBody(200000));
+}
+
+// 连接窗口是瓶颈时按权重分配带宽
+static void test_priority(MNSER::Address::ptr addr) {
+    H2Client c;
+    // 流的初始窗口为 0, 两个响应都在服务端排队
+    std::string settings;
+    MNSER::http::Http2AppendSetting(settings, MNSER::http::Http2Setting::INITIAL_WINDOW_SIZE, 0);
+    CHECK(c.connect(addr, settings));
+    c.m_autoWindow = false;
+    c.m_sock->setRecvTimeout(300);
+    uint32_t low = c.request("GET", "/big/100000", "", 0);
+    uint32_t high = c.request("GET", "/big/100000", "", 255);
+    while(c.readOne());
+    CHECK(c.m_received[low] == 0 && c.m_received[high] == 0);
+
+    // 只放开流窗口, 连接窗口剩下 65535
+    std::string out;
+    MNSER::http::Http2AppendWindowUpdate(out, low, 1000000);
+    MNSER::http::Http2AppendWindowUpdate(out, high, 1000000);
+    c.send(out);
+    while(c.readOne());
+    size_t l = c.m_received[low];
+    size_t h = c.m_received[high];
+    MS_LOG_INFO(g_logger) << "priority low=" << l << " high=" << h;
+    CHECK(l + h == HTTP2_DEFAULT_WINDOW_SIZE);
+    CHECK(h > l * 8);
+}
+
+// 对端关闭写方向后, 已经收完的请求照常响应, 消息体没收完的流被重置
+static void test_drain(MNSER::Address::ptr addr) {
+    H2Client c;
+    CHECK(c.connect(addr));
+    uint32_t done = c.request("GET", "/sleep/100");
+    uint32_t partial = c.m_nextId;
+    c.m_nextId += 2;
+    HPackHeaders headers;
+    headers.push_back(std::make_pair(std::string(":method"), std::string("POST")));
+    headers.push_back(std::make_pair(std::string(":scheme"), std::string("http")));
+    headers.push_back(std::make_pair(std::string(":path"), std::string("/upload")));
+    headers.push_back(std::make_pair(std::string(":authority"), std::string("127.0.0.1")));
+    std::string block;
+    c.m_enc.encode(headers, block);
+    std::string out;
+    MNSER::http::Http2AppendFrame(out, Http2FrameType::HEADERS, MNSER::http::HTTP2_FLAG_END_HEADERS
+            ,partial, block.data(), block.size());
+    MNSER::http::Http2AppendFrame(out, Http2FrameType::DATA, 0, partial, "abc", 3);
+    c.send(out);
+    usleep(20 * 1000);
+    ::shutdown(c.m_sock->getSocket(), SHUT_WR);
+
+    CHECK(c.wait(done) && c.result(done).body == "sleep");
+    CHECK(c.wait(partial) && c.result(partial).reset);
+    while(c.readOne());
+    CHECK(c.m_goaway);
+}
+
+// HTTP/1.1 Upgrade: h2c, 升级请求的响应在流 1 上返回
+static void test_upgrade(MNSER::Address::ptr addr) {
+    auto sock = MNSER::Socket::CreateTCP(addr);
+    CHECK(sock->connect(addr));
+    MNSER::SocketStream::ptr stream(new MNSER::SocketStream(sock));
+    std::string req = "GET /hello HTTP/1.1\r\nHost: up\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+                      "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABkAAQAAP__\r\n\r\n";
+    stream->writeFixSize(req.data(), req.size());
+    std::string rsp;
+    char c;
+    while(rsp.find("\r\n\r\n") == std::string::npos && stream->read(&c, 1) == 1) {
+        rsp.push_back(c);
+    }
+    CHECK(rsp.find("HTTP/1.1 101") == 0);
+    CHECK(rsp.find("Upgrade: h2c") != std::string::npos);
+
+    H2Client h2;
+    h2.m_sock = sock;
+    h2.m_stream = stream;
+    std::string out = HTTP2_PREFACE;
+    MNSER::http::Http2AppendFrame(out, Http2FrameType::SETTINGS, 0, 0, nullptr, 0);
+    h2.send(out);
+    CHECK(h2.wait(1) && h2.result(1).body == "hello up");
+    h2.m_nextId = 3;
+    uint32_t id = h2.request("GET", "/hello");
+    CHECK(h2.wait(id) && h2.result(id).body == "hello 127.0.0.1");
+}
+
+// 同一个端口上 HTTP/1.1 照常工作
+static void test_http11(uint16_t port) {
+    auto r = MNSER::http::HttpConnection::DoGet("http://127.0.0.1:" + std::to_string(port) + "/hello", 1000);
+    CHECK(r->response && r->response->getBody() == "hello 127.0.0.1");
+}
+
+static void run() {
+    g_logger->setLevel(MNSER::LogLevel::INFO);
+    MS_LOG_NAME("system")->setLevel(MNSER::LogLevel::ERROR);
+    test_hpack();
+    uint16_t port = 20000 + getpid() % 1000;
+    start_server(port);
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    test_basic(addr);
+    test_large_header(addr);
+    test_multiplex(addr);
+    test_flow_control(addr);
+    test_priority(addr);
+    test_drain(addr);
+    test_upgrade(addr);
+    test_http11(port);
+    s_server->stop();
+    TestResult();
+}
+
+int main(int argc, char** argv) {
+    MNSER::IOManager iom(2);
+    iom.schedule(run);
+    iom.stop();
+    return s_fails ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+#include "http_batch.h"
+#include "http_server.h"
+#include "log.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static MNSER::http::HttpServer::ptr s_server;
+
+static std::string ChunkBody(int n) {
+    std::string rt;
+    for(int i = 1; i <= n; ++i) {
+        rt.append(i, 'a' + i % 26);
+    }
+    return rt;
+}
+
+// /sleep/N 等待 N 毫秒后返回 N
+static void start_server(uint16_t port) {
+    s_server.reset(new MNSER::http::HttpServer(true));
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    s_server->getServletDispatch()->addRouteServlet("/sleep/:ms", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            int ms = req->getParamAs<int>("ms", 0);
+            usleep(ms * 1000);
+            rsp->setBody("sleep " + std::to_string(ms));
+            return 0;
+    });
+    // /chunk/N 用 chunked 编码分 N 块返回, 第 i 块是 i 个 'a'+i%26
+    s_server->getServletDispatch()->addRouteServlet("/chunk/:n", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            int n = req->getParamAs<int>("n", 0);
+            auto writer = session->createResponseWriter(rsp);
+            for(int i = 1; i <= n; ++i) {
+                std::string data(i, 'a' + i % 26);
+                if(writer->write(data.c_str(), data.size()) <= 0) {
+                    break;
+                }
+            }
+            return 0;
+    });
+    // /big/N 直接设置消息体, 由 sendResponse 整体压缩
+    s_server->getServletDispatch()->addRouteServlet("/big/:n", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(ChunkBody(req->getParamAs<int>("n", 0)));
+            return 0;
+    });
+    // 没有消息体的响应
+    s_server->getServletDispatch()->addServlet("/empty", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            return 0;
+    });
+    s_server->start();
+}
+
+static std::string Body(MNSER::http::HttpBatch::ptr batch, size_t idx) {
+    auto r = batch->getResult(idx);
+    return r && r->response ? r->response->getBody() : "";
+}
+
+// 并发请求按完成顺序返回, 总耗时接近最慢的那个
+static void test_fanout(MNSER::http::HttpConnectionPool::ptr pool) {
+    MNSER::http::HttpBatch::ptr batch(new MNSER::http::HttpBatch);
+    int sleeps[] = {300, 100, 200, 0};
+    for(auto ms : sleeps) {
+        batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET
+                    ,"/sleep/" + std::to_string(ms)), 2000);
+    }
+    uint64_t start = MNSER::GetCurrentMS();
+    batch->start();
+    std::vector<int64_t> order;
+    int64_t idx;
+    while((idx = batch->next()) >= 0) {
+        order.push_back(idx);
+        CHECK(batch->getResult(idx)->result == 0);
+    }
+    uint64_t used = MNSER::GetCurrentMS() - start;
+    CHECK((order == std::vector<int64_t>{3, 1, 2, 0}));
+    CHECK(Body(batch, 0) == "sleep 300");
+    CHECK(used < 500);
+    MS_LOG_INFO(g_logger) << "fanout used=" << used << "ms";
+}
+
+// 截止时间和取消
+static void test_deadline(MNSER::http::HttpConnectionPool::ptr pool) {
+    MNSER::http::HttpBatch::ptr batch(new MNSER::http::HttpBatch);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET, "/sleep/500"), 100);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET, "/sleep/500"), 2000);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET, "/sleep/10"), 2000);
+    uint64_t start = MNSER::GetCurrentMS();
+    batch->start();
+    MNSER::IOManager::GetThis()->addTimer(50, [batch](){
+        batch->cancel(1);
+    });
+    batch->wait();
+    uint64_t used = MNSER::GetCurrentMS() - start;
+    CHECK(batch->getResult(0)->result == (int)MNSER::http::HttpResult::Error::TIMEOUT);
+    CHECK(batch->getResult(1)->result == (int)MNSER::http::HttpResult::Error::CANCELLED);
+    CHECK(Body(batch, 2) == "sleep 10");
+    CHECK(used < 300);
+    MS_LOG_INFO(g_logger) << "deadline used=" << used << "ms "
+        << batch->getResult(0)->toString();
+}
+
+// 流水线: 同一个连接上发 4 个请求, 中间一个超时, 其它的照常返回
+static void test_pipeline(MNSER::http::HttpConnectionPool::ptr pool) {
+    MNSER::http::HttpBatch::ptr batch(new MNSER::http::HttpBatch);
+    batch->setPipelineDepth(4);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET, "/sleep/50"), 2000);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET, "/sleep/300"), 100);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::HEAD, "/sleep/0"), 2000);
+    batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET, "/sleep/20"), 2000);
+    int before = pool->getTotal();
+    batch->start();
+    batch->wait();
+    CHECK(Body(batch, 0) == "sleep 50");
+    CHECK(batch->getResult(1)->result == (int)MNSER::http::HttpResult::Error::TIMEOUT);
+    CHECK(batch->getResult(2)->result == 0 && Body(batch, 2).empty());
+    CHECK(Body(batch, 3) == "sleep 20");
+    CHECK(pool->getTotal() - before <= 1);
+    MS_LOG_INFO(g_logger) << "pipeline total connections=" << pool->getTotal();
+}
+
+// chunked 响应在同一个连接上流水线返回, 多读的数据要留给下一个响应
+static void test_chunked(MNSER::http::HttpConnectionPool::ptr pool) {
+    MNSER::http::HttpBatch::ptr batch(new MNSER::http::HttpBatch);
+    batch->setPipelineDepth(4);
+    int counts[] = {1, 300, 0, 40};
+    for(auto n : counts) {
+        batch->add(pool, pool->createRequest(MNSER::http::HttpMethod::GET
+                    ,"/chunk/" + std::to_string(n)), 2000);
+    }
+    batch->start();
+    batch->wait();
+    for(size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        CHECK(Body(batch, i) == ChunkBody(counts[i]));
+    }
+    MS_LOG_INFO(g_logger) << "chunked body size=" << Body(batch, 1).size();
+}
+
+// 响应按 Accept-Encoding 压缩, 客户端透明解压
+static void test_gzip(MNSER::http::HttpConnectionPool::ptr pool) {
+    const char* paths[] = {"/big/300", "/chunk/300", "/big/10"};
+    const char* encodings[] = {"gzip", "deflate", "identity"};
+    for(auto path : paths) {
+        for(auto encoding : encodings) {
+            auto r = pool->doGet(path, 2000, {{"Accept-Encoding", encoding}});
+            CHECK(r->result == 0);
+            if(!r->response) {
+                continue;
+            }
+            std::string body = r->response->getBody();
+            bool compressed = r->response->getHeader("vary") == "Accept-Encoding";
+            CHECK(body == ChunkBody(atoi(strrchr(path, '/') + 1)));
+            CHECK(compressed == (strcmp(encoding, "identity") != 0 && body.size() >= 1024));
+            CHECK(r->response->getHeader("content-encoding").empty());
+        }
+    }
+}
+
+// 空消息体的响应带 content-length: 0, 长连接上的请求立即返回
+static void test_empty(MNSER::http::HttpConnectionPool::ptr pool) {
+    uint64_t start = MNSER::GetCurrentMS();
+    for(int i = 0; i < 3; ++i) {
+        auto r = pool->doGet("/empty", 2000);
+        CHECK(r->result == 0 && r->response && r->response->getBody().empty());
+    }
+    uint64_t used = MNSER::GetCurrentMS() - start;
+    CHECK(used < 500);
+    MS_LOG_INFO(g_logger) << "empty used=" << used << "ms";
+
+    MNSER::http::HttpResponse rsp(0x11, false);
+    std::string header;
+    rsp.dumpHeader(header);
+    CHECK(header.find("content-length: 0\r\n") != std::string::npos);
+    header.clear();
+    rsp.setStatus(MNSER::http::HttpStatus::NO_CONTENT);
+    rsp.dumpHeader(header);
+    CHECK(header.find("content-length") == std::string::npos);
+    header.clear();
+    rsp.setStatus(MNSER::http::HttpStatus::OK);
+    rsp.setHeader("transfer-encoding", "chunked");
+    rsp.dumpHeader(header);
+    CHECK(header.find("content-length") == std::string::npos);
+}
+
+// 多个协程并发取用和归还连接, 淘汰定时器同时在其他线程上运行
+// 连接很快过期, 取用, 归还和淘汰都会销毁连接; 释放连接池时淘汰可能正在执行
+static void test_pool_evict(uint16_t port) {
+    auto interval = MNSER::Config::Lookup<uint64_t>("http.connection_pool.evict_interval");
+    uint64_t old_interval = *interval->getValue();
+    interval->setValue(1);
+    MNSER::IOManager* iom = MNSER::IOManager::GetThis();
+    for(int round = 0; round < 20; ++round) {
+        MNSER::http::HttpConnectionPool::ptr pool(new MNSER::http::HttpConnectionPool(
+                    "127.0.0.1", "", port, false, 4, 10, 100));
+        std::atomic<int> done{0};
+        std::atomic<int> fails{0};
+        for(int f = 0; f < 4; ++f) {
+            iom->schedule([pool, &done, &fails]() {
+                for(int i = 0; i < 10; ++i) {
+                    auto r = pool->doGet("/empty", 2000);
+                    if(r->result != 0) {
+                        ++fails;
+                    }
+                    if(i % 3 == 0) {
+                        usleep(5 * 1000);
+                    }
+                }
+                ++done;
+            });
+        }
+        while(done < 4) {
+            usleep(1000);
+        }
+        CHECK(fails == 0);
+        // 留在池中的连接都已过期, 由定时器淘汰
+        usleep(50 * 1000);
+        CHECK(pool->getTotal() == 0);
+        pool.reset();
+    }
+    interval->setValue(old_interval);
+}
+
+static void run() {
+    g_logger->setLevel(MNSER::LogLevel::INFO);
+    MS_LOG_NAME("system")->setLevel(MNSER::LogLevel::WARN);
+    uint16_t port = 18000 + getpid() % 1000;
+    start_server(port);
+    MNSER::http::HttpConnectionPool::ptr pool(new MNSER::http::HttpConnectionPool(
+                "127.0.0.1", "", port, false, 16, 30 * 1000, 100));
+    test_fanout(pool);
+    test_deadline(pool);
+    test_pipeline(pool);
+    test_chunked(pool);
+    test_gzip(pool);
+    test_empty(pool);
+    test_pool_evict(port);
+    s_server->stop();
+    pool.reset();
+    TestResult();
+}
+
+int main(int argc, char** argv) {
+    MNSER::IOManager iom(2);
+    iom.schedule(run);
+    iom.stop();
+    return s_fails ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "http_server.h"
+#include "http_file_servlet.h"
 #include "log.h"
 
 static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
@@ -23,6 +24,50 @@ void run() {
             return 0;
     });
 
+    // 流式读取上传的消息体, 只统计长度
+    MNSER::http::FunctionServlet::ptr upload(new MNSER::http::FunctionServlet(
+                [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            auto body = req->getBodyStream();
+            char buf[4096];
+            uint64_t total = 0;
+            int rt = 0;
+            while((rt = body->read(buf, sizeof(buf))) > 0) {
+                total += rt;
+            }
+            rsp->setBody("upload size=" + std::to_string(total) + " rt=" + std::to_string(rt));
+            return 0;
+    }));
+    upload->setStreamBody(true);
+    sd->addServlet("/MNSER/upload", upload);
+
+    // 先发送响应头, 再分块写消息体
+    sd->addServlet("/MNSER/chunked", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setHeader("Content-Type", "text/plain");
+            auto writer = session->createResponseWriter(rsp);
+            for(int i = 0; i < 5; ++i) {
+                std::string line = "chunk " + std::to_string(i) + "\n";
+                if(writer->write(line.c_str(), line.size()) <= 0) {
+                    break;
+                }
+            }
+            return 0;
+    });
+
+    // 静态文件, /static/xxx 映射到当前目录下的文件
+    sd->addGlobServlet("/static/*", std::make_shared<MNSER::http::StaticFileServlet>(".", "/static/"));
+
+    // 路由匹配, 优先于模糊匹配, :id 作为请求参数
+    sd->addRouteServlet("/MNSER/user/:id", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody("user id=" + req->getParam("id"));
+            return 0;
+    });
+
     sd->addGlobServlet("/MNSER/*", [](MNSER::http::HttpRequest::ptr req
                 ,MNSER::http::HttpResponse::ptr rsp
                 ,MNSER::http::HttpSession::ptr session) {
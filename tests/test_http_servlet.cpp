@@ -0,0 +1,438 @@
+#include <fstream>
+#include <sys/stat.h>
+
+#include "http_server.h"
+#include "http_file_servlet.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static MNSER::http::HttpServer::ptr s_server;
+static std::string s_dir;
+
+// 原始响应, 头部名字转成小写
+struct RawResponse {
+    int status = 0;
+    std::map<std::string, std::string> headers;
+    std::string body;
+
+    bool has(const std::string& name) const { return headers.count(name) > 0;}
+    std::string get(const std::string& name) const {
+        auto it = headers.find(name);
+        return it == headers.end() ? "" : it->second;
+    }
+};
+
+// 从 pos 开始解析一个响应, 有 content-length 时按长度取消息体, 否则取到数据结尾
+// head 为 true 时响应没有消息体
+static bool ParseRaw(const std::string& data, size_t& pos, RawResponse& rsp, bool head = false) {
+    size_t end = data.find("\r\n\r\n", pos);
+    if(end == std::string::npos) {
+        return false;
+    }
+    std::string header = data.substr(pos, end - pos);
+    pos = end + 4;
+    size_t line_end = header.find("\r\n");
+    std::string line = header.substr(0, line_end);
+    if(line.size() < 12 || line.compare(0, 5, "HTTP/") != 0) {
+        return false;
+    }
+    rsp.status = atoi(line.c_str() + 9);
+    while(line_end != std::string::npos) {
+        size_t start = line_end + 2;
+        line_end = header.find("\r\n", start);
+        line = header.substr(start, line_end == std::string::npos ? std::string::npos : line_end - start);
+        size_t colon = line.find(':');
+        if(colon == std::string::npos) {
+            continue;
+        }
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        rsp.headers[MNSER::ToLower(line.substr(0, colon))] = value;
+    }
+    if(head) {
+        return true;
+    }
+    if(rsp.has("content-length")) {
+        size_t len = atoll(rsp.get("content-length").c_str());
+        if(pos + len > data.size()) {
+            return false;
+        }
+        rsp.body = data.substr(pos, len);
+        pos += len;
+    } else {
+        rsp.body = data.substr(pos);
+        pos = data.size();
+    }
+    return true;
+}
+
+// 解码 chunked 消息体, 必须以结束块结尾
+static bool DecodeChunked(const std::string& raw, std::string& out) {
+    size_t pos = 0;
+    while(true) {
+        size_t crlf = raw.find("\r\n", pos);
+        if(crlf == std::string::npos) {
+            return false;
+        }
+        size_t len = strtoul(raw.c_str() + pos, nullptr, 16);
+        pos = crlf + 2;
+        if(len == 0) {
+            return raw.compare(pos, std::string::npos, "\r\n") == 0;
+        }
+        if(pos + len + 2 > raw.size() || raw.compare(pos + len, 2, "\r\n") != 0) {
+            return false;
+        }
+        out.append(raw, pos, len);
+        pos += len + 2;
+    }
+}
+
+// 发送原始请求, 读到服务器关闭连接为止
+static std::string Send(MNSER::Address::ptr addr, const std::string& data) {
+    MNSER::Socket::ptr sock = MNSER::Socket::CreateTCP(addr);
+    if(!sock->connect(addr)) {
+        return "";
+    }
+    sock->setRecvTimeout(3000);
+    MNSER::SocketStream ss(sock);
+    if(ss.writeFixSize(data.data(), data.size()) <= 0) {
+        return "";
+    }
+    std::string rt;
+    char buf[64 * 1024];
+    int n = 0;
+    while((n = sock->recv(buf, sizeof(buf))) > 0) {
+        rt.append(buf, n);
+    }
+    return rt;
+}
+
+static std::string Pattern(size_t n) {
+    std::string rt(n, 0);
+    for(size_t i = 0; i < n; ++i) {
+        rt[i] = 'a' + i % 26;
+    }
+    return rt;
+}
+
+static void WriteFile(const std::string& name, const std::string& data) {
+    std::ofstream ofs(s_dir + "/" + name);
+    ofs << data;
+}
+
+static void start_server(uint16_t port) {
+    s_server.reset(new MNSER::http::HttpServer(true));
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto sd = s_server->getServletDispatch();
+    sd->addRouteServlet("/big/:n", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(Pattern(req->getParamAs<size_t>("n", 0)));
+            return 0;
+    });
+    // 流式读取消息体并原样返回, 读取出错时返回 error
+    auto echo = std::make_shared<MNSER::http::FunctionServlet>([](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            auto body = req->getBodyStream();
+            std::string data;
+            char buf[4096];
+            int rt = 0;
+            while((rt = body->read(buf, sizeof(buf))) > 0) {
+                data.append(buf, rt);
+            }
+            rsp->setBody(rt < 0 ? "error" : data);
+            return 0;
+    });
+    echo->setStreamBody(true);
+    sd->addServlet("/stream", echo);
+    // 不读取消息体, 由服务器丢弃
+    auto ignore = std::make_shared<MNSER::http::FunctionServlet>([](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody("ignored");
+            return 0;
+    });
+    ignore->setStreamBody(true);
+    sd->addServlet("/ignore", ignore);
+    // 长度未知, 分 5 次写出
+    sd->addServlet("/chunked", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            auto writer = session->createResponseWriter(rsp);
+            for(int i = 0; i < 5; ++i) {
+                std::string line = "chunk " + std::to_string(i) + "\n";
+                if(writer->write(line.c_str(), line.size()) <= 0) {
+                    break;
+                }
+            }
+            return 0;
+    });
+    // 已知长度, 分 2 次写出
+    sd->addServlet("/fixed", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            auto writer = session->createResponseWriter(rsp, 10);
+            writer->write("01234", 5);
+            writer->write("56789", 5);
+            return 0;
+    });
+    sd->addRouteServlet("/user/:id", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody("user " + req->getParam("id"));
+            return 0;
+    });
+    sd->addRouteServlet("/files/*path", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody("files " + req->getParam("path"));
+            return 0;
+    });
+    sd->addGlobServlet("/static/*", std::make_shared<MNSER::http::StaticFileServlet>(s_dir, "/static/"));
+    s_server->start();
+}
+
+// 响应头和引用的消息体一起写出, 大消息体和流水线上的多个响应都完整且不错位
+static void test_send_response(MNSER::Address::ptr addr) {
+    std::string data = Send(addr, "GET /big/1048576 HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    size_t pos = 0;
+    RawResponse rsp;
+    CHECK(ParseRaw(data, pos, rsp) && pos == data.size());
+    CHECK(rsp.status == 200 && rsp.get("content-length") == "1048576");
+    CHECK(rsp.body == Pattern(1048576));
+
+    data = Send(addr, "GET /big/10 HTTP/1.1\r\nHost: t\r\nConnection: keep-alive\r\n\r\n"
+                "HEAD /big/100 HTTP/1.1\r\nHost: t\r\nConnection: keep-alive\r\n\r\n"
+                "GET /big/20 HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    RawResponse r1, r2, r3;
+    CHECK(ParseRaw(data, pos, r1) && r1.body == Pattern(10));
+    CHECK(ParseRaw(data, pos, r2, true) && r2.get("content-length") == "100");
+    CHECK(ParseRaw(data, pos, r3) && r3.body == Pattern(20) && pos == data.size());
+}
+
+// 流式消息体: 按 content-length 和 chunked 读到结尾, 超过上限时拒绝, 没读完的消息体被丢弃
+static void test_stream_body(MNSER::Address::ptr addr) {
+    std::string body = Pattern(100000);
+    std::string data = Send(addr, "POST /stream HTTP/1.1\r\nHost: t\r\nConnection: close\r\n"
+                "Content-Length: 100000\r\n\r\n" + body);
+    size_t pos = 0;
+    RawResponse rsp;
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 200 && rsp.body == body);
+
+    data = Send(addr, "POST /stream HTTP/1.1\r\nHost: t\r\nConnection: close\r\n"
+                "Transfer-Encoding: chunked\r\n\r\n"
+                "5\r\nhello\r\n6;ext=1\r\n world\r\n0\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.body == "hello world");
+
+    // servlet 没有读取的消息体不会被当成下一个请求
+    data = Send(addr, "POST /ignore HTTP/1.1\r\nHost: t\r\nConnection: keep-alive\r\n"
+                "Content-Length: 5000\r\n\r\n"
+                + Pattern(5000) + "GET /big/5 HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    RawResponse r1, r2;
+    CHECK(ParseRaw(data, pos, r1) && r1.body == "ignored");
+    CHECK(ParseRaw(data, pos, r2) && r2.body == Pattern(5));
+
+    auto max_body = MNSER::Config::Lookup<uint64_t>("http.request.max_body_size");
+    uint64_t old_max = *max_body->getValue();
+    max_body->setValue(1000);
+    data = Send(addr, "POST /stream HTTP/1.1\r\nHost: t\r\nContent-Length: 2000\r\n\r\n" + Pattern(2000));
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 413);
+    // chunked 的长度事先未知, 读取超过上限时出错
+    std::string chunk = Pattern(800);
+    data = Send(addr, "POST /stream HTTP/1.1\r\nHost: t\r\nTransfer-Encoding: chunked\r\n\r\n"
+                "320\r\n" + chunk + "\r\n320\r\n" + chunk + "\r\n0\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.body == "error");
+    max_body->setValue(old_max);
+}
+
+// 写入器: 长度未知时 HTTP/1.1 用 chunked, HTTP/1.0 以关闭连接结束, 已知长度时用 content-length
+static void test_response_writer(MNSER::Address::ptr addr) {
+    std::string expect;
+    for(int i = 0; i < 5; ++i) {
+        expect += "chunk " + std::to_string(i) + "\n";
+    }
+    std::string data = Send(addr, "GET /chunked HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    size_t pos = 0;
+    RawResponse rsp;
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 200);
+    CHECK(MNSER::ToLower(rsp.get("transfer-encoding")) == "chunked" && !rsp.has("content-length"));
+    std::string decoded;
+    CHECK(DecodeChunked(rsp.body, decoded) && decoded == expect);
+
+    data = Send(addr, "GET /chunked HTTP/1.0\r\nHost: t\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && !rsp.has("transfer-encoding") && rsp.body == expect);
+
+    data = Send(addr, "GET /fixed HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.get("content-length") == "10"
+            && !rsp.has("transfer-encoding") && rsp.body == "0123456789");
+}
+
+// 静态文件: Content-Type, Range, 条件请求, HEAD, 目录的 index.html 和越界路径
+static void test_static_file(MNSER::Address::ptr addr) {
+    std::string data = Send(addr, "GET /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    size_t pos = 0;
+    RawResponse rsp;
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 200 && rsp.body == "0123456789");
+    CHECK(rsp.get("content-type") == "text/plain; charset=utf-8");
+    std::string etag = rsp.get("etag");
+    std::string last_modified = rsp.get("last-modified");
+    CHECK(!etag.empty() && !last_modified.empty());
+
+    data = Send(addr, "GET /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\nRange: bytes=2-5\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 206 && rsp.body == "2345");
+    CHECK(rsp.get("content-range") == "bytes 2-5/10");
+
+    data = Send(addr, "GET /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\nRange: bytes=-3\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 206 && rsp.body == "789");
+
+    data = Send(addr, "GET /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\nRange: bytes=20-\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 416 && rsp.get("content-range") == "bytes */10");
+
+    data = Send(addr, "GET /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\nIf-None-Match: "
+                + etag + "\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp, true) && rsp.status == 304 && pos == data.size());
+
+    data = Send(addr, "GET /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\nIf-Modified-Since: "
+                + last_modified + "\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp, true) && rsp.status == 304 && pos == data.size());
+
+    data = Send(addr, "HEAD /static/a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp, true) && rsp.status == 200
+            && rsp.get("content-length") == "10" && pos == data.size());
+
+    data = Send(addr, "GET /static/ HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status == 200 && rsp.body == "<html></html>");
+    CHECK(rsp.get("content-type") == "text/html; charset=utf-8");
+
+    data = Send(addr, "GET /static/../a.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.status != 200);
+}
+
+// 路由参数和通配后缀
+static void test_route(MNSER::Address::ptr addr) {
+    std::string data = Send(addr, "GET /user/42 HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    size_t pos = 0;
+    RawResponse rsp;
+    CHECK(ParseRaw(data, pos, rsp) && rsp.body == "user 42");
+
+    data = Send(addr, "GET /files/a/b/c.txt HTTP/1.1\r\nHost: t\r\nConnection: close\r\n\r\n");
+    pos = 0;
+    rsp = RawResponse();
+    CHECK(ParseRaw(data, pos, rsp) && rsp.body == "files a/b/c.txt");
+}
+
+// 多个线程查找路由的同时增删路由, 查找到的总是完整的路由表
+static void test_route_concurrent() {
+    MNSER::http::ServletDispatch::ptr sd(new MNSER::http::ServletDispatch);
+    auto cb = [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+        return 0;
+    };
+    MNSER::http::Servlet::ptr user = std::make_shared<MNSER::http::FunctionServlet>(cb);
+    MNSER::http::Servlet::ptr tmp = std::make_shared<MNSER::http::FunctionServlet>(cb);
+    sd->addRouteServlet("/user/:id", user);
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> bad{0};
+    std::atomic<uint64_t> lookups{0};
+    std::vector<MNSER::Thread::ptr> thrs;
+    for(int t = 0; t < 4; ++t) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([&]() {
+            while(!stop) {
+                MNSER::http::HttpRequest::ptr req(new MNSER::http::HttpRequest);
+                req->setPath("/user/7");
+                if(sd->getMatchedServlet(req) != user || req->getParam("id") != "7") {
+                    ++bad;
+                }
+                req.reset(new MNSER::http::HttpRequest);
+                req->setPath("/tmp/3");
+                auto slt = sd->getMatchedServlet(req);
+                if(slt != tmp && slt != sd->getDefault()) {
+                    ++bad;
+                }
+                ++lookups;
+            }
+        }, "route_" + std::to_string(t))));
+    }
+    for(int i = 0; i < 200; ++i) {
+        sd->addRouteServlet("/tmp/:n", tmp);
+        sd->addServlet("/exact/" + std::to_string(i), cb);
+        sd->delRouteServlet("/tmp/:n");
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+    CHECK(bad == 0);
+    CHECK(sd->getMatchedServlet("/exact/199") != sd->getDefault());
+    MS_LOG_INFO(g_logger) << "route lookups=" << lookups;
+}
+
+static void run() {
+    g_logger->setLevel(MNSER::LogLevel::INFO);
+    MS_LOG_NAME("system")->setLevel(MNSER::LogLevel::ERROR);
+    s_dir = "/tmp/test_http_servlet_" + std::to_string(getpid());
+    mkdir(s_dir.c_str(), 0755);
+    WriteFile("a.txt", "0123456789");
+    WriteFile("index.html", "<html></html>");
+
+    uint16_t port = 21000 + getpid() % 1000;
+    start_server(port);
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    test_send_response(addr);
+    test_stream_body(addr);
+    test_response_writer(addr);
+    test_static_file(addr);
+    test_route(addr);
+    test_route_concurrent();
+    s_server->stop();
+
+    unlink((s_dir + "/a.txt").c_str());
+    unlink((s_dir + "/index.html").c_str());
+    rmdir(s_dir.c_str());
+    TestResult();
+}
+
+int main(int argc, char** argv) {
+    MNSER::IOManager iom(2);
+    iom.schedule(run);
+    iom.stop();
+    return s_fails ? 1 : 0;
+}
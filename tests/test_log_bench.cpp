@@ -0,0 +1,194 @@
+#include <sys/time.h>
+#include <iomanip>
+
+#include "log.h"
+#include "thread.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+// 丢弃输出的 Appender, 只统计写出的字节数
+class NullLogAppender : public MNSER::LogAppender {
+public:
+    typedef std::shared_ptr<NullLogAppender> ptr;
+    std::string toYamlString() override { return ""; }
+    uint64_t getBytes() const { return m_bytes; }
+protected:
+    void write(const struct iovec* iov, int cnt) override {
+        for(int i = 0; i < cnt; ++i) {
+            m_bytes += iov[i].iov_len;
+        }
+    }
+private:
+    uint64_t m_bytes = 0;
+};
+
+// LogStream 的输出要和 std::ostream 一致
+static void test_stream() {
+    MNSER::LogStream ls;
+    std::stringstream ss;
+#define XX(v) ls << v; ss << v;
+    XX("str " << std::string("string") << ' ' << true << ' ' << (short)-3 << ' ' << (unsigned short)3);
+    XX(' ' << -1 << ' ' << 2u << ' ' << -3l << ' ' << 4ul << ' ' << -5ll << ' ' << 6ull);
+    XX(' ' << 1.5 << ' ' << 0.1f << ' ' << 1e20 << ' ' << 123456789.0 << ' ' << (uint8_t)'x');
+    XX(' ' << (void*)0 << ' ' << (void*)0x1234 << std::endl);
+    XX(std::hex << 255 << ' ' << std::setw(4) << std::setfill('0') << 10 << std::dec << ' ' << 10);
+    XX(' ' << std::boolalpha << true << ' ' << MNSER::LogLevel::ToString(MNSER::LogLevel::INFO));
+#undef XX
+    CHECK(ls.str() == ss.str());
+
+    // 超过内部缓冲区的内容
+    MNSER::LogStream big;
+    std::string s(MNSER::LogStream::INLINE_SIZE - 10, 'a');
+    big << s << 1234567890 << s << 3.5;
+    CHECK(big.str() == s + "1234567890" + s + "3.5");
+
+    MNSER::LogEvent event(g_logger, MNSER::LogLevel::INFO, __FILE__, __LINE__, 0, 0, 0, 0, "t");
+    event.format("%s %d", s.c_str(), 10);
+    event.getSS() << " end";
+    CHECK(event.getContent() == s + " 10 end");
+}
+
+static void test_formatter() {
+    MNSER::Logger::ptr logger(new MNSER::Logger("fmt"));
+    MNSER::LogEvent event(logger, MNSER::LogLevel::WARN, "a.cpp", 12, 34, 56, 78, 86400 * 365 + 43200, "tname");
+    event.getSS() << "msg";
+    MNSER::LogFormatter fmt("%d{%Y}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%r%T%m%n");
+    CHECK(!fmt.isError());
+    CHECK(fmt.format(logger, MNSER::LogLevel::WARN, event) == "1971\t56\ttname\t78\t[WARN]\t[fmt]\ta.cpp:12\t34\tmsg\n");
+    // 同一秒内用缓存, 不同格式互不影响
+    MNSER::LogFormatter fmt2("%d{%m}|%d{%Y}");
+    CHECK(fmt2.format(logger, MNSER::LogLevel::WARN, event) == "01|1971");
+    CHECK(fmt.format(logger, MNSER::LogLevel::WARN, event).compare(0, 5, "1971\t") == 0);
+
+    CHECK(MNSER::LogFormatter("%q").isError());
+    CHECK(MNSER::LogFormatter("%d{%Y").isError());
+}
+
+// Appender 列表修改后马上生效, 删除的 Appender 和替换的 formatter 随即释放
+static void test_appenders() {
+    MNSER::Logger::ptr logger(new MNSER::Logger("appenders"));
+    NullLogAppender::ptr a1(new NullLogAppender);
+    NullLogAppender::ptr a2(new NullLogAppender);
+    logger->addAppender(a1);
+    MS_LOG_INFO(logger) << "1";
+    logger->addAppender(a2);
+    MS_LOG_INFO(logger) << "2";
+    logger->delAppender(a1);
+    MS_LOG_INFO(logger) << "3";
+    CHECK(a1->getBytes() > 0 && a1->getBytes() == a2->getBytes());
+    uint64_t bytes = a2->getBytes();
+    logger->setLevel(MNSER::LogLevel::ERROR);
+    MS_LOG_INFO(logger) << "4";
+    CHECK(a2->getBytes() == bytes);
+
+    logger->clearAppender();
+    MS_LOG_ERROR(logger) << "5";
+    CHECK(a2->getBytes() == bytes);
+
+    std::weak_ptr<NullLogAppender> weak_appender = a1;
+    MNSER::LogFormatter::ptr fmt(new MNSER::LogFormatter("%m%n"));
+    std::weak_ptr<MNSER::LogFormatter> weak_fmt = fmt;
+    a2->setFormatter(fmt);
+    a2->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%p %m%n")));
+    a1.reset();
+    fmt.reset();
+    CHECK(weak_appender.expired() && weak_fmt.expired());
+
+    // 加入的 Logger 和新建的 Logger 通过 MS_LOG_NAME 查找得到同一个对象
+    MNSER::LoggerMgr::GetInstance()->addLogger(logger);
+    CHECK(MS_LOG_NAME("appenders") == logger);
+    CHECK(MS_LOG_NAME("bench_lookup") == MS_LOG_NAME("bench_lookup"));
+
+    // 多个线程写日志的同时修改 Appender 列表
+    std::atomic<bool> stop{false};
+    std::vector<MNSER::Thread::ptr> thrs;
+    for(int i = 0; i < 4; ++i) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([logger, &stop]() {
+            while(!stop) {
+                MS_LOG_ERROR(logger) << "concurrent";
+            }
+        }, "appenders_" + std::to_string(i))));
+    }
+    for(int i = 0; i < 1000; ++i) {
+        NullLogAppender::ptr a(new NullLogAppender);
+        a->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%m%n")));
+        logger->addAppender(a);
+        if(i % 2) {
+            logger->clearAppender();
+        }
+    }
+    stop = true;
+    for(auto& i : thrs) {
+        i->join();
+    }
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+template<class Fun>
+static void bench(const std::string& name, int n, Fun fun) {
+    // 预热
+    for(int i = 0; i < n / 10; ++i) {
+        fun(i);
+    }
+    uint64_t start = now_ns();
+    for(int i = 0; i < n; ++i) {
+        fun(i);
+    }
+    uint64_t used = now_ns() - start;
+    MS_LOG_INFO(g_logger) << name << ": " << used / n << " ns/line";
+}
+
+int main(int argc, char** argv) {
+    test_stream();
+    test_formatter();
+    test_appenders();
+    int n = argc > 1 ? atoi(argv[1]) : 1000000;
+    MNSER::Logger::ptr logger(new MNSER::Logger("bench"));
+    NullLogAppender::ptr appender(new NullLogAppender);
+    appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%m%n")));
+    logger->addAppender(appender);
+    logger->setLevel(MNSER::LogLevel::INFO);
+
+    std::string str = "a std::string";
+    bench("message %m%n", n, [&](int i) {
+        MS_LOG_INFO(logger) << "bench message " << i << " " << 3.25 << " " << str;
+    });
+    bench("printf %m%n", n, [&](int i) {
+        MS_LOG_FMT_INFO(logger, "bench message %d %g %s", i, 3.25, str.c_str());
+    });
+
+    // 默认格式 %d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n
+    MNSER::Logger::ptr def_logger(new MNSER::Logger("bench_default"));
+    NullLogAppender::ptr def_appender(new NullLogAppender);
+    def_logger->addAppender(def_appender);
+    bench("message default pattern", n, [&](int i) {
+        MS_LOG_INFO(def_logger) << "bench message " << i << " " << 3.25 << " " << str;
+    });
+    bench("below level", n, [&](int i) {
+        MS_LOG_DEBUG(logger) << "bench message " << i;
+    });
+
+    // 多个线程同时写同一个 Logger, 每个线程的平均耗时
+    const int threads = 4;
+    std::vector<MNSER::Thread::ptr> thrs;
+    uint64_t start = now_ns();
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([logger, n]() {
+            for(int i = 0; i < n / 4; ++i) {
+                MS_LOG_INFO(logger) << "bench message " << i;
+            }
+        }, "bench_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    MS_LOG_INFO(g_logger) << threads << " threads: " << (now_ns() - start) / (n / 4) << " ns/line";
+    CHECK(appender->getBytes() > 0);
+    return TestResult();
+}
@@ -0,0 +1,232 @@
+#include <fstream>
+#include <dirent.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "config.h"
+#include "thread.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static std::string s_dir;
+
+// 目录下 prefix 开头的文件名
+static std::vector<std::string> list_files(const std::string& prefix) {
+    std::vector<std::string> rt;
+    DIR* d = opendir(s_dir.c_str());
+    struct dirent* dp;
+    while(d && (dp = readdir(d)) != nullptr) {
+        std::string name = dp->d_name;
+        if(name.compare(0, prefix.size(), prefix) == 0) {
+            rt.push_back(name);
+        }
+    }
+    if(d) {
+        closedir(d);
+    }
+    return rt;
+}
+
+static std::string decode(const std::string& file, const std::string& pattern) {
+    MNSER::BinaryLogReader reader(file);
+    CHECK(reader.isValid());
+    MNSER::LogFormatter::ptr fmt(new MNSER::LogFormatter(pattern));
+    std::string out;
+    while(reader.next(fmt, out));
+    return out;
+}
+
+// 记录写出内容的文本 Appender
+class MemLogAppender : public MNSER::LogAppender {
+public:
+    typedef std::shared_ptr<MemLogAppender> ptr;
+    std::string toYamlString() override { return ""; }
+    std::string getData() {
+        MNSER::Mutex::Lock lock(m_writeMutex);
+        return m_data;
+    }
+protected:
+    void write(const struct iovec* iov, int cnt) override {
+        for(int i = 0; i < cnt; ++i) {
+            m_data.append((const char*)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+private:
+    std::string m_data;
+};
+
+// 参数的格式化和 snprintf 一致
+static void test_format() {
+    MNSER::LogBinSite site(__FILE__, __LINE__, MNSER::LogLevel::INFO
+            ,"%d|%5d|%-5s|%08.3f|%x|%llu|%c|%%|%zu|%.2s|%e|%ld");
+    MNSER::LogEvent event(g_logger, MNSER::LogLevel::INFO, __FILE__, __LINE__, 0, 0, 0, 0, "t");
+    std::string str = "abc";
+    event.binary(&site, -12, 34, "ab", 3.14159, 255u, 1234567890123ull, 'x', (size_t)7, str, 1e10, -5l);
+    char buf[256];
+    snprintf(buf, sizeof(buf), site.fmt, -12, 34, "ab", 3.14159, 255u, 1234567890123ull
+            ,'x', (size_t)7, str.c_str(), 1e10, -5l);
+    CHECK(event.getContent() == buf);
+
+    // 类型不一致按参数类型输出, 参数不够原样输出
+    MNSER::LogBinSite site2(__FILE__, __LINE__, MNSER::LogLevel::INFO, "%s %d %f %d");
+    MNSER::LogEvent event2(g_logger, MNSER::LogLevel::INFO, __FILE__, __LINE__, 0, 0, 0, 0, "t");
+    event2.binary(&site2, 10, "str", 2);
+    CHECK(event2.getContent() == "10 str 2 %d");
+}
+
+static void test_file() {
+    std::string file = s_dir + "/bin.log";
+    MNSER::Logger::ptr logger(new MNSER::Logger("binary"));
+    MNSER::BinaryLogAppender::ptr appender(new MNSER::BinaryLogAppender(file));
+    MemLogAppender::ptr text(new MemLogAppender);
+    text->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%p %m%n")));
+    logger->addAppender(appender);
+    logger->addAppender(text);
+
+    std::string name = "name";
+    for(int i = 0; i < 3; ++i) {
+        MS_LOG_BIN_INFO(logger, "loop %d %s %.1f", i, name, i * 0.5);
+    }
+    MS_LOG_BIN_WARN(logger, "no args");
+    MS_LOG_INFO(logger) << "text " << 42;
+    std::string expect = "INFO loop 0 name 0.0\nINFO loop 1 name 0.5\nINFO loop 2 name 1.0\n"
+        "WARN no args\nINFO text 42\n";
+    CHECK(text->getData() == expect);
+    CHECK(decode(file, "%p %m%n") == expect);
+
+    std::string detail = decode(file, "[%c] %N %f:%l%n");
+    CHECK(detail.find("[binary] " + MNSER::Thread::GetName() + " " __FILE__ ":") == 0);
+
+    // 新的 Appender 追加到同一个文件, 调用点重新定义
+    appender.reset(new MNSER::BinaryLogAppender(file));
+    logger->clearAppender();
+    logger->addAppender(appender);
+    MS_LOG_BIN_ERROR(logger, "again %d", 1);
+    CHECK(decode(file, "%p %m%n") == expect + "ERROR again 1\n");
+
+    CHECK(!MNSER::BinaryLogReader(s_dir + "/none.log").isValid());
+}
+
+// 切分出的每个文件都可以单独解码
+static void test_rotate() {
+    std::string file = s_dir + "/rotate.log";
+    MNSER::Logger::ptr logger(new MNSER::Logger("binary_rotate"));
+    MNSER::BinaryLogAppender::ptr appender(new MNSER::BinaryLogAppender(file));
+    appender->setMaxSize(1000);
+    logger->addAppender(appender);
+    const int n = 100;
+    for(int i = 0; i < n; ++i) {
+        MS_LOG_BIN_INFO(logger, "rotate %d", i);
+    }
+    auto files = list_files("rotate.log");
+    CHECK(files.size() > 2);
+    int lines = 0;
+    for(auto& f : files) {
+        std::string data = decode(s_dir + "/" + f, "%m%n");
+        CHECK(data.find("unknown") == std::string::npos);
+        for(auto c : data) {
+            lines += c == '\n';
+        }
+    }
+    CHECK(lines == n);
+}
+
+// 异步模式下多个线程写, 条数一致
+static void test_async() {
+    std::string file = s_dir + "/async.log";
+    MNSER::Logger::ptr logger(new MNSER::Logger("binary_async"));
+    MNSER::BinaryLogAppender::ptr appender(new MNSER::BinaryLogAppender(file));
+    appender->setAsync(true);
+    logger->addAppender(appender);
+    const int threads = 4;
+    const int n = 10000;
+    std::vector<MNSER::Thread::ptr> thrs;
+    for(int t = 0; t < threads; ++t) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([logger, n]() {
+            for(int i = 0; i < n; ++i) {
+                MS_LOG_BIN_DEBUG(logger, "async %d", i);
+            }
+        }, "binary_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+    std::string data = decode(file, "%N %m%n");
+    size_t lines = 0;
+    for(size_t pos = data.find("async "); pos != std::string::npos; pos = data.find("async ", pos + 1)) {
+        ++lines;
+    }
+    CHECK(lines == threads * n);
+    CHECK(data.find("binary_3 async 9999\n") != std::string::npos);
+}
+
+static void test_config() {
+    std::string file = s_dir + "/conf.log";
+    std::string yaml =
+        "logs:\n"
+        "    - name: binary_conf\n"
+        "      level: debug\n"
+        "      appenders:\n"
+        "          - type: BinaryLogAppender\n"
+        "            file: " + file + "\n"
+        "            max_size: 1M\n"
+        "            async: true\n";
+    MNSER::Config::LoadFromYaml(YAML::Load(yaml));
+    YAML::Node node = YAML::Load(MS_LOG_NAME("binary_conf")->toYamlString());
+    CHECK(node["appenders"][0]["type"].as<std::string>() == "BinaryLogAppender");
+    CHECK(node["appenders"][0]["max_size"].as<uint64_t>() == 1024 * 1024);
+    MS_LOG_BIN_DEBUG(MS_LOG_NAME("binary_conf"), "from config %d", 1);
+    MNSER::AsyncLogWriter::GetInstance()->flush();
+    CHECK(decode(file, "%m%n") == "from config 1\n");
+    MS_LOG_NAME("binary_conf")->clearAppender();
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+// 调用线程上的耗时, 文本和二进制都用异步模式
+static void bench() {
+    const int n = 200000;
+    std::string str = "a std::string";
+    for(int binary = 0; binary < 2; ++binary) {
+        std::string file = s_dir + "/bench.log";
+        unlink(file.c_str());
+        MNSER::Logger::ptr logger(new MNSER::Logger("bench"));
+        MNSER::FileLogAppender::ptr appender(binary ? new MNSER::BinaryLogAppender(file)
+                : new MNSER::FileLogAppender(file));
+        appender->setAsync(true);
+        logger->addAppender(appender);
+        uint64_t start = now_ns();
+        for(int i = 0; i < n; ++i) {
+            if(binary) {
+                MS_LOG_BIN_DEBUG(logger, "bench message %d %g %s", i, 3.25, str);
+            } else {
+                MS_LOG_FMT_DEBUG(logger, "bench message %d %g %s", i, 3.25, str.c_str());
+            }
+        }
+        uint64_t used = now_ns() - start;
+        MNSER::AsyncLogWriter::GetInstance()->flush();
+        MS_LOG_INFO(g_logger) << (binary ? "binary" : "text") << " " << used / n << " ns/line";
+    }
+}
+
+int main(int argc, char** argv) {
+    char tmpl[] = "/tmp/test_log_binary_XXXXXX";
+    s_dir = mkdtemp(tmpl);
+    test_format();
+    test_file();
+    test_rotate();
+    test_async();
+    test_config();
+    bench();
+    for(auto& f : list_files("")) {
+        unlink((s_dir + "/" + f).c_str());
+    }
+    rmdir(s_dir.c_str());
+    return TestResult();
+}
@@ -0,0 +1,194 @@
+#include <fstream>
+#include <algorithm>
+#include <set>
+#include <dirent.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "log.h"
+#include "config.h"
+#include "test_check.h"
+
+static std::string s_dir;
+
+static std::string read_file(const std::string& name) {
+    std::ifstream ifs(name);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static std::string read_gz(const std::string& name) {
+    std::string rt;
+    gzFile gz = gzopen(name.c_str(), "rb");
+    if(!gz) {
+        return rt;
+    }
+    char buf[4096];
+    int n;
+    while((n = gzread(gz, buf, sizeof(buf))) > 0) {
+        rt.append(buf, n);
+    }
+    gzclose(gz);
+    return rt;
+}
+
+// 目录下 prefix 开头的文件名, 已排序
+static std::vector<std::string> list_files(const std::string& prefix) {
+    std::vector<std::string> rt;
+    DIR* d = opendir(s_dir.c_str());
+    struct dirent* dp;
+    while(d && (dp = readdir(d)) != nullptr) {
+        std::string name = dp->d_name;
+        if(name.compare(0, prefix.size(), prefix) == 0) {
+            rt.push_back(name);
+        }
+    }
+    if(d) {
+        closedir(d);
+    }
+    std::sort(rt.begin(), rt.end());
+    return rt;
+}
+
+static MNSER::Logger::ptr make_logger(MNSER::FileLogAppender::ptr appender) {
+    MNSER::Logger::ptr logger(new MNSER::Logger("file"));
+    appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%m%n")));
+    logger->addAppender(appender);
+    return logger;
+}
+
+// 文件被删除或者被移走之后, 检查间隔内重新打开
+static void test_reopen() {
+    std::string file = s_dir + "/reopen.log";
+    MNSER::FileLogAppender::ptr appender(new MNSER::FileLogAppender(file));
+    auto logger = make_logger(appender);
+    MS_LOG_INFO(logger) << "line 1";
+    CHECK(read_file(file) == "line 1\n");
+
+    unlink(file.c_str());
+    MS_LOG_INFO(logger) << "line 2";
+    usleep(1100 * 1000);
+    MS_LOG_INFO(logger) << "line 3";
+    CHECK(read_file(file) == "line 3\n");
+
+    // logrotate 方式: 移走之后旧的 fd 写到移走的文件, 检查到之后写新文件
+    std::string moved = file + ".moved";
+    rename(file.c_str(), moved.c_str());
+    usleep(1100 * 1000);
+    MS_LOG_INFO(logger) << "line 4";
+    CHECK(read_file(file) == "line 4\n");
+    CHECK(read_file(moved) == "line 3\n");
+}
+
+// 按大小切分, 最多保留 3 个, 切出去的压缩
+static void test_size_rotate() {
+    std::string file = s_dir + "/size.log";
+    MNSER::FileLogAppender::ptr appender(new MNSER::FileLogAppender(file));
+    appender->setMaxSize(1000);
+    appender->setMaxFiles(3);
+    appender->setCompress(true);
+    auto logger = make_logger(appender);
+
+    // 每行 100 字节, 每个文件 10 行
+    std::string pad(90, 'x');
+    for(int i = 0; i < 55; ++i) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%08d ", i);
+        MS_LOG_INFO(logger) << buf << pad;
+    }
+    CHECK(read_file(file).size() == 500);
+
+    // 等待后台压缩完成
+    std::vector<std::string> files;
+    for(int i = 0; i < 100; ++i) {
+        files = list_files("size.log.");
+        bool done = files.size() == 3;
+        for(auto& f : files) {
+            if(f.size() < 3 || f.compare(f.size() - 3, 3, ".gz") != 0) {
+                done = false;
+            }
+        }
+        if(done) {
+            break;
+        }
+        usleep(10 * 1000);
+    }
+    CHECK(files.size() == 3);
+
+    // 保留的是最后的三个, 每个 10 行
+    std::set<std::string> firsts;
+    for(auto& f : files) {
+        std::string data = read_gz(s_dir + "/" + f);
+        CHECK(data.size() == 1000);
+        firsts.insert(data.substr(0, 8));
+    }
+    CHECK(firsts == std::set<std::string>({"00000020", "00000030", "00000040"}));
+    appender->setMaxFiles(0);
+    std::string yaml = appender->toYamlString();
+    CHECK(yaml.find("max_size: 1000") != std::string::npos);
+    CHECK(yaml.find("compress: true") != std::string::npos);
+}
+
+// 文件最后修改是昨天, 按天切分时第一次写入就切分
+static void test_time_rotate() {
+    std::string file = s_dir + "/time.log";
+    {
+        std::ofstream ofs(file);
+        ofs << "yesterday\n";
+    }
+    struct timeval tv[2];
+    gettimeofday(&tv[0], nullptr);
+    tv[0].tv_sec -= 86400;
+    tv[1] = tv[0];
+    utimes(file.c_str(), tv);
+
+    MNSER::FileLogAppender::ptr appender(new MNSER::FileLogAppender(file));
+    appender->setRotate(MNSER::FileLogAppender::DAILY);
+    auto logger = make_logger(appender);
+    MS_LOG_INFO(logger) << "today";
+    MS_LOG_INFO(logger) << "today again";
+    CHECK(read_file(file) == "today\ntoday again\n");
+    auto files = list_files("time.log.");
+    CHECK(files.size() == 1);
+    if(files.size() == 1) {
+        CHECK(read_file(s_dir + "/" + files[0]) == "yesterday\n");
+    }
+}
+
+static void test_config() {
+    std::string file = s_dir + "/conf.log";
+    std::string yaml =
+        "logs:\n"
+        "    - name: file_conf\n"
+        "      level: info\n"
+        "      appenders:\n"
+        "          - type: FileLogAppender\n"
+        "            file: " + file + "\n"
+        "            max_size: 10M\n"
+        "            rotate: hourly\n"
+        "            max_files: 5\n"
+        "            compress: true\n";
+    MNSER::Config::LoadFromYaml(YAML::Load(yaml));
+    YAML::Node node = YAML::Load(MS_LOG_NAME("file_conf")->toYamlString());
+    CHECK(node["appenders"][0]["max_size"].as<uint64_t>() == 10 * 1024 * 1024);
+    CHECK(node["appenders"][0]["rotate"].as<std::string>() == "hourly");
+    CHECK(node["appenders"][0]["max_files"].as<uint32_t>() == 5);
+    CHECK(node["appenders"][0]["compress"].as<bool>());
+    MS_LOG_NAME("file_conf")->clearAppender();
+}
+
+int main(int argc, char** argv) {
+    char tmpl[] = "/tmp/test_log_file_XXXXXX";
+    s_dir = mkdtemp(tmpl);
+    test_reopen();
+    test_size_rotate();
+    test_time_rotate();
+    test_config();
+    for(auto& f : list_files("")) {
+        unlink((s_dir + "/" + f).c_str());
+    }
+    rmdir(s_dir.c_str());
+    return TestResult();
+}
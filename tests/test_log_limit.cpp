@@ -0,0 +1,120 @@
+#include "log.h"
+#include "thread.h"
+#include "test_check.h"
+
+// 记录写出内容的 Appender
+class MemLogAppender : public MNSER::LogAppender {
+public:
+    typedef std::shared_ptr<MemLogAppender> ptr;
+    std::string toYamlString() override { return ""; }
+    std::string getData() {
+        MNSER::Mutex::Lock lock(m_writeMutex);
+        return m_data;
+    }
+    void clear() {
+        MNSER::Mutex::Lock lock(m_writeMutex);
+        m_data.clear();
+    }
+    size_t countOf(const std::string& str) {
+        std::string data = getData();
+        size_t n = 0;
+        for(size_t pos = data.find(str); pos != std::string::npos; pos = data.find(str, pos + 1)) {
+            ++n;
+        }
+        return n;
+    }
+protected:
+    void write(const struct iovec* iov, int cnt) override {
+        for(int i = 0; i < cnt; ++i) {
+            m_data.append((const char*)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+private:
+    std::string m_data;
+};
+
+static MNSER::Logger::ptr s_logger;
+static MemLogAppender::ptr s_appender;
+
+static void test_every_n() {
+    s_appender->clear();
+    for(int i = 0; i < 10; ++i) {
+        MS_LOG_INFO_EVERY_N(s_logger, 4) << "n " << i;
+    }
+    CHECK(s_appender->getData() == "n 0\nn 4 [suppressed 3 messages]\nn 8 [suppressed 3 messages]\n");
+
+    // 每个调用点单独计数
+    s_appender->clear();
+    for(int i = 0; i < 3; ++i) {
+        MS_LOG_INFO_EVERY_N(s_logger, 2) << "site_a";
+        MS_LOG_INFO_EVERY_N(s_logger, 2) << "site_b";
+    }
+    CHECK(s_appender->countOf("site_a") == 2 && s_appender->countOf("site_b") == 2);
+
+    // 低于级别时不计数
+    s_logger->setLevel(MNSER::LogLevel::ERROR);
+    for(int i = 0; i < 3; ++i) {
+        MS_LOG_INFO_EVERY_N(s_logger, 2) << "level " << i;
+    }
+    s_logger->setLevel(MNSER::LogLevel::DEBUG);
+    CHECK(s_appender->countOf("level") == 0);
+}
+
+static void test_every_ms() {
+    s_appender->clear();
+    for(int i = 0; i < 5; ++i) {
+        for(int j = 0; j < 10; ++j) {
+            MS_LOG_WARN_EVERY_MS(s_logger, 100) << "ms " << i;
+        }
+        usleep(120 * 1000);
+    }
+    CHECK(s_appender->countOf("ms ") == 5);
+    CHECK(s_appender->countOf("[suppressed 9 messages]") == 4);
+}
+
+// 同一个调用点
+static void limited(const char* tag, int i) {
+    MS_LOG_ERROR_LIMIT(s_logger, 10, 5) << tag << " " << i;
+}
+
+static void test_token_bucket() {
+    s_appender->clear();
+    // 连续最多 5 条, 之后每 100ms 一条
+    for(int i = 0; i < 20; ++i) {
+        limited("bucket", i);
+    }
+    CHECK(s_appender->countOf("bucket ") == 5);
+    usleep(250 * 1000);
+    for(int i = 0; i < 20; ++i) {
+        limited("refill", i);
+    }
+    CHECK(s_appender->countOf("refill ") == 2);
+    CHECK(s_appender->getData().find("refill 0 [suppressed 15 messages]") != std::string::npos);
+
+    // 多个线程共用一个调用点, 输出的条数不超过令牌数
+    s_appender->clear();
+    std::vector<MNSER::Thread::ptr> thrs;
+    for(int t = 0; t < 4; ++t) {
+        thrs.push_back(MNSER::Thread::ptr(new MNSER::Thread([]() {
+            for(int i = 0; i < 10000; ++i) {
+                MS_LOG_ERROR_LIMIT(s_logger, 1, 8) << "threads";
+            }
+        }, "limit_" + std::to_string(t))));
+    }
+    for(auto& i : thrs) {
+        i->join();
+    }
+    size_t n = s_appender->countOf("threads");
+    CHECK(n >= 8 && n <= 9);
+}
+
+int main(int argc, char** argv) {
+    s_logger.reset(new MNSER::Logger("limit"));
+    s_appender.reset(new MemLogAppender);
+    s_appender->setFormatter(MNSER::LogFormatter::ptr(new MNSER::LogFormatter("%m%n")));
+    s_logger->addAppender(s_appender);
+    test_every_n();
+    test_every_ms();
+    test_token_bucket();
+    return TestResult();
+}
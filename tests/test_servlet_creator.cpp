@@ -0,0 +1,55 @@
+#include "http_servlet.h"
+#include "log.h"
+#include "util.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+// 构造开销比较大的 servlet, 模拟需要预先初始化资源的业务
+class HeavyServlet : public MNSER::http::Servlet {
+public:
+    HeavyServlet()
+        :Servlet("HeavyServlet") {
+        for(int i = 0; i < 64; ++i) {
+            m_table[std::to_string(i)] = std::string(64, 'a' + i % 26);
+        }
+        m_buffer.resize(16 * 1024);
+    }
+
+    virtual int32_t handle(MNSER::http::HttpRequest::ptr request
+                   , MNSER::http::HttpResponse::ptr response
+                   , MNSER::http::HttpSession::ptr session) override {
+        m_buffer[0] = 'x';
+        return m_table.size();
+    }
+
+    virtual void reset() override {
+        m_buffer[0] = 0;
+    }
+private:
+    std::map<std::string, std::string> m_table;
+    std::string m_buffer;
+};
+
+void bench(const std::string& name, MNSER::http::IServletCreator::ptr creator, int n) {
+    uint64_t start = MNSER::GetCurrentUS();
+    int64_t sum = 0;
+    for(int i = 0; i < n; ++i) {
+        auto slt = creator->get();
+        sum += slt->handle(nullptr, nullptr, nullptr);
+    }
+    uint64_t used = MNSER::GetCurrentUS() - start;
+    MS_LOG_INFO(g_logger) << name << " n=" << n << " used=" << used << "us"
+        << " per_request=" << (used * 1000.0 / n) << "ns sum=" << sum;
+}
+
+int main(int argc, char** argv) {
+    int n = 200000;
+    if(argc > 1) {
+        n = atoi(argv[1]);
+    }
+    MNSER::http::Servlet::ptr hold(new HeavyServlet);
+    bench("HoldServletCreator", std::make_shared<MNSER::http::HoldServletCreator>(hold), n);
+    bench("ServletCreator", std::make_shared<MNSER::http::ServletCreator<HeavyServlet> >(), n);
+    bench("PoolServletCreator", std::make_shared<MNSER::http::PoolServletCreator<HeavyServlet> >(), n);
+    return 0;
+}
@@ -0,0 +1,229 @@
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "http_server.h"
+#include "http_connection.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static MNSER::http::HttpServer::ptr s_server;
+static std::string s_cert_file;
+static std::string s_key_file;
+
+// 生成 127.0.0.1 和 localhost 的自签名证书
+static bool gen_cert() {
+    std::string prefix = "/tmp/test_ssl_" + std::to_string(getpid());
+    s_cert_file = prefix + ".crt";
+    s_key_file = prefix + ".key";
+
+    EVP_PKEY* pkey = EVP_EC_gen("prime256v1");
+    X509* x509 = X509_new();
+    X509_set_version(x509, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), -60);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME* name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"127.0.0.1", -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, x509, x509, nullptr, nullptr, 0);
+    X509_EXTENSION* ext = X509V3_EXT_conf_nid(nullptr, &ctx, NID_subject_alt_name
+                                ,(char*)"IP:127.0.0.1,DNS:localhost");
+    X509_add_ext(x509, ext, -1);
+    X509_EXTENSION_free(ext);
+    X509_sign(x509, pkey, EVP_sha256());
+
+    bool ok = false;
+    FILE* fp = fopen(s_cert_file.c_str(), "w");
+    if(fp) {
+        ok = PEM_write_X509(fp, x509);
+        fclose(fp);
+    }
+    fp = fopen(s_key_file.c_str(), "w");
+    if(fp) {
+        ok = PEM_write_PrivateKey(fp, pkey, nullptr, nullptr, 0, nullptr, nullptr) && ok;
+        fclose(fp);
+    }
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+    return ok;
+}
+
+static std::string BigBody(size_t n) {
+    std::string rt(n, 0);
+    for(size_t i = 0; i < n; ++i) {
+        rt[i] = 'a' + i % 26;
+    }
+    return rt;
+}
+
+static void start_server(uint16_t port) {
+    s_server.reset(new MNSER::http::HttpServer(true));
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    while(!s_server->bind(addr, true)) {
+        sleep(1);
+    }
+    CHECK(s_server->loadCertificates(s_cert_file, s_key_file));
+    auto sd = s_server->getServletDispatch();
+    sd->addServlet("/hello", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody("hello tls");
+            return 0;
+    });
+    sd->addServlet("/echo", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(req->getBody());
+            return 0;
+    });
+    sd->addRouteServlet("/big/:n", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(BigBody(req->getParamAs<size_t>("n", 0)));
+            return 0;
+    });
+    s_server->start();
+}
+
+// 用 SSLSocket 直接发一个请求, 返回是否复用了会话
+static bool raw_request(MNSER::Address::ptr addr, const std::string& host, bool& reused) {
+    MNSER::SSLSocket::ptr sock = MNSER::SSLSocket::CreateTCP(addr);
+    sock->setHostName(host);
+    if(!sock->connect(addr, 1000)) {
+        return false;
+    }
+    reused = sock->isSessionReused();
+    sock->setRecvTimeout(1000);
+    MNSER::SocketStream stream(sock);
+    std::string req = "GET /hello HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    if(stream.writeFixSize(req.data(), req.size()) <= 0) {
+        return false;
+    }
+    // 读完整个响应, TLS 1.3 的会话票据在握手之后才收到
+    std::string rsp;
+    char buf[1024];
+    int rt = 0;
+    while((rt = stream.read(buf, sizeof(buf))) > 0) {
+        rsp.append(buf, rt);
+    }
+    return rsp.find("hello tls") != std::string::npos;
+}
+
+static void test_https(const std::string& base) {
+    auto r = MNSER::http::HttpConnection::DoGet(base + "/hello", 1000);
+    CHECK(r->response && r->response->getBody() == "hello tls");
+
+    std::string body = BigBody(1024 * 1024 + 7);
+    r = MNSER::http::HttpConnection::DoPost(base + "/echo", 3000, {}, body);
+    CHECK(r->response && r->response->getBody() == body);
+
+    r = MNSER::http::HttpConnection::DoGet(base + "/big/3000000", 3000);
+    CHECK(r->response && r->response->getBody() == BigBody(3000000));
+
+    // 连接池中的连接复用
+    auto pool = MNSER::http::HttpConnectionPool::Create(base, "", 4, 30000, 100);
+    for(int i = 0; i < 10; ++i) {
+        auto pr = pool->doGet("/hello", 1000);
+        CHECK(pr->response && pr->response->getBody() == "hello tls");
+    }
+}
+
+static void test_concurrent(const std::string& base) {
+    const int n = 20;
+    std::atomic<int> ok{0};
+    std::atomic<int> done{0};
+    for(int i = 0; i < n; ++i) {
+        MNSER::IOManager::GetThis()->schedule([base, &ok, &done]() {
+            auto r = MNSER::http::HttpConnection::DoGet(base + "/big/200000", 3000);
+            if(r->response && r->response->getBody() == BigBody(200000)) {
+                ++ok;
+            }
+            ++done;
+        });
+    }
+    while(done < n) {
+        usleep(10 * 1000);
+    }
+    CHECK(ok == n);
+}
+
+// 两个协程同时读同一个连接, 后到的协程排队等待, 不轮询
+static void test_shared_read(MNSER::Address::ptr addr) {
+    MNSER::SSLSocket::ptr sock = MNSER::SSLSocket::CreateTCP(addr);
+    sock->setHostName("localhost");
+    CHECK(sock->connect(addr, 1000));
+    sock->setRecvTimeout(3000);
+    std::atomic<int> done{0};
+    std::atomic<int> eof{0};
+    std::atomic<size_t> bytes{0};
+    for(int i = 0; i < 2; ++i) {
+        MNSER::IOManager::GetThis()->schedule([sock, &done, &eof, &bytes]() {
+            char buf[16];
+            int rt = 0;
+            while((rt = sock->recv(buf, sizeof(buf))) > 0) {
+                bytes += rt;
+            }
+            if(rt == 0) {
+                ++eof;
+            }
+            ++done;
+        });
+    }
+    usleep(100 * 1000);
+    std::string req = "GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                      "GET /hello HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    CHECK(sock->send(req.data(), req.size()) == (int)req.size());
+    uint64_t start = MNSER::GetCurrentMS();
+    while(done < 2 && MNSER::GetCurrentMS() - start < 5000) {
+        usleep(10 * 1000);
+    }
+    CHECK(done == 2 && eof == 2);
+    CHECK(bytes > 2 * strlen("hello tls"));
+}
+
+static void test_resume(MNSER::Address::ptr addr) {
+    bool reused = true;
+    CHECK(raw_request(addr, "localhost", reused));
+    CHECK(!reused);
+    CHECK(raw_request(addr, "localhost", reused));
+    CHECK(reused);
+
+    // 证书中没有这个主机名, 校验失败
+    CHECK(!raw_request(addr, "example.com", reused));
+}
+
+static void run() {
+    g_logger->setLevel(MNSER::LogLevel::INFO);
+    MS_LOG_NAME("system")->setLevel(MNSER::LogLevel::FATAL);
+    CHECK(gen_cert());
+    // 客户端信任自签名证书
+    MNSER::Config::Lookup<std::string>("ssl.ca_file")->setValue(s_cert_file);
+
+    uint16_t port = 21000 + getpid() % 1000;
+    start_server(port);
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    std::string base = "https://127.0.0.1:" + std::to_string(port);
+    test_https(base);
+    test_concurrent(base);
+    test_resume(addr);
+    test_shared_read(addr);
+
+    s_server->stop();
+    unlink(s_cert_file.c_str());
+    unlink(s_key_file.c_str());
+    TestResult();
+}
+
+int main(int argc, char** argv) {
+    MNSER::IOManager iom(2);
+    iom.schedule(run);
+    iom.stop();
+    return s_fails ? 1 : 0;
+}
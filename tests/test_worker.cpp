@@ -0,0 +1,111 @@
+#include "worker.h"
+#include "http_server.h"
+#include "http_connection.h"
+#include "config.h"
+#include "log.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static void test_cpu_list() {
+    std::vector<int> cpus;
+    CHECK(MNSER::ParseCpuList("0, 2,4-6", cpus));
+    CHECK(cpus == std::vector<int>({0, 2, 4, 5, 6}));
+    cpus.clear();
+    CHECK(MNSER::ParseCpuList("", cpus) && cpus.empty());
+    CHECK(!MNSER::ParseCpuList("a", cpus));
+    CHECK(!MNSER::ParseCpuList("3-1", cpus));
+    CHECK(!MNSER::ParseCpuList("1-", cpus));
+}
+
+// 在 worker 中执行 cb 并等待完成
+static void run_in(MNSER::IOManager* iom, std::function<void()> cb) {
+    std::atomic<bool> done{false};
+    iom->schedule([cb, &done]() {
+        cb();
+        done = true;
+    });
+    while(!done) {
+        usleep(1000);
+    }
+}
+
+static void run() {
+    g_logger->setLevel(MNSER::LogLevel::INFO);
+    MS_LOG_NAME("system")->setLevel(MNSER::LogLevel::ERROR);
+    test_cpu_list();
+
+    uint16_t port = 22000 + getpid() % 1000;
+    std::string yaml =
+        "workers:\n"
+        "    accept:\n"
+        "        thread_num: 1\n"
+        "    io:\n"
+        "        thread_num: 2\n"
+        "    process:\n"
+        "        thread_num: 2\n"
+        "        cpus: 0\n"
+        "servers:\n"
+        "    - address: [\"127.0.0.1:" + std::to_string(port) + "\"]\n"
+        "      keepalive: 1\n"
+        "      name: test_worker\n"
+        "      accept_worker: accept\n"
+        "      io_worker: io\n"
+        "      process_worker: process\n";
+    MNSER::Config::LoadFromYaml(YAML::Load(yaml));
+
+    CHECK(MNSER::WorkerMgr::GetInstance()->init());
+    CHECK(MNSER::WorkerMgr::GetInstance()->getCount() == 3);
+    CHECK(MNSER::WorkerMgr::GetInstance()->get("io") != nullptr);
+    CHECK(MNSER::WorkerMgr::GetInstance()->get("none") == nullptr);
+
+    // process 的线程都绑定在 CPU 0
+    MNSER::IOManager* process = MNSER::WorkerMgr::GetInstance()->get("process");
+    for(int i = 0; i < 4; ++i) {
+        int cpu = -1;
+        run_in(process, [&cpu]() { cpu = sched_getcpu();});
+        CHECK(cpu == 0);
+    }
+
+    std::vector<MNSER::TcpServer::ptr> servers;
+    CHECK(MNSER::TcpServer::CreateFromConfig(servers) && servers.size() == 1);
+    if(servers.size() != 1) {
+        return;
+    }
+    auto server = std::dynamic_pointer_cast<MNSER::http::HttpServer>(servers[0]);
+    CHECK(server && server->getName() == "test_worker");
+    // servlet 在 process 中执行, 返回所在的调度器名称
+    server->getServletDispatch()->addServlet("/where", [](MNSER::http::HttpRequest::ptr req
+                ,MNSER::http::HttpResponse::ptr rsp
+                ,MNSER::http::HttpSession::ptr session) {
+            rsp->setBody(MNSER::Scheduler::GetThis()->getName());
+            return 0;
+    });
+    server->start();
+    for(int i = 0; i < 3; ++i) {
+        auto r = MNSER::http::HttpConnection::DoGet("http://127.0.0.1:" + std::to_string(port) + "/where", 1000);
+        CHECK(r->response && r->response->getBody() == "process");
+    }
+
+    // 不存在的 worker 和类型
+    MNSER::TcpServerConf conf;
+    conf.address.push_back("127.0.0.1:" + std::to_string(port + 1));
+    conf.io_worker = "missing";
+    CHECK(!MNSER::TcpServer::Create(conf));
+    conf.io_worker = "";
+    conf.type = "unknown";
+    CHECK(!MNSER::TcpServer::Create(conf));
+
+    server->stop();
+    usleep(100 * 1000);
+    TestResult();
+}
+
+int main(int argc, char** argv) {
+    {
+        MNSER::IOManager iom(1);
+        iom.schedule(run);
+    }
+    MNSER::WorkerMgr::GetInstance()->stop();
+    return s_fails ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+#include <set>
+
+#include "http_server.h"
+#include "ws_connection.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+using MNSER::http::WSOpcode;
+
+static MNSER::http::HttpServer::ptr s_server;
+static MNSER::Mutex s_mutex;
+static std::set<MNSER::http::WSSession::ptr> s_chat;
+static int s_closed = 0;
+
+// 各种长度和偏移下和逐字节计算的结果一致
+static void test_mask() {
+    uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+    for(size_t len = 0; len < 100; ++len) {
+        for(size_t offset = 0; offset < 4; ++offset) {
+            std::string data(len, 0);
+            for(size_t i = 0; i < len; ++i) {
+                data[i] = (char)(i * 7);
+            }
+            std::string expect = data;
+            for(size_t i = 0; i < len; ++i) {
+                expect[i] ^= key[(offset + i) & 3];
+            }
+            MNSER::http::WSMask(&data[0], len, key, offset);
+            CHECK(data == expect);
+        }
+    }
+    CHECK(MNSER::http::WSAcceptKey("dGhlIHNhbXBsZSBub25jZQ==") == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+}
+
+static void start_server(uint16_t port) {
+    s_server.reset(new MNSER::http::HttpServer(true));
+    auto addr = MNSER::IPv4Address::Create("127.0.0.1", port);
+    while(!s_server->bind(addr)) {
+        sleep(1);
+    }
+    auto wsd = s_server->getWSServletDispatch();
+    // 原样返回, 消息前加上路由参数
+    wsd->addRouteServlet("/echo/:tag", [](MNSER::http::HttpRequest::ptr header
+                ,MNSER::http::WSMessage::ptr msg
+                ,MNSER::http::WSSession::ptr session) {
+            if(msg->getData() == "quit") {
+                return 1;
+            }
+            session->sendMessage(header->getParam("tag") + ":" + msg->getData(), msg->getOpcode());
+            return 0;
+    }, nullptr, [](MNSER::http::HttpRequest::ptr header, MNSER::http::WSSession::ptr session) {
+            MNSER::Mutex::Lock lock(s_mutex);
+            ++s_closed;
+            return 0;
+    });
+    // 收到的消息广播给所有连接
+    wsd->addServlet("/chat", [](MNSER::http::HttpRequest::ptr header
+                ,MNSER::http::WSMessage::ptr msg
+                ,MNSER::http::WSSession::ptr session) {
+            std::vector<MNSER::http::WSSession::ptr> sessions;
+            {
+                MNSER::Mutex::Lock lock(s_mutex);
+                sessions.assign(s_chat.begin(), s_chat.end());
+            }
+            auto frame = MNSER::http::WSFrame::Create(WSOpcode::TEXT, msg->getData());
+            MNSER::http::WSSession::Broadcast(sessions, frame);
+            return 0;
+    }, [](MNSER::http::HttpRequest::ptr header, MNSER::http::WSSession::ptr session) {
+            MNSER::Mutex::Lock lock(s_mutex);
+            s_chat.insert(session);
+            return 0;
+    }, [](MNSER::http::HttpRequest::ptr header, MNSER::http::WSSession::ptr session) {
+            MNSER::Mutex::Lock lock(s_mutex);
+            s_chat.erase(session);
+            return 0;
+    });
+    s_server->start();
+}
+
+static std::string Recv(MNSER::http::WSConnection::ptr conn) {
+    auto msg = conn->recvMessage();
+    return msg ? msg->getData() : "<null>";
+}
+
+static void test_echo(const std::string& base) {
+    auto rt = MNSER::http::WSConnection::Create(base + "/echo/a", 1000);
+    CHECK(rt.second);
+    if(!rt.second) {
+        MS_LOG_ERROR(g_logger) << rt.first->toString();
+        return;
+    }
+    auto conn = rt.second;
+    conn->sendMessage("hello");
+    CHECK(Recv(conn) == "a:hello");
+
+    // 分片发送, 中间夹一个 ping
+    conn->sendMessage("frag", WSOpcode::TEXT, false);
+    conn->ping();
+    conn->sendMessage("ment", WSOpcode::CONTINUE, true);
+    CHECK(Recv(conn) == "a:fragment");
+
+    // 64 位长度的二进制消息
+    std::string big(200 * 1000, 0);
+    for(size_t i = 0; i < big.size(); ++i) {
+        big[i] = (char)(i % 251);
+    }
+    conn->sendMessage(big, WSOpcode::BIN);
+    auto msg = conn->recvMessage();
+    CHECK(msg && msg->getOpcode() == WSOpcode::BIN && msg->getData() == "a:" + big);
+
+    // handle 返回非 0, 服务端关闭连接
+    conn->sendMessage("quit");
+    CHECK(!conn->recvMessage());
+    usleep(50 * 1000);
+    CHECK(s_closed == 1);
+
+    // 客户端发起关闭
+    rt = MNSER::http::WSConnection::Create(base + "/echo/b", 1000);
+    CHECK(rt.second);
+    if(rt.second) {
+        rt.second->sendClose();
+        CHECK(!rt.second->recvMessage());
+        usleep(50 * 1000);
+        CHECK(s_closed == 2);
+    }
+
+    // 没有注册的路径按普通 http 请求处理, 握手失败
+    rt = MNSER::http::WSConnection::Create(base + "/none", 1000);
+    CHECK(!rt.second && rt.first->response
+            && rt.first->response->getStatus() == MNSER::http::HttpStatus::NOT_FOUND);
+}
+
+static void test_broadcast(const std::string& base) {
+    std::vector<MNSER::http::WSConnection::ptr> conns;
+    for(int i = 0; i < 3; ++i) {
+        auto rt = MNSER::http::WSConnection::Create(base + "/chat", 1000);
+        CHECK(rt.second);
+        if(rt.second) {
+            conns.push_back(rt.second);
+        }
+    }
+    usleep(50 * 1000);
+    conns[0]->sendMessage("hi all");
+    for(auto& i : conns) {
+        CHECK(Recv(i) == "hi all");
+    }
+    for(auto& i : conns) {
+        i->sendClose();
+        i->recvMessage();
+    }
+}
+
+// 不回应的连接在 idle_timeout 后被服务端关闭
+static void test_keepalive(const std::string& base) {
+    MNSER::Config::Lookup<uint64_t>("ws.ping_interval", 0)->setValue(50);
+    MNSER::Config::Lookup<uint64_t>("ws.idle_timeout", 0)->setValue(200);
+    auto rt = MNSER::http::WSConnection::Create(base + "/echo/k", 1000);
+    CHECK(rt.second);
+    if(!rt.second) {
+        return;
+    }
+    uint64_t start = MNSER::GetCurrentMS();
+    usleep(400 * 1000);
+    CHECK(!rt.second->recvMessage());
+    uint64_t used = MNSER::GetCurrentMS() - start;
+    CHECK(used < 1000);
+    MS_LOG_INFO(g_logger) << "keepalive closed after " << used << "ms";
+}
+
+static void run() {
+    g_logger->setLevel(MNSER::LogLevel::INFO);
+    MS_LOG_NAME("system")->setLevel(MNSER::LogLevel::ERROR);
+    test_mask();
+    uint16_t port = 19000 + getpid() % 1000;
+    start_server(port);
+    std::string base = "ws://127.0.0.1:" + std::to_string(port);
+    test_echo(base);
+    test_broadcast(base);
+    test_keepalive(base);
+    s_server->stop();
+    TestResult();
+}
+
+int main(int argc, char** argv) {
+    MNSER::IOManager iom(2);
+    iom.schedule(run);
+    iom.stop();
+    return s_fails ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "zlib_stream.h"
+#include "log.h"
+#include "util.h"
+#include "test_check.h"
+
+static MNSER::Logger::ptr g_logger = MS_LOG_ROOT();
+
+static std::string RandomText(size_t size) {
+    static const char* s_words[] = {"hello ", "world ", "zlib ", "stream ", "mnser\n"};
+    std::string rt;
+    while(rt.size() < size) {
+        rt += s_words[rand() % 5];
+    }
+    rt.resize(size);
+    return rt;
+}
+
+// 分成小块写入, 压缩再解压后和原数据一致
+static void test_roundtrip(MNSER::ZlibStream::Type type) {
+    std::string data = RandomText(100 * 1000);
+    auto enc = MNSER::ZlibStream::Create(true, 1024, type);
+    for(size_t i = 0; i < data.size(); i += 777) {
+        CHECK(enc->write(data.c_str() + i, std::min((size_t)777, data.size() - i)) > 0);
+    }
+    CHECK(enc->flush() == 0);
+    std::string zdata = enc->getResult();
+    CHECK(zdata.size() == enc->getOutSize());
+    CHECK(zdata.size() < data.size() / 2);
+
+    // 解压的输出交给回调
+    std::string out;
+    auto dec = MNSER::ZlibStream::Create(false, 1024, type);
+    dec->setOutputCallback([&out](const void* buf, size_t len) {
+        out.append((const char*)buf, len);
+        return (int)len;
+    });
+    for(size_t i = 0; i < zdata.size(); i += 100) {
+        CHECK(dec->write(zdata.c_str() + i, std::min((size_t)100, zdata.size() - i)) > 0);
+    }
+    CHECK(dec->flush() == 0);
+    CHECK(out == data);
+    MS_LOG_INFO(g_logger) << "type=" << type << " in=" << data.size() << " out=" << zdata.size();
+}
+
+// 数据不完整, 数据损坏, 解压结果超过上限
+static void test_error() {
+    std::string data = RandomText(64 * 1024);
+    auto enc = MNSER::ZlibStream::CreateGzip(true);
+    enc->write(data.c_str(), data.size());
+    enc->flush();
+    std::string zdata = enc->getResult();
+
+    auto dec = MNSER::ZlibStream::CreateGzip(false);
+    dec->write(zdata.c_str(), zdata.size() / 2);
+    CHECK(dec->flush() < 0);
+
+    std::string bad = zdata;
+    bad[20] ^= 0xff;
+    bad[21] ^= 0xff;
+    dec = MNSER::ZlibStream::CreateGzip(false);
+    CHECK(dec->write(bad.c_str(), bad.size()) < 0 || dec->flush() < 0);
+
+    dec = MNSER::ZlibStream::CreateGzip(false);
+    dec->setMaxOutSize(1024);
+    CHECK(dec->write(zdata.c_str(), zdata.size()) < 0);
+    CHECK(dec->hasError());
+
+    // 放回缓存的 z_stream 重置过, 再次使用结果正确
+    dec = MNSER::ZlibStream::CreateGzip(false);
+    CHECK(dec->write(zdata.c_str(), zdata.size()) > 0);
+    CHECK(dec->flush() == 0);
+    CHECK(dec->getResult() == data);
+}
+
+// 复用缓存的 z_stream 和每次新建的耗时对比
+static void bench() {
+    std::string data = RandomText(2048);
+    const int n = 2000;
+    uint64_t start = MNSER::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        auto enc = MNSER::ZlibStream::CreateGzip(true);
+        enc->write(data.c_str(), data.size());
+        enc->flush();
+    }
+    uint64_t pooled = MNSER::GetCurrentUS() - start;
+
+    start = MNSER::GetCurrentUS();
+    for(int i = 0; i < n; ++i) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+        char out[4096];
+        zs.next_in = (Bytef*)data.c_str();
+        zs.avail_in = data.size();
+        zs.next_out = (Bytef*)out;
+        zs.avail_out = sizeof(out);
+        deflate(&zs, Z_FINISH);
+        deflateEnd(&zs);
+    }
+    uint64_t fresh = MNSER::GetCurrentUS() - start;
+    MS_LOG_INFO(g_logger) << "gzip 2K x " << n << " pooled=" << pooled << "us init_each="
+        << fresh << "us";
+}
+
+int main(int argc, char** argv) {
+    test_roundtrip(MNSER::ZlibStream::GZIP);
+    test_roundtrip(MNSER::ZlibStream::ZLIB);
+    test_roundtrip(MNSER::ZlibStream::DEFLATE);
+    test_error();
+    bench();
+    return TestResult();
+}